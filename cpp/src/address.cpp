@@ -0,0 +1,749 @@
+#include "address.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const int V6 = 0; // slots of the two lookups
+const int V4 = 1;
+
+const char* cacheFamilyName(AddressFamily family)
+{
+    switch (family)
+    {
+        case AddressFamily::Any:  return "any";
+        case AddressFamily::IPv4: return "4";
+        case AddressFamily::IPv6: return "6";
+    }
+    return "?";
+}
+
+// Numeric host of any family, without the port check of parseNumericAddress()
+bool parseLiteral(const std::string& host, unsigned short port, PeerAddress& address)
+{
+    address = PeerAddress();
+    auto* v4 = reinterpret_cast<sockaddr_in*>(&address.storage);
+    auto* v6 = reinterpret_cast<sockaddr_in6*>(&address.storage);
+    if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port   = htons(port);
+        address.len    = sizeof(sockaddr_in);
+        return true;
+    }
+    address = PeerAddress();
+    if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
+    {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port   = htons(port);
+        address.len     = sizeof(sockaddr_in6);
+        return true;
+    }
+    return false;
+}
+
+double secondsSince(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// The AAAA and A lookups, each getaddrinfo() on a thread of its own. The
+// threads are detached: a lookup still hanging when another address has
+// already connected must not hold the test up, so they share this state
+// (and the eventfd that wakes the connect loop) instead of the stack.
+struct Lookups
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool wanted[2] = {false, false};
+    bool done[2] = {false, false};
+    bool taken[2] = {false, false};
+    std::vector<PeerAddress> results[2];
+    int status[2] = {0, 0}; // getaddrinfo() error, 0 = answered
+    Clock::time_point doneAt[2];
+    int wakeFd = eventfd(0, EFD_NONBLOCK);
+
+    ~Lookups()
+    {
+        if (wakeFd >= 0)
+        {
+            close(wakeFd);
+        }
+    }
+
+    bool allDone() const
+    {
+        return (!wanted[V6] || done[V6]) && (!wanted[V4] || done[V4]);
+    }
+};
+
+void runLookup(std::shared_ptr<Lookups> lookups, int slot, std::string host, std::string port,
+               int socktype)
+{
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = slot == V6 ? AF_INET6 : AF_INET;
+    hints.ai_socktype = socktype;
+    hints.ai_flags    = AI_NUMERICSERV;
+    addrinfo* res = nullptr;
+    int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+
+    std::vector<PeerAddress> found;
+    for (addrinfo* ai = res; status == 0 && ai != nullptr; ai = ai->ai_next)
+    {
+        PeerAddress address;
+        std::memcpy(&address.storage, ai->ai_addr, ai->ai_addrlen);
+        address.len = ai->ai_addrlen;
+        // /etc/hosts can list the same address twice ("multi on")
+        bool seen = std::any_of(found.begin(), found.end(), [&](const PeerAddress& f) {
+            return f.len == address.len && std::memcmp(&f.storage, &address.storage, f.len) == 0;
+        });
+        if (!seen)
+        {
+            found.push_back(address);
+        }
+    }
+    if (res)
+    {
+        freeaddrinfo(res);
+    }
+
+    std::lock_guard<std::mutex> lock(lookups->mutex);
+    lookups->results[slot] = std::move(found);
+    lookups->status[slot] = status;
+    lookups->done[slot] = true;
+    lookups->doneAt[slot] = Clock::now();
+    lookups->changed.notify_all();
+    uint64_t one = 1;
+    (void)!write(lookups->wakeFd, &one, sizeof(one));
+}
+
+std::shared_ptr<Lookups> startLookups(const std::string& host, unsigned short port,
+                                      AddressFamily family, int socktype)
+{
+    auto lookups = std::make_shared<Lookups>();
+    lookups->wanted[V6] = family != AddressFamily::IPv4;
+    lookups->wanted[V4] = family != AddressFamily::IPv6;
+    for (int slot : {V6, V4})
+    {
+        if (lookups->wanted[slot])
+        {
+            std::thread(runLookup, lookups, slot, host, std::to_string(port), socktype).detach();
+        }
+    }
+    return lookups;
+}
+
+// RFC 8305 section 3: go on an AAAA answer at once, on an A answer once
+// RESOLUTION_DELAY has passed without the AAAA one, or when both are done
+void waitForAnswers(Lookups& lookups)
+{
+    std::unique_lock<std::mutex> lock(lookups.mutex);
+    while (!lookups.allDone())
+    {
+        bool haveV6 = lookups.done[V6] && !lookups.results[V6].empty();
+        bool haveV4 = lookups.done[V4] && !lookups.results[V4].empty();
+        if (haveV6 || (haveV4 && !lookups.wanted[V6]))
+        {
+            return;
+        }
+        if (haveV4)
+        {
+            auto deadline = lookups.doneAt[V4] + RESOLUTION_DELAY;
+            if (!lookups.changed.wait_until(lock, deadline, [&]() { return lookups.done[V6]; }))
+            {
+                return;
+            }
+            continue;
+        }
+        lookups.changed.wait(lock);
+    }
+}
+
+// Move answers that came in since the last call into the per-family queues
+void takeAnswers(Lookups& lookups, std::deque<PeerAddress> (&queues)[2], ConnectReport& report)
+{
+    std::lock_guard<std::mutex> lock(lookups.mutex);
+    for (int slot : {V6, V4})
+    {
+        if (lookups.done[slot] && !lookups.taken[slot])
+        {
+            lookups.taken[slot] = true;
+            const auto& found = lookups.results[slot];
+            queues[slot].insert(queues[slot].end(), found.begin(), found.end());
+            (slot == V6 ? report.v6Addresses : report.v4Addresses) +=
+                static_cast<int>(found.size());
+        }
+    }
+}
+
+// RFC 8305 section 4: alternate families, IPv6 first
+bool nextAddress(std::deque<PeerAddress> (&queues)[2], int& lastSlot, PeerAddress& address)
+{
+    int slot = lastSlot == V6 ? V4 : V6;
+    if (queues[slot].empty())
+    {
+        slot = 1 - slot;
+    }
+    if (queues[slot].empty())
+    {
+        return false;
+    }
+    address = queues[slot].front();
+    queues[slot].pop_front();
+    lastSlot = slot;
+    return true;
+}
+
+void logLookupErrors(const Lookups& lookups, const std::string& host)
+{
+    for (int slot : {V6, V4})
+    {
+        if (lookups.wanted[slot] && lookups.done[slot] && lookups.status[slot] != 0)
+        {
+            spdlog::error("getaddrinfo({}, {}) failed: {}", host, slot == V6 ? "AAAA" : "A",
+                          gai_strerror(lookups.status[slot]));
+        }
+    }
+}
+
+// socket() + setup in nonblocking mode + connect(); fd < 0 with error set
+// if it failed on the spot
+int startAttempt(const PeerAddress& address, const SocketSetup& setup, int& error, bool& connected)
+{
+    connected = false;
+    int fd = socket(address.family(), SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        error = errno;
+        return -1;
+    }
+    if (setup && !setup(fd))
+    {
+        error = EINVAL;
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (connect(fd, address.sockAddr(), address.len) == 0)
+    {
+        connected = true;
+    }
+    else if (errno != EINPROGRESS)
+    {
+        error = errno;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+bool sameAddress(const PeerAddress& a, const PeerAddress& b)
+{
+    return a.len == b.len && std::memcmp(&a.storage, &b.storage, a.len) == 0;
+}
+
+std::string formatAddress(const sockaddr* addr)
+{
+    char ip[INET6_ADDRSTRLEN] = {0};
+    if (addr->sa_family == AF_INET6)
+    {
+        const auto* in6 = reinterpret_cast<const sockaddr_in6*>(addr);
+        unsigned short port = ntohs(in6->sin6_port);
+        if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+        {
+            inet_ntop(AF_INET, in6->sin6_addr.s6_addr + 12, ip, sizeof(ip));
+            return std::string(ip) + ":" + std::to_string(port);
+        }
+        inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip));
+        return "[" + std::string(ip) + "]:" + std::to_string(port);
+    }
+    const auto* in = reinterpret_cast<const sockaddr_in*>(addr);
+    inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(in->sin_port));
+}
+
+std::string formatPeer(int sockfd)
+{
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(sockfd, reinterpret_cast<sockaddr*>(&addr), &len) < 0)
+    {
+        return "?";
+    }
+    return formatAddress(reinterpret_cast<sockaddr*>(&addr));
+}
+
+int openServerSocket(int type, AddressFamily family)
+{
+    if (family != AddressFamily::IPv4)
+    {
+        int fd = socket(AF_INET6, type, 0);
+        if (fd >= 0)
+        {
+            int v6only = family == AddressFamily::IPv6;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+            return fd;
+        }
+        // A kernel without IPv6 still serves IPv4 dual-stack requests
+        if (family == AddressFamily::IPv6 || errno != EAFNOSUPPORT)
+        {
+            spdlog::error("Error creating IPv6 server socket: {}", strerror(errno));
+            return -1;
+        }
+    }
+    int fd = socket(AF_INET, type, 0);
+    if (fd < 0)
+    {
+        spdlog::error("Error creating server socket: {}", strerror(errno));
+    }
+    return fd;
+}
+
+bool bindWildcard(int sockfd, unsigned short port)
+{
+    int domain = AF_INET;
+    socklen_t len = sizeof(domain);
+    getsockopt(sockfd, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+    if (domain == AF_INET6)
+    {
+        sockaddr_in6 addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr   = in6addr_any;
+        addr.sin6_port   = htons(port);
+        return bind(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(port);
+    return bind(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+}
+
+int happyEyeballsConnect(const std::string& host, unsigned short port, AddressFamily family,
+                         const SocketSetup& setup, ConnectReport& report,
+                         const PeerAddress* cached)
+{
+    report.host = host;
+    auto resolveStart = Clock::now();
+    auto lookups = startLookups(host, port, family, SOCK_STREAM);
+    if (cached)
+    {
+        report.source = "cache"; // goes first; the answers can come in meanwhile
+        (cached->family() == AF_INET6 ? report.v6Addresses : report.v4Addresses) = 1;
+    }
+    else
+    {
+        waitForAnswers(*lookups);
+    }
+
+    struct InFlight
+    {
+        int fd;
+        size_t attempt; // index into report.attempts
+        Clock::time_point start;
+    };
+    std::deque<PeerAddress> queues[2];
+    std::vector<InFlight> inFlight;
+    int lastSlot = V4; // so IPv6 goes first
+    bool cachedDue = cached != nullptr;
+    int winnerFd = -1;
+    auto firstAttempt = Clock::now();
+    auto nextAttempt = firstAttempt;
+    report.resolveSeconds = secondsSince(resolveStart, firstAttempt);
+
+    auto record = [&](const PeerAddress& address, double seconds, int error) {
+        ConnectAttempt attempt;
+        attempt.address = address;
+        attempt.seconds = seconds;
+        attempt.error   = error;
+        report.attempts.push_back(attempt);
+        return report.attempts.size() - 1;
+    };
+
+    while (winnerFd < 0)
+    {
+        takeAnswers(*lookups, queues, report);
+        if (cached)
+        {
+            // The resolver's copy of the cached address isn't tried or counted twice
+            for (int slot : {V6, V4})
+            {
+                auto& queue = queues[slot];
+                auto dup = std::remove_if(queue.begin(), queue.end(), [&](const PeerAddress& a) {
+                    return sameAddress(a, *cached);
+                });
+                (slot == V6 ? report.v6Addresses : report.v4Addresses) -=
+                    static_cast<int>(queue.end() - dup);
+                queue.erase(dup, queue.end());
+            }
+        }
+        auto now = Clock::now();
+        bool queued = !queues[V6].empty() || !queues[V4].empty();
+
+        // Start the next attempt when its delay is up or nothing else is running
+        PeerAddress address;
+        bool next = false;
+        if (cachedDue)
+        {
+            address = *cached;
+            lastSlot = cached->family() == AF_INET6 ? V6 : V4; // the other family follows
+            cachedDue = false;
+            next = true;
+        }
+        else
+        {
+            next = queued && (now >= nextAttempt || inFlight.empty()) &&
+                   nextAddress(queues, lastSlot, address);
+        }
+        if (next)
+        {
+            int error = 0;
+            bool connected = false;
+            int fd = startAttempt(address, setup, error, connected);
+            if (fd < 0)
+            {
+                record(address, secondsSince(now, Clock::now()), error);
+                continue; // failed on the spot: straight on to the next one
+            }
+            size_t index = record(address, 0.0, -1);
+            if (connected)
+            {
+                report.attempts[index].seconds = secondsSince(now, Clock::now());
+                report.attempts[index].error = 0;
+                winnerFd = fd;
+                break;
+            }
+            inFlight.push_back({fd, index, now});
+            nextAttempt = now + CONNECTION_ATTEMPT_DELAY;
+            continue;
+        }
+
+        bool resolving;
+        {
+            std::lock_guard<std::mutex> lock(lookups->mutex);
+            resolving = !lookups->allDone();
+        }
+        if (inFlight.empty() && !queued && !resolving)
+        {
+            break; // every address failed
+        }
+
+        // Wait for a handshake, a late answer or the next attempt's turn
+        std::vector<pollfd> fds;
+        for (const InFlight& f : inFlight)
+        {
+            fds.push_back({f.fd, POLLOUT, 0});
+        }
+        if (resolving)
+        {
+            fds.push_back({lookups->wakeFd, POLLIN, 0});
+        }
+        int timeoutMs = -1;
+        if (queued)
+        {
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(nextAttempt - now);
+            timeoutMs = static_cast<int>(std::max<long long>(wait.count(), 0));
+        }
+        if (poll(fds.data(), fds.size(), timeoutMs) < 0 && errno != EINTR)
+        {
+            spdlog::error("Connect: poll() failed: {}", strerror(errno));
+            break;
+        }
+        now = Clock::now();
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (fds[i].fd == lookups->wakeFd)
+            {
+                uint64_t count;
+                (void)!read(lookups->wakeFd, &count, sizeof(count));
+                continue;
+            }
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+            auto it = std::find_if(inFlight.begin(), inFlight.end(),
+                                   [&](const InFlight& f) { return f.fd == fds[i].fd; });
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(it->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            ConnectAttempt& attempt = report.attempts[it->attempt];
+            attempt.seconds = secondsSince(it->start, now);
+            attempt.error   = error;
+            if (error == 0 && winnerFd < 0)
+            {
+                winnerFd = it->fd;
+            }
+            else if (error != 0)
+            {
+                close(it->fd);
+                nextAttempt = now; // RFC 8305 section 5: a failure starts the next one
+            }
+            else
+            {
+                continue; // a second winner in the same poll: dropped below
+            }
+            inFlight.erase(it);
+        }
+    }
+
+    // The losers are abandoned; the winner goes back to blocking for the engines
+    auto end = Clock::now();
+    for (const InFlight& f : inFlight)
+    {
+        if (f.fd != winnerFd)
+        {
+            report.attempts[f.attempt].seconds = secondsSince(f.start, end);
+            report.attempts[f.attempt].error = -1;
+            close(f.fd);
+        }
+    }
+    if (winnerFd < 0)
+    {
+        if (report.attempts.empty())
+        {
+            logLookupErrors(*lookups, host);
+            spdlog::error("Could not resolve {}", host);
+        }
+        for (const ConnectAttempt& a : report.attempts)
+        {
+            spdlog::error("Could not connect to {}:{} -> {}: {}", host, port,
+                          formatAddress(a.address.sockAddr()),
+                          a.error > 0 ? strerror(a.error) : "setup failed");
+        }
+        return -1;
+    }
+    fcntl(winnerFd, F_SETFL, fcntl(winnerFd, F_GETFL) & ~O_NONBLOCK);
+    for (const ConnectAttempt& a : report.attempts)
+    {
+        if (a.error == 0)
+        {
+            report.winner = a.address;
+        }
+    }
+    report.connectSeconds = secondsSince(firstAttempt, end);
+    return winnerFd;
+}
+
+bool resolveAll(const std::string& host, unsigned short port, AddressFamily family,
+                int socktype, std::vector<PeerAddress>& addresses)
+{
+    auto lookups = startLookups(host, port, family, socktype);
+    {
+        std::unique_lock<std::mutex> lock(lookups->mutex);
+        lookups->changed.wait(lock, [&]() { return lookups->allDone(); });
+    }
+    std::deque<PeerAddress> queues[2];
+    ConnectReport unused;
+    takeAnswers(*lookups, queues, unused);
+    int lastSlot = V4;
+    PeerAddress address;
+    while (nextAddress(queues, lastSlot, address))
+    {
+        addresses.push_back(address);
+    }
+    if (addresses.empty())
+    {
+        logLookupErrors(*lookups, host);
+        spdlog::error("Could not resolve {}", host);
+        return false;
+    }
+    return true;
+}
+
+int connectAddress(const PeerAddress& address, const SocketSetup& setup, double& seconds)
+{
+    int fd = socket(address.family(), SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (setup && !setup(fd))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    auto start = Clock::now();
+    if (connect(fd, address.sockAddr(), address.len) < 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    seconds = secondsSince(start, Clock::now());
+    return fd;
+}
+
+bool parseNumericAddress(const std::string& host, unsigned short port, AddressFamily family,
+                         PeerAddress& address)
+{
+    if (!parseLiteral(host, port, address))
+    {
+        return false;
+    }
+    return family == AddressFamily::Any ||
+           address.family() == (family == AddressFamily::IPv6 ? AF_INET6 : AF_INET);
+}
+
+bool loadCachedAddress(const std::string& path, const std::string& host, unsigned short port,
+                       AddressFamily family, PeerAddress& address)
+{
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string name;
+        unsigned short cachedPort = 0;
+        std::string cachedFamily;
+        std::string literal;
+        if (fields >> name >> cachedPort >> cachedFamily >> literal && name == host &&
+            cachedPort == port && cachedFamily == cacheFamilyName(family))
+        {
+            return parseNumericAddress(literal, port, family, address);
+        }
+    }
+    return false;
+}
+
+void storeCachedAddress(const std::string& path, const std::string& host, unsigned short port,
+                        AddressFamily family, const PeerAddress& address)
+{
+    char literal[NI_MAXHOST] = {};
+    if (getnameinfo(address.sockAddr(), address.len, literal, sizeof(literal), nullptr, 0,
+                    NI_NUMERICHOST) != 0)
+    {
+        return;
+    }
+    std::string entry = fmt::format("{} {} {}", host, port, cacheFamilyName(family));
+
+    // Every other entry is kept; the new file replaces the old in one rename
+    std::string kept;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.rfind(entry + " ", 0) != 0)
+        {
+            kept += line + "\n";
+        }
+    }
+    std::string temp = path + ".tmp";
+    std::ofstream out(temp, std::ios::trunc);
+    out << kept << entry << ' ' << literal << '\n';
+    out.close();
+    if (!out || std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        spdlog::warn("Connect: could not write the address cache {}: {}", path, strerror(errno));
+        std::remove(temp.c_str());
+    }
+}
+
+int connectKnownAddress(const std::string& host, const PeerAddress& address, const char* source,
+                        double resolveSeconds, const SocketSetup& setup, ConnectReport& report)
+{
+    report = ConnectReport();
+    report.host   = host;
+    report.source = source;
+    report.resolveSeconds = resolveSeconds;
+    (address.family() == AF_INET6 ? report.v6Addresses : report.v4Addresses) = 1;
+    ConnectAttempt attempt;
+    attempt.address = address;
+    int fd = connectAddress(address, setup, attempt.seconds);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    attempt.error = 0;
+    report.attempts.push_back(attempt);
+    report.winner = address;
+    report.connectSeconds = attempt.seconds;
+    return fd;
+}
+
+double ConnectReport::winnerSeconds() const
+{
+    for (const ConnectAttempt& a : attempts)
+    {
+        if (a.error == 0)
+        {
+            return a.seconds;
+        }
+    }
+    return 0.0;
+}
+
+std::string attemptResult(const ConnectAttempt& attempt)
+{
+    if (attempt.error == 0)
+    {
+        return "ok";
+    }
+    return attempt.error > 0 ? strerror(attempt.error) : "abandoned";
+}
+
+void logConnectReport(const ConnectReport& report)
+{
+    std::string source = report.source == std::string("resolver")
+        ? "" : fmt::format(" ({})", report.source);
+    spdlog::info("Connect: {} resolved to {} IPv6 + {} IPv4 address(es) in {:.3f} ms{}",
+                 report.host, report.v6Addresses, report.v4Addresses,
+                 report.resolveSeconds * 1000.0, source);
+    for (const ConnectAttempt& a : report.attempts)
+    {
+        if (a.error != 0)
+        {
+            spdlog::info("Connect: {} {} after {:.3f} ms", formatAddress(a.address.sockAddr()),
+                         a.error > 0 ? "failed (" + attemptResult(a) + ")" : attemptResult(a),
+                         a.seconds * 1000.0);
+        }
+    }
+    spdlog::info("Connect: connected to {} in {:.3f} ms ({} attempt(s))",
+                 formatAddress(report.winner.sockAddr()), report.connectSeconds * 1000.0,
+                 report.attempts.size());
+}
+
+void logStreamConnects(const std::vector<double>& seconds)
+{
+    if (seconds.empty())
+    {
+        return;
+    }
+    double total = 0.0;
+    double longest = 0.0;
+    for (double s : seconds)
+    {
+        total += s;
+        longest = std::max(longest, s);
+    }
+    spdlog::info("Connect: {} data stream(s) in {:.3f} ms mean, {:.3f} ms max", seconds.size(),
+                 total / static_cast<double>(seconds.size()) * 1000.0, longest * 1000.0);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+// Addresses for both ends. The server listens dual-stack (one AF_INET6
+// socket with IPV6_V6ONLY off also takes IPv4, as v4-mapped addresses)
+// unless -4 / -6 narrows it, falling back to AF_INET where IPv6 is disabled.
+// The client resolves AAAA and A at once and races connections across every
+// address Happy Eyeballs style (RFC 8305): IPv6 first, families interleaved,
+// a new attempt every CONNECTION_ATTEMPT_DELAY (or as soon as one fails)
+// while the earlier ones keep going, first handshake wins. The later streams
+// then connect straight to the winner. A numeric host skips the resolver
+// and the race. An address from the --addr-cache file is the race's first
+// attempt, started before any answer is in: the resolver runs meanwhile,
+// and its addresses join CONNECTION_ATTEMPT_DELAY later (or as soon as the
+// cached one fails), so a dead record costs no more than that delay.
+enum class AddressFamily
+{
+    Any,  // dual-stack / both record types
+    IPv4, // -4
+    IPv6, // -6
+};
+
+// RFC 8305 section 3: how long an A answer waits for the AAAA one
+static const auto RESOLUTION_DELAY = std::chrono::milliseconds(50);
+// ...and section 5: the gap between starting connection attempts
+static const auto CONNECTION_ATTEMPT_DELAY = std::chrono::milliseconds(250);
+
+struct PeerAddress
+{
+    sockaddr_storage storage{};
+    socklen_t len = 0;
+
+    int family() const { return storage.ss_family; }
+    const sockaddr* sockAddr() const { return reinterpret_cast<const sockaddr*>(&storage); }
+};
+
+bool sameAddress(const PeerAddress& a, const PeerAddress& b);
+
+// "192.0.2.1:5201" or "[2001:db8::1]:5201"; v4-mapped IPv6 prints as IPv4
+std::string formatAddress(const sockaddr* addr);
+
+// formatAddress() of sockfd's peer; "?" if it has none
+std::string formatPeer(int sockfd);
+
+// One AF_INET6 / AF_INET socket of type, as family asks (Any: dual-stack,
+// falling back to IPv4 only). -1 (logged) on failure.
+int openServerSocket(int type, AddressFamily family);
+
+// bind() sockfd (from openServerSocket()) to the wildcard address of its family
+bool bindWildcard(int sockfd, unsigned short port);
+
+// What resolving the host and connecting the first socket took
+struct ConnectAttempt
+{
+    PeerAddress address;
+    double seconds = 0.0; // from its connect() to the outcome
+    int error = 0;        // errno; 0 = won, -1 = abandoned when another won
+};
+
+struct ConnectReport
+{
+    std::string host;
+    const char* source = "resolver"; // "numeric": no lookups, no race; "cache": raced first
+    int v6Addresses = 0;
+    int v4Addresses = 0;
+    double resolveSeconds = 0.0; // until there was something to connect to
+    double connectSeconds = 0.0; // from the first attempt to the winning handshake
+    PeerAddress winner;
+    std::vector<ConnectAttempt> attempts; // in the order they started
+
+    // The winning attempt's own handshake time
+    double winnerSeconds() const;
+};
+
+// Called on each fresh socket before its connect(), e.g. to apply tuning;
+// false drops that address
+using SocketSetup = std::function<bool(int sockfd)>;
+
+// Resolve host:port (both record types in parallel) and race connections to
+// every address, cached (if not null) first. The winning socket is blocking
+// again; -1 with every failure logged if none connected.
+int happyEyeballsConnect(const std::string& host, unsigned short port, AddressFamily family,
+                         const SocketSetup& setup, ConnectReport& report,
+                         const PeerAddress* cached = nullptr);
+
+// Every address of host:port for socktype in RFC 8305 order; false (logged)
+// if there are none
+bool resolveAll(const std::string& host, unsigned short port, AddressFamily family,
+                int socktype, std::vector<PeerAddress>& addresses);
+
+// Blocking socket() + setup + connect() to one known address; -1 (errno
+// left set) on failure. seconds: how long connect() took.
+int connectAddress(const PeerAddress& address, const SocketSetup& setup, double& seconds);
+
+// host as a literal address; false for a name, or for a literal of the
+// other family than -4 / -6 asks for
+bool parseNumericAddress(const std::string& host, unsigned short port, AddressFamily family,
+                         PeerAddress& address);
+
+// --addr-cache: one "host port family address" line per host, the address
+// the last race to host:port over family won. false if path has none.
+bool loadCachedAddress(const std::string& path, const std::string& host, unsigned short port,
+                       AddressFamily family, PeerAddress& address);
+
+// Replace host:port's line in path (logged, not fatal, if it can't be written)
+void storeCachedAddress(const std::string& path, const std::string& host, unsigned short port,
+                        AddressFamily family, const PeerAddress& address);
+
+// The first connection to an address known without the resolver, with
+// report filled in as happyEyeballsConnect() would (source says how it was
+// known, resolveSeconds what finding it took). -1, errno set and nothing
+// logged, if it failed.
+int connectKnownAddress(const std::string& host, const PeerAddress& address, const char* source,
+                        double resolveSeconds, const SocketSetup& setup, ConnectReport& report);
+
+// "Connect: ..." lines: what resolved, each attempt, the winner and the
+// setup time, apart from the data phases
+void logConnectReport(const ConnectReport& report);
+
+// One line with the data streams' connect() times (mean and max)
+void logStreamConnects(const std::vector<double>& seconds);
+
+// "ok", "abandoned" or the attempt's strerror()
+std::string attemptResult(const ConnectAttempt& attempt);
@@ -0,0 +1,864 @@
+#include "af_xdp.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <net/if.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <spdlog/spdlog.h>
+
+#include "address.hpp"
+
+namespace
+{
+
+const size_t ETH_HEADER = 14;
+const size_t IPV4_HEADER = 20; // no options, both ways
+const size_t IPV6_HEADER = 40;
+const size_t UDP_HEADER = 8;
+const int NEIGHBOUR_WAIT_MS = 1000; // for the priming datagram's ARP / ND to finish
+const int DRAIN_POLL_US = 100;
+
+bool fail(const char* what)
+{
+    spdlog::error("AF_XDP: {} failed: {}", what, strerror(errno));
+    return false;
+}
+
+int bpf(int cmd, bpf_attr& attr)
+{
+    return static_cast<int>(syscall(__NR_bpf, cmd, &attr, sizeof(attr)));
+}
+
+// Big-endian 16-bit words, as the Internet checksum adds them
+uint32_t sumWords(const uint8_t* p, size_t len, uint32_t sum)
+{
+    for (size_t i = 0; i + 1 < len; i += 2)
+    {
+        sum += static_cast<uint32_t>(p[i] << 8 | p[i + 1]);
+    }
+    if (len % 2)
+    {
+        sum += static_cast<uint32_t>(p[len - 1] << 8);
+    }
+    return sum;
+}
+
+uint16_t foldChecksum(uint32_t sum)
+{
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum & 0xffff);
+}
+
+void putBe16(uint8_t* p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+uint16_t getBe16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+// The address bytes (4 or 16) and port of an AF_INET / AF_INET6 sockaddr
+const uint8_t* ipBytes(const sockaddr_storage& addr, size_t& len, uint16_t& port)
+{
+    if (addr.ss_family == AF_INET)
+    {
+        const auto& in = reinterpret_cast<const sockaddr_in&>(addr);
+        len = 4;
+        port = ntohs(in.sin_port);
+        return reinterpret_cast<const uint8_t*>(&in.sin_addr);
+    }
+    const auto& in6 = reinterpret_cast<const sockaddr_in6&>(addr);
+    len = 16;
+    port = ntohs(in6.sin6_port);
+    return reinterpret_cast<const uint8_t*>(&in6.sin6_addr);
+}
+
+// One rtnetlink request; onMessage sees every reply message until the
+// dump (or the single answer) ends. False with errno set on error.
+template <typename F>
+bool rtnetlink(void* request, size_t len, F onMessage)
+{
+    int nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl < 0)
+    {
+        return false;
+    }
+    if (send(nl, request, len, 0) < 0)
+    {
+        close(nl);
+        return false;
+    }
+    alignas(nlmsghdr) char buf[16384];
+    bool ok = true;
+    bool done = false;
+    while (!done)
+    {
+        ssize_t r = recv(nl, buf, sizeof(buf), 0);
+        if (r <= 0)
+        {
+            ok = false;
+            break;
+        }
+        int left = static_cast<int>(r);
+        for (auto* h = reinterpret_cast<nlmsghdr*>(buf); NLMSG_OK(h, left); h = NLMSG_NEXT(h, left))
+        {
+            if (h->nlmsg_type == NLMSG_DONE)
+            {
+                done = true;
+            }
+            else if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                int error = static_cast<nlmsgerr*>(NLMSG_DATA(h))->error;
+                if (error != 0)
+                {
+                    errno = -error;
+                    ok = false;
+                }
+                done = true;
+            }
+            else
+            {
+                onMessage(h);
+                done = done || !(h->nlmsg_flags & NLM_F_MULTI);
+            }
+        }
+    }
+    close(nl);
+    return ok;
+}
+
+// The interface and next hop (the gateway, else dst itself) the kernel routes dst by
+bool routeTo(const sockaddr_storage& dst, int& oif, std::vector<uint8_t>& nextHop)
+{
+    size_t len = 0;
+    uint16_t port = 0;
+    const uint8_t* addr = ipBytes(dst, len, port);
+    struct
+    {
+        nlmsghdr header;
+        rtmsg route;
+        char attrs[64];
+    } request;
+    std::memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+    request.header.nlmsg_type = RTM_GETROUTE;
+    request.header.nlmsg_flags = NLM_F_REQUEST;
+    request.route.rtm_family = static_cast<unsigned char>(dst.ss_family);
+    request.route.rtm_dst_len = static_cast<unsigned char>(len * 8);
+    auto* rta = reinterpret_cast<rtattr*>(reinterpret_cast<char*>(&request) +
+                                          NLMSG_ALIGN(request.header.nlmsg_len));
+    rta->rta_type = RTA_DST;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(len));
+    std::memcpy(RTA_DATA(rta), addr, len);
+    request.header.nlmsg_len = NLMSG_ALIGN(request.header.nlmsg_len) + RTA_ALIGN(rta->rta_len);
+
+    oif = 0;
+    nextHop.assign(addr, addr + len);
+    bool ok = rtnetlink(&request, request.header.nlmsg_len, [&](nlmsghdr* h) {
+        if (h->nlmsg_type != RTM_NEWROUTE)
+        {
+            return;
+        }
+        auto* route = static_cast<rtmsg*>(NLMSG_DATA(h));
+        int attrLen = static_cast<int>(RTM_PAYLOAD(h));
+        for (rtattr* a = RTM_RTA(route); RTA_OK(a, attrLen); a = RTA_NEXT(a, attrLen))
+        {
+            if (a->rta_type == RTA_OIF)
+            {
+                std::memcpy(&oif, RTA_DATA(a), sizeof(oif));
+            }
+            else if (a->rta_type == RTA_GATEWAY && RTA_PAYLOAD(a) == len)
+            {
+                auto* gw = static_cast<const uint8_t*>(RTA_DATA(a));
+                nextHop.assign(gw, gw + len);
+            }
+        }
+    });
+    return ok && oif > 0;
+}
+
+// A usable neighbour-table entry for addr on ifindex
+bool neighbourMac(int family, int ifindex, const std::vector<uint8_t>& addr, uint8_t* mac)
+{
+    struct
+    {
+        nlmsghdr header;
+        ndmsg neighbour;
+    } request;
+    std::memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(ndmsg));
+    request.header.nlmsg_type = RTM_GETNEIGH;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.neighbour.ndm_family = static_cast<uint8_t>(family);
+
+    bool found = false;
+    bool ok = rtnetlink(&request, request.header.nlmsg_len, [&](nlmsghdr* h) {
+        auto* n = static_cast<ndmsg*>(NLMSG_DATA(h));
+        if (h->nlmsg_type != RTM_NEWNEIGH || found || n->ndm_ifindex != ifindex ||
+            (n->ndm_state & (NUD_INCOMPLETE | NUD_FAILED | NUD_NONE)) || n->ndm_state == 0)
+        {
+            return;
+        }
+        const uint8_t* lladdr = nullptr;
+        bool match = false;
+        int attrLen = static_cast<int>(h->nlmsg_len - NLMSG_LENGTH(sizeof(ndmsg)));
+        for (auto* a = reinterpret_cast<rtattr*>(reinterpret_cast<char*>(n) +
+                                                 NLMSG_ALIGN(sizeof(ndmsg)));
+             RTA_OK(a, attrLen); a = RTA_NEXT(a, attrLen))
+        {
+            if (a->rta_type == NDA_DST && RTA_PAYLOAD(a) == addr.size())
+            {
+                match = std::memcmp(RTA_DATA(a), addr.data(), addr.size()) == 0;
+            }
+            else if (a->rta_type == NDA_LLADDR && RTA_PAYLOAD(a) == ETH_ALEN)
+            {
+                lladdr = static_cast<const uint8_t*>(RTA_DATA(a));
+            }
+        }
+        if (match && lladdr)
+        {
+            std::memcpy(mac, lladdr, ETH_ALEN);
+            found = true;
+        }
+    });
+    return ok && found;
+}
+
+// SIOCGIFHWADDR / SIOCGIFMTU for device
+bool interfaceInfo(const std::string& device, uint8_t* mac, int& mtu)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        return false;
+    }
+    ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, device.c_str(), IFNAMSIZ - 1);
+    bool ok = ioctl(sock, SIOCGIFHWADDR, &ifr) == 0;
+    if (ok)
+    {
+        std::memcpy(mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+        ok = ioctl(sock, SIOCGIFMTU, &ifr) == 0;
+        mtu = ifr.ifr_mtu;
+    }
+    close(sock);
+    return ok;
+}
+
+// Jumps by label, patched once the program is complete
+class BpfProgram
+{
+public:
+    void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+    {
+        bpf_insn insn;
+        std::memset(&insn, 0, sizeof(insn));
+        insn.code = code;
+        insn.dst_reg = dst & 0xf;
+        insn.src_reg = src & 0xf;
+        insn.off = off;
+        insn.imm = imm;
+        insns_.push_back(insn);
+    }
+
+    void jump(uint8_t op, uint8_t dst, int32_t imm, int label)
+    {
+        fixups_.emplace_back(insns_.size(), label);
+        emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+    }
+
+    void jumpReg(uint8_t op, uint8_t dst, uint8_t src, int label)
+    {
+        fixups_.emplace_back(insns_.size(), label);
+        emit(BPF_JMP | op | BPF_X, dst, src, 0, 0);
+    }
+
+    void label(int label) { labels_[label] = static_cast<int>(insns_.size()); }
+
+    const std::vector<bpf_insn>& finish()
+    {
+        for (const auto& [at, label] : fixups_)
+        {
+            insns_[at].off = static_cast<int16_t>(labels_[label] - static_cast<int>(at) - 1);
+        }
+        return insns_;
+    }
+
+private:
+    std::vector<bpf_insn> insns_;
+    std::vector<std::pair<size_t, int>> fixups_;
+    int labels_[4] = {};
+};
+
+// Redirect UDP to port (IPv4 without options, or IPv6 without extension
+// headers) into the XSKMAP slot of the packet's RX queue; pass the rest
+std::vector<bpf_insn> redirectProgram(int mapFd, uint16_t port)
+{
+    enum { PASS, IPV4, REDIRECT };
+    const int32_t portBe = htons(port); // as a 16-bit load of the packet reads it
+    BpfProgram p;
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0); // r6 = ctx
+    p.emit(BPF_LDX | BPF_MEM | BPF_W, 2, 6, offsetof(xdp_md, data), 0);
+    p.emit(BPF_LDX | BPF_MEM | BPF_W, 3, 6, offsetof(xdp_md, data_end), 0);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_HEADER);
+    p.jumpReg(BPF_JGT, 4, 3, PASS);
+    p.emit(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0); // ethertype
+    p.jump(BPF_JEQ, 5, htons(ETH_P_IP), IPV4);
+    p.jump(BPF_JNE, 5, htons(ETH_P_IPV6), PASS);
+
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_HEADER + IPV6_HEADER + UDP_HEADER);
+    p.jumpReg(BPF_JGT, 4, 3, PASS);
+    p.emit(BPF_LDX | BPF_MEM | BPF_B, 5, 2, ETH_HEADER + 6, 0); // next header
+    p.jump(BPF_JNE, 5, IPPROTO_UDP, PASS);
+    p.emit(BPF_LDX | BPF_MEM | BPF_H, 5, 2, ETH_HEADER + IPV6_HEADER + 2, 0);
+    p.jump(BPF_JNE, 5, portBe, PASS);
+    p.jump(BPF_JA, 0, 0, REDIRECT);
+
+    p.label(IPV4);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_HEADER + IPV4_HEADER + UDP_HEADER);
+    p.jumpReg(BPF_JGT, 4, 3, PASS);
+    p.emit(BPF_LDX | BPF_MEM | BPF_B, 5, 2, ETH_HEADER, 0); // version + IHL
+    p.emit(BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, 0x0f);
+    p.jump(BPF_JNE, 5, IPV4_HEADER / 4, PASS);
+    p.emit(BPF_LDX | BPF_MEM | BPF_B, 5, 2, ETH_HEADER + 9, 0); // protocol
+    p.jump(BPF_JNE, 5, IPPROTO_UDP, PASS);
+    p.emit(BPF_LDX | BPF_MEM | BPF_H, 5, 2, ETH_HEADER + IPV4_HEADER + 2, 0);
+    p.jump(BPF_JNE, 5, portBe, PASS);
+
+    p.label(REDIRECT);
+    p.emit(BPF_LDX | BPF_MEM | BPF_W, 2, 6, offsetof(xdp_md, rx_queue_index), 0);
+    p.emit(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, mapFd);
+    p.emit(0, 0, 0, 0, 0); // second half of the 64-bit immediate
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS); // the fallback action
+    p.emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    p.emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    p.label(PASS);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS);
+    p.emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+    return p.finish();
+}
+
+} // namespace
+
+XdpSocket::~XdpSocket()
+{
+    for (int fd : {linkFd_, progFd_, fd_, mapFd_})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    for (Ring* ring : {&fill_, &completion_, &rx_, &tx_})
+    {
+        if (ring->map)
+        {
+            munmap(ring->map, ring->mapLen);
+        }
+    }
+    if (umem_)
+    {
+        munmap(umem_, static_cast<size_t>(XDP_FRAMES) * XDP_FRAME_SIZE);
+    }
+}
+
+bool XdpSocket::mapRing(Ring& ring, uint64_t pgoff, uint32_t entries, size_t descSize,
+                        uint32_t producerOff, uint32_t consumerOff, uint32_t flagsOff,
+                        uint32_t descOff)
+{
+    ring.mapLen = descOff + entries * descSize;
+    void* map = mmap(nullptr, ring.mapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd_, static_cast<off_t>(pgoff));
+    if (map == MAP_FAILED)
+    {
+        return fail("ring mmap()");
+    }
+    char* base = static_cast<char*>(map);
+    ring.map = map;
+    ring.producer = reinterpret_cast<uint32_t*>(base + producerOff);
+    ring.consumer = reinterpret_cast<uint32_t*>(base + consumerOff);
+    ring.flags = reinterpret_cast<uint32_t*>(base + flagsOff);
+    ring.descs = base + descOff;
+    ring.mask = entries - 1;
+    return true;
+}
+
+// Socket, UMEM and its rings, plus the RX or the TX ring; bound later
+bool XdpSocket::openSocket(const std::string& device, bool rx)
+{
+    ifindex_ = static_cast<int>(if_nametoindex(device.c_str()));
+    if (ifindex_ == 0)
+    {
+        spdlog::error("AF_XDP: no interface {}", device);
+        return false;
+    }
+    fd_ = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+    {
+        return fail("socket(AF_XDP) (needs root)");
+    }
+    size_t umemLen = static_cast<size_t>(XDP_FRAMES) * XDP_FRAME_SIZE;
+    void* umem = mmap(nullptr, umemLen, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem == MAP_FAILED)
+    {
+        return fail("UMEM mmap()");
+    }
+    umem_ = static_cast<char*>(umem);
+
+    xdp_umem_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.addr = reinterpret_cast<uint64_t>(umem_);
+    reg.len = umemLen;
+    reg.chunk_size = XDP_FRAME_SIZE;
+    if (setsockopt(fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+    {
+        return fail("XDP_UMEM_REG");
+    }
+    // Fill and completion rings hold every frame, so neither can overflow
+    uint32_t frames = XDP_FRAMES;
+    uint32_t descs = XDP_RING_SIZE;
+    if (setsockopt(fd_, SOL_XDP, XDP_UMEM_FILL_RING, &frames, sizeof(frames)) < 0 ||
+        setsockopt(fd_, SOL_XDP, XDP_UMEM_COMPLETION_RING, &frames, sizeof(frames)) < 0 ||
+        setsockopt(fd_, SOL_XDP, rx ? XDP_RX_RING : XDP_TX_RING, &descs, sizeof(descs)) < 0)
+    {
+        return fail("ring setup");
+    }
+    xdp_mmap_offsets off;
+    socklen_t offLen = sizeof(off);
+    if (getsockopt(fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &offLen) < 0)
+    {
+        return fail("XDP_MMAP_OFFSETS");
+    }
+    bool ok = mapRing(fill_, XDP_UMEM_PGOFF_FILL_RING, frames, sizeof(uint64_t),
+                      off.fr.producer, off.fr.consumer, off.fr.flags, off.fr.desc) &&
+              mapRing(completion_, XDP_UMEM_PGOFF_COMPLETION_RING, frames, sizeof(uint64_t),
+                      off.cr.producer, off.cr.consumer, off.cr.flags, off.cr.desc);
+    if (ok && rx)
+    {
+        ok = mapRing(rx_, XDP_PGOFF_RX_RING, descs, sizeof(xdp_desc), off.rx.producer,
+                     off.rx.consumer, off.rx.flags, off.rx.desc);
+    }
+    else if (ok)
+    {
+        ok = mapRing(tx_, XDP_PGOFF_TX_RING, descs, sizeof(xdp_desc), off.tx.producer,
+                     off.tx.consumer, off.tx.flags, off.tx.desc);
+    }
+    return ok;
+}
+
+// Zero-copy if the driver does it, else copy mode
+bool XdpSocket::bindSocket(unsigned queue)
+{
+    sockaddr_xdp sxdp;
+    std::memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = static_cast<uint32_t>(ifindex_);
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp)) < 0)
+    {
+        sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+        if (bind(fd_, reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp)) < 0)
+        {
+            return fail("bind()");
+        }
+    }
+    xdp_options options;
+    socklen_t optLen = sizeof(options);
+    zeroCopy_ = getsockopt(fd_, SOL_XDP, XDP_OPTIONS, &options, &optLen) == 0 &&
+                (options.flags & XDP_OPTIONS_ZEROCOPY);
+    return true;
+}
+
+bool XdpSocket::openSender(const std::string& device, unsigned queue,
+                           const sockaddr_storage& local, const sockaddr_storage& peer,
+                           size_t payloadSize, size_t stampBytes)
+{
+    ipv6_ = peer.ss_family == AF_INET6;
+    size_t addrLen = 0;
+    uint16_t srcPort = 0;
+    uint16_t dstPort = 0;
+    const uint8_t* src = ipBytes(local, addrLen, srcPort);
+    const uint8_t* dst = ipBytes(peer, addrLen, dstPort);
+
+    // 1) Which way the kernel would send it, and to which MAC
+    int oif = 0;
+    std::vector<uint8_t> nextHop;
+    if (!routeTo(peer, oif, nextHop))
+    {
+        return fail("route lookup");
+    }
+    int ifindex = static_cast<int>(if_nametoindex(device.c_str()));
+    if (ifindex == 0)
+    {
+        spdlog::error("AF_XDP: no interface {}", device);
+        return false;
+    }
+    if (oif != ifindex)
+    {
+        char name[IF_NAMESIZE] = "?";
+        if_indextoname(static_cast<unsigned>(oif), name);
+        spdlog::error("AF_XDP: {} is reached through {}, not {}",
+                      formatAddress(reinterpret_cast<const sockaddr*>(&peer)), name, device);
+        return false;
+    }
+    uint8_t dstMac[ETH_ALEN];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(NEIGHBOUR_WAIT_MS);
+    while (!neighbourMac(peer.ss_family, oif, nextHop, dstMac))
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            spdlog::error("AF_XDP: no neighbour entry for the next hop on {}; is the server "
+                          "reachable?", device);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    uint8_t srcMac[ETH_ALEN];
+    int mtu = 0;
+    if (!interfaceInfo(device, srcMac, mtu))
+    {
+        return fail("SIOCGIFHWADDR");
+    }
+    size_t ipLen = ipv6_ ? IPV6_HEADER : IPV4_HEADER;
+    headerLen_ = ETH_HEADER + ipLen + UDP_HEADER;
+    frameLen_ = headerLen_ + payloadSize;
+    if (ipLen + UDP_HEADER + payloadSize > static_cast<size_t>(mtu) ||
+        frameLen_ > XDP_FRAME_SIZE - XDP_PACKET_HEADROOM)
+    {
+        spdlog::error("AF_XDP: {}-byte datagrams do not fit {}'s MTU of {} in one frame",
+                      payloadSize, device, mtu);
+        return false;
+    }
+    stampBytes_ = std::min(stampBytes, payloadSize);
+
+    // 2) Socket, TX ring and the UMEM, every frame on the free list
+    if (!openSocket(device, false) || !bindSocket(queue))
+    {
+        return false;
+    }
+    description_ = fmt::format("{} queue {}, {}", device, queue,
+                               zeroCopy_ ? "zero-copy" : "copy mode");
+
+    // 3) The headers every frame carries, written once
+    uint8_t header[ETH_HEADER + IPV6_HEADER + UDP_HEADER];
+    std::memset(header, 0, sizeof(header));
+    std::memcpy(header, dstMac, ETH_ALEN);
+    std::memcpy(header + ETH_ALEN, srcMac, ETH_ALEN);
+    putBe16(header + 12, ipv6_ ? ETH_P_IPV6 : ETH_P_IP);
+    uint8_t* ip = header + ETH_HEADER;
+    uint16_t udpLen = static_cast<uint16_t>(UDP_HEADER + payloadSize);
+    if (ipv6_)
+    {
+        ip[0] = 0x60;
+        putBe16(ip + 4, udpLen);
+        ip[6] = IPPROTO_UDP;
+        ip[7] = 64; // hop limit
+        std::memcpy(ip + 8, src, 16);
+        std::memcpy(ip + 24, dst, 16);
+    }
+    else
+    {
+        ip[0] = 0x45;
+        putBe16(ip + 2, static_cast<uint16_t>(IPV4_HEADER + udpLen));
+        putBe16(ip + 6, 0x4000); // DF, so the id can stay 0
+        ip[8] = 64;
+        ip[9] = IPPROTO_UDP;
+        std::memcpy(ip + 12, src, 4);
+        std::memcpy(ip + 16, dst, 4);
+        putBe16(ip + 10, foldChecksum(sumWords(ip, IPV4_HEADER, 0)));
+    }
+    uint8_t* udp = ip + ipLen;
+    putBe16(udp, srcPort);
+    putBe16(udp + 2, dstPort);
+    putBe16(udp + 4, udpLen);
+
+    // Pseudo-header + UDP header; the zero payload adds nothing
+    uint32_t sum = sumWords(src, addrLen, 0);
+    sum = sumWords(dst, addrLen, sum);
+    sum += IPPROTO_UDP + udpLen;
+    checksumBase_ = sumWords(udp, UDP_HEADER, sum);
+
+    freeFrames_.reserve(XDP_FRAMES);
+    for (uint32_t i = 0; i < XDP_FRAMES; i++)
+    {
+        uint64_t addr = static_cast<uint64_t>(i) * XDP_FRAME_SIZE;
+        std::memcpy(umem_ + addr, header, headerLen_);
+        freeFrames_.push_back(addr);
+    }
+    reserved_.reserve(XDP_RING_SIZE);
+    return true;
+}
+
+bool XdpSocket::openReceiver(const std::string& device, unsigned queue, uint16_t port)
+{
+    port_ = port;
+    if (!openSocket(device, true))
+    {
+        return false;
+    }
+    // Every frame starts out on the fill ring
+    uint64_t* fill = static_cast<uint64_t*>(fill_.descs);
+    for (uint32_t i = 0; i < XDP_FRAMES; i++)
+    {
+        fill[i] = static_cast<uint64_t>(i) * XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(fill_.producer, XDP_FRAMES, __ATOMIC_RELEASE);
+
+    // 1) XSKMAP + redirect program, attached natively if the driver can
+    bpf_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = queue + 1;
+    mapFd_ = bpf(BPF_MAP_CREATE, attr);
+    if (mapFd_ < 0)
+    {
+        return fail("XSKMAP creation (needs CAP_BPF)");
+    }
+    std::vector<bpf_insn> insns = redirectProgram(mapFd_, port);
+    static const char license[] = "GPL";
+    std::memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = reinterpret_cast<uint64_t>(insns.data());
+    attr.insn_cnt = static_cast<uint32_t>(insns.size());
+    attr.license = reinterpret_cast<uint64_t>(license);
+    progFd_ = bpf(BPF_PROG_LOAD, attr);
+    if (progFd_ < 0)
+    {
+        // Again with the verifier's log, for the message
+        char log[4096] = "";
+        attr.log_buf = reinterpret_cast<uint64_t>(log);
+        attr.log_size = sizeof(log);
+        attr.log_level = 1;
+        int err = errno;
+        bpf(BPF_PROG_LOAD, attr);
+        spdlog::error("AF_XDP: loading the redirect program failed: {}\n{}", strerror(err), log);
+        return false;
+    }
+    bool native = true;
+    for (uint32_t flags : {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE})
+    {
+        std::memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = static_cast<uint32_t>(progFd_);
+        attr.link_create.target_ifindex = static_cast<uint32_t>(ifindex_);
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = flags;
+        linkFd_ = bpf(BPF_LINK_CREATE, attr);
+        if (linkFd_ >= 0 || errno == EBUSY || errno == EEXIST)
+        {
+            break;
+        }
+        native = false;
+    }
+    if (linkFd_ < 0)
+    {
+        return fail(errno == EBUSY || errno == EEXIST
+                        ? "attaching XDP (another program holds the interface)"
+                        : "attaching XDP");
+    }
+
+    // 2) Bind, then point the queue's map slot at the socket
+    if (!bindSocket(queue))
+    {
+        return false;
+    }
+    uint32_t key = queue;
+    uint32_t value = static_cast<uint32_t>(fd_);
+    std::memset(&attr, 0, sizeof(attr));
+    attr.map_fd = static_cast<uint32_t>(mapFd_);
+    attr.key = reinterpret_cast<uint64_t>(&key);
+    attr.value = reinterpret_cast<uint64_t>(&value);
+    attr.flags = BPF_ANY;
+    if (bpf(BPF_MAP_UPDATE_ELEM, attr) < 0)
+    {
+        return fail("XSKMAP update");
+    }
+    description_ = fmt::format("{} queue {}, {}, {} XDP", device, queue,
+                               zeroCopy_ ? "zero-copy" : "copy mode",
+                               native ? "native" : "generic");
+    held_.reserve(XDP_RING_SIZE);
+    return true;
+}
+
+void XdpSocket::reclaimCompletions()
+{
+    uint32_t cons = *completion_.consumer;
+    uint32_t prod = __atomic_load_n(completion_.producer, __ATOMIC_ACQUIRE);
+    const uint64_t* addrs = static_cast<const uint64_t*>(completion_.descs);
+    for (uint32_t i = cons; i != prod; i++)
+    {
+        freeFrames_.push_back(addrs[i & completion_.mask]);
+    }
+    __atomic_store_n(completion_.consumer, prod, __ATOMIC_RELEASE);
+    outstanding_ -= prod - cons;
+}
+
+void XdpSocket::wakeTx()
+{
+    if (__atomic_load_n(tx_.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+    {
+        // EAGAIN / EBUSY: the driver is still working through the ring
+        sendto(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    }
+}
+
+int XdpSocket::reserve(int n, char** payloads)
+{
+    reclaimCompletions();
+    uint32_t used = *tx_.producer - __atomic_load_n(tx_.consumer, __ATOMIC_ACQUIRE);
+    size_t room = std::min<size_t>(freeFrames_.size(), XDP_RING_SIZE - used);
+    int count = static_cast<int>(std::min<size_t>(static_cast<size_t>(n), room));
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t addr = freeFrames_.back();
+        freeFrames_.pop_back();
+        reserved_.push_back(addr);
+        payloads[i] = umem_ + addr + headerLen_;
+    }
+    return count;
+}
+
+void XdpSocket::submit(int n)
+{
+    uint32_t prod = *tx_.producer;
+    xdp_desc* descs = static_cast<xdp_desc*>(tx_.descs);
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t addr = reserved_[static_cast<size_t>(i)];
+        uint8_t* frame = reinterpret_cast<uint8_t*>(umem_ + addr);
+        uint16_t checksum = foldChecksum(sumWords(frame + headerLen_, stampBytes_, checksumBase_));
+        putBe16(frame + headerLen_ - 2, checksum == 0 ? 0xffff : checksum);
+        xdp_desc& d = descs[(prod + static_cast<uint32_t>(i)) & tx_.mask];
+        d.addr = addr;
+        d.len = static_cast<uint32_t>(frameLen_);
+        d.options = 0;
+    }
+    __atomic_store_n(tx_.producer, prod + static_cast<uint32_t>(n), __ATOMIC_RELEASE);
+    outstanding_ += static_cast<uint32_t>(n);
+    reserved_.clear();
+    wakeTx();
+}
+
+bool XdpSocket::drain(int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true)
+    {
+        reclaimCompletions();
+        if (outstanding_ == 0)
+        {
+            return true;
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        wakeTx();
+        std::this_thread::sleep_for(std::chrono::microseconds(DRAIN_POLL_US));
+    }
+}
+
+int XdpSocket::receive(XdpDatagram* out, int n)
+{
+    uint32_t cons = *rx_.consumer;
+    uint32_t prod = __atomic_load_n(rx_.producer, __ATOMIC_ACQUIRE);
+    uint32_t take = std::min(prod - cons, static_cast<uint32_t>(n));
+    const xdp_desc* descs = static_cast<const xdp_desc*>(rx_.descs);
+    int count = 0;
+    for (uint32_t i = 0; i < take; i++)
+    {
+        const xdp_desc& d = descs[(cons + i) & rx_.mask];
+        held_.push_back(d.addr & ~static_cast<uint64_t>(XDP_FRAME_SIZE - 1));
+        const uint8_t* frame = reinterpret_cast<const uint8_t*>(umem_ + d.addr);
+        size_t len = d.len;
+        if (len < ETH_HEADER)
+        {
+            continue;
+        }
+
+        // The program only lets through what it checked; parse to find the payload
+        XdpDatagram& dg = out[count];
+        const uint8_t* udp = nullptr;
+        uint16_t ethertype = getBe16(frame + 12);
+        const uint8_t* ip = frame + ETH_HEADER;
+        if (ethertype == ETH_P_IP && len >= ETH_HEADER + IPV4_HEADER + UDP_HEADER)
+        {
+            udp = ip + (ip[0] & 0x0f) * 4;
+            auto& in = reinterpret_cast<sockaddr_in&>(dg.peer);
+            in.sin_family = AF_INET;
+            std::memcpy(&in.sin_addr, ip + 12, 4);
+            dg.peerLen = sizeof(sockaddr_in);
+        }
+        else if (ethertype == ETH_P_IPV6 && len >= ETH_HEADER + IPV6_HEADER + UDP_HEADER)
+        {
+            udp = ip + IPV6_HEADER;
+            auto& in6 = reinterpret_cast<sockaddr_in6&>(dg.peer);
+            std::memset(&in6, 0, sizeof(in6));
+            in6.sin6_family = AF_INET6;
+            std::memcpy(&in6.sin6_addr, ip + 8, 16);
+            dg.peerLen = sizeof(sockaddr_in6);
+        }
+        if (!udp || udp + UDP_HEADER > frame + len || getBe16(udp + 2) != port_)
+        {
+            continue;
+        }
+        uint16_t srcPort = htons(getBe16(udp));
+        if (dg.peer.ss_family == AF_INET)
+        {
+            reinterpret_cast<sockaddr_in&>(dg.peer).sin_port = srcPort;
+        }
+        else
+        {
+            reinterpret_cast<sockaddr_in6&>(dg.peer).sin6_port = srcPort;
+        }
+        size_t udpLen = getBe16(udp + 4);
+        size_t avail = static_cast<size_t>(frame + len - udp);
+        dg.payload = reinterpret_cast<const char*>(udp + UDP_HEADER);
+        dg.len = std::min(udpLen, avail) - std::min(std::min(udpLen, avail), UDP_HEADER);
+        count++;
+    }
+    __atomic_store_n(rx_.consumer, cons + take, __ATOMIC_RELEASE);
+    return count;
+}
+
+void XdpSocket::release()
+{
+    uint32_t prod = *fill_.producer;
+    uint64_t* fill = static_cast<uint64_t*>(fill_.descs);
+    for (size_t i = 0; i < held_.size(); i++)
+    {
+        fill[(prod + static_cast<uint32_t>(i)) & fill_.mask] = held_[i];
+    }
+    __atomic_store_n(fill_.producer, prod + static_cast<uint32_t>(held_.size()), __ATOMIC_RELEASE);
+    held_.clear();
+}
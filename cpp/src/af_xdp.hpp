@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+// AF_XDP datapath for -u --engine xdp, on the raw syscalls (no libxdp or
+// libbpf); only built with -DIPERFER_AF_XDP=ON. Datagrams skip the socket
+// layer: the sender writes whole Ethernet frames into its UMEM and hands
+// them to the NIC queue's TX ring, the receiver takes them off the RX
+// ring, where a small XDP program redirects the test's UDP port to it.
+// Everything else goes on to the kernel as before, and so does test
+// traffic the NIC hashes to other queues: on a multi-queue NIC, steer the
+// flow to --xdp-queue (ethtool -N <dev> flow-type udp4 dst-port <port>
+// action <queue>). The FIN and the server's report keep to the UDP socket.
+//
+// Frames circulate between the socket and the kernel through the UMEM's
+// fill and completion rings; their Ethernet/IP/UDP headers are written once,
+// so a send only stamps the iPerfer header and fixes the UDP checksum.
+// Zero-copy is tried before copy mode, native XDP before generic (SKB) XDP.
+// Needs root (CAP_NET_ADMIN, CAP_BPF) and Linux 5.9+ for the bpf_link.
+static const size_t XDP_FRAME_SIZE = 4096;
+static const uint32_t XDP_FRAMES = 4096;    // 16 MB of UMEM; fill/completion ring size
+static const uint32_t XDP_RING_SIZE = 2048; // RX / TX descriptors
+
+// One received datagram, valid until the next release()
+struct XdpDatagram
+{
+    const char* payload = nullptr;
+    size_t len = 0;
+    sockaddr_storage peer{};
+    socklen_t peerLen = 0;
+};
+
+class XdpSocket
+{
+public:
+    XdpSocket() = default;
+    ~XdpSocket();
+
+    XdpSocket(const XdpSocket&) = delete;
+    XdpSocket& operator=(const XdpSocket&) = delete;
+
+    // Sender on device's queue: frames from local to peer (IPv4 or IPv6, as
+    // a connected UDP socket's getsockname()/getpeername() give them), via
+    // the next hop's MAC from the neighbour table. payloadSize is each
+    // datagram's UDP payload; only its first stampBytes ever change, the
+    // rest stays zero. False (logged) on failure.
+    bool openSender(const std::string& device, unsigned queue, const sockaddr_storage& local,
+                    const sockaddr_storage& peer, size_t payloadSize, size_t stampBytes);
+
+    // Receiver for UDP port on device's queue; attaches the redirect
+    // program, which goes away with this socket. False (logged) on failure.
+    bool openReceiver(const std::string& device, unsigned queue, uint16_t port);
+
+    // Up to n free TX frames; payloads[i] is frame i's UDP payload
+    int reserve(int n, char** payloads);
+    // Queue the n frames reserve() gave out and wake the driver; submit(0)
+    // only wakes it, so that completions keep coming in copy mode
+    void submit(int n);
+    // Wait up to timeoutMs for every submitted frame to complete
+    bool drain(int timeoutMs);
+
+    // Whatever the RX ring holds, up to n datagrams; never blocks (poll()
+    // fd() for POLLIN). Frames that are not UDP to our port are dropped.
+    int receive(XdpDatagram* out, int n);
+    // Give the frames of the last receive() back to the fill ring
+    void release();
+
+    int fd() const { return fd_; }
+    // "eth0 queue 0, copy mode, native XDP"
+    const std::string& description() const { return description_; }
+
+private:
+    struct Ring
+    {
+        uint32_t* producer = nullptr;
+        uint32_t* consumer = nullptr;
+        uint32_t* flags = nullptr;
+        void* descs = nullptr;
+        uint32_t mask = 0;
+        void* map = nullptr;
+        size_t mapLen = 0;
+    };
+
+    bool openSocket(const std::string& device, bool rx);
+    bool mapRing(Ring& ring, uint64_t pgoff, uint32_t entries, size_t descSize,
+                 uint32_t producerOff, uint32_t consumerOff, uint32_t flagsOff, uint32_t descOff);
+    bool bindSocket(unsigned queue);
+    void reclaimCompletions();
+    void wakeTx();
+
+    int fd_ = -1;
+    int ifindex_ = 0;
+    char* umem_ = nullptr;
+    Ring fill_;
+    Ring completion_;
+    Ring rx_;
+    Ring tx_;
+    bool zeroCopy_ = false;
+    std::string description_;
+
+    // Sender
+    std::vector<uint64_t> freeFrames_;
+    std::vector<uint64_t> reserved_;
+    uint32_t outstanding_ = 0; // submitted, not yet completed
+    size_t headerLen_ = 0;     // Ethernet + IP + UDP
+    size_t frameLen_ = 0;
+    size_t stampBytes_ = 0;
+    bool ipv6_ = false;
+    uint32_t checksumBase_ = 0; // pseudo-header + UDP header + zero payload
+
+    // Receiver
+    std::vector<uint64_t> held_; // frames the last receive() handed out
+    uint16_t port_ = 0;
+    int progFd_ = -1;
+    int mapFd_ = -1;
+    int linkFd_ = -1;
+};
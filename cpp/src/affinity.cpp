@@ -0,0 +1,125 @@
+#include "affinity.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+// Up to the first character past the number; false if there is none
+bool parseCpu(const std::string& text, size_t& pos, int& cpu)
+{
+    const char* start = text.c_str() + pos;
+    char* end = nullptr;
+    errno = 0;
+    long value = std::strtol(start, &end, 10);
+    if (end == start || errno != 0 || value < 0 || value >= CPU_SETSIZE || *start == '-' ||
+        *start == '+')
+    {
+        return false;
+    }
+    cpu = static_cast<int>(value);
+    pos += static_cast<size_t>(end - start);
+    return true;
+}
+
+} // namespace
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+    {
+        spdlog::error("sched_getaffinity() failed: {}", strerror(errno));
+        return false;
+    }
+
+    size_t pos = 0;
+    while (true)
+    {
+        int first = 0;
+        int last = 0;
+        if (!parseCpu(text, pos, first))
+        {
+            spdlog::error("Error: --affinity takes a CPU list like 0-3,8");
+            return false;
+        }
+        last = first;
+        if (pos < text.size() && text[pos] == '-')
+        {
+            pos++;
+            if (!parseCpu(text, pos, last) || last < first)
+            {
+                spdlog::error("Error: --affinity takes a CPU list like 0-3,8");
+                return false;
+            }
+        }
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+            {
+                spdlog::error("Error: --affinity CPU {} is offline or outside this process's "
+                              "CPU set", cpu);
+                return false;
+            }
+            cpus.push_back(cpu);
+        }
+        if (pos == text.size())
+        {
+            return true;
+        }
+        if (text[pos] != ',')
+        {
+            spdlog::error("Error: --affinity takes a CPU list like 0-3,8");
+            return false;
+        }
+        pos++;
+    }
+}
+
+int cpuForStream(const std::vector<int>& cpus, int stream)
+{
+    return cpus.empty() ? -1 : cpus[static_cast<size_t>(stream) % cpus.size()];
+}
+
+bool pinThisThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // Returns the error instead of setting errno
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        spdlog::error("Pinning a thread to CPU {} failed: {}", cpu, strerror(err));
+        return false;
+    }
+    return true;
+}
+
+int cpuNumaNode(int cpu)
+{
+    // The cpu directory holds a nodeN link for the node it belongs to
+    for (int node = 0; node < CPU_SETSIZE; node++)
+    {
+        std::string path = fmt::format("/sys/devices/system/cpu/cpu{}/node{}", cpu, node);
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0)
+        {
+            return node;
+        }
+        if (node > 0 && stat(fmt::format("/sys/devices/system/node/node{}", node).c_str(),
+                             &st) != 0)
+        {
+            break; // past the last node
+        }
+    }
+    return -1;
+}
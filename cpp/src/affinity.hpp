@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// --affinity: stream i's thread is pinned to cpus[i % cpus.size()] before it
+// runs the RTT and data phases. The data phase allocates (and zero-fills) its
+// buffers on that thread, so under the default first-touch memory policy they
+// land on the pinned CPU's NUMA node without any libnuma calls. Threads a
+// stream starts itself (the --bidir receiver) inherit its CPU.
+static const double CPU_BOUND_UTILIZATION = 0.9; // of one CPU: the summary calls it CPU-bound
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}; false (logged) on a malformed list
+// or a CPU this process may not run on
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+
+// -1 when no --affinity list was given
+int cpuForStream(const std::vector<int>& cpus, int stream);
+
+// Pin the calling thread; false (logged) if the kernel refuses
+bool pinThisThread(int cpu);
+
+// From sysfs; -1 when the machine doesn't expose NUMA nodes
+int cpuNumaNode(int cpu);
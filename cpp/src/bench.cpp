@@ -0,0 +1,381 @@
+// iperfer_bench: runs the sender and receiver data paths against each other
+// inside one process, over a socketpair and over loopback TCP, and prints one
+// CSV row per case on stdout (logs go to stderr). Both ends are the same
+// sendDataPhase()/receiveDataPhase() the client and server run, so a change
+// to an engine or a send/receive path shows up here without a network.
+//
+// Suites:
+//   stream  window 0 (no acks): raw throughput of every engine (copy path)
+//           and, on the blocking engine, every --zerocopy and --recv-mode path
+//   phase   the acked data phase (--window chunks in flight) per engine
+//
+// The columns, in this order, are part of the format; add new ones at the end:
+//   suite,transport,engine,send,recv,chunk,window,bytes,seconds,goodput_mbps,
+//   send_syscalls,recv_syscalls,send_cpu_s_per_gb,status
+// status is ok, skipped (needs something this kernel or transport lacks) or
+// failed; the exit status is 1 if any case failed.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <cxxopts.hpp>
+
+#include "buffer_pool.hpp"
+#include "clock.hpp"
+#include "common.hpp"
+#include "data_phase.hpp"
+#include "interval.hpp"
+#include "io_engine.hpp"
+#include "recv_path.hpp"
+#include "sweep.hpp"
+#include "zerocopy.hpp"
+
+namespace
+{
+
+const char* DEFAULT_CHUNKS = "4K,80000,1M";
+const double DEFAULT_CASE_SECONDS = 0.25;
+const int DEFAULT_BENCH_WINDOW = 8;
+
+enum class Transport
+{
+    Socketpair, // AF_UNIX stream pair
+    Loopback,   // TCP over 127.0.0.1
+};
+
+const char* transportName(Transport transport)
+{
+    return transport == Transport::Socketpair ? "socketpair" : "loopback";
+}
+
+struct BenchCase
+{
+    const char* suite = "";
+    Transport transport = Transport::Loopback;
+    EngineKind engine = EngineKind::Blocking;
+    ZeroCopyMode send = ZeroCopyMode::Copy;
+    RecvMode recv = RecvMode::Copy;
+    size_t chunk = CHUNK_SIZE;
+    int window = 0;
+
+    std::string name() const
+    {
+        return fmt::format("{}/{}/{}/{}/{}/{}", suite, transportName(transport),
+                           engineKindName(engine), zeroCopyModeName(send), recvModeName(recv),
+                           chunk);
+    }
+};
+
+struct BenchResult
+{
+    StreamResult sent;
+    StreamResult received;
+    const char* status = "ok";
+};
+
+// Every combination iPerfer accepts: the non-copy paths bypass the engine,
+// so they only run on the blocking one (as the command line requires)
+std::vector<BenchCase> buildCases(const std::vector<size_t>& chunks, int window)
+{
+    const EngineKind engines[] = {EngineKind::Blocking, EngineKind::Epoll, EngineKind::Uring};
+    std::vector<BenchCase> cases;
+    for (Transport transport : {Transport::Socketpair, Transport::Loopback})
+    {
+        for (size_t chunk : chunks)
+        {
+            BenchCase c;
+            c.suite = "stream";
+            c.transport = transport;
+            c.chunk = chunk;
+            for (EngineKind engine : engines)
+            {
+                c.engine = engine;
+                cases.push_back(c);
+            }
+            c.engine = EngineKind::Blocking;
+            for (ZeroCopyMode send : {ZeroCopyMode::MsgZerocopy, ZeroCopyMode::Sendfile,
+                                      ZeroCopyMode::Splice})
+            {
+                c.send = send;
+                cases.push_back(c);
+            }
+            c.send = ZeroCopyMode::Copy;
+            for (RecvMode recv : {RecvMode::Trunc, RecvMode::Splice})
+            {
+                c.recv = recv;
+                cases.push_back(c);
+            }
+        }
+    }
+    for (size_t chunk : chunks)
+    {
+        for (EngineKind engine : engines)
+        {
+            BenchCase c;
+            c.suite = "phase";
+            c.engine = engine;
+            c.chunk = chunk;
+            c.window = window;
+            cases.push_back(c);
+        }
+    }
+    return cases;
+}
+
+// MSG_ZEROCOPY and MSG_TRUNC discards are TCP only, and the splice receive
+// path leans on TCP's non-blocking splice semantics; the server only ever
+// sees TCP anyway
+bool supported(const BenchCase& c)
+{
+    return c.transport == Transport::Loopback ||
+           (c.send != ZeroCopyMode::MsgZerocopy && c.recv == RecvMode::Copy);
+}
+
+// A connected pair: fds[0] sends, fds[1] receives
+bool openPair(Transport transport, int fds[2])
+{
+    if (transport == Transport::Socketpair)
+    {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        {
+            spdlog::error("socketpair() failed: {}", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    int listenSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSock < 0)
+    {
+        spdlog::error("Error creating listen socket: {}", strerror(errno));
+        return false;
+    }
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0; // any free port
+    socklen_t len = sizeof(addr);
+    bool ok = bind(listenSock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+              listen(listenSock, 1) == 0 &&
+              getsockname(listenSock, reinterpret_cast<sockaddr*>(&addr), &len) == 0;
+    fds[0] = ok ? socket(AF_INET, SOCK_STREAM, 0) : -1;
+    ok = ok && fds[0] >= 0 &&
+         connect(fds[0], reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    fds[1] = ok ? accept(listenSock, nullptr, nullptr) : -1;
+    if (fds[1] < 0)
+    {
+        spdlog::error("Loopback connection failed: {}", strerror(errno));
+        if (fds[0] >= 0)
+        {
+            close(fds[0]);
+        }
+        close(listenSock);
+        return false;
+    }
+    close(listenSock);
+    return true;
+}
+
+// Sender and receiver each on a thread with an engine of their own, as in
+// iPerfer; the sender half-closes after its phase so the receiver sees the end
+BenchResult runCase(const BenchCase& c, double seconds)
+{
+    BenchResult result;
+    if (!supported(c))
+    {
+        result.status = "skipped";
+        return result;
+    }
+    auto probe = makeIoEngine(c.engine);
+    if (!probe)
+    {
+        result.status = "skipped";
+        return result;
+    }
+    probe.reset();
+
+    int fds[2];
+    if (!openPair(c.transport, fds))
+    {
+        result.status = "failed";
+        return result;
+    }
+
+    SendSpec sendSpec;
+    sendSpec.durationSeconds = seconds;
+    sendSpec.window          = c.window;
+    sendSpec.chunkSize       = c.chunk;
+    sendSpec.zerocopy        = c.send;
+    RecvSpec recvSpec;
+    recvSpec.mode      = c.recv;
+    recvSpec.readSize  = std::max(c.chunk, DEFAULT_READ_SIZE);
+    recvSpec.chunkSize = c.chunk;
+    recvSpec.acks      = c.window != 0;
+    // Pre-faulted buffers from one arena, as iPerfer runs its streams
+    BufferArena arena(sendArenaBytes(sendSpec) + recvArenaBytes(recvSpec));
+    sendSpec.arena = &arena;
+    recvSpec.arena = &arena;
+
+    std::thread receiver([&]() {
+        auto engine = makeIoEngine(c.engine);
+        if (engine && engine->attach(fds[1]))
+        {
+            IntervalMeter meter(nullptr, 0);
+            receiveDataPhase(*engine, fds[1], recvSpec, meter, result.received);
+        }
+        // Unblocks a sender still waiting on acks
+        shutdown(fds[1], SHUT_RDWR);
+    });
+    std::thread sender([&]() {
+        auto engine = makeIoEngine(c.engine);
+        if (engine && engine->attach(fds[0]))
+        {
+            IntervalMeter meter(nullptr, 0);
+            sendDataPhase(*engine, fds[0], sendSpec, IdleRtt{}, meter, result.sent);
+        }
+        shutdown(fds[0], SHUT_WR);
+    });
+    sender.join();
+    receiver.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    if (!result.sent.ok || !result.received.ok || result.received.bytes == 0)
+    {
+        result.status = "failed";
+    }
+    return result;
+}
+
+void printRow(const BenchCase& c, const BenchResult& r)
+{
+    double gigabytes = static_cast<double>(r.sent.bytes) / 1e9;
+    fmt::print("{},{},{},{},{},{},{},{},{:.6f},{:.3f},{},{},{:.4f},{}\n", c.suite,
+               transportName(c.transport), engineKindName(c.engine), zeroCopyModeName(c.send),
+               recvModeName(c.recv), c.chunk, c.window, r.received.bytes, r.received.seconds,
+               r.received.rateMbps, r.sent.syscalls, r.received.syscalls,
+               gigabytes > 0.0 ? r.sent.cpuSeconds / gigabytes : 0.0, r.status);
+    std::fflush(stdout);
+}
+
+bool parseChunkList(const std::string& text, std::vector<size_t>& chunks)
+{
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t comma = text.find(',', start);
+        std::string item = text.substr(start, comma == std::string::npos ? comma : comma - start);
+        size_t bytes = 0;
+        if (!parseByteSize(item, bytes) || bytes < 1 || bytes > MAX_CHUNK_SIZE)
+        {
+            return false;
+        }
+        chunks.push_back(bytes);
+        if (comma == std::string::npos)
+        {
+            break;
+        }
+        start = comma + 1;
+    }
+    return !chunks.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Keep stdout for the rows alone
+    spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+    signal(SIGPIPE, SIG_IGN);
+
+    try
+    {
+        cxxopts::Options options("iperfer_bench", "In-process benchmarks of the iPerfer I/O paths");
+        options.add_options()
+            ("t,time", "Seconds per case",
+                cxxopts::value<double>()->default_value(std::to_string(DEFAULT_CASE_SECONDS)))
+            ("chunks", "Comma-separated chunk sizes, e.g. 4K,80000,1M",
+                cxxopts::value<std::string>()->default_value(DEFAULT_CHUNKS))
+            ("w,window", "Chunks in flight for the phase suite",
+                cxxopts::value<int>()->default_value(std::to_string(DEFAULT_BENCH_WINDOW)))
+            ("filter", "Only run cases whose name (suite/transport/engine/send/recv/chunk) "
+                "contains this", cxxopts::value<std::string>()->default_value(""))
+            ("list", "Print the case names and exit")
+            ("help", "Print usage");
+        auto parsed = options.parse(argc, argv);
+        if (parsed.count("help"))
+        {
+            fmt::print("{}\n", options.help());
+            return 0;
+        }
+
+        double seconds = parsed["time"].as<double>();
+        int window = parsed["window"].as<int>();
+        std::vector<size_t> chunks;
+        if (seconds <= 0.0)
+        {
+            spdlog::error("Error: -t must be > 0");
+            return 1;
+        }
+        if (window < 1)
+        {
+            spdlog::error("Error: --window must be at least 1");
+            return 1;
+        }
+        if (!parseChunkList(parsed["chunks"].as<std::string>(), chunks))
+        {
+            spdlog::error("Error: --chunks must list sizes between 1 byte and {} bytes",
+                          MAX_CHUNK_SIZE);
+            return 1;
+        }
+
+        std::vector<BenchCase> cases;
+        const std::string filter = parsed["filter"].as<std::string>();
+        for (const BenchCase& c : buildCases(chunks, window))
+        {
+            if (c.name().find(filter) != std::string::npos)
+            {
+                cases.push_back(c);
+            }
+        }
+        if (parsed.count("list"))
+        {
+            for (const BenchCase& c : cases)
+            {
+                fmt::print("{}\n", c.name());
+            }
+            return 0;
+        }
+
+        if (!initStampClock(ClockSource::Steady))
+        {
+            return 1;
+        }
+        fmt::print("suite,transport,engine,send,recv,chunk,window,bytes,seconds,goodput_mbps,"
+                   "send_syscalls,recv_syscalls,send_cpu_s_per_gb,status\n");
+        bool failed = false;
+        for (const BenchCase& c : cases)
+        {
+            BenchResult r = runCase(c, seconds);
+            failed = failed || std::strcmp(r.status, "failed") == 0;
+            printRow(c, r);
+        }
+        return failed ? 1 : 0;
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error("Error: {}", e.what());
+        return 1;
+    }
+}
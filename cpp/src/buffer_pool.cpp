@@ -0,0 +1,128 @@
+#include "buffer_pool.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+size_t roundUp(size_t bytes, size_t align)
+{
+    return (bytes + align - 1) / align * align;
+}
+
+// One write per page is what faults it in
+void prefault(char* p, size_t bytes)
+{
+    for (size_t off = 0; off < bytes; off += SMALL_PAGE_SIZE)
+    {
+        reinterpret_cast<volatile char*>(p)[off] = 0;
+    }
+}
+
+} // namespace
+
+const char* arenaBackingName(ArenaBacking backing)
+{
+    switch (backing)
+    {
+        case ArenaBacking::None:    return "heap";
+        case ArenaBacking::HugeTlb: return "hugetlb";
+        case ArenaBacking::Thp:     return "thp";
+    }
+    return "?";
+}
+
+BufferArena::BufferArena(size_t capacity)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+    size_t length = roundUp(capacity, HUGE_PAGE_SIZE);
+
+    // Private hugetlb mappings reserve their pages up front, so this either
+    // fails here or never faults for lack of pages later
+    void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        backing_ = ArenaBacking::HugeTlb;
+        mapped_ = length;
+    }
+    else
+    {
+        // Over-map by one huge page so the arena can start on a 2MB boundary,
+        // which THP needs to use huge pages at all
+        size_t padded = length + HUGE_PAGE_SIZE;
+        p = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            spdlog::debug("Buffers: arena mmap of {} bytes failed: {}", padded, strerror(errno));
+            return;
+        }
+        char* start = static_cast<char*>(p);
+        char* aligned = reinterpret_cast<char*>(
+            roundUp(reinterpret_cast<uintptr_t>(start), HUGE_PAGE_SIZE));
+        if (aligned > start)
+        {
+            munmap(start, static_cast<size_t>(aligned - start));
+        }
+        size_t tail = padded - static_cast<size_t>(aligned - start) - length;
+        if (tail > 0)
+        {
+            munmap(aligned + length, tail);
+        }
+        p = aligned;
+        madvise(p, length, MADV_HUGEPAGE); // best effort: THP may be off
+        backing_ = ArenaBacking::Thp;
+        mapped_ = length;
+    }
+    base_ = static_cast<char*>(p);
+    capacity_ = capacity;
+    spdlog::debug("Buffers: {} byte arena ({})", mapped_, arenaBackingName(backing_));
+}
+
+BufferArena::~BufferArena()
+{
+    if (base_ != nullptr)
+    {
+        munmap(base_, mapped_);
+    }
+}
+
+char* BufferArena::take(size_t bytes)
+{
+    if (base_ == nullptr || bytes == 0)
+    {
+        return nullptr;
+    }
+    size_t slice = arenaSliceBytes(bytes);
+    size_t offset = used_.fetch_add(slice, std::memory_order_relaxed);
+    if (offset + slice > mapped_)
+    {
+        return nullptr; // the sizing missed a case; the caller uses the heap
+    }
+    char* p = base_ + offset;
+    prefault(p, slice);
+    return p;
+}
+
+size_t arenaSliceBytes(size_t bytes)
+{
+    return roundUp(bytes, SLICE_ALIGN);
+}
+
+DataBuffer::DataBuffer(BufferArena* arena, size_t bytes)
+    : size_(bytes)
+{
+    data_ = arena ? arena->take(bytes) : nullptr;
+    if (data_ == nullptr)
+    {
+        own_.assign(bytes, '\0'); // zero-filling faults it in
+        data_ = own_.data();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// One arena for every stream's data buffers: the payload slots a sender keeps
+// in flight and the buffer a receiver copies into. It is a single mmap,
+// backed by 2MB huge pages when the kernel has some reserved (MAP_HUGETLB),
+// else by ordinary pages marked MADV_HUGEPAGE so THP can back them. Slices
+// are handed out on huge page boundaries and pre-faulted by the thread that
+// takes them, before its data phase starts the clock: short -t runs no
+// longer pay for page faults in their first chunks, and with --affinity the
+// pages come from the pinned CPU's NUMA node (first touch). No two slices
+// share a huge page, which would put one stream's buffer on whichever node
+// touched it first, at the cost of up to 2MB per slice.
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+static const size_t SLICE_ALIGN = HUGE_PAGE_SIZE;
+static const size_t SMALL_PAGE_SIZE = 4096;
+
+enum class ArenaBacking
+{
+    None,    // the mmap failed; every buffer comes from the heap
+    HugeTlb, // MAP_HUGETLB
+    Thp,     // 4K pages + MADV_HUGEPAGE
+};
+
+const char* arenaBackingName(ArenaBacking backing);
+
+class BufferArena
+{
+public:
+    // capacity: the sum of the slices that will be taken, each rounded up to
+    // SLICE_ALIGN; 0 makes an empty arena
+    explicit BufferArena(size_t capacity);
+    ~BufferArena();
+    BufferArena(const BufferArena&) = delete;
+    BufferArena& operator=(const BufferArena&) = delete;
+
+    ArenaBacking backing() const { return backing_; }
+    size_t capacity() const { return capacity_; }
+
+    // A zeroed, pre-faulted slice of bytes, or nullptr once it doesn't fit.
+    // Safe to call from several stream threads at once.
+    char* take(size_t bytes);
+
+private:
+    char* base_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mapped_ = 0;
+    ArenaBacking backing_ = ArenaBacking::None;
+    std::atomic<size_t> used_{0};
+};
+
+// Bytes a slice of bytes occupies in an arena
+size_t arenaSliceBytes(size_t bytes);
+
+// A slice of arena when one fits there (arena may be null), else a heap
+// buffer; zeroed and pre-faulted either way
+class DataBuffer
+{
+public:
+    DataBuffer(BufferArena* arena, size_t bytes);
+
+    char* data() { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    std::vector<char> own_;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,210 @@
+#include "clock.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <spdlog/spdlog.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define IPERFER_HAVE_TSC 1
+#endif
+
+namespace
+{
+
+const int OVERHEAD_READS = 1000;
+const uint64_t TSC_CALIBRATION_NS = 10000000; // 10ms
+
+// Written by initStampClock(); the tsc scale and bases then once by the
+// calibration thread, before it sets g_calibrated
+ClockSource g_source = ClockSource::Steady;
+double g_nsPerTick = 0.0;
+uint64_t g_tscBase = 0;
+uint64_t g_steadyBase = 0;
+std::atomic<bool> g_calibrated{false};
+
+uint64_t steadyNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t coarseNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+#ifdef IPERFER_HAVE_TSC
+// CPUID 0x80000007 EDX bit 8: the TSC ticks at a constant rate in every
+// P-/C-state, so it can stand in for a clock
+bool invariantTsc()
+{
+    unsigned a = 0, b = 0, c = 0, d = 0;
+    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+}
+
+uint64_t tscNs()
+{
+    return g_steadyBase +
+           static_cast<uint64_t>(static_cast<double>(__rdtsc() - g_tscBase) * g_nsPerTick);
+}
+
+// The TSC's rate against steady_clock over TSC_CALIBRATION_NS from
+// startTicks. The TSC is read before steady_clock at the end, so tsc stamps
+// can only step forward (by the gap between the reads) when they take over.
+void calibrateTsc(uint64_t startNs, uint64_t startTicks)
+{
+    std::this_thread::sleep_for(std::chrono::nanoseconds(TSC_CALIBRATION_NS));
+    uint64_t ticks = __rdtsc();
+    uint64_t ns = steadyNs();
+    g_nsPerTick = static_cast<double>(ns - startNs) / static_cast<double>(ticks - startTicks);
+    g_tscBase = ticks;
+    g_steadyBase = ns;
+    g_calibrated.store(true, std::memory_order_release);
+}
+#endif
+
+// Mean ns per read when read back to back
+template <typename Read>
+double readCost(Read read)
+{
+    volatile uint64_t sink = 0;
+    uint64_t start = steadyNs();
+    for (int i = 0; i < OVERHEAD_READS; i++)
+    {
+        sink = read();
+    }
+    (void)sink;
+    return static_cast<double>(steadyNs() - start) / OVERHEAD_READS;
+}
+
+} // namespace
+
+bool parseClockSource(const std::string& text, ClockSource& source)
+{
+    if (text == "auto" || text == "steady")
+    {
+        source = ClockSource::Steady;
+    }
+    else if (text == "coarse")
+    {
+        source = ClockSource::Coarse;
+    }
+    else if (text == "tsc")
+    {
+        source = ClockSource::Tsc;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char* clockSourceName(ClockSource source)
+{
+    switch (source)
+    {
+        case ClockSource::Steady: return "steady";
+        case ClockSource::Coarse: return "coarse";
+        case ClockSource::Tsc:    return "tsc";
+    }
+    return "?";
+}
+
+bool initStampClock(ClockSource requested)
+{
+#ifdef IPERFER_HAVE_TSC
+    bool haveTsc = invariantTsc();
+#else
+    bool haveTsc = false;
+#endif
+    if (requested == ClockSource::Tsc && !haveTsc)
+    {
+        spdlog::error("Error: --clock tsc needs an invariant TSC, which this CPU doesn't report");
+        return false;
+    }
+    g_source = requested;
+
+    double steady = readCost(steadyNs);
+    double coarse = readCost(coarseNs);
+    std::string tsc;
+#ifdef IPERFER_HAVE_TSC
+    if (haveTsc)
+    {
+        // What a read costs doesn't depend on the scale, so it is measured
+        // before there is one
+        tsc = fmt::format(", tsc={:.1f}", readCost(tscNs));
+        if (g_source == ClockSource::Tsc)
+        {
+            std::thread(calibrateTsc, steadyNs(), static_cast<uint64_t>(__rdtsc())).detach();
+        }
+    }
+#endif
+    spdlog::info("Clock: stamps from {}{}; ns/read steady={:.1f}, coarse={:.1f}{}",
+                 clockSourceName(g_source),
+                 g_source == ClockSource::Tsc ? " (steady for the 10 ms it calibrates)" : "",
+                 steady, coarse, tsc);
+    return true;
+}
+
+ClockSource stampClockSource()
+{
+    return g_source;
+}
+
+uint64_t stampNs()
+{
+    switch (g_source)
+    {
+        case ClockSource::Coarse:
+            return coarseNs();
+        case ClockSource::Tsc:
+#ifdef IPERFER_HAVE_TSC
+            if (g_calibrated.load(std::memory_order_acquire))
+            {
+                return tscNs();
+            }
+#endif
+        case ClockSource::Steady:
+            break;
+    }
+    return steadyNs();
+}
+
+LoopTimer::LoopTimer(double durationSeconds)
+    : startNs_(stampNs()), lastCheckNs_(startNs_), duration_(durationSeconds)
+{
+}
+
+bool LoopTimer::expired()
+{
+    if (++sinceCheck_ < checkEvery_)
+    {
+        return false;
+    }
+    sinceCheck_ = 0;
+    uint64_t now = stampNs();
+    uint64_t gap = now - lastCheckNs_;
+    lastCheckNs_ = now;
+    // A gap of 0 is the coarse clock between ticks, not a fast loop
+    if (gap > 0 && gap < CHECK_INTERVAL_NS / 2 && checkEvery_ < MAX_CHECK_EVERY)
+    {
+        checkEvery_ *= 2;
+    }
+    else if (gap > CHECK_INTERVAL_NS * 2 && checkEvery_ > 1)
+    {
+        // Down to the count that would have fit this gap in one interval
+        // (usually 1): sends that start blocking slow down all at once
+        uint64_t fit = static_cast<uint64_t>(checkEvery_) * CHECK_INTERVAL_NS / gap;
+        checkEvery_ = static_cast<unsigned>(std::max<uint64_t>(fit, 1));
+    }
+    elapsed_ = static_cast<double>(now - startNs_) / 1e9;
+    return elapsed_ >= duration_;
+}
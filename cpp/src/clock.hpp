@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Timing for the data loops. The totals every rate is computed from stay on
+// steady_clock; the per-iteration work (deadline checks, -i interval stamps)
+// runs on a cheaper stamp clock picked once at startup (--clock):
+//
+//   steady  steady_clock (clock_gettime(CLOCK_MONOTONIC) via the vDSO)
+//   coarse  CLOCK_MONOTONIC_COARSE: a few ns per read, but only tick
+//           resolution (1-4ms), so interval edges move by up to a tick
+//   tsc     rdtsc scaled by a calibration against steady_clock; needs an
+//           invariant TSC (x86 only)
+//
+// auto is steady. tsc is only used when asked for: its 10ms calibration
+// runs on a thread of its own from startup, and until it is done the stamps
+// come from steady_clock, so no data phase ever waits for it. The switch
+// is continuous, since the tsc stamps are scaled from a steady_clock read.
+enum class ClockSource
+{
+    Steady,
+    Coarse,
+    Tsc,
+};
+
+static const uint64_t CHECK_INTERVAL_NS = 100000; // aim for one deadline read per 100us
+static const unsigned MAX_CHECK_EVERY = 1024;     // iterations between reads, at most
+
+bool parseClockSource(const std::string& text, ClockSource& source);
+const char* clockSourceName(ClockSource source);
+
+// Pick (and for tsc, start calibrating) the stamp clock before any data
+// loop runs, and log what one read of each available source costs. false
+// (logged) if the requested source isn't available here.
+bool initStampClock(ClockSource requested);
+
+ClockSource stampClockSource();
+
+// Nanoseconds on the stamp clock since an arbitrary epoch
+uint64_t stampNs();
+
+// Deadline for a send loop. expired() is called once per iteration but only
+// reads the clock every checkEvery_ calls, doubling that count while reads
+// come too close together and cutting it to fit as soon as one gap runs
+// long, so reads stay about CHECK_INTERVAL_NS apart however long an
+// iteration takes. The deadline is overshot by a couple of intervals, or
+// by one batch of iterations that all slowed down at once.
+class LoopTimer
+{
+public:
+    explicit LoopTimer(double durationSeconds);
+
+    bool expired();
+
+    // Seconds since the start as of the last read: stale by up to one
+    // check interval, which is plenty for -i reporting
+    double elapsed() const { return elapsed_; }
+
+    // A fresh read, for loops without a deadline
+    double now() const { return static_cast<double>(stampNs() - startNs_) / 1e9; }
+
+private:
+    uint64_t startNs_;
+    uint64_t lastCheckNs_;
+    double duration_;
+    double elapsed_ = 0.0;
+    unsigned checkEvery_ = 1;
+    unsigned sinceCheck_ = 0;
+};
@@ -0,0 +1,274 @@
+#include "common.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "address.hpp"
+#include "affinity.hpp"
+
+size_t ChunkTracker::onData(size_t r)
+{
+    partial += r;
+    size_t completed = partial / chunkSize;
+    partial %= chunkSize;
+    chunkCount += static_cast<int>(completed);
+    return completed;
+}
+
+double averageLastRtts(const std::vector<double>& rttSamples)
+{
+    double avgRTT = 0.0;
+    int n = static_cast<int>(rttSamples.size());
+    if (n > 0)
+    {
+        int startIndex = (n > 4) ? (n - 4) : 0;
+        double sum = 0.0;
+        for (int i = startIndex; i < n; i++)
+        {
+            sum += rttSamples[i];
+        }
+        int count = n - startIndex;
+        avgRTT = sum / count;
+    }
+    return avgRTT;
+}
+
+// Subtracting chunkCount idle RTTs (the assignment's correction) turns any
+// queueing the RTT phase didn't see into wildly inflated rates, and there is
+// no right amount to subtract for a pipelined sender, so nothing is
+double goodputMbps(long long bytes, double seconds)
+{
+    if (seconds <= 0.0)
+    {
+        return 0.0;
+    }
+    return (static_cast<double>(bytes) * 8.0 / seconds) / 1e6;
+}
+
+// 1.0 = perfectly even share, 1/n = one stream got everything
+double fairnessIndex(const std::vector<StreamResult>& results)
+{
+    double sum = 0.0;
+    double sumSq = 0.0;
+    for (const auto& r : results)
+    {
+        sum += r.rateMbps;
+        sumSq += r.rateMbps * r.rateMbps;
+    }
+    if (sumSq <= 0.0)
+    {
+        return 0.0;
+    }
+    return (sum * sum) / (static_cast<double>(results.size()) * sumSq);
+}
+
+SummaryTotals sumResults(const std::vector<StreamResult>& results)
+{
+    SummaryTotals totals;
+    double rttSum = 0.0;
+    for (const auto& r : results)
+    {
+        if (!r.ok)
+        {
+            continue;
+        }
+        totals.bytes += r.bytes;
+        totals.rateMbps += r.rateMbps;
+        rttSum += r.rttMillis;
+        totals.okStreams++;
+    }
+    if (totals.okStreams > 0)
+    {
+        totals.rttMillis = static_cast<int>(std::round(rttSum / totals.okStreams));
+    }
+    return totals;
+}
+
+// The totals line keeps the single-stream summary format
+void logSummary(const char* verb, const std::vector<StreamResult>& results)
+{
+    if (results.size() > 1)
+    {
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const StreamResult& r = results[i];
+            spdlog::info("[stream {}] {}={} KB, Rate={:.3f} Mbps, RTT={}ms",
+                         i, verb, r.bytes / 1000LL, r.rateMbps, r.rttMillis);
+        }
+    }
+
+    SummaryTotals totals = sumResults(results);
+    if (totals.okStreams == 0)
+    {
+        return;
+    }
+    if (results.size() > 1)
+    {
+        spdlog::info("[SUM] {}={} KB, Rate={:.3f} Mbps, RTT={}ms, Streams={}, Fairness={:.3f}",
+                     verb, totals.bytes / 1000LL, totals.rateMbps, totals.rttMillis,
+                     totals.okStreams, fairnessIndex(results));
+    }
+    else
+    {
+        spdlog::info("{}={} KB, Rate={:.3f} Mbps, RTT={}ms",
+                     verb, totals.bytes / 1000LL, totals.rateMbps, totals.rttMillis);
+    }
+}
+
+double threadCpuSeconds()
+{
+    rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) < 0)
+    {
+        return 0.0;
+    }
+    auto seconds = [](const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; };
+    return seconds(ru.ru_utime) + seconds(ru.ru_stime);
+}
+
+void logCpuSummary(const char* pathName, const std::vector<StreamResult>& results)
+{
+    long long totalBytes = 0;
+    double cpuSeconds = 0.0;
+    for (const auto& r : results)
+    {
+        if (r.ok)
+        {
+            totalBytes += r.bytes;
+            cpuSeconds += r.cpuSeconds;
+        }
+    }
+    double gigabytes = static_cast<double>(totalBytes) / 1e9;
+    double perGB = (gigabytes > 0.0) ? cpuSeconds / gigabytes : 0.0;
+    spdlog::info("Send path={}, CPU={:.3f} s total, {:.4f} s/GB", pathName, cpuSeconds, perGB);
+}
+
+void logThreadSummary(const char* verb, const std::vector<StreamResult>& results)
+{
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const StreamResult& r = results[i];
+        if (!r.ok || r.seconds <= 0.0)
+        {
+            continue;
+        }
+        double utilization = r.cpuSeconds / r.seconds;
+        std::string pinned;
+        if (r.cpu >= 0)
+        {
+            int node = cpuNumaNode(r.cpu);
+            pinned = node >= 0 ? fmt::format(" on CPU {} (node {})", r.cpu, node)
+                               : fmt::format(" on CPU {}", r.cpu);
+        }
+        spdlog::info("[stream {}] {} thread: CPU={:.3f} s of {:.3f} s ({:.1f}%){}{}", i, verb,
+                     r.cpuSeconds, r.seconds, utilization * 100.0, pinned,
+                     utilization >= CPU_BOUND_UTILIZATION ? ", CPU-bound" : "");
+    }
+}
+
+void logVerifySummary(const char* verb, const std::vector<StreamResult>& results,
+                      const char* impl)
+{
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const StreamResult& r = results[i];
+        if (!r.ok || !r.verify.enabled)
+        {
+            continue;
+        }
+        double share = r.seconds > 0.0 ? r.verify.seconds / r.seconds : 0.0;
+        double gbps = r.verify.seconds > 0.0
+            ? static_cast<double>(r.bytes) / r.verify.seconds / 1e9 : 0.0;
+        std::string crc = impl ? fmt::format(", crc32c on {}", impl) : "";
+        spdlog::log(r.verify.badChunks > 0 ? spdlog::level::err : spdlog::level::info,
+                    "[stream {}] {} verified: {} chunks, {} bad; checks took {:.3f} s "
+                    "({:.1f}% of the data phase, {:.1f} GB/s{})", i, verb, r.verify.chunks,
+                    r.verify.badChunks, r.verify.seconds, share * 100.0, gbps, crc);
+    }
+}
+
+void logSyscallSummary(const char* pathName, size_t readSize,
+                       const std::vector<StreamResult>& results)
+{
+    long long totalBytes = 0;
+    unsigned long syscalls = 0;
+    unsigned long ackSyscalls = 0;
+    for (const auto& r : results)
+    {
+        if (r.ok)
+        {
+            totalBytes += r.bytes;
+            syscalls += r.syscalls;
+            ackSyscalls += r.ackSyscalls;
+        }
+    }
+    double perSyscall = (syscalls > 0) ? static_cast<double>(totalBytes) / syscalls : 0.0;
+    spdlog::info("Recv path={}, ReadSize={} B, Syscalls={} ({:.0f} B/syscall), AckSyscalls={}",
+                 pathName, readSize, syscalls, perSyscall, ackSyscalls);
+}
+
+void logTcpInfoSummary(const std::vector<StreamResult>& results)
+{
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i].tcpInfo.valid)
+        {
+            spdlog::info("[stream {}] TCP_INFO: Mss={}{}", i, results[i].tcpInfo.mss,
+                         formatTcpInfo(results[i].tcpInfo));
+        }
+    }
+}
+
+int openListenSocket(unsigned short port, int backlog, const SocketTuning& tuning,
+                     AddressFamily family, bool reusePort)
+{
+    // 1) Create socket (dual-stack unless -4 / -6)
+    int serverSock = openServerSocket(SOCK_STREAM, family);
+    if (serverSock < 0)
+    {
+        exit(1);
+    }
+
+    // 2) Reuse address
+    int optval = 1;
+    setsockopt(serverSock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    if (reusePort && setsockopt(serverSock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+    {
+        spdlog::error("setsockopt(SO_REUSEPORT) failed: {}", strerror(errno));
+        close(serverSock);
+        exit(1);
+    }
+
+    // 2') Tuning, before listen() so every accepted connection inherits it
+    if (!applySocketTuning(serverSock, tuning) ||
+        (tuning.fastOpen && !enableFastOpen(serverSock, true)))
+    {
+        close(serverSock);
+        exit(1);
+    }
+
+    // 3) Bind
+    if (!bindWildcard(serverSock, port))
+    {
+        spdlog::error("Error binding to port {}: {}", port, strerror(errno));
+        close(serverSock);
+        exit(1);
+    }
+
+    // 4) Listen
+    if (listen(serverSock, backlog) < 0)
+    {
+        spdlog::error("Error listening on socket: {}", strerror(errno));
+        close(serverSock);
+        exit(1);
+    }
+    return serverSock;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "address.hpp"
+#include "link_rate.hpp"
+#include "payload.hpp"
+#include "profile.hpp"
+#include "sockopt.hpp"
+
+// Constants from the assignment
+static const int ONE_BYTE_SIZE = 1;
+static const size_t CHUNK_SIZE = 80000; // 80KB
+static const int BACKLOG = 5;
+static const int RTT_EXCHANGES = 8; // client does 8 round trips; server measures 7
+static const int MAX_RTT_EXCHANGES = 64; // --rtt-count
+static const int DEFAULT_WINDOW = 1; // chunks in flight; 1 = stop-and-wait
+static const size_t RECV_CHUNKS = 4; // default server read: this many chunks per recv()
+static const size_t DEFAULT_READ_SIZE = RECV_CHUNKS * CHUNK_SIZE;
+static const int DEFAULT_STREAMS = 1; // parallel connections per test (-P)
+
+// One message size of a --sweep (or the single step of -l)
+struct SweepStep
+{
+    size_t chunkSize = 0;
+    long long bytes = 0;
+    double seconds = 0.0;
+    double rateMbps = 0.0;         // goodput, like the summary rate
+    unsigned long syscalls = 0;    // payload + frame headers
+    unsigned long ackSyscalls = 0;
+};
+
+// Outcome of one connection's RTT + data phases
+struct StreamResult
+{
+    long long bytes = 0;
+    int rttMillis = 0;
+    double seconds = 0.0;  // wall-clock length of the data phase
+    double rateMbps = 0.0; // goodput: bytes over seconds
+    LinkRateEstimate linkRate; // sender with acks only
+    double cpuSeconds = 0.0; // user + sys CPU of the data phase (the thread that ran it)
+    int cpu = -1;            // --affinity: the CPU that thread was pinned to
+    unsigned long syscalls = 0;    // syscalls that moved payload in the data phase
+    unsigned long ackSyscalls = 0; // ...and those that moved acks
+    long long exchanges = -1; // latency mode (server): requests echoed; -1 = throughput test
+    std::vector<SweepStep> steps; // sized data phase (-l / --sweep) only
+    TcpInfoSnapshot tcpInfo; // --tcp-info: taken as the data phase ends
+    VerifyStats verify;      // --verify: receiver only
+    StreamProfile profile;   // --profile: in the direction the stream reports
+    bool ok = false; // RTT phase completed and the data phase ran
+};
+
+// Server-side chunk accounting over arbitrarily sized reads
+struct ChunkTracker
+{
+    size_t chunkSize = CHUNK_SIZE;
+    size_t partial = 0;     // bytes of the current chunk received so far
+    int chunkCount = 0;     // how many 80KB chunks are complete
+
+    // Feed r freshly received bytes; returns how many chunks they completed
+    size_t onData(size_t r);
+
+    // onData() for a receive loop specialized on the chunk size's class: a
+    // power-of-two chunkSize (chunkShift = its log2) takes a shift and a
+    // mask in place of the division
+    template <bool Pow2Chunks>
+    size_t onDataSized(size_t r, unsigned chunkShift)
+    {
+        if constexpr (Pow2Chunks)
+        {
+            partial += r;
+            size_t completed = partial >> chunkShift;
+            partial &= chunkSize - 1;
+            chunkCount += static_cast<int>(completed);
+            return completed;
+        }
+        else
+        {
+            return onData(r);
+        }
+    }
+};
+
+// Average of the last 4 RTT samples (earlier ones include connection warm-up)
+double averageLastRtts(const std::vector<double>& rttSamples);
+
+// Bytes over the wall-clock time they took, ack waits included; the
+// bottleneck estimate from the ack timing is reported separately (link_rate.hpp)
+double goodputMbps(long long bytes, double seconds);
+
+// Jain's fairness index over per-stream rates
+double fairnessIndex(const std::vector<StreamResult>& results);
+
+// What the summary line reports, over the streams that completed
+struct SummaryTotals
+{
+    long long bytes = 0;
+    double rateMbps = 0.0;
+    int rttMillis = 0; // mean over streams
+    int okStreams = 0;
+};
+
+SummaryTotals sumResults(const std::vector<StreamResult>& results);
+
+// Per-stream lines (only when there is more than one) and then the totals
+void logSummary(const char* verb, const std::vector<StreamResult>& results);
+
+// CPU seconds (user + sys) consumed so far by the calling thread
+double threadCpuSeconds();
+
+// "CPU=<s/GB>" line comparing send paths; pathName labels the mode used
+void logCpuSummary(const char* pathName, const std::vector<StreamResult>& results);
+
+// --affinity / --busy-poll: per-stream thread CPU as a share of the data
+// phase's wall-clock time, flagging threads that were CPU-bound
+void logThreadSummary(const char* verb, const std::vector<StreamResult>& results);
+
+// --verify: per-stream chunks checked, bad chunks and the time the checks
+// took as a share of the data phase. impl names the local CRC32C
+// (crc32cImplName()); nullptr for the peer's results.
+void logVerifySummary(const char* verb, const std::vector<StreamResult>& results,
+                      const char* impl);
+
+// Payload/ack syscall counts and bytes per payload syscall, summed over streams
+void logSyscallSummary(const char* pathName, size_t readSize,
+                       const std::vector<StreamResult>& results);
+
+// Per-stream TCP_INFO line (--tcp-info), for the streams that captured one
+void logTcpInfoSummary(const std::vector<StreamResult>& results);
+
+// socket + SO_REUSEADDR (+ SO_REUSEPORT) + tuning + bind(wildcard:port) +
+// listen, dual-stack unless family narrows it; exits on failure. reusePort
+// lets several sockets (--daemon workers) share the port.
+int openListenSocket(unsigned short port, int backlog, const SocketTuning& tuning,
+                     AddressFamily family, bool reusePort);
@@ -0,0 +1,450 @@
+#include "control.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "sweep.hpp"
+
+namespace
+{
+
+const size_t REPLY_SIZE = 3 * sizeof(uint32_t); // magic, version, status
+// magic, forward count, reverse count, words per result
+const size_t RESULTS_HEADER_WORDS = 4;
+const size_t RESULT_WORDS = 17;
+const uint32_t MAX_MESSAGE_WORDS = 64; // per TestParams / result, from any peer
+
+// The control connection is never attached to an IoEngine: it only carries
+// a few small messages around the data phase
+bool sendFull(int sockfd, const char* buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t s = send(sockfd, buf + sent, len - sent, MSG_NOSIGNAL);
+        if (s < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (s <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(s);
+    }
+    return true;
+}
+
+bool recvFull(int sockfd, char* buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t r = recv(sockfd, buf + got, len - got, 0);
+        if (r < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (r <= 0)
+        {
+            return false;
+        }
+        got += static_cast<size_t>(r);
+    }
+    return true;
+}
+
+void putWords(char* buf, const uint32_t* words, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t w = htonl(words[i]);
+        std::memcpy(buf + i * sizeof(w), &w, sizeof(w));
+    }
+}
+
+void getWords(const char* buf, uint32_t* words, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        std::memcpy(&words[i], buf + i * sizeof(uint32_t), sizeof(uint32_t));
+        words[i] = ntohl(words[i]);
+    }
+}
+
+// One stream's counters; rates travel in bit/s and times in ns, like the
+// UDP report datagram
+void resultWords(const StreamResult& r, uint64_t* words)
+{
+    const uint64_t values[RESULT_WORDS] = {
+        static_cast<uint64_t>(r.ok),
+        static_cast<uint64_t>(r.bytes),
+        static_cast<uint64_t>(std::llround(r.rateMbps * 1e6)),
+        static_cast<uint64_t>(r.rttMillis),
+        static_cast<uint64_t>(std::llround(r.cpuSeconds * 1e9)),
+        r.syscalls,
+        r.ackSyscalls,
+        static_cast<uint64_t>(r.exchanges), // -1 survives the round trip
+        static_cast<uint64_t>(std::llround(r.seconds * 1e9)),
+        static_cast<uint64_t>(r.linkRate.method),
+        static_cast<uint64_t>(std::llround(r.linkRate.rateMbps * 1e6)),
+        r.linkRate.samples,
+        static_cast<uint64_t>(r.verify.enabled),
+        r.verify.chunks,
+        r.verify.badChunks,
+        static_cast<uint64_t>(std::llround(r.verify.seconds * 1e9)),
+        static_cast<uint64_t>(r.linkRate.capped),
+    };
+    std::memcpy(words, values, sizeof(values));
+}
+
+// The first count words of a result, big-endian
+void putResult(char* buf, const StreamResult& r, size_t count)
+{
+    uint64_t words[RESULT_WORDS];
+    resultWords(r, words);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t w = htobe64(words[i]);
+        std::memcpy(buf + i * sizeof(w), &w, sizeof(w));
+    }
+}
+
+// count words of a result; the ones an older sender lacks keep their
+// defaults, the ones this build doesn't know are skipped
+void getResult(const char* buf, size_t count, StreamResult& r)
+{
+    uint64_t words[RESULT_WORDS];
+    resultWords(StreamResult{}, words);
+    for (size_t i = 0; i < std::min(count, RESULT_WORDS); i++)
+    {
+        std::memcpy(&words[i], buf + i * sizeof(uint64_t), sizeof(uint64_t));
+        words[i] = be64toh(words[i]);
+    }
+    r.ok          = words[0] != 0;
+    r.bytes       = static_cast<long long>(words[1]);
+    r.rateMbps    = static_cast<double>(words[2]) / 1e6;
+    r.rttMillis   = static_cast<int>(words[3]);
+    r.cpuSeconds  = static_cast<double>(words[4]) / 1e9;
+    r.syscalls    = static_cast<unsigned long>(words[5]);
+    r.ackSyscalls = static_cast<unsigned long>(words[6]);
+    r.exchanges   = static_cast<long long>(words[7]);
+    r.seconds     = static_cast<double>(words[8]) / 1e9;
+    r.linkRate.method = words[9] <= static_cast<uint64_t>(LinkRateMethod::ServiceTime)
+                        ? static_cast<LinkRateMethod>(words[9]) : LinkRateMethod::None;
+    r.linkRate.rateMbps = static_cast<double>(words[10]) / 1e6;
+    r.linkRate.samples  = words[11];
+    r.verify.enabled    = words[12] != 0;
+    r.verify.chunks     = words[13];
+    r.verify.badChunks  = words[14];
+    r.verify.seconds    = static_cast<double>(words[15]) / 1e9;
+    r.linkRate.capped   = words[16] != 0;
+}
+
+// The TestParams fields, in the order they were added to the protocol
+void paramFields(const TestParams& params, uint32_t* fields)
+{
+    const uint32_t values[TEST_PARAMS_FIELDS] = {
+        static_cast<uint32_t>(params.mode),
+        static_cast<uint32_t>(params.direction),
+        static_cast<uint32_t>(params.streams),
+        static_cast<uint32_t>(params.window),
+        static_cast<uint32_t>(params.chunkSize),
+        static_cast<uint32_t>(std::llround(params.durationSeconds * 1000.0)),
+        static_cast<uint32_t>(params.payload),
+        static_cast<uint32_t>(params.verify),
+        static_cast<uint32_t>(static_cast<uint64_t>(params.bitrate) >> 32),
+        static_cast<uint32_t>(static_cast<uint64_t>(params.bitrate)),
+        static_cast<uint32_t>(params.probe),
+        static_cast<uint32_t>(params.rttExchanges),
+    };
+    std::memcpy(fields, values, sizeof(values));
+}
+
+// The count fields a client sent into params: the ones it lacks keep their
+// defaults, and the ones past TEST_PARAMS_FIELDS are ignored
+ControlStatus parseTestParams(const uint32_t* received, size_t count, bool canVerify,
+                              TestParams& params)
+{
+    uint32_t words[TEST_PARAMS_FIELDS];
+    paramFields(TestParams{}, words);
+    std::memcpy(words, received, std::min(count, TEST_PARAMS_FIELDS) * sizeof(uint32_t));
+    if (words[0] > static_cast<uint32_t>(TestMode::ConnectTransactions) ||
+        words[1] > static_cast<uint32_t>(Direction::Bidir) ||
+        words[6] > static_cast<uint32_t>(PayloadPattern::Sequence))
+    {
+        return ControlStatus::BadParams;
+    }
+    params.mode            = static_cast<TestMode>(words[0]);
+    params.direction       = static_cast<Direction>(words[1]);
+    params.streams         = static_cast<int>(words[2]);
+    params.window          = static_cast<int>(words[3]);
+    params.chunkSize       = words[4];
+    params.durationSeconds = words[5] / 1000.0;
+    params.payload         = static_cast<PayloadPattern>(words[6]);
+    params.verify          = words[7] != 0;
+    params.bitrate = static_cast<double>((static_cast<uint64_t>(words[8]) << 32) | words[9]);
+    params.probe   = words[10] != 0;
+    params.rttExchanges = static_cast<int>(words[11]);
+    ControlStatus status = checkTestParams(params);
+    if (status == ControlStatus::Ok && params.verify &&
+        params.direction != Direction::Reverse && !canVerify)
+    {
+        spdlog::error("Control: the client asked for --verify, which needs --recv-mode copy");
+        return ControlStatus::BadParams;
+    }
+    return status;
+}
+
+} // namespace
+
+const char* testModeName(TestMode mode)
+{
+    switch (mode)
+    {
+        case TestMode::Throughput:          return "throughput";
+        case TestMode::Sized:               return "sized";
+        case TestMode::Latency:             return "latency";
+        case TestMode::Transactions:        return "transactions";
+        case TestMode::ConnectTransactions: return "connect-transactions";
+    }
+    return "?";
+}
+
+bool exchangeMode(TestMode mode)
+{
+    return mode == TestMode::Latency || mode == TestMode::Transactions ||
+           mode == TestMode::ConnectTransactions;
+}
+
+const char* controlStatusName(ControlStatus status)
+{
+    switch (status)
+    {
+        case ControlStatus::Ok:         return "ok";
+        case ControlStatus::BadVersion: return "unsupported protocol version";
+        case ControlStatus::BadParams:  return "invalid test parameters";
+        case ControlStatus::NotServed:  return "no control channel";
+    }
+    return "?";
+}
+
+ControlStatus checkTestParams(const TestParams& params)
+{
+    if (params.version != CONTROL_VERSION)
+    {
+        return ControlStatus::BadVersion;
+    }
+    bool timed = params.mode != TestMode::Latency;
+    if (params.streams < 1 || params.streams > MAX_CONTROL_STREAMS || params.window < 0 ||
+        params.chunkSize < 1 || params.chunkSize > MAX_CHUNK_SIZE ||
+        (timed && params.durationSeconds <= 0.0) ||
+        (params.mode != TestMode::Throughput && params.direction != Direction::Forward) ||
+        (params.verify && params.mode != TestMode::Throughput) ||
+        (params.bitrate > 0.0 && params.mode != TestMode::Throughput) ||
+        (params.probe && exchangeMode(params.mode)) ||
+        params.rttExchanges < 1 || params.rttExchanges > MAX_RTT_EXCHANGES)
+    {
+        return ControlStatus::BadParams;
+    }
+    return ControlStatus::Ok;
+}
+
+bool proposeTest(int sockfd, const TestParams& params, ControlReply& reply)
+{
+    uint32_t words[TEST_PARAMS_WORDS] = {CONTROL_MAGIC, params.version, TEST_PARAMS_FIELDS};
+    paramFields(params, words + 3);
+    char buf[TEST_PARAMS_SIZE];
+    putWords(buf, words, TEST_PARAMS_WORDS);
+    if (!sendFull(sockfd, buf, sizeof(buf)))
+    {
+        spdlog::error("Control: sending the test parameters failed: {}", strerror(errno));
+        return false;
+    }
+
+    // The magic first: a server without a control channel answers our bytes
+    // with RTT acks and would never send a whole reply
+    char replyBuf[REPLY_SIZE];
+    uint32_t replyWords[3];
+    if (!recvFull(sockfd, replyBuf, sizeof(uint32_t)))
+    {
+        spdlog::error("Control: the server closed the control connection; "
+                      "rerun with --no-control for servers without one");
+        return false;
+    }
+    getWords(replyBuf, replyWords, 1);
+    if (replyWords[0] != CONTROL_MAGIC)
+    {
+        spdlog::error("Control: the server does not speak the control protocol; "
+                      "rerun with --no-control");
+        return false;
+    }
+    if (!recvFull(sockfd, replyBuf + sizeof(uint32_t), REPLY_SIZE - sizeof(uint32_t)))
+    {
+        spdlog::error("Control: reading the server's reply failed");
+        return false;
+    }
+    getWords(replyBuf, replyWords, 3);
+    reply.version = replyWords[1];
+    reply.status  = static_cast<ControlStatus>(replyWords[2]);
+    return true;
+}
+
+bool acceptTest(int sockfd, bool canVerify, TestParams& params)
+{
+    // Magic, version and field count first: they say how long the rest is
+    char buf[MAX_MESSAGE_WORDS * sizeof(uint32_t)];
+    uint32_t words[MAX_MESSAGE_WORDS];
+    if (!recvFull(sockfd, buf, 3 * sizeof(uint32_t)))
+    {
+        spdlog::error("Control: reading the test parameters failed");
+        return false;
+    }
+    getWords(buf, words, 3);
+    if (words[0] != CONTROL_MAGIC)
+    {
+        spdlog::error("Control: bad magic {:#x} from the client", words[0]);
+        return false;
+    }
+
+    ControlReply reply;
+    params = TestParams{};
+    params.version = words[1];
+    size_t count = words[2];
+    if (params.version != CONTROL_VERSION)
+    {
+        // Another layout: its length says nothing we can trust
+        reply.status = ControlStatus::BadVersion;
+    }
+    else if (count > MAX_MESSAGE_WORDS)
+    {
+        spdlog::error("Control: {} test parameters from the client", count);
+        reply.status = ControlStatus::BadParams;
+    }
+    else
+    {
+        if (!recvFull(sockfd, buf, count * sizeof(uint32_t)))
+        {
+            spdlog::error("Control: reading the test parameters failed");
+            return false;
+        }
+        getWords(buf, words, count);
+        reply.status = parseTestParams(words, count, canVerify, params);
+    }
+
+    if (!sendControlReply(sockfd, reply))
+    {
+        spdlog::error("Control: sending the reply failed");
+        return false;
+    }
+    if (reply.status != ControlStatus::Ok)
+    {
+        spdlog::error("Control: rejected the client's test (version {}): {}",
+                      params.version, controlStatusName(reply.status));
+        return false;
+    }
+    std::string paced = params.bitrate > 0.0
+        ? fmt::format(", paced to {:.3f} Mbps per stream", params.bitrate / 1e6) : "";
+    spdlog::info("Control: {} test, {}, {} stream(s), window {}, chunk {} B, {:.3f} s, "
+                 "{} payload{}{}{}", testModeName(params.mode), directionName(params.direction),
+                 params.streams, params.window, params.chunkSize, params.durationSeconds,
+                 payloadPatternName(params.payload), params.verify ? ", verified" : "", paced,
+                 params.probe ? ", latency probe" : "");
+    return true;
+}
+
+bool acceptNextTest(int sockfd, bool canVerify, TestParams& params)
+{
+    char first = 0;
+    ssize_t r = 0;
+    do
+    {
+        r = recv(sockfd, &first, sizeof(first), MSG_PEEK);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0)
+    {
+        return false; // the client is done
+    }
+    return acceptTest(sockfd, canVerify, params);
+}
+
+bool sendControlReply(int sockfd, const ControlReply& reply)
+{
+    uint32_t words[3] = {CONTROL_MAGIC, reply.version, static_cast<uint32_t>(reply.status)};
+    char buf[REPLY_SIZE];
+    putWords(buf, words, 3);
+    return sendFull(sockfd, buf, sizeof(buf));
+}
+
+bool sendResults(int sockfd, const std::vector<StreamResult>& forward,
+                 const std::vector<StreamResult>& reverse)
+{
+    const size_t resultSize = RESULT_WORDS * sizeof(uint64_t);
+    std::vector<char> buf(RESULTS_HEADER_WORDS * sizeof(uint32_t) +
+                          (forward.size() + reverse.size()) * resultSize);
+    uint32_t header[RESULTS_HEADER_WORDS] = {CONTROL_MAGIC, static_cast<uint32_t>(forward.size()),
+                                             static_cast<uint32_t>(reverse.size()),
+                                             static_cast<uint32_t>(RESULT_WORDS)};
+    putWords(buf.data(), header, RESULTS_HEADER_WORDS);
+    char* p = buf.data() + RESULTS_HEADER_WORDS * sizeof(uint32_t);
+    for (const auto* results : {&forward, &reverse})
+    {
+        for (const StreamResult& r : *results)
+        {
+            putResult(p, r, RESULT_WORDS);
+            p += resultSize;
+        }
+    }
+    if (!sendFull(sockfd, buf.data(), buf.size()))
+    {
+        spdlog::error("Control: sending the results failed");
+        return false;
+    }
+    return true;
+}
+
+bool recvResults(int sockfd, std::vector<StreamResult>& forward,
+                 std::vector<StreamResult>& reverse)
+{
+    char headerBuf[RESULTS_HEADER_WORDS * sizeof(uint32_t)];
+    uint32_t header[RESULTS_HEADER_WORDS];
+    if (!recvFull(sockfd, headerBuf, sizeof(headerBuf)))
+    {
+        spdlog::error("Control: the peer closed before sending its results");
+        return false;
+    }
+    getWords(headerBuf, header, RESULTS_HEADER_WORDS);
+    size_t resultWords = header[3];
+    if (header[0] != CONTROL_MAGIC || header[1] > MAX_CONTROL_STREAMS ||
+        header[2] > MAX_CONTROL_STREAMS || resultWords > MAX_MESSAGE_WORDS)
+    {
+        spdlog::error("Control: malformed results from the peer");
+        return false;
+    }
+
+    const size_t resultSize = resultWords * sizeof(uint64_t);
+    std::vector<char> buf((header[1] + header[2]) * resultSize);
+    if (!recvFull(sockfd, buf.data(), buf.size()))
+    {
+        spdlog::error("Control: the peer's results were cut short");
+        return false;
+    }
+    forward.assign(header[1], StreamResult{});
+    reverse.assign(header[2], StreamResult{});
+    const char* p = buf.data();
+    for (auto* results : {&forward, &reverse})
+    {
+        for (StreamResult& r : *results)
+        {
+            getResult(p, resultWords, r);
+            p += resultSize;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "data_phase.hpp"
+
+// Control channel. Before any data stream the client opens one extra
+// connection and sends a TestParams message (big-endian words, starting
+// with CONTROL_MAGIC); the server checks it and answers with a ControlReply.
+// Only then does the client connect its -P data streams, which keep the
+// per-stream protocol (hello byte, RTT phase, data phase) unchanged, and
+// (--under-load) one latency probe connection after them. Once
+// every stream is done both ends swap their per-stream counters over the
+// control connection, so each can report the other's view as well. The
+// client may then propose another test on the same connection (--repeat),
+// with fresh data streams; closing it ends the session.
+//
+// A server tells a control connection from an assignment-style data stream
+// by its first byte (CONTROL_HELLO can't be any RTT hello), so clients
+// without a control channel (--no-control, or other implementations) are
+// served exactly as before.
+//
+// Both messages say how many words follow, and fields are only ever
+// appended: a server fills in defaults for the fields an older client
+// doesn't send and ignores the ones past those it knows; results work the
+// same way. CONTROL_VERSION only changes if that layout itself does.
+static const uint32_t CONTROL_MAGIC = 0x49504354; // "IPCT"
+static const char CONTROL_HELLO = 'I';            // first byte of the magic on the wire
+static const uint32_t CONTROL_VERSION = 1;
+static const int MAX_CONTROL_STREAMS = 128;
+
+// What the data streams will do; the stream's hello byte still says the same
+enum class TestMode : uint32_t
+{
+    Throughput = 0, // timed 80KB-chunk data phase (any Direction)
+    Sized = 1,      // -l / --sweep framed steps
+    Latency = 2,    // --latency exchanges
+    Transactions = 3,        // --rr over the -P streams
+    ConnectTransactions = 4, // --rr --crr: a connection per transaction, until the results
+};
+
+// Modes whose streams only exchange small messages, with no data buffers
+bool exchangeMode(TestMode mode);
+
+enum class ControlStatus : uint32_t
+{
+    Ok = 0,
+    BadVersion = 1, // a CONTROL_VERSION the server can't read
+    BadParams = 2,  // out-of-range stream count, chunk size, ...
+    NotServed = 3,  // the server (--daemon) runs tests without a control channel
+};
+
+struct TestParams
+{
+    uint32_t version = CONTROL_VERSION;
+    TestMode mode = TestMode::Throughput;
+    Direction direction = Direction::Forward;
+    int streams = DEFAULT_STREAMS;
+    int window = DEFAULT_WINDOW;
+    size_t chunkSize = CHUNK_SIZE; // throughput chunk size; the receiver acks these
+    double durationSeconds = 0.0;
+    PayloadPattern payload = PayloadPattern::Zeros; // what both ends' senders fill chunks with
+    bool verify = false; // --verify: receivers check every chunk against payload
+    double bitrate = 0.0; // -b: both ends' senders pace to this (bits/s); 0 = unpaced
+    bool probe = false;   // --under-load: a latency probe connects after the streams
+    int rttExchanges = RTT_EXCHANGES; // --rtt-count: round trips in each stream's RTT phase
+};
+
+struct ControlReply
+{
+    uint32_t version = CONTROL_VERSION; // the server's
+    ControlStatus status = ControlStatus::Ok;
+};
+
+// magic, version, field count, then the fields; bitrate takes two
+static const size_t TEST_PARAMS_FIELDS = 12;
+static const size_t TEST_PARAMS_WORDS = 3 + TEST_PARAMS_FIELDS;
+static const size_t TEST_PARAMS_SIZE = TEST_PARAMS_WORDS * sizeof(uint32_t);
+
+const char* testModeName(TestMode mode);
+const char* controlStatusName(ControlStatus status);
+
+// Server: whether this build can run params
+ControlStatus checkTestParams(const TestParams& params);
+
+// Client: send params and read the reply. false (logged) if the connection
+// fails or the peer answers with anything but a ControlReply, e.g. an
+// assignment-style server acking the magic as RTT bytes.
+bool proposeTest(int sockfd, const TestParams& params, ControlReply& reply);
+
+// Server, after peeking CONTROL_HELLO: read the params, check them and
+// answer. canVerify: this server receives into its own buffer (--recv-mode
+// copy), so it can honour --verify. true only when the reply was Ok.
+bool acceptTest(int sockfd, bool canVerify, TestParams& params);
+
+// Server, after a test's results swap: acceptTest() on the client's next
+// proposal. false, quietly, when the client closed the connection instead.
+bool acceptNextTest(int sockfd, bool canVerify, TestParams& params);
+
+bool sendControlReply(int sockfd, const ControlReply& reply);
+
+// End of test, both ends: forward = client -> server data, reverse = server
+// -> client, each as this end measured it. The client sends first.
+bool sendResults(int sockfd, const std::vector<StreamResult>& forward,
+                 const std::vector<StreamResult>& reverse);
+bool recvResults(int sockfd, std::vector<StreamResult>& forward,
+                 std::vector<StreamResult>& reverse);
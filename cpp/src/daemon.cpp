@@ -0,0 +1,512 @@
+#include "daemon.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "address.hpp"
+#include "affinity.hpp"
+#include "common.hpp"
+#include "control.hpp"
+#include "data_phase.hpp"
+#include "latency.hpp"
+#include "recv_path.hpp"
+#include "sweep.hpp"
+
+static const int MAX_EVENTS = 64;
+static const int READS_PER_EVENT = 16; // bound one busy client's turn so others get served
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// What the workers share: one SO_REUSEPORT listen socket each, and each
+// one's live client count, which decides when a sibling may steal
+struct WorkerPool
+{
+    explicit WorkerPool(size_t workers) : loads(workers) {}
+
+    std::vector<int> listenSocks; // [worker]
+    std::vector<std::atomic<int>> loads;
+    std::atomic<unsigned long> nextId{1};
+};
+
+// Per-client state machine: RTT exchanges first, then the data phase. A
+// declined control connection only waits for the client to close it.
+struct DaemonConn
+{
+    enum class Phase { Rtt, Data, Declined };
+
+    int fd = -1;
+    unsigned long id = 0;
+    std::string peer;
+    Phase phase = Phase::Rtt;
+
+    // RTT phase
+    int exchanges = 0;
+    std::vector<double> rttSamples;
+    Clock::time_point ackSendTime;
+    int rttMillis = 0;
+
+    // Data phase
+    Clock::time_point dataStart;
+    long long bytes = 0;
+    ChunkTracker tracker;
+    std::unique_ptr<ChunkReceiver> receiver;
+
+    size_t pendingAcks = 0; // ack bytes owed but not yet accepted by the socket
+    bool wantWrite = false; // EPOLLOUT currently armed
+};
+
+// One worker: its own epoll instance and accept queue. The kernel spreads
+// new connections over the workers' queues by hash; a worker also watches
+// its siblings' queues (edge-triggered and EPOLLEXCLUSIVE, so one arrival
+// wakes at most one thief) and takes from one while it has fewer clients
+// than that sibling. A connection stays on the worker that accepted it.
+class Reactor
+{
+public:
+    Reactor(int index, WorkerPool& pool, const ServerOptions& opts)
+        : index_(index),
+          pool_(pool),
+          opts_(opts),
+          scratch_(opts.recvMode == RecvMode::Copy ? opts.readSize : 0),
+          acks_(opts.readSize / CHUNK_SIZE + 1, 'A')
+    {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0)
+        {
+            spdlog::error("epoll_create1() failed: {}", strerror(errno));
+            exit(1);
+        }
+        for (size_t w = 0; w < pool_.listenSocks.size(); w++)
+        {
+            bool own = static_cast<int>(w) == index_;
+            epoll_event ev{};
+            ev.events = own ? EPOLLIN : EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+            ev.data.fd = pool_.listenSocks[w];
+            if (epoll_ctl(epfd_, EPOLL_CTL_ADD, pool_.listenSocks[w], &ev) < 0)
+            {
+                spdlog::error("epoll_ctl() failed: {}", strerror(errno));
+                exit(1);
+            }
+        }
+    }
+
+    [[noreturn]] void run()
+    {
+        epoll_event events[MAX_EVENTS];
+        while (true)
+        {
+            int n = epoll_wait(epfd_, events, MAX_EVENTS, -1);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                spdlog::error("epoll_wait() failed: {}", strerror(errno));
+                exit(1);
+            }
+            for (int i = 0; i < n; i++)
+            {
+                int fd = events[i].data.fd;
+                int owner = listenOwner(fd);
+                if (owner >= 0)
+                {
+                    acceptAll(owner);
+                    continue;
+                }
+                auto it = conns_.find(fd);
+                if (it == conns_.end())
+                {
+                    continue; // closed earlier in this batch
+                }
+                handle(*it->second, events[i].events);
+            }
+        }
+    }
+
+private:
+    // The worker whose listen socket fd is, or -1 for a client connection
+    int listenOwner(int fd) const
+    {
+        for (size_t w = 0; w < pool_.listenSocks.size(); w++)
+        {
+            if (pool_.listenSocks[w] == fd)
+            {
+                return static_cast<int>(w);
+            }
+        }
+        return -1;
+    }
+
+    int load(int worker) const
+    {
+        return pool_.loads[worker].load(std::memory_order_relaxed);
+    }
+
+    // Drain owner's accept queue: all of it if it is ours, else only while
+    // we are the less loaded of the two (the sibling keeps the rest)
+    void acceptAll(int owner)
+    {
+        const bool stealing = owner != index_;
+        while (!stealing || load(index_) < load(owner))
+        {
+            sockaddr_storage clientAddr;
+            socklen_t clientLen = sizeof(clientAddr);
+            int fd = accept4(pool_.listenSocks[owner], reinterpret_cast<sockaddr*>(&clientAddr),
+                             &clientLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    spdlog::error("Error accepting connection: {}", strerror(errno));
+                }
+                return;
+            }
+
+            auto conn = std::make_unique<DaemonConn>();
+            conn->fd = fd;
+            conn->id = pool_.nextId.fetch_add(1, std::memory_order_relaxed);
+            conn->peer = formatAddress(reinterpret_cast<sockaddr*>(&clientAddr));
+            conn->rttSamples.reserve(RTT_EXCHANGES - 1);
+            conn->receiver = std::make_unique<ChunkReceiver>(nullptr, fd, opts_.recvMode,
+                                                             scratch_.data(), opts_.readSize);
+            if (!conn->receiver->init())
+            {
+                close(fd);
+                continue;
+            }
+            // Every chunk is acked: without this Nagle holds an ack back until
+            // the client's delayed ACK for the previous one, ~40ms whenever the
+            // client is only draining its window (as in receivePhase())
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+            {
+                spdlog::error("epoll_ctl() failed: {}", strerror(errno));
+                close(fd);
+                continue;
+            }
+            spdlog::info("[client {} {}] Client connected (worker {}{})", conn->id, conn->peer,
+                         index_, stealing ? fmt::format(", from worker {}'s queue", owner) : "");
+            conns_.emplace(fd, std::move(conn));
+            pool_.loads[index_].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void handle(DaemonConn& c, uint32_t events)
+    {
+        if (events & EPOLLOUT)
+        {
+            if (!flushAcks(c))
+            {
+                finish(c, false);
+                return;
+            }
+        }
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            bool alive = (c.phase == DaemonConn::Phase::Rtt)  ? onRttReadable(c)
+                       : (c.phase == DaemonConn::Phase::Data) ? onDataReadable(c)
+                                                              : onDeclinedReadable(c);
+            if (!alive)
+            {
+                return; // finish() already ran
+            }
+        }
+        armWrite(c, c.pendingAcks > 0);
+    }
+
+    // One 'M' at a time: the client only sends the next after seeing our 'A',
+    // and anything after the last exchange already belongs to the data phase
+    bool onRttReadable(DaemonConn& c)
+    {
+        while (c.phase == DaemonConn::Phase::Rtt)
+        {
+            char inByte = 0;
+            ssize_t r = recv(c.fd, &inByte, ONE_BYTE_SIZE, 0);
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            if (r <= 0)
+            {
+                spdlog::error("[client {} {}] RTT measurement: recv() failed",
+                              c.id, c.peer);
+                finish(c, false);
+                return false;
+            }
+
+            // Tests here are per connection: tell a control client to go
+            // ahead without one. It closes the connection once it has the
+            // reply; until then whatever of its TestParams is still coming
+            // is dropped, so our close() doesn't turn into a reset.
+            if (c.exchanges == 0 && inByte == CONTROL_HELLO)
+            {
+                ControlReply reply;
+                reply.status = ControlStatus::NotServed;
+                if (!sendControlReply(c.fd, reply))
+                {
+                    closeQuietly(c);
+                    return false;
+                }
+                spdlog::info("[client {} {}] Control connection declined; "
+                             "its streams are served on their own", c.id, c.peer);
+                shutdown(c.fd, SHUT_WR);
+                c.phase = DaemonConn::Phase::Declined;
+                return onDeclinedReadable(c);
+            }
+
+            if (c.exchanges == 0 && (inByte == LATENCY_HELLO || inByte == SIZED_HELLO ||
+                                     inByte == REVERSE_HELLO || inByte == BIDIR_HELLO ||
+                                     inByte == RR_HELLO))
+            {
+                spdlog::error("[client {} {}] {} mode is not served by --daemon", c.id, c.peer,
+                              inByte == LATENCY_HELLO ? "latency"
+                              : inByte == SIZED_HELLO ? "-l/--sweep"
+                              : inByte == RR_HELLO    ? "--rr" : "-R/--bidir");
+                finish(c, false);
+                return false;
+            }
+
+            if (c.exchanges > 0)
+            {
+                double ms = std::chrono::duration<double, std::milli>(
+                    Clock::now() - c.ackSendTime).count();
+                c.rttSamples.push_back(ms);
+            }
+
+            c.pendingAcks += ONE_BYTE_SIZE;
+            if (!flushAcks(c))
+            {
+                spdlog::error("[client {} {}] RTT measurement: send() failed",
+                              c.id, c.peer);
+                finish(c, false);
+                return false;
+            }
+            c.ackSendTime = Clock::now();
+
+            if (++c.exchanges == RTT_EXCHANGES)
+            {
+                double avgRTT = averageLastRtts(c.rttSamples);
+                c.rttMillis = static_cast<int>(std::round(avgRTT));
+                c.phase = DaemonConn::Phase::Data;
+                c.dataStart = Clock::now();
+            }
+        }
+        return onDataReadable(c);
+    }
+
+    bool onDataReadable(DaemonConn& c)
+    {
+        for (int i = 0; i < READS_PER_EVENT; i++)
+        {
+            ssize_t r = c.receiver->receive();
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            if (r <= 0)
+            {
+                // Client closed (normal end of test) or errored
+                finish(c, r == 0);
+                return false;
+            }
+            c.bytes += r;
+            c.pendingAcks += c.tracker.onData(static_cast<size_t>(r)) * ONE_BYTE_SIZE;
+        }
+        if (!flushAcks(c))
+        {
+            spdlog::error("[client {} {}] Data transfer: ack send failed", c.id, c.peer);
+            finish(c, false);
+            return false;
+        }
+        return true;
+    }
+
+    // Discard what a declined control client sends until it closes
+    bool onDeclinedReadable(DaemonConn& c)
+    {
+        char drain[256];
+        while (true)
+        {
+            ssize_t r = recv(c.fd, drain, sizeof(drain), 0);
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            if (r <= 0)
+            {
+                closeQuietly(c);
+                return false;
+            }
+        }
+    }
+
+    // Push as many owed acks as the socket takes right now
+    bool flushAcks(DaemonConn& c)
+    {
+        while (c.pendingAcks > 0)
+        {
+            size_t len = std::min(c.pendingAcks, acks_.size());
+            ssize_t sent = send(c.fd, acks_.data(), len, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return true; // EPOLLOUT will resume
+                }
+                return false;
+            }
+            c.pendingAcks -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    void armWrite(DaemonConn& c, bool want)
+    {
+        if (want == c.wantWrite)
+        {
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        if (want)
+        {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = c.fd;
+        epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+        c.wantWrite = want;
+    }
+
+    void finish(DaemonConn& c, bool clean)
+    {
+        if (c.phase == DaemonConn::Phase::Data)
+        {
+            double dataSeconds = std::chrono::duration<double>(
+                Clock::now() - c.dataStart).count();
+            long long bytes = c.bytes - static_cast<long long>(c.tracker.partial);
+            double rateMbps = goodputMbps(bytes, dataSeconds);
+            spdlog::info("[client {} {}] Received={} KB, Rate={:.3f} Mbps, RTT={}ms{}",
+                         c.id, c.peer, bytes / 1000LL, rateMbps, c.rttMillis,
+                         clean ? "" : " (connection error)");
+            if (opts_.reportSyscalls)
+            {
+                unsigned long syscalls = c.receiver->syscalls();
+                spdlog::info("[client {} {}] Recv path={}, Syscalls={} ({:.0f} B/syscall)",
+                             c.id, c.peer, recvModeName(opts_.recvMode), syscalls,
+                             syscalls ? static_cast<double>(c.bytes) / syscalls : 0.0);
+            }
+        }
+        else
+        {
+            spdlog::info("[client {} {}] Disconnected during RTT phase", c.id, c.peer);
+        }
+
+        closeQuietly(c);
+    }
+
+    // No summary line: the connection never entered a phase
+    void closeQuietly(DaemonConn& c)
+    {
+        int fd = c.fd;
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        conns_.erase(fd); // destroys c
+        pool_.loads[index_].fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    int index_;
+    WorkerPool& pool_;
+    const ServerOptions& opts_;
+    int epfd_ = -1;
+    std::unordered_map<int, std::unique_ptr<DaemonConn>> conns_;
+    std::vector<char> scratch_; // copy-mode payload is discarded, so all clients share it
+    std::vector<char> acks_;
+};
+
+// Hundreds of concurrent clients outgrow the usual soft limit of 1024 fds
+void raiseFdLimit()
+{
+    rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// Each worker builds its reactor (and its scratch buffer) on its own,
+// pinned thread
+[[noreturn]] void runWorker(int index, WorkerPool& pool, const ServerOptions& opts)
+{
+    int cpu = cpuForStream(opts.cpus, index);
+    if (cpu >= 0)
+    {
+        pinThisThread(cpu);
+    }
+    Reactor reactor(index, pool, opts);
+    reactor.run();
+}
+
+} // namespace
+
+void runDaemon(const ServerOptions& opts)
+{
+    // A client vanishing mid-ack must not take the whole daemon down
+    signal(SIGPIPE, SIG_IGN);
+    raiseFdLimit();
+
+    // One listen socket per worker in an SO_REUSEPORT group
+    size_t workers = opts.workers > 0 ? static_cast<size_t>(opts.workers)
+                   : !opts.cpus.empty() ? opts.cpus.size()
+                   : std::max(1u, std::thread::hardware_concurrency());
+    WorkerPool pool(workers);
+    for (size_t w = 0; w < workers; w++)
+    {
+        int sock = openListenSocket(opts.port, opts.backlog, opts.tuning, opts.family, true);
+        if (fcntl(sock, F_SETFL, O_NONBLOCK) < 0)
+        {
+            spdlog::error("fcntl(O_NONBLOCK) failed: {}", strerror(errno));
+            exit(1);
+        }
+        pool.listenSocks.push_back(sock);
+    }
+    spdlog::info("iPerfer server started (daemon, backlog {}, {} worker(s))", opts.backlog,
+                 workers);
+
+    // This thread is worker 0
+    for (size_t w = 1; w < workers; w++)
+    {
+        std::thread(runWorker, static_cast<int>(w), std::ref(pool), std::cref(opts)).detach();
+    }
+    runWorker(0, pool, opts);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "options.hpp"
+
+// Persistent server (-s --daemon): a fixed pool of epoll reactors (--workers,
+// default one per CPU) that accepts any number of concurrent clients and runs
+// each one's RTT and data phases as a non-blocking state machine. Each worker
+// listens on its own SO_REUSEPORT socket and steals from a busier sibling's
+// accept queue when it has fewer clients. Every client is summarized on its
+// own log line. Payload is taken with opts.recvMode / opts.readSize. Never returns.
+[[noreturn]] void runDaemon(const ServerOptions& opts);
@@ -0,0 +1,398 @@
+#include "data_phase.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "clock.hpp"
+#include "interval.hpp"
+#include "pacing.hpp"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t DIRECTION_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+} // namespace
+
+const char* directionName(Direction direction)
+{
+    switch (direction)
+    {
+        case Direction::Forward: return "forward";
+        case Direction::Reverse: return "reverse";
+        case Direction::Bidir:   return "bidir";
+    }
+    return "?";
+}
+
+size_t sendSlots(const SendSpec& spec)
+{
+    bool ownMemory = spec.zerocopy == ZeroCopyMode::Copy || spec.zerocopy == ZeroCopyMode::MsgZerocopy;
+    return ownMemory ? static_cast<size_t>(std::max(spec.window, 1)) : 1;
+}
+
+size_t sendArenaBytes(const SendSpec& spec)
+{
+    return arenaSliceBytes(sendSlots(spec) * spec.chunkSize);
+}
+
+size_t recvArenaBytes(const RecvSpec& spec)
+{
+    return spec.mode == RecvMode::Copy ? arenaSliceBytes(spec.readSize) : 0;
+}
+
+bool sendDirectionHeader(IoEngine& io, int sockfd, double durationSeconds, int window)
+{
+    uint32_t header[2] = {
+        htonl(static_cast<uint32_t>(std::llround(durationSeconds * 1000.0))),
+        htonl(static_cast<uint32_t>(window)),
+    };
+    return io.sendAll(sockfd, reinterpret_cast<const char*>(header), DIRECTION_HEADER_SIZE);
+}
+
+bool recvDirectionHeader(IoEngine& io, int sockfd, double& durationSeconds, int& window)
+{
+    uint32_t header[2];
+    if (!io.recvAll(sockfd, reinterpret_cast<char*>(header), DIRECTION_HEADER_SIZE))
+    {
+        return false;
+    }
+    durationSeconds = ntohl(header[0]) / 1000.0;
+    window = static_cast<int>(ntohl(header[1]));
+    return durationSeconds > 0.0 && window >= 0;
+}
+
+namespace
+{
+
+// How the sender hears back from the receiver (SendSpec::window)
+enum class AckWindow
+{
+    StopAndWait, // window == 1: each chunk timed from its send() to its ack
+    Windowed,    // window > 1: acks read whenever the window is full
+    Sink,        // window == 0: none come back (--bidir)
+};
+
+// The send loop with its configuration fixed at compile time, so that
+// nothing inside it branches on the window, pacing or stamping
+template <AckWindow Acks, bool Paced, bool Stamped>
+void sendPhase(IoEngine& io, int sockfd, const SendSpec& spec, const IdleRtt& idleRtt,
+               IntervalMeter& meter, StreamResult& result)
+{
+    const int window = spec.window;
+
+    // Data transfer for <durationSeconds>, keeping up to <window> chunks
+    // unacked (window == 1 is the classic stop-and-wait)
+    const size_t chunkSize = spec.chunkSize;
+    const size_t slots = sendSlots(spec);
+    DataBuffer chunks(spec.arena, slots * chunkSize); // 80KB of zeros per slot by default
+    fillPayload(spec.payload, chunks.data(), chunkSize, slots);
+    std::vector<char> ackBuf(std::max(window, 1), '\0');
+    ChunkSender sender(io, sockfd, spec.zerocopy, chunks.data(), chunkSize, slots);
+    if (!sender.init())
+    {
+        return;
+    }
+    long long totalBytesSent = 0;
+    int chunkCount = 0; // how many chunks we send
+    int inFlight = 0;   // chunks sent but not yet acked
+    bool ackFailed = false;
+    LinkRateEstimator link(chunkSize, window, idleRtt);
+    TokenBucket bucket(spec.bitrate, chunkSize);
+
+    // The deadline and -i stamps come from the loop timer; steady_clock only
+    // for the totals and where an ack wait dwarfs the read anyway
+    double cpuStart = threadCpuSeconds();
+    auto dataStart = Clock::now();
+    LoopTimer timer(spec.durationSeconds);
+    // -b: a token wait gives up where the timer's deadline falls
+    auto paceDeadline = dataStart +
+        std::chrono::duration_cast<TokenBucket::Clock::duration>(
+            std::chrono::duration<double>(spec.durationSeconds));
+    while (!timer.expired())
+    {
+        // -b: wait for the chunk's tokens before its service time starts
+        if constexpr (Paced)
+        {
+            if (!bucket.take(chunkSize, paceDeadline))
+            {
+                break;
+            }
+        }
+        Clock::time_point sendStart;
+        if constexpr (Acks == AckWindow::StopAndWait)
+        {
+            sendStart = Clock::now();
+        }
+
+        // Send one chunk; the sender takes the slots in turn, and with a window
+        // the one stamped here was acked (so sent) window chunks ago
+        if constexpr (Stamped)
+        {
+            stampSequence(chunks.data() + (static_cast<size_t>(chunkCount) % slots) * chunkSize,
+                          static_cast<uint64_t>(chunkCount));
+        }
+        if (!sender.send())
+        {
+            spdlog::error("Data transfer: send() failed");
+            break;
+        }
+        totalBytesSent += static_cast<long long>(chunkSize);
+        chunkCount++;
+        inFlight++;
+        meter.add(static_cast<long long>(chunkSize), timer.elapsed());
+
+        // Window full: wait for at least one 1-byte ack, taking all that are queued
+        if constexpr (Acks != AckWindow::Sink)
+        {
+            if (inFlight < window)
+            {
+                continue;
+            }
+            result.ackSyscalls++;
+            auto waitStart = meter.enabled() ? Clock::now() : sendStart;
+            ssize_t r = io.recvSome(sockfd, ackBuf.data(), inFlight);
+            auto ackTime = Clock::now();
+            if (meter.enabled())
+            {
+                meter.addAckWait(std::chrono::duration<double>(ackTime - waitStart).count());
+            }
+            if (r <= 0)
+            {
+                spdlog::error("Data transfer: ack receive failed (peer closed?)");
+                ackFailed = true;
+                break;
+            }
+            inFlight -= static_cast<int>(r);
+
+            // Stop-and-wait times each chunk from its send(); a full window
+            // times the gaps between ack reads
+            if constexpr (Acks == AckWindow::StopAndWait)
+            {
+                link.onServiceTime(std::chrono::duration<double>(ackTime - sendStart).count());
+            }
+            else
+            {
+                link.onAcks(std::chrono::duration<double>(ackTime - dataStart).count(),
+                            static_cast<int>(r));
+            }
+        }
+    }
+
+    // Drain the acks still outstanding so every counted chunk was delivered
+    while (Acks != AckWindow::Sink && !ackFailed && inFlight > 0)
+    {
+        result.ackSyscalls++;
+        ssize_t r = io.recvSome(sockfd, ackBuf.data(), inFlight);
+        if (r <= 0)
+        {
+            spdlog::error("Data transfer: ack receive failed (peer closed?)");
+            break;
+        }
+        inFlight -= static_cast<int>(r);
+    }
+    auto dataEnd = Clock::now();
+    sender.finish();
+    result.cpuSeconds = threadCpuSeconds() - cpuStart;
+    result.syscalls   = sender.syscalls();
+    if (sender.copiedSends() > 0)
+    {
+        spdlog::info("MSG_ZEROCOPY: kernel copied {} of {} completed sends "
+                     "(expected on loopback)", sender.copiedSends(), sender.completedSends());
+    }
+
+    // Goodput over the whole data phase, the final drain included; the link
+    // estimate comes from the ack timing instead
+    double dataSeconds = std::chrono::duration<double>(dataEnd - dataStart).count();
+    meter.finish(dataSeconds);
+
+    result.bytes    = totalBytesSent;
+    result.seconds  = dataSeconds;
+    result.rateMbps = goodputMbps(totalBytesSent, dataSeconds);
+    result.linkRate = link.finish(result.rateMbps);
+    result.ok       = true;
+}
+
+using SendKernel = void (*)(IoEngine&, int, const SendSpec&, const IdleRtt&, IntervalMeter&,
+                            StreamResult&);
+
+template <AckWindow Acks>
+SendKernel sendKernel(bool paced, bool stamped)
+{
+    if (paced)
+    {
+        return stamped ? &sendPhase<Acks, true, true> : &sendPhase<Acks, true, false>;
+    }
+    return stamped ? &sendPhase<Acks, false, true> : &sendPhase<Acks, false, false>;
+}
+
+// The receive loop with acking, verifying and the chunk size class fixed
+// at compile time
+template <bool Acks, bool Verify, bool Pow2Chunks>
+void receivePhase(IoEngine& io, int sockfd, const RecvSpec& spec, IntervalMeter& meter,
+                  StreamResult& result)
+{
+    // Buffers first: faulting them in isn't part of the timed phase
+    DataBuffer dataBuf(spec.arena, spec.mode == RecvMode::Copy ? spec.readSize : 0);
+    std::vector<char> acks(spec.readSize / spec.chunkSize + 1, 'A'); // one 'A' per completed chunk
+    ChunkTracker tracker;
+    tracker.chunkSize = spec.chunkSize;
+    const unsigned chunkShift = static_cast<unsigned>(std::countr_zero(spec.chunkSize));
+    std::optional<PayloadVerifier> verifier;
+    if constexpr (Verify)
+    {
+        verifier.emplace(spec.payload, spec.chunkSize);
+    }
+    ChunkReceiver receiver(&io, sockfd, spec.mode, dataBuf.data(), spec.readSize);
+    if (!receiver.init())
+    {
+        return;
+    }
+    if constexpr (Acks)
+    {
+        // Nagle would hold an ack back until the sender's delayed ACK for the
+        // previous one: a ~40ms stall whenever the sender is only draining
+        int on = 1;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    double cpuStart = threadCpuSeconds();
+    auto dataStart = Clock::now();
+    LoopTimer stamps(0.0); // no deadline: the sender ends the phase
+    long long totalBytesReceived = 0;
+
+    while (true)
+    {
+        // Take whatever has arrived; the tracker finds the chunk boundaries.
+        // Verifying needs the bytes in dataBuf, not in an engine's own buffers.
+        ssize_t r = Verify ? receiver.receive(spec.readSize) : receiver.receive();
+        if (r <= 0)
+        {
+            // closed or error
+            if (r < 0)
+            {
+                spdlog::error("Data transfer: {} receive failed: {}",
+                              recvModeName(spec.mode), strerror(errno));
+            }
+            break;
+        }
+        totalBytesReceived += r;
+        if (meter.enabled())
+        {
+            meter.add(r, stamps.now());
+        }
+        if constexpr (Verify)
+        {
+            // steady_clock, not the stamp clock: a coarse tick is longer than a check
+            auto verifyStart = Clock::now();
+            verifier->onData(dataBuf.data(), static_cast<size_t>(r));
+            verifier->stats().seconds +=
+                std::chrono::duration<double>(Clock::now() - verifyStart).count();
+        }
+
+        size_t completed = tracker.onDataSized<Pow2Chunks>(static_cast<size_t>(r), chunkShift);
+        if constexpr (Acks)
+        {
+            if (completed == 0)
+            {
+                continue;
+            }
+
+            // Cumulative ack: one byte per completed chunk, sent in a single write
+            result.ackSyscalls++;
+            if (!io.sendAll(sockfd, acks.data(), completed * ONE_BYTE_SIZE))
+            {
+                spdlog::error("Data transfer: ack send failed");
+                break;
+            }
+        }
+    }
+    totalBytesReceived -= static_cast<long long>(tracker.partial); // ignore a torn last chunk
+
+    auto dataEnd = Clock::now();
+    double dataSeconds = std::chrono::duration<double>(dataEnd - dataStart).count();
+    meter.finish(dataSeconds);
+
+    result.bytes      = totalBytesReceived;
+    result.seconds    = dataSeconds;
+    result.rateMbps   = goodputMbps(totalBytesReceived, dataSeconds);
+    result.cpuSeconds = threadCpuSeconds() - cpuStart;
+    result.syscalls   = receiver.syscalls();
+    if constexpr (Verify)
+    {
+        result.verify = verifier->stats();
+    }
+    result.ok         = true;
+}
+
+using RecvKernel = void (*)(IoEngine&, int, const RecvSpec&, IntervalMeter&, StreamResult&);
+
+template <bool Acks>
+RecvKernel recvKernel(bool verify, bool pow2Chunks)
+{
+    if (verify)
+    {
+        return pow2Chunks ? &receivePhase<Acks, true, true> : &receivePhase<Acks, true, false>;
+    }
+    return pow2Chunks ? &receivePhase<Acks, false, true> : &receivePhase<Acks, false, false>;
+}
+
+} // namespace
+
+void sendDataPhase(IoEngine& io, int sockfd, const SendSpec& spec, const IdleRtt& idleRtt,
+                   IntervalMeter& meter, StreamResult& result)
+{
+    // Picked once; the loop itself is specialized for the choice
+    const bool paced = spec.bitrate > 0.0;
+    const bool stamped = spec.payload == PayloadPattern::Sequence;
+    SendKernel kernel = spec.window == 0 ? sendKernel<AckWindow::Sink>(paced, stamped)
+                      : spec.window == 1 ? sendKernel<AckWindow::StopAndWait>(paced, stamped)
+                                         : sendKernel<AckWindow::Windowed>(paced, stamped);
+    kernel(io, sockfd, spec, idleRtt, meter, result);
+}
+
+void receiveDataPhase(IoEngine& io, int sockfd, const RecvSpec& spec, IntervalMeter& meter,
+                      StreamResult& result)
+{
+    const bool pow2Chunks = std::has_single_bit(spec.chunkSize);
+    RecvKernel kernel = spec.acks ? recvKernel<true>(spec.verify, pow2Chunks)
+                                  : recvKernel<false>(spec.verify, pow2Chunks);
+    kernel(io, sockfd, spec, meter, result);
+}
+
+void runBidirectional(IoEngine& io, int sockfd, const SendSpec& sendSpec,
+                      const RecvSpec& recvSpec, const IdleRtt& idleRtt, IntervalMeter& sendMeter,
+                      IntervalMeter& recvMeter, StreamResult& sent, StreamResult& received)
+{
+    // Engines are per thread, so the receiver gets its own on the same socket
+    auto recvEngine = makeIoEngine(io.kind());
+    if (!recvEngine || !recvEngine->attach(sockfd))
+    {
+        return;
+    }
+    std::thread receiver([&]() {
+        receiveDataPhase(*recvEngine, sockfd, recvSpec, recvMeter, received);
+    });
+
+    sendDataPhase(io, sockfd, sendSpec, idleRtt, sendMeter, sent);
+    // The peer's receiver runs until EOF; ours until the peer does the same
+    if (shutdown(sockfd, SHUT_WR) < 0)
+    {
+        spdlog::error("shutdown(SHUT_WR) failed: {}", strerror(errno));
+    }
+    receiver.join();
+}
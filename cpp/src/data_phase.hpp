@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+
+#include "buffer_pool.hpp"
+#include "common.hpp"
+#include "io_engine.hpp"
+#include "payload.hpp"
+#include "recv_path.hpp"
+#include "zerocopy.hpp"
+
+class IntervalMeter;
+
+// Which way the timed data phase runs. Forward is the assignment's
+// client-sends test; for the others the client opens with REVERSE_HELLO or
+// BIDIR_HELLO in place of its first RTT 'M' and, after the RTT phase, sends
+// an 8-byte {duration ms, window} header (network order) so the server can
+// time its own sending. That way a client behind NAT still measures its
+// download over the connection it opened.
+enum class Direction
+{
+    Forward, // client sends, server receives and acks
+    Reverse, // -R: server sends, client receives and acks
+    Bidir,   // --bidir: both send at once on the one socket, without acks
+};
+
+static const char REVERSE_HELLO = 'R';
+static const char BIDIR_HELLO = 'B';
+
+const char* directionName(Direction direction);
+
+// Sender side. window == 0 means no acks come back (--bidir, where the
+// return direction carries the peer's payload instead), so the sender only
+// stops at the deadline.
+struct SendSpec
+{
+    double durationSeconds = 0.0;
+    int window = DEFAULT_WINDOW;
+    size_t chunkSize = CHUNK_SIZE; // the unit the receiver acks
+    ZeroCopyMode zerocopy = ZeroCopyMode::Copy;
+    PayloadPattern payload = PayloadPattern::Zeros; // seq needs zerocopy == Copy
+    BufferArena* arena = nullptr; // payload slots come from here while it has room
+    double bitrate = 0.0; // -b: token-bucket pace in bits/s (pacing.hpp); 0 = unpaced
+};
+
+// Receiver side; acks must agree with the sender's window != 0
+struct RecvSpec
+{
+    RecvMode mode = RecvMode::Copy;
+    size_t readSize = DEFAULT_READ_SIZE;
+    size_t chunkSize = CHUNK_SIZE; // must match the sender's
+    bool acks = true;
+    bool verify = false; // --verify: check each chunk against payload (mode must be Copy)
+    PayloadPattern payload = PayloadPattern::Zeros; // what the sender fills chunks with
+    BufferArena* arena = nullptr; // the copy-mode buffer comes from here while it has room
+};
+
+// Payload slots a sender keeps: one per chunk in flight for the paths that
+// hand the kernel our memory (copy, MSG_ZEROCOPY); sendfile and splice send
+// from their own memfd
+size_t sendSlots(const SendSpec& spec);
+
+// Arena bytes one stream's phase takes for spec, to size a BufferArena
+size_t sendArenaBytes(const SendSpec& spec);
+size_t recvArenaBytes(const RecvSpec& spec);
+
+bool sendDirectionHeader(IoEngine& io, int sockfd, double durationSeconds, int window);
+bool recvDirectionHeader(IoEngine& io, int sockfd, double& durationSeconds, int& window);
+
+// spec.chunkSize chunks for spec.durationSeconds, keeping up to spec.window of
+// them unacked (and paced to spec.bitrate if set), then drain the acks. Fills result's bytes, goodput, link rate
+// estimate (idleRtt is its baseline), CPU time and syscall counts.
+// Leaves the socket open.
+void sendDataPhase(IoEngine& io, int sockfd, const SendSpec& spec, const IdleRtt& idleRtt,
+                   IntervalMeter& meter, StreamResult& result);
+
+// Receive (acking whole chunks when spec.acks) until the peer closes or
+// shuts down its side. Fills result's bytes, goodput, CPU time and syscall
+// count, and with spec.verify its verify stats. Leaves the socket open.
+void receiveDataPhase(IoEngine& io, int sockfd, const RecvSpec& spec, IntervalMeter& meter,
+                      StreamResult& result);
+
+// --bidir: receives on a second thread with its own engine of io's kind while
+// this one sends, then half-closes so the peer's receiver sees the end
+void runBidirectional(IoEngine& io, int sockfd, const SendSpec& sendSpec,
+                      const RecvSpec& recvSpec, const IdleRtt& idleRtt, IntervalMeter& sendMeter,
+                      IntervalMeter& recvMeter, StreamResult& sent, StreamResult& received);
@@ -1,402 +1,1629 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <chrono>
+#include <charconv>
 #include <cmath>
 #include <cstring>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
-#include <netdb.h>
 #include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <cxxopts.hpp>
 
-// Constants from the assignment
-static const int ONE_BYTE_SIZE = 1;
-static const size_t CHUNK_SIZE = 80000; // 80KB
-static const int BACKLOG = 5;
-static const int RTT_EXCHANGES = 8; // client does 8 round trips; server measures 7
+#include "address.hpp"
+#include "affinity.hpp"
+#include "buffer_pool.hpp"
+#include "clock.hpp"
+#include "common.hpp"
+#include "control.hpp"
+#include "daemon.hpp"
+#include "data_phase.hpp"
+#include "interval.hpp"
+#include "io_engine.hpp"
+#include "latency.hpp"
+#include "options.hpp"
+#include "probe.hpp"
+#include "profile.hpp"
+#include "recv_path.hpp"
+#include "report.hpp"
+#include "startup.hpp"
+#include "sweep.hpp"
+#include "udp.hpp"
+#include "zerocopy.hpp"
 
-bool sendAll(int sockfd, const char* buffer, size_t len)
+// ===============================================================
+// SERVER MODE
+// ===============================================================
+
+// --affinity: pin the calling stream thread before it allocates its buffers.
+// Returns the CPU, or -1 when unpinned (none asked for, or refused: logged)
+int pinStream(const std::vector<int>& cpus, int stream)
 {
-    size_t totalSent = 0;
-    while (totalSent < len)
+    int cpu = cpuForStream(cpus, stream);
+    return (cpu >= 0 && pinThisThread(cpu)) ? cpu : -1;
+}
+
+// RTT measurement + data phase for one accepted connection. Closes clientSock.
+// received/sent: the client -> server and server -> client directions; which
+// of them run is the client's choice (-R / --bidir), signalled by its first byte.
+// params: negotiated over the control connection, else the defaults (80KB
+// chunks of zeros, no verification) that an assignment-style client expects.
+// arena: the run's data buffers (see serverArenaBytes())
+void serveStream(int clientSock, const ServerOptions& opts, const TestParams& params,
+                 BufferArena* arena,
+                 IntervalMeter& recvMeter, IntervalMeter& sendMeter, StreamResult& received,
+                 StreamResult& sent)
+{
+    auto engine = makeIoEngine(opts.engine);
+    if (!engine || !engine->attach(clientSock))
+    {
+        close(clientSock);
+        return;
+    }
+    IoEngine& io = *engine;
+    if (opts.tuning.tcpInfo)
     {
-        ssize_t sent = send(sockfd, buffer + totalSent, len - totalSent, 0);
-        if (sent < 0)
+        recvMeter.watchSocket(clientSock);
+        sendMeter.watchSocket(clientSock);
+    }
+
+    // 6) RTT measurement phase
+    std::vector<double> rttSamples;
+    rttSamples.reserve(params.rttExchanges - 1);
+
+    char inByte = 0;
+    auto ackSendTime      = std::chrono::steady_clock::now();
+    bool haveLastAckTime  = false;
+    bool sized            = false; // client frames its chunks (-l / --sweep)
+    Direction direction   = Direction::Forward;
+
+    // --profile: counters read at the phase boundaries only
+    std::optional<PhaseProfiler> profiler;
+    StreamProfile profile;
+    if (opts.profile)
+    {
+        profiler.emplace();
+        profiler->begin(io);
+    }
+
+    for (int i = 0; i < params.rttExchanges; i++)
+    {
+        // Receive 1 byte from client
+        if (!io.recvAll(clientSock, &inByte, ONE_BYTE_SIZE))
         {
-            spdlog::error("send() failed: {}", strerror(errno));
-            return false;
+            spdlog::error("RTT measurement: recv() failed");
+            close(clientSock);
+            return;
         }
-        if (sent == 0)
+
+        // A latency client opens with its own hello instead of the first 'M'
+        if (i == 0 && inByte == LATENCY_HELLO)
         {
-            // Connection closed unexpectedly
-            return false;
+            received.exchanges = echoLatencyExchanges(io, clientSock);
+            received.ok = received.exchanges >= 0;
+            close(clientSock);
+            return;
+        }
+        // ...and so does a --rr one
+        if (i == 0 && inByte == RR_HELLO)
+        {
+            received.exchanges = answerTransactions(io, clientSock);
+            received.ok = received.exchanges >= 0;
+            close(clientSock);
+            return;
+        }
+        // The other hellos still count as the first RTT exchange
+        if (i == 0 && inByte == SIZED_HELLO)
+        {
+            sized = true;
+        }
+        if (i == 0 && (inByte == REVERSE_HELLO || inByte == BIDIR_HELLO))
+        {
+            direction = inByte == REVERSE_HELLO ? Direction::Reverse : Direction::Bidir;
         }
-        totalSent += sent;
+
+        // If we have a prior ackSendTime, measure RTT
+        if (haveLastAckTime)
+        {
+            auto now  = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(now - ackSendTime).count();
+            rttSamples.push_back(ms);
+        }
+
+        // Send back 'A'
+        char ack = 'A';
+        if (!io.sendAll(clientSock, &ack, ONE_BYTE_SIZE))
+        {
+            spdlog::error("RTT measurement: send() failed");
+            close(clientSock);
+            return;
+        }
+
+        ackSendTime     = std::chrono::steady_clock::now();
+        haveLastAckTime = true;
     }
-    return true;
-}
 
-bool recvAll(int sockfd, char* buffer, size_t len)
-{
-    size_t totalRecv = 0;
-    while (totalRecv < len)
+    // Compute average RTT from last 4
+    double avgRTT    = averageLastRtts(rttSamples); // of ~7 samples
+    int   rttMillis  = static_cast<int>(std::round(avgRTT));
+    IdleRtt idleRtt  = idleRttOf(rttSamples); // baseline for the link rate estimate
+    received.rttMillis = rttMillis;
+    sent.rttMillis     = rttMillis;
+    if (profiler)
+    {
+        profiler->end(io, 2LL * params.rttExchanges, profile.rtt);
+        profile.rtt.exchanges = params.rttExchanges;
+        profiler->begin(io);
+    }
+
+    // 7') Framed data phase: chunk sizes come from the client's headers
+    if (sized)
     {
-        ssize_t r = recv(sockfd, buffer + totalRecv, len - totalRecv, 0);
-        if (r < 0)
+        double cpuStart = threadCpuSeconds();
+        receiveSizedSteps(io, clientSock, opts, arena, recvMeter, received);
+        received.cpuSeconds = threadCpuSeconds() - cpuStart;
+        if (profiler)
         {
-            spdlog::error("recv() failed: {}", strerror(errno));
-            return false;
+            profiler->end(io, received.bytes, profile.data);
+            received.profile = profile;
         }
-        if (r == 0)
+        if (opts.tuning.tcpInfo)
         {
-            // Connection closed
-            return false;
+            readTcpInfo(clientSock, received.tcpInfo);
         }
-        totalRecv += r;
+        close(clientSock);
+        received.ok = !received.steps.empty();
+        return;
     }
-    return true;
+
+    // 7) Data transfer phase, in the direction(s) the client asked for
+    RecvSpec recvSpec;
+    recvSpec.mode     = opts.recvMode;
+    recvSpec.readSize  = opts.readSize;
+    recvSpec.chunkSize = params.chunkSize;
+    recvSpec.acks      = direction != Direction::Bidir;
+    recvSpec.verify    = params.verify;
+    recvSpec.payload   = params.payload;
+    recvSpec.arena     = arena;
+    SendSpec sendSpec;
+    sendSpec.chunkSize = params.chunkSize;
+    sendSpec.payload   = params.payload;
+    sendSpec.arena     = arena;
+    sendSpec.bitrate   = params.bitrate;
+    if (direction != Direction::Forward &&
+        !recvDirectionHeader(io, clientSock, sendSpec.durationSeconds, sendSpec.window))
+    {
+        spdlog::error("Data transfer: bad {} header from the client", directionName(direction));
+        close(clientSock);
+        return;
+    }
+    switch (direction)
+    {
+        case Direction::Forward:
+            receiveDataPhase(io, clientSock, recvSpec, recvMeter, received);
+            break;
+        case Direction::Reverse:
+            sendDataPhase(io, clientSock, sendSpec, idleRtt, sendMeter, sent);
+            break;
+        case Direction::Bidir:
+            runBidirectional(io, clientSock, sendSpec, recvSpec, idleRtt, sendMeter,
+                             recvMeter, sent, received);
+            break;
+    }
+    if (profiler)
+    {
+        profiler->end(io, received.bytes + sent.bytes, profile.data);
+        (direction == Direction::Forward ? received : sent).profile = profile;
+    }
+
+    // 8) - 9) Goodput and link estimate are in the result(s); TCP_INFO goes with
+    //         the direction this side sends in, if any
+    if (opts.tuning.tcpInfo)
+    {
+        readTcpInfo(clientSock, direction == Direction::Forward ? received.tcpInfo : sent.tcpInfo);
+    }
+    close(clientSock);
 }
 
-// ===============================================================
-// SERVER MODE 
-// ===============================================================
-void runServer(unsigned short port)
+// accept() one connection; exits on failure like the rest of the setup
+int acceptClient(int serverSock)
 {
-    // 1) Create socket
-    int serverSock = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSock < 0)
+    sockaddr_storage clientAddr;
+    socklen_t clientLen = sizeof(clientAddr);
+    int clientSock = accept(serverSock, reinterpret_cast<sockaddr*>(&clientAddr), &clientLen);
+    if (clientSock < 0)
     {
-        spdlog::error("Error creating server socket: {}", strerror(errno));
+        spdlog::error("Error accepting connection: {}", strerror(errno));
+        close(serverSock);
         exit(1);
     }
+    return clientSock;
+}
 
-    // 2) Reuse address
-    int optval = 1;
-    setsockopt(serverSock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+// Peek, so a data stream's first RTT byte stays queued for serveStream()
+bool opensWithControlHello(int sock)
+{
+    char first = 0;
+    ssize_t r = 0;
+    do
+    {
+        r = recv(sock, &first, ONE_BYTE_SIZE, MSG_PEEK);
+    } while (r < 0 && errno == EINTR);
+    return r == ONE_BYTE_SIZE && first == CONTROL_HELLO;
+}
 
-    // 3) Bind
-    sockaddr_in serverAddr;
-    std::memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family      = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port        = htons(port);
+// What the streams' data phases will take from the arena. Without a control
+// connection the direction and mode aren't known up front, so this sizes for
+// the forward test; other tests' buffers come from the heap instead.
+size_t serverArenaBytes(const ServerOptions& opts, const TestParams* params, int streams)
+{
+    RecvSpec recvSpec;
+    recvSpec.mode     = opts.recvMode;
+    recvSpec.readSize = opts.readSize;
+    size_t perStream = recvArenaBytes(recvSpec); // forward and sized tests
+    if (params && exchangeMode(params->mode))
+    {
+        perStream = 0;
+    }
+    else if (params && params->direction != Direction::Forward)
+    {
+        SendSpec sendSpec;
+        sendSpec.window    = params->window;
+        sendSpec.chunkSize = params->chunkSize;
+        perStream = sendArenaBytes(sendSpec) +
+                    (params->direction == Direction::Bidir ? perStream : 0);
+    }
+    return perStream * static_cast<size_t>(streams);
+}
 
-    if (bind(serverSock, reinterpret_cast<sockaddr*>(&serverAddr),
-             sizeof(serverAddr)) < 0)
+// --crr: the client reconnects for every transaction, so instead of one
+// connection per stream, each stream's thread accepts and answers
+// connections one after another until the client's results arrive on
+// controlSock. results[i]: the transactions thread i answered.
+void serveConnectTransactions(int serverSock, int controlSock, const ServerOptions& opts,
+                              const TestParams& params, std::vector<StreamResult>& results)
+{
+    // The threads poll() one accept queue, so a connection a sibling took
+    // must not block the others in accept()
+    int stopFd = eventfd(0, EFD_CLOEXEC);
+    int flags = fcntl(serverSock, F_GETFL);
+    fcntl(serverSock, F_SETFL, flags | O_NONBLOCK);
+    std::vector<std::thread> workers;
+    workers.reserve(results.size());
+    for (size_t i = 0; i < results.size(); i++)
     {
-        spdlog::error("Error binding to port {}: {}", port, strerror(errno));
-        close(serverSock);
-        exit(1);
+        workers.emplace_back([serverSock, stopFd, &opts, &params, &results, i]() {
+            StreamResult& total = results[i];
+            total.cpu = pinStream(opts.cpus, static_cast<int>(i));
+            total.exchanges = 0;
+            total.ok = true;
+            IntervalMeter noMeter(nullptr, static_cast<int>(i));
+            pollfd fds[2] = {{serverSock, POLLIN, 0}, {stopFd, POLLIN, 0}};
+            while (true)
+            {
+                if (poll(fds, 2, -1) < 0 && errno != EINTR)
+                {
+                    break;
+                }
+                if (fds[1].revents != 0)
+                {
+                    break;
+                }
+                int clientSock = accept4(serverSock, nullptr, nullptr, SOCK_CLOEXEC);
+                if (clientSock < 0)
+                {
+                    continue; // a sibling got there first
+                }
+                StreamResult answered;
+                StreamResult unused;
+                serveStream(clientSock, opts, params, nullptr, noMeter, noMeter, answered, unused);
+                total.exchanges += std::max(answered.exchanges, 0LL);
+            }
+        });
     }
 
-    // 4) Listen
-    if (listen(serverSock, BACKLOG) < 0)
+    // The client sends its results once its last transaction is done
+    pollfd control = {controlSock, POLLIN, 0};
+    while (poll(&control, 1, -1) < 0 && errno == EINTR)
     {
-        spdlog::error("Error listening on socket: {}", strerror(errno));
-        close(serverSock);
-        exit(1);
     }
+    uint64_t one = 1;
+    if (write(stopFd, &one, sizeof(one)) < 0)
+    {
+        spdlog::error("eventfd write failed: {}", strerror(errno));
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    fcntl(serverSock, F_SETFL, flags);
+    close(stopFd);
+}
+
+// One test: accept its streams, serve each on its own thread, swap results
+// over controlSock (if any) and report. params is what the control
+// connection agreed (defaults without one); firstSock, if >= 0, is stream 0,
+// already accepted.
+void serveTest(int serverSock, const ServerOptions& opts, int controlSock,
+               const TestParams& params, int streams, int firstSock)
+{
+    BufferArena arena(serverArenaBytes(opts, controlSock >= 0 ? &params : nullptr, streams));
+
+    // 5) Accept one connection per stream; each is served on its own thread
+    //    as soon as it arrives so early streams don't skew their RTT phase
+    //    The client picks the direction, so there are results (and interval
+    //    reporters) for both; only the direction(s) it ran get filled
+    std::vector<StreamResult> results(streams);
+    std::vector<StreamResult> sent(streams);
+    std::unique_ptr<IntervalReporter> reporter;
+    std::unique_ptr<IntervalReporter> sendReporter;
+    if (opts.intervalSeconds > 0.0)
+    {
+        reporter = std::make_unique<IntervalReporter>(streams, opts.intervalSeconds, "Received");
+        sendReporter = std::make_unique<IntervalReporter>(streams, opts.intervalSeconds, "Sent");
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(streams);
+    if (params.mode == TestMode::ConnectTransactions)
+    {
+        serveConnectTransactions(serverSock, controlSock, opts, params, results);
+    }
+    for (int i = 0; i < streams && params.mode != TestMode::ConnectTransactions; i++)
+    {
+        int clientSock = (i == 0 && firstSock >= 0) ? firstSock : acceptClient(serverSock);
+        spdlog::info("Client connected from {}", formatPeer(clientSock));
+        if (opts.reportSocket && i == 0)
+        {
+            logSocketSettings(clientSock);
+        }
+
+        workers.emplace_back([&results, &sent, &opts, &reporter, &sendReporter, &arena, &params,
+                              i, clientSock]() {
+            int cpu = pinStream(opts.cpus, i);
+            IntervalMeter recvMeter(reporter.get(), i);
+            IntervalMeter sendMeter(sendReporter.get(), i);
+            serveStream(clientSock, opts, params, &arena, recvMeter, sendMeter, results[i],
+                        sent[i]);
+            results[i].cpu = cpu;
+            sent[i].cpu    = cpu;
+        });
+    }
+    // --under-load: the probe connects once every stream has; its echoes
+    // only go in the log
+    StreamResult probed;
+    if (params.probe)
+    {
+        int probeSock = acceptClient(serverSock);
+        workers.emplace_back([&opts, &params, &probed, probeSock]() {
+            IntervalMeter noMeter(nullptr, 0);
+            StreamResult unused;
+            serveStream(probeSock, opts, params, nullptr, noMeter, noMeter, probed, unused);
+        });
+    }
+
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    if (reporter)
+    {
+        reporter->stop();
+        sendReporter->stop();
+    }
+
+    // 9') The client sends its counters first, then gets ours
+    std::vector<StreamResult> peerForward;
+    std::vector<StreamResult> peerReverse;
+    bool havePeer = false;
+    if (controlSock >= 0)
+    {
+        havePeer = recvResults(controlSock, peerForward, peerReverse);
+        if (havePeer)
+        {
+            sendResults(controlSock, results, sent);
+        }
+    }
+
+    // 10) Log final summary
+    if (params.probe)
+    {
+        spdlog::info("Under load: echoed {} probes", std::max(probed.exchanges, 0LL));
+    }
+    bool latency = results[0].exchanges >= 0;
+    bool reverse = sumResults(sent).okStreams > 0;
+    bool forward = !reverse || sumResults(results).okStreams > 0;
+    if (latency)
+    {
+        long long exchanges = 0;
+        for (const auto& r : results)
+        {
+            exchanges += std::max(r.exchanges, 0LL);
+        }
+        if (params.mode == TestMode::ConnectTransactions)
+        {
+            spdlog::info("Transactions: answered {}, a connection each, on {} thread(s)",
+                         exchanges, streams);
+        }
+        else if (params.mode == TestMode::Transactions)
+        {
+            spdlog::info("Transactions: answered {} over {} stream(s)", exchanges, streams);
+        }
+        else
+        {
+            spdlog::info("Latency: echoed {} exchanges over {} stream(s)", exchanges, streams);
+        }
+    }
+    else
+    {
+        if (forward)
+        {
+            logSummary("Received", results);
+        }
+        if (reverse)
+        {
+            logSummary("Sent", sent);
+            logLinkRateSummary("Sent", sent);
+        }
+        if (havePeer && forward)
+        {
+            logSummary("Sent (client)", peerForward);
+            logLinkRateSummary("Sent (client)", peerForward);
+        }
+        if (havePeer && reverse)
+        {
+            logSummary("Received (client)", peerReverse);
+        }
+        if (results[0].steps.size() > 1)
+        {
+            logSweepSummary("Received", results);
+        }
+        if (opts.reportSyscalls && forward)
+        {
+            logSyscallSummary(recvModeName(opts.recvMode), opts.readSize, results);
+        }
+        if (forward)
+        {
+            logVerifySummary("Received", results, crc32cImplName());
+        }
+        if (havePeer && reverse)
+        {
+            logVerifySummary("Received (client)", peerReverse, nullptr);
+        }
+        if (opts.reportThreads && forward)
+        {
+            logThreadSummary("Receive", results);
+        }
+        if (opts.reportThreads && reverse)
+        {
+            logThreadSummary("Send", sent);
+        }
+        logTcpInfoSummary(reverse ? sent : results);
+        if (opts.profile)
+        {
+            logProfileSummary(reverse ? "Sent" : "Received", reverse ? sent : results);
+        }
+    }
+
+    RunReport report;
+    report.role            = "server";
+    bool transactions = params.mode == TestMode::Transactions ||
+                        params.mode == TestMode::ConnectTransactions;
+    report.mode            = transactions ? "transactions" : latency ? "latency" : "throughput";
+    report.engine          = engineKindName(opts.engine);
+    report.path            = recvModeName(opts.recvMode);
+    report.direction       = directionName(!reverse ? Direction::Forward
+                                          : forward ? Direction::Bidir : Direction::Reverse);
+    report.streams         = streams;
+    report.intervalSeconds = opts.intervalSeconds;
+    report.readSize        = opts.readSize;
+    report.buffers         = arenaBackingName(arena.backing());
+    report.payload         = payloadPatternName(params.payload);
+    report.verify          = params.verify;
+    report.intervals       = reporter.get();
+    if (forward)
+    {
+        report.results = std::move(results);
+    }
+    if (reverse)
+    {
+        report.reverseResults   = std::move(sent);
+        report.reverseIntervals = sendReporter.get();
+    }
+    if (havePeer && forward)
+    {
+        report.peerResults = std::move(peerForward);
+    }
+    if (havePeer && reverse)
+    {
+        report.peerReverseResults = std::move(peerReverse);
+    }
+    writeReport(opts.output, report);
+}
+
+void runServer(const ServerOptions& opts)
+{
+    // 1) - 4) Create, bind and listen
+    int serverSock = openListenSocket(opts.port, std::max(opts.backlog, opts.streams),
+                                      opts.tuning, opts.family, false);
     spdlog::info("iPerfer server started");
 
-    // 5) Accept
-    sockaddr_in clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
-    int clientSock = accept(serverSock,
-                            reinterpret_cast<sockaddr*>(&clientAddr),
-                            &clientLen);
-    if (clientSock < 0)
+    // 4') A control connection comes first and says how many streams follow;
+    //     a client without one is already on its first data stream, and -P
+    //     has to match its own
+    int firstSock = acceptClient(serverSock);
+    if (!opensWithControlHello(firstSock))
     {
-        spdlog::error("Error accepting connection: {}", strerror(errno));
+        serveTest(serverSock, opts, -1, TestParams{}, opts.streams, firstSock);
         close(serverSock);
-        exit(1);
+        return;
     }
-    spdlog::info("Client connected");
 
+    // 4'') ...and then runs as many tests over it as the client proposes
+    //      (--repeat), until it closes the connection
+    int controlSock = firstSock;
+    const bool canVerify = opts.recvMode == RecvMode::Copy;
+    TestParams params;
+    if (!acceptTest(controlSock, canVerify, params))
+    {
+        close(controlSock);
+        close(serverSock);
+        exit(1);
+    }
+    do
+    {
+        serveTest(serverSock, opts, controlSock, params, params.streams, -1);
+    } while (acceptNextTest(controlSock, canVerify, params));
+    close(controlSock);
     close(serverSock);
+}
 
-    // 6) RTT measurement phase
-    std::vector<double> rttSamples; 
-    rttSamples.reserve(RTT_EXCHANGES - 1);
+// -u: one paced datagram test instead of the TCP phases
+void runServerUdp(const ServerOptions& opts)
+{
+    pinStream(opts.cpus, 0);
+    UdpStats received;
+    runUdpServer(opts, received);
+    if (!received.valid)
+    {
+        return;
+    }
+    logUdpSummary("Received", received, true);
+
+    RunReport report;
+    report.role            = "server";
+    report.mode            = "udp";
+    report.engine          = engineKindName(opts.engine);
+    report.streams         = 1;
+    report.udpReceived     = &received;
+    writeReport(opts.output, report);
+}
 
-    char inByte = 0;
-    auto ackSendTime      = std::chrono::high_resolution_clock::now();
-    bool haveLastAckTime  = false;
 
-    for (int i = 0; i < RTT_EXCHANGES; i++)
+// ===============================================================
+// CLIENT MODE
+// ===============================================================
+
+// The timed data phase's two sides as opts asks for them. --bidir runs
+// without acks: the return path carries payload instead.
+SendSpec clientSendSpec(const ClientOptions& opts, BufferArena* arena)
+{
+    SendSpec sendSpec;
+    sendSpec.durationSeconds = opts.durationSeconds;
+    sendSpec.window          = opts.direction == Direction::Bidir ? 0 : opts.window;
+    sendSpec.zerocopy        = opts.zerocopy;
+    sendSpec.payload         = opts.payload;
+    sendSpec.arena           = arena;
+    sendSpec.bitrate         = opts.bitrate;
+    return sendSpec;
+}
+
+RecvSpec clientRecvSpec(const ClientOptions& opts, BufferArena* arena)
+{
+    RecvSpec recvSpec;
+    recvSpec.acks    = opts.direction != Direction::Bidir;
+    recvSpec.verify  = opts.verify;
+    recvSpec.payload = opts.payload;
+    recvSpec.arena   = arena;
+    return recvSpec;
+}
+
+// What the streams' data phases will take from the arena
+size_t clientArenaBytes(const ClientOptions& opts)
+{
+    size_t perStream = 0;
+    if (!opts.chunkSizes.empty())
     {
-        // Receive 1 byte from client
-        if (!recvAll(clientSock, &inByte, ONE_BYTE_SIZE))
+        perStream = arenaSliceBytes(*std::max_element(opts.chunkSizes.begin(),
+                                                      opts.chunkSizes.end()));
+    }
+    else if (opts.latencyCount == 0)
+    {
+        if (opts.direction != Direction::Reverse)
+        {
+            perStream += sendArenaBytes(clientSendSpec(opts, nullptr));
+        }
+        if (opts.direction != Direction::Forward)
+        {
+            perStream += recvArenaBytes(clientRecvSpec(opts, nullptr));
+        }
+    }
+    return perStream * static_cast<size_t>(opts.streams);
+}
+
+// RTT measurement + timed data phase on one connected socket. Closes sockfd.
+// sent/received: the client -> server and server -> client directions; only
+// the one(s) opts.direction asks for are filled.
+void runClientStream(int sockfd, const ClientOptions& opts, BufferArena* arena,
+                     IntervalMeter& sendMeter, IntervalMeter& recvMeter, StreamResult& sent,
+                     StreamResult& received)
+{
+    auto engine = makeIoEngine(opts.engine);
+    if (!engine || !engine->attach(sockfd))
+    {
+        close(sockfd);
+        return;
+    }
+    IoEngine& io = *engine;
+    if (opts.tuning.tcpInfo)
+    {
+        sendMeter.watchSocket(sockfd);
+        recvMeter.watchSocket(sockfd);
+    }
+
+    // 4) RTT measurement (8 times, or --rtt-count); the first byte tells the
+    //    server what follows
+    char hello = 'M';
+    if (!opts.chunkSizes.empty())
+    {
+        hello = SIZED_HELLO;
+    }
+    else if (opts.direction != Direction::Forward)
+    {
+        hello = opts.direction == Direction::Reverse ? REVERSE_HELLO : BIDIR_HELLO;
+    }
+    std::vector<double> rttSamples;
+    rttSamples.reserve(opts.rttExchanges);
+
+    // --profile: counters read at the phase boundaries only
+    std::optional<PhaseProfiler> profiler;
+    StreamProfile profile;
+    if (opts.profile)
+    {
+        profiler.emplace();
+        profiler->begin(io);
+    }
+
+    for (int i = 0; i < opts.rttExchanges; i++)
+    {
+        auto sendTime = std::chrono::steady_clock::now();
+
+        char outByte = (i == 0) ? hello : 'M';
+        if (!io.sendAll(sockfd, &outByte, ONE_BYTE_SIZE))
+        {
+            spdlog::error("RTT measurement: send() failed");
+            close(sockfd);
+            return;
+        }
+
+        char inByte = 0;
+        if (!io.recvAll(sockfd, &inByte, ONE_BYTE_SIZE))
         {
             spdlog::error("RTT measurement: recv() failed");
-            close(clientSock);
+            close(sockfd);
             return;
         }
+        auto recvTime = std::chrono::steady_clock::now();
 
-        // If we have a prior ackSendTime, measure RTT
-        if (haveLastAckTime)
+        double ms = std::chrono::duration<double, std::milli>(recvTime - sendTime).count();
+        rttSamples.push_back(ms);
+    }
+
+    // Average of last 4 RTT measurements
+    double avgRTT = averageLastRtts(rttSamples); // of 8 samples
+    // We'll keep the integer ms
+    int rttMillis = static_cast<int>(std::round(avgRTT));
+    // And the samples' mean and spread as the link estimate's idle baseline
+    IdleRtt idleRtt = idleRttOf(rttSamples);
+    sent.rttMillis     = rttMillis;
+    received.rttMillis = rttMillis;
+    markStartup(StartupPhase::DataStart);
+    if (profiler)
+    {
+        profiler->end(io, 2LL * opts.rttExchanges, profile.rtt);
+        profile.rtt.exchanges = opts.rttExchanges;
+    }
+    if (profiler)
+    {
+        profiler->begin(io);
+    }
+
+    // 5') -l / --sweep: framed batches, one step per chunk size
+    if (!opts.chunkSizes.empty())
+    {
+        double cpuStart = threadCpuSeconds();
+        bool ok = sendSizedSteps(io, sockfd, opts, arena, sendMeter, sent);
+        sent.cpuSeconds = threadCpuSeconds() - cpuStart;
+        if (profiler)
         {
-            auto now  = std::chrono::high_resolution_clock::now();
-            double ms = std::chrono::duration<double, std::milli>(now - ackSendTime).count();
-            rttSamples.push_back(ms);
+            profiler->end(io, sent.bytes, profile.data);
+            sent.profile = profile;
+        }
+        if (opts.tuning.tcpInfo)
+        {
+            readTcpInfo(sockfd, sent.tcpInfo);
         }
+        close(sockfd);
+        sent.ok = ok;
+        return;
+    }
 
-        // Send back 'A'
-        char ack = 'A';
-        if (!sendAll(clientSock, &ack, ONE_BYTE_SIZE))
+    // 5) Data transfer for <durationSeconds> in the direction(s) asked for
+    SendSpec sendSpec = clientSendSpec(opts, arena);
+    RecvSpec recvSpec = clientRecvSpec(opts, arena);
+    if (opts.direction != Direction::Forward &&
+        !sendDirectionHeader(io, sockfd, sendSpec.durationSeconds, sendSpec.window))
+    {
+        spdlog::error("Data transfer: sending the {} header failed", directionName(opts.direction));
+        close(sockfd);
+        return;
+    }
+    switch (opts.direction)
+    {
+        case Direction::Forward:
+            sendDataPhase(io, sockfd, sendSpec, idleRtt, sendMeter, sent);
+            break;
+        case Direction::Reverse:
+            receiveDataPhase(io, sockfd, recvSpec, recvMeter, received);
+            break;
+        case Direction::Bidir:
+            runBidirectional(io, sockfd, sendSpec, recvSpec, idleRtt, sendMeter, recvMeter,
+                             sent, received);
+            break;
+    }
+    if (profiler)
+    {
+        profiler->end(io, sent.bytes + received.bytes, profile.data);
+        (opts.direction == Direction::Reverse ? received : sent).profile = profile;
+    }
+
+    // 6) Goodput and link estimate are in the result(s); TCP_INFO goes with the
+    //    direction this side sends in, if any
+    if (opts.tuning.tcpInfo)
+    {
+        readTcpInfo(sockfd, opts.direction == Direction::Reverse ? received.tcpInfo : sent.tcpInfo);
+    }
+    close(sockfd);
+}
+
+// What the client tells the server over the control connection
+TestParams testParams(const ClientOptions& opts)
+{
+    TestParams params;
+    params.mode = opts.crr                   ? TestMode::ConnectTransactions
+                : opts.rr.requestSize > 0    ? TestMode::Transactions
+                : opts.latencyCount > 0      ? TestMode::Latency
+                : !opts.chunkSizes.empty()   ? TestMode::Sized : TestMode::Throughput;
+    params.direction       = opts.direction;
+    params.streams         = opts.streams;
+    params.window          = opts.direction == Direction::Bidir ? 0 : opts.window;
+    params.durationSeconds = opts.durationSeconds;
+    params.payload         = opts.payload;
+    params.verify          = opts.verify;
+    params.bitrate         = opts.bitrate;
+    params.probe           = opts.probeInterval > 0.0;
+    params.rttExchanges    = opts.rttExchanges;
+    return params;
+}
+
+// End of test: our counters go first, then the server's come back over
+// controlSock, which stays open for the next run; false (nothing to report)
+// without one or if the swap failed.
+bool exchangeResults(int controlSock, const std::vector<StreamResult>& forward,
+                     const std::vector<StreamResult>& reverse,
+                     std::vector<StreamResult>& peerForward, std::vector<StreamResult>& peerReverse)
+{
+    if (controlSock < 0)
+    {
+        return false;
+    }
+    return sendResults(controlSock, forward, reverse) &&
+           recvResults(controlSock, peerForward, peerReverse);
+}
+
+// Each stream fills its own histogram; they are merged for the report
+void runLatencyClient(const std::vector<int>& socks, int controlSock, const ClientOptions& opts,
+                      const ConnectReport& connect, const std::vector<double>& connectSeconds,
+                      int run)
+{
+    const size_t streams = socks.size();
+    std::vector<LatencyHistogram> hists(streams);
+    std::vector<StreamResult> results(streams);
+    std::vector<std::thread> workers;
+    workers.reserve(streams);
+    markStartup(StartupPhase::DataStart);
+    for (size_t i = 0; i < streams; i++)
+    {
+        workers.emplace_back([&hists, &results, &socks, &opts, i]() {
+            results[i].cpu = pinStream(opts.cpus, static_cast<int>(i));
+            auto engine = makeIoEngine(opts.engine);
+            if (engine && engine->attach(socks[i]))
+            {
+                results[i].ok = runLatencyExchanges(*engine, socks[i], opts.msgSize,
+                                                    opts.latencyCount, hists[i]);
+            }
+            results[i].exchanges = static_cast<long long>(hists[i].count());
+            close(socks[i]);
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    LatencyHistogram total;
+    for (const auto& h : hists)
+    {
+        total.merge(h);
+    }
+    logLatencySummary(opts.msgSize, total);
+    if (run <= 0)
+    {
+        logStartupTimeline();
+    }
+
+    // The server's side is only an echo count; it goes in the report alone
+    std::vector<StreamResult> peerResults;
+    std::vector<StreamResult> peerReverse;
+    bool havePeer = exchangeResults(controlSock, results, {}, peerResults, peerReverse);
+
+    RunReport report;
+    report.mode    = "latency";
+    report.engine  = engineKindName(opts.engine);
+    report.streams = static_cast<int>(streams);
+    report.msgSize = opts.msgSize;
+    report.results = std::move(results);
+    report.latency = &total;
+    report.connect = &connect;
+    report.connectSeconds = connectSeconds;
+    report.run     = run;
+    report.startup = run <= 0;
+    if (havePeer)
+    {
+        report.peerResults = std::move(peerResults);
+    }
+    writeReport(opts.output, report);
+}
+
+// Applies opts.tuning to a data stream's socket before its connect(); the
+// control connection (tune false) keeps the kernel defaults. fastOpen:
+// --fastopen too, which the raced first connection goes without, as its
+// nonblocking connect() has to see the real handshake.
+SocketSetup streamSetup(const ClientOptions& opts, bool tune, bool fastOpen)
+{
+    return [&opts, tune, fastOpen](int sockfd) {
+        return !tune || (applySocketTuning(sockfd, opts.tuning) &&
+                         (!fastOpen || !opts.tuning.fastOpen || enableFastOpen(sockfd, false)));
+    };
+}
+
+// socket() + connect() to the address the first connection won with; exits
+// on failure. seconds: how long the handshake took.
+int connectToServer(const PeerAddress& serverAddr, const ClientOptions& opts, bool tune,
+                    double& seconds)
+{
+    int sockfd = connectAddress(serverAddr, streamSetup(opts, tune, tune), seconds);
+    if (sockfd < 0)
+    {
+        spdlog::error("Could not connect to {}:{} -> {}: {}", opts.hostname, opts.port,
+                      formatAddress(serverAddr.sockAddr()), strerror(errno));
+        exit(1);
+    }
+    return sockfd;
+}
+
+// Agree on the test over the freshly connected controlSock; returns it, or
+// -1 (closed) if the server has no control channel (--daemon). Exits if the
+// server refuses.
+int negotiateTest(int controlSock, const ClientOptions& opts)
+{
+    ControlReply reply;
+    if (!proposeTest(controlSock, testParams(opts), reply))
+    {
+        close(controlSock);
+        exit(1);
+    }
+    if (reply.status == ControlStatus::NotServed && opts.rttExchanges != RTT_EXCHANGES)
+    {
+        spdlog::error("Control: the server runs without a control channel, so its RTT "
+                      "phase is {} round trips; drop --rtt-count", RTT_EXCHANGES);
+        close(controlSock);
+        exit(1);
+    }
+    if (reply.status == ControlStatus::NotServed)
+    {
+        spdlog::info("Control: the server runs without a control channel; "
+                     "reporting this side only");
+        close(controlSock);
+        return -1;
+    }
+    if (reply.status != ControlStatus::Ok)
+    {
+        spdlog::error("Control: the server (protocol version {}) refused the test: {}",
+                      reply.version, controlStatusName(reply.status));
+        close(controlSock);
+        exit(1);
+    }
+    return controlSock;
+}
+
+// --rr: a thread per stream runs transactions for -t seconds, on its
+// connected socket in socks, or (--crr, socks empty) on a fresh connection
+// to the winning address each time. The histograms are merged for the report.
+void runTransactionClient(const std::vector<int>& socks, int controlSock,
+                          const ClientOptions& opts, const ConnectReport& connect,
+                          const std::vector<double>& connectSeconds, int run)
+{
+    const size_t streams = static_cast<size_t>(opts.streams);
+    std::vector<LatencyHistogram> hists(streams);
+    std::vector<StreamResult> results(streams);
+    std::vector<std::thread> workers;
+    workers.reserve(streams);
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(opts.durationSeconds));
+    markStartup(StartupPhase::DataStart);
+    for (size_t i = 0; i < streams; i++)
+    {
+        workers.emplace_back([&hists, &results, &socks, &opts, &connect, deadline, i]() {
+            results[i].cpu = pinStream(opts.cpus, static_cast<int>(i));
+            auto engine = makeIoEngine(opts.engine);
+            if (!engine)
+            {
+                return;
+            }
+            if (opts.crr)
+            {
+                SocketSetup setup = streamSetup(opts, true, true);
+                auto openConnection = [&connect, &setup]() {
+                    double seconds = 0.0;
+                    return connectAddress(connect.winner, setup, seconds);
+                };
+                results[i].ok = runConnectTransactions(*engine, openConnection, opts.rr, deadline,
+                                                       hists[i]);
+            }
+            else
+            {
+                results[i].ok = engine->attach(socks[i]) &&
+                                runTransactions(*engine, socks[i], opts.rr, deadline, hists[i]);
+                close(socks[i]);
+            }
+            results[i].exchanges = static_cast<long long>(hists[i].count());
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    LatencyHistogram total;
+    for (const auto& h : hists)
+    {
+        total.merge(h);
+    }
+    TransactionSummary summary;
+    summary.spec        = opts.rr;
+    summary.connectEach = opts.crr;
+    summary.count       = total.count();
+    summary.seconds     = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                              .count();
+    logTransactionSummary(summary, total);
+    if (run <= 0)
+    {
+        logStartupTimeline();
+    }
+
+    std::vector<StreamResult> peerResults;
+    std::vector<StreamResult> peerReverse;
+    bool havePeer = exchangeResults(controlSock, results, {}, peerResults, peerReverse);
+
+    RunReport report;
+    report.mode            = "transactions";
+    report.engine          = engineKindName(opts.engine);
+    report.streams         = static_cast<int>(streams);
+    report.durationSeconds = opts.durationSeconds;
+    report.results         = std::move(results);
+    report.latency         = &total;
+    report.transactions    = &summary;
+    report.connect         = &connect;
+    report.connectSeconds  = connectSeconds;
+    report.run             = run;
+    report.startup         = run <= 0;
+    if (havePeer)
+    {
+        report.peerResults = std::move(peerResults);
+    }
+    writeReport(opts.output, report);
+}
+
+// One test's data streams, from their connect() to the report. firstSock,
+// if >= 0, is stream 0 (--no-control's raced connection); run is the
+// --repeat index for the report, -1 without.
+void runClientTest(const ClientOptions& opts, int firstSock, int controlSock,
+                   const ConnectReport& connect, int run)
+{
+    const int streams = opts.streams;
+
+    // --crr connects afresh for every transaction instead
+    if (opts.crr)
+    {
+        runTransactionClient({}, controlSock, opts, connect, {}, run);
+        return;
+    }
+
+    // 2) Create + 3) Connect every stream to the winning address before any
+    //    of them starts sending, so all flows enter the data phase together
+    std::vector<int> socks;
+    std::vector<double> connectSeconds;
+    socks.reserve(streams);
+    for (int i = 0; i < streams; i++)
+    {
+        double seconds = connect.winnerSeconds();
+        socks.push_back(i == 0 && firstSock >= 0 ? firstSock
+                        : connectToServer(connect.winner, opts, true, seconds));
+        connectSeconds.push_back(seconds);
+    }
+    markStartup(StartupPhase::Streams);
+    logStreamConnects(connectSeconds);
+    if (opts.reportSocket)
+    {
+        logSocketSettings(socks[0]);
+    }
+
+    // Latency mode: timed ping-pongs instead of the RTT + data phases
+    if (opts.latencyCount > 0)
+    {
+        runLatencyClient(socks, controlSock, opts, connect, connectSeconds, run);
+        return;
+    }
+    if (opts.rr.requestSize > 0)
+    {
+        runTransactionClient(socks, controlSock, opts, connect, connectSeconds, run);
+        return;
+    }
+
+    // 4) - 6) One worker thread per stream
+    const bool sends    = opts.direction != Direction::Reverse;
+    const bool receives = opts.direction != Direction::Forward;
+    std::vector<StreamResult> results(streams);
+    std::vector<StreamResult> received(streams);
+    std::unique_ptr<IntervalReporter> reporter;
+    std::unique_ptr<IntervalReporter> recvReporter;
+    if (opts.intervalSeconds > 0.0 && sends)
+    {
+        reporter = std::make_unique<IntervalReporter>(streams, opts.intervalSeconds, "Sent");
+    }
+    if (opts.intervalSeconds > 0.0 && receives)
+    {
+        recvReporter = std::make_unique<IntervalReporter>(streams, opts.intervalSeconds, "Received");
+    }
+    BufferArena arena(clientArenaBytes(opts));
+
+    // --under-load: the probe connects last, untuned, and takes its idle
+    // baseline before any stream starts
+    std::unique_ptr<LoadProbe> probe;
+    if (opts.probeInterval > 0.0)
+    {
+        double seconds = 0.0;
+        probe = std::make_unique<LoadProbe>(connectToServer(connect.winner, opts, false, seconds),
+                                            opts.probeInterval);
+        probe->measureIdle();
+        probe->start();
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(streams);
+    for (int i = 0; i < streams; i++)
+    {
+        workers.emplace_back([&results, &received, &socks, &opts, &reporter, &recvReporter,
+                              &arena, i]() {
+            int cpu = pinStream(opts.cpus, i);
+            IntervalMeter sendMeter(reporter.get(), i);
+            IntervalMeter recvMeter(recvReporter.get(), i);
+            runClientStream(socks[i], opts, &arena, sendMeter, recvMeter, results[i],
+                            received[i]);
+            results[i].cpu  = cpu;
+            received[i].cpu = cpu;
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    if (probe)
+    {
+        probe->stop();
+    }
+    if (reporter)
+    {
+        reporter->stop();
+    }
+    if (recvReporter)
+    {
+        recvReporter->stop();
+    }
+    std::vector<StreamResult> peerForward;
+    std::vector<StreamResult> peerReverse;
+    bool havePeer = exchangeResults(controlSock, results, received, peerForward, peerReverse);
+
+    if (sends)
+    {
+        logSummary("Sent", results);
+        logLinkRateSummary("Sent", results);
+    }
+    if (receives)
+    {
+        logSummary("Received", received);
+    }
+    if (havePeer && sends)
+    {
+        logSummary("Received (server)", peerForward);
+    }
+    if (havePeer && receives)
+    {
+        logSummary("Sent (server)", peerReverse);
+        logLinkRateSummary("Sent (server)", peerReverse);
+    }
+    if (opts.chunkSizes.size() > 1)
+    {
+        logSweepSummary("Sent", results);
+    }
+    if (opts.reportCpu)
+    {
+        logCpuSummary(zeroCopyModeName(opts.zerocopy), results);
+    }
+    if (receives)
+    {
+        logVerifySummary("Received", received, crc32cImplName());
+    }
+    if (havePeer && sends)
+    {
+        logVerifySummary("Received (server)", peerForward, nullptr);
+    }
+    if (opts.reportThreads && sends)
+    {
+        logThreadSummary("Send", results);
+    }
+    if (opts.reportThreads && receives)
+    {
+        logThreadSummary("Receive", received);
+    }
+    logTcpInfoSummary(sends ? results : received);
+    if (opts.profile)
+    {
+        logProfileSummary(sends ? "Sent" : "Received", sends ? results : received);
+    }
+    if (probe)
+    {
+        logLoadProbeSummary(*probe);
+    }
+    if (run <= 0)
+    {
+        logStartupTimeline();
+    }
+
+    RunReport report;
+    report.engine          = engineKindName(opts.engine);
+    report.path            = zeroCopyModeName(opts.zerocopy);
+    report.buffers         = arenaBackingName(arena.backing());
+    report.payload         = payloadPatternName(opts.payload);
+    report.verify          = opts.verify;
+    report.direction       = directionName(opts.direction);
+    report.streams         = streams;
+    report.window          = opts.window;
+    report.durationSeconds = opts.durationSeconds;
+    report.intervalSeconds = opts.intervalSeconds;
+    report.bitrate         = opts.bitrate;
+    report.run             = run;
+    report.connect         = &connect;
+    report.connectSeconds  = std::move(connectSeconds);
+    report.probe           = probe.get();
+    report.startup         = run <= 0;
+    if (sends)
+    {
+        report.results   = std::move(results);
+        report.intervals = reporter.get();
+    }
+    if (receives)
+    {
+        report.reverseResults   = std::move(received);
+        report.reverseIntervals = recvReporter.get();
+    }
+    if (havePeer && sends)
+    {
+        report.peerResults = std::move(peerForward);
+    }
+    if (havePeer && receives)
+    {
+        report.peerReverseResults = std::move(peerReverse);
+    }
+    writeReport(opts.output, report);
+}
+
+void runClient(const ClientOptions& opts)
+{
+    markStartup(StartupPhase::Options);
+    const std::string& hostname = opts.hostname;
+    const unsigned short port = opts.port;
+
+    // 1) Resolve hostname; UDP has no handshake to race, so its datagrams go
+    //    to the first address in RFC 8305 order
+    if (opts.udp)
+    {
+        std::vector<PeerAddress> addresses;
+        if (!resolveAll(hostname, port, opts.family, SOCK_DGRAM, addresses))
+        {
+            exit(1);
+        }
+        const PeerAddress& serverAddr = addresses.front();
+        pinStream(opts.cpus, 0);
+        UdpStats sent;
+        UdpStats received;
+        runUdpClient(serverAddr, opts, sent, received);
+        logUdpSummary("Sent", sent, false);
+        if (received.valid)
         {
-            spdlog::error("RTT measurement: send() failed");
-            close(clientSock);
-            return;
+            logUdpSummary("Received (server)", received, true);
         }
 
-        ackSendTime     = std::chrono::high_resolution_clock::now();
-        haveLastAckTime = true;
+        RunReport report;
+        report.mode            = "udp";
+        report.engine          = engineKindName(opts.engine);
+        report.streams         = 1;
+        report.durationSeconds = opts.durationSeconds;
+        report.msgSize         = opts.datagramSize;
+        report.udpSent         = &sent;
+        report.udpReceived     = &received;
+        writeReport(opts.output, report);
+        return;
     }
 
-    // Compute average RTT from last 4
-    double avgRTT = 0.0;
-    int n = static_cast<int>(rttSamples.size()); // ~7
-    if (n > 0)
+    // 1') - 2') The first connection (the control one, else stream 0) races
+    //    every address, and the test is agreed over it before any stream
+    //    A numeric host goes straight to its connect(); a cached address is
+    //    the race's first attempt
+    ConnectReport connect;
+    SocketSetup firstSetup = streamSetup(opts, !opts.control, false);
+    int firstSock = -1;
+    auto lookupStart = std::chrono::steady_clock::now();
+    PeerAddress known;
+    bool numeric = parseNumericAddress(hostname, port, opts.family, known);
+    if (numeric)
     {
-        int startIndex = (n > 4) ? (n - 4) : 0;
-        double sum = 0.0;
-        for (int i = startIndex; i < n; i++)
+        double lookup = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                      lookupStart).count();
+        firstSock = connectKnownAddress(hostname, known, "numeric", lookup, firstSetup, connect);
+        if (firstSock < 0)
         {
-            sum += rttSamples[i];
+            spdlog::info("Connect: {} failed ({}); resolving {} again",
+                         formatAddress(known.sockAddr()), strerror(errno), hostname);
+            connect = ConnectReport();
         }
-        int count = n - startIndex;
-        avgRTT = sum / count;
     }
-    int   rttMillis = static_cast<int>(std::round(avgRTT));
-    double avgRTTsec = avgRTT / 1000.0; // for net time calculation
-
-    // 7) Data transfer phase
-    auto dataStart = std::chrono::high_resolution_clock::now();
-
-    long long totalBytesReceived = 0;
-    std::vector<char> dataBuf(CHUNK_SIZE, '\0');
-    int chunkCount = 0; // how many 80KB chunks are received
-
-    while (true)
+    if (firstSock < 0)
     {
-        // We'll try to receive exactly 80KB
-        if (!recvAll(clientSock, dataBuf.data(), CHUNK_SIZE))
+        bool cached = !numeric && !opts.addrCache.empty() &&
+                      loadCachedAddress(opts.addrCache, hostname, port, opts.family, known);
+        firstSock = happyEyeballsConnect(hostname, port, opts.family, firstSetup, connect,
+                                         cached ? &known : nullptr);
+        if (firstSock < 0)
         {
-            // closed or error
-            break;
+            exit(1);
         }
-        totalBytesReceived += CHUNK_SIZE;
-        chunkCount++;
-
-        // Send 1-byte ack
-        char ack = 'A';
-        if (!sendAll(clientSock, &ack, ONE_BYTE_SIZE))
+        // A cached address that won is already in the file
+        if (!opts.addrCache.empty() && (!cached || !sameAddress(connect.winner, known)))
         {
-            spdlog::error("Data transfer: ack send failed");
-            break;
+            storeCachedAddress(opts.addrCache, hostname, port, opts.family, connect.winner);
         }
     }
-
-    auto dataEnd = std::chrono::high_resolution_clock::now();
-    close(clientSock);
-
-    double dataSeconds = std::chrono::duration<double>(dataEnd - dataStart).count();
-
-    // 8) Subtract total RTT overhead
-    // Because each 80KB chunk has a "stop-and-wait" for an ACK on the client side,
-    // from the server's perspective we can do the same assumption: each chunk cost ~1 RTT
-    double netSeconds = dataSeconds - (chunkCount * avgRTTsec);
-    if (netSeconds < 0.0)
+    markStartup(StartupPhase::Connected);
+    logConnectReport(connect);
+    int controlSock = opts.control ? negotiateTest(firstSock, opts) : -1;
+    if (opts.control)
     {
-        // fallback if negative
-        netSeconds = dataSeconds;
+        markStartup(StartupPhase::Control);
     }
 
-    // 9) Compute throughput using netSeconds
-    double rateMbps = 0.0;
-    if (netSeconds > 0.0)
+    // 2) - 10) Every run (--repeat) connects fresh data streams to the
+    //    winning address; resolving, the race and the control handshake are
+    //    paid for once. A run that overruns its --every slot is followed at once.
+    const auto every = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(opts.everySeconds));
+    const auto firstStart = std::chrono::steady_clock::now();
+    for (int run = 0; run < opts.repeat; run++)
     {
-        rateMbps = (static_cast<double>(totalBytesReceived) * 8.0 / netSeconds) / 1e6;
+        if (run > 0)
+        {
+            std::this_thread::sleep_until(firstStart + run * every);
+            if (controlSock >= 0)
+            {
+                controlSock = negotiateTest(controlSock, opts);
+            }
+        }
+        if (opts.repeat > 1)
+        {
+            spdlog::info("Repeat: run {} of {}", run + 1, opts.repeat);
+        }
+        runClientTest(opts, run == 0 && !opts.control ? firstSock : -1, controlSock, connect,
+                      opts.repeat > 1 ? run : -1);
+    }
+    if (controlSock >= 0)
+    {
+        close(controlSock);
     }
-    long long totalKB = totalBytesReceived / 1000LL;
-
-    // 10) Log final summary
-    spdlog::info("Received={} KB, Rate={:.3f} Mbps, RTT={}ms",
-                 totalKB, rateMbps, rttMillis);
 }
 
-
 // ===============================================================
-// CLIENT MODE (MODIFIED to subtract total RTT overhead)
+// MAIN - parse arguments, run server or client
 // ===============================================================
-void runClient(const std::string& hostname, unsigned short port, double durationSeconds)
-{
-    // 1) Resolve hostname
-    addrinfo hints, *res;
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family   = AF_INET;  // IPv4
-    hints.ai_socktype = SOCK_STREAM;
 
-    int status = getaddrinfo(hostname.c_str(), nullptr, &hints, &res);
-    if (status != 0)
+// --json / --csv; false (error logged) if both are given
+bool parseOutputFormat(const cxxopts::ParseResult& parsed, OutputFormat& format)
+{
+    if (parsed.count("json") && parsed.count("csv"))
     {
-        spdlog::error("getaddrinfo() failed: {}", gai_strerror(status));
-        exit(1);
+        spdlog::error("Error: --json and --csv are mutually exclusive");
+        return false;
     }
+    if (parsed.count("json") || parsed.count("csv"))
+    {
+        format = parsed.count("json") ? OutputFormat::Json : OutputFormat::Csv;
+        // Keep stdout for the report alone
+        spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+    }
+    return true;
+}
 
-    sockaddr_in serverAddr;
-    std::memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port   = htons(port);
-
-    auto* ipv4 = reinterpret_cast<sockaddr_in*>(res->ai_addr);
-    serverAddr.sin_addr = ipv4->sin_addr;
-    freeaddrinfo(res);
-
-    // 2) Create socket
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0)
+// -i is optional on both sides; false (error logged) if it is given but not > 0
+bool parseInterval(const cxxopts::ParseResult& parsed, double& intervalSeconds)
+{
+    if (!parsed.count("interval"))
     {
-        spdlog::error("Error creating client socket: {}", strerror(errno));
-        exit(1);
+        return true;
     }
+    intervalSeconds = parsed["interval"].as<double>();
+    if (intervalSeconds <= 0.0)
+    {
+        spdlog::error("Error: interval must be greater than 0");
+        return false;
+    }
+    return true;
+}
 
-    // 3) Connect
-    if (connect(sockfd, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0)
+// -4 / -6 narrow both sides to one family; false (error logged) on both
+bool parseAddressFamily(const cxxopts::ParseResult& parsed, AddressFamily& family)
+{
+    if (parsed.count("ipv4") && parsed.count("ipv6"))
     {
-        spdlog::error("Could not connect to {}:{} -> {}",
-                      hostname, port, strerror(errno));
-        close(sockfd);
-        exit(1);
+        spdlog::error("Error: -4 and -6 are mutually exclusive");
+        return false;
+    }
+    if (parsed.count("ipv4"))
+    {
+        family = AddressFamily::IPv4;
+    }
+    else if (parsed.count("ipv6"))
+    {
+        family = AddressFamily::IPv6;
     }
+    return true;
+}
 
-    // 4) RTT measurement (8 times)
-    std::vector<double> rttSamples;
-    rttSamples.reserve(RTT_EXCHANGES);
+// --affinity is optional on both sides; false (error logged) on a bad list
+bool parseAffinity(const cxxopts::ParseResult& parsed, std::vector<int>& cpus)
+{
+    return !parsed.count("affinity") || parseCpuList(parsed["affinity"].as<std::string>(), cpus);
+}
 
-    for (int i = 0; i < RTT_EXCHANGES; i++)
+// --engine xdp needs -u and --xdp-dev; --xdp-dev / --xdp-queue need it.
+// False (error logged) otherwise.
+bool parseXdpOptions(const cxxopts::ParseResult& parsed, EngineKind engine, std::string& device,
+                     unsigned& queue)
+{
+    if (engine != EngineKind::Xdp)
     {
-        auto sendTime = std::chrono::high_resolution_clock::now();
-
-        char outByte = 'M';
-        if (!sendAll(sockfd, &outByte, ONE_BYTE_SIZE))
+        if (parsed.count("xdp-dev") || parsed.count("xdp-queue"))
         {
-            spdlog::error("RTT measurement: send() failed");
-            close(sockfd);
-            return;
+            spdlog::error("Error: --xdp-dev and --xdp-queue need --engine xdp");
+            return false;
         }
+        return true;
+    }
+    if (!parsed.count("udp") || !parsed.count("xdp-dev"))
+    {
+        spdlog::error("Error: --engine xdp drives -u tests only, on the --xdp-dev interface");
+        return false;
+    }
+    device = parsed["xdp-dev"].as<std::string>();
+    queue = parsed.count("xdp-queue") ? parsed["xdp-queue"].as<unsigned>() : 0;
+    return true;
+}
 
-        char inByte = 0;
-        if (!recvAll(sockfd, &inByte, ONE_BYTE_SIZE))
+// --sndbuf/--rcvbuf/--nodelay/--congestion/--mss/--max-pacing-rate/--tcp-info;
+// false (error logged) on a malformed value. reportSocket: a tuning option was given.
+bool parseSocketTuning(const cxxopts::ParseResult& parsed, SocketTuning& tuning,
+                       bool& reportSocket)
+{
+    auto parseBuffer = [&parsed](const char* name, int& size) {
+        if (!parsed.count(name))
         {
-            spdlog::error("RTT measurement: recv() failed");
-            close(sockfd);
-            return;
+            return true;
         }
-        auto recvTime = std::chrono::high_resolution_clock::now();
-
-        double ms = std::chrono::duration<double, std::milli>(recvTime - sendTime).count();
-        rttSamples.push_back(ms);
+        size_t bytes = 0;
+        if (!parseByteSize(parsed[name].as<std::string>(), bytes) || bytes < 1 ||
+            bytes > MAX_SOCKET_BUFFER)
+        {
+            spdlog::error("Error: --{} must be a size between 1 and {} bytes, e.g. 4M",
+                          name, MAX_SOCKET_BUFFER);
+            return false;
+        }
+        size = static_cast<int>(bytes);
+        return true;
+    };
+    if (!parseBuffer("sndbuf", tuning.sndbuf) || !parseBuffer("rcvbuf", tuning.rcvbuf))
+    {
+        return false;
     }
-
-    // Average of last 4 RTT measurements
-    double avgRTT = 0.0;
-    int n = static_cast<int>(rttSamples.size()); // should be 8
-    if (n > 0)
+    tuning.nodelay = parsed.count("nodelay") > 0;
+    if (parsed.count("congestion"))
     {
-        int startIndex = (n > 4) ? (n - 4) : 0;
-        double sum = 0.0;
-        for (int i = startIndex; i < n; i++)
+        tuning.congestion = parsed["congestion"].as<std::string>();
+        if (tuning.congestion.empty() || tuning.congestion.size() >= MAX_CONGESTION_NAME)
         {
-            sum += rttSamples[i];
+            spdlog::error("Error: --congestion needs an algorithm name, e.g. cubic or bbr");
+            return false;
         }
-        int count = n - startIndex;
-        avgRTT = sum / count;
     }
-    // We'll keep the integer ms
-    int rttMillis = static_cast<int>(std::round(avgRTT));
-    // But also store it in seconds for the throughput correction
-    double avgRTTsec = avgRTT / 1000.0; // convert ms -> sec
-
-    // 5) Data transfer for <durationSeconds>, stop-and-wait
-    std::vector<char> chunk(CHUNK_SIZE, '\0'); // 80KB of zeros
-    long long totalBytesSent = 0;
-    int chunkCount = 0; // how many 80KB chunks we send
-
-    auto dataStart = std::chrono::high_resolution_clock::now();
-    while (true)
+    if (parsed.count("mss"))
     {
-        auto now = std::chrono::high_resolution_clock::now();
-        double elapsed = std::chrono::duration<double>(now - dataStart).count();
-        if (elapsed >= durationSeconds)
+        tuning.mss = parsed["mss"].as<int>();
+        if (tuning.mss < MIN_MSS || tuning.mss > MAX_MSS)
         {
-            break;
+            spdlog::error("Error: --mss must be between {} and {} bytes", MIN_MSS, MAX_MSS);
+            return false;
         }
-
-        // Send 80KB
-        if (!sendAll(sockfd, chunk.data(), CHUNK_SIZE))
+    }
+    if (parsed.count("max-pacing-rate"))
+    {
+        double bitsPerSecond = 0.0;
+        if (!parseBitrate(parsed["max-pacing-rate"].as<std::string>(), bitsPerSecond))
         {
-            spdlog::error("Data transfer: send() failed");
-            break;
+            spdlog::error("Error: --max-pacing-rate must be a positive rate, e.g. 500M");
+            return false;
         }
-        totalBytesSent += CHUNK_SIZE;
-        chunkCount++;
-
-        // Wait for 1-byte ack
-        char ackBuf[ONE_BYTE_SIZE];
-        if (!recvAll(sockfd, ackBuf, ONE_BYTE_SIZE))
+        tuning.maxPacingRate = static_cast<uint64_t>(bitsPerSecond / 8.0);
+    }
+    if (parsed.count("busy-poll"))
+    {
+        tuning.busyPollUs = parsed["busy-poll"].as<int>();
+        if (tuning.busyPollUs < 1 || tuning.busyPollUs > MAX_BUSY_POLL_US)
         {
-            spdlog::error("Data transfer: ack receive failed (server closed?)");
-            break;
+            spdlog::error("Error: --busy-poll must be between 1 and {} microseconds",
+                          MAX_BUSY_POLL_US);
+            return false;
         }
     }
-    auto dataEnd = std::chrono::high_resolution_clock::now();
-
-    close(sockfd);
-
-    // 6) Calculate throughput
-    double dataSeconds = std::chrono::duration<double>(dataEnd - dataStart).count();
-
-    // We now subtract the "RTT overhead" from dataSeconds
-    //   Because each chunk is stop-and-wait, we approximate that
-    //   each chunk costs about 1 average RTT of "waiting" time.
-    //   => total overhead ~ chunkCount * avgRTTsec
-    double netSeconds = dataSeconds - (chunkCount * avgRTTsec);
-    if (netSeconds < 0.0)
+    tuning.preferBusyPoll = parsed.count("prefer-busy-poll") > 0;
+    if (tuning.preferBusyPoll && tuning.busyPollUs == 0)
     {
-        // Just in case it's negative from rounding or very large RTT
-        netSeconds = dataSeconds;
+        spdlog::error("Error: --prefer-busy-poll needs --busy-poll");
+        return false;
     }
+    tuning.tcpInfo = parsed.count("tcp-info") > 0;
+    tuning.fastOpen = parsed.count("fastopen") > 0;
+    reportSocket = parsed.count("sndbuf") || parsed.count("rcvbuf") || tuning.nodelay ||
+                   !tuning.congestion.empty() || tuning.mss > 0 || tuning.maxPacingRate > 0 ||
+                   tuning.busyPollUs > 0;
+    return true;
+}
 
-    // Then we compute throughput using netSeconds
-    double rateMbps = 0.0;
-    if (netSeconds > 0.0)
+// The plain assignment form, -c with -h HOST, -p PORT and -t SECS in any
+// order, read without building the cxxopts table, which costs more than
+// connecting and the control exchange together. false for anything else,
+// including a value cxxopts would reject, which then parses as usual.
+bool parsePlainClient(int argc, char* argv[], std::string& host, int& port, double& seconds)
+{
+    if (argc != 8 || std::strcmp(argv[1], "-c") != 0)
     {
-        rateMbps = (static_cast<double>(totalBytesSent) * 8.0 / netSeconds) / 1e6;
+        return false;
     }
-    long long totalKB = totalBytesSent / 1000LL;
-
-    spdlog::info("Sent={} KB, Rate={:.3f} Mbps, RTT={}ms",
-                 totalKB, rateMbps, rttMillis);
+    bool haveHost = false, havePort = false, haveTime = false;
+    for (int i = 2; i < argc; i += 2)
+    {
+        const char* value = argv[i + 1];
+        const char* end = value + std::strlen(value);
+        if (*value == '\0' || *value == '-')
+        {
+            return false;
+        }
+        if (std::strcmp(argv[i], "-h") == 0 && !haveHost)
+        {
+            host = value;
+            haveHost = true;
+        }
+        else if (std::strcmp(argv[i], "-p") == 0 && !havePort)
+        {
+            auto [ptr, ec] = std::from_chars(value, end, port);
+            if (ec != std::errc() || ptr != end)
+            {
+                return false;
+            }
+            havePort = true;
+        }
+        else if (std::strcmp(argv[i], "-t") == 0 && !haveTime)
+        {
+            auto [ptr, ec] = std::from_chars(value, end, seconds);
+            if (ec != std::errc() || ptr != end || !std::isfinite(seconds))
+            {
+                return false;
+            }
+            haveTime = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-// ===============================================================
-// MAIN - parse arguments, run server or client
-// ===============================================================
 int main(int argc, char* argv[])
 {
+    // The default logger is built on first use; build it here so the
+    // startup timeline charges it to its own phase
+    spdlog::default_logger_raw();
+    markStartup(StartupPhase::Logger);
     if (argc < 4)
     {
         spdlog::error("Error: missing or extra arguments");
         return 1;
     }
 
+    // Every option left at its default, as the cxxopts path below would
+    ClientOptions plain;
+    int plainPort = 0;
+    if (parsePlainClient(argc, argv, plain.hostname, plainPort, plain.durationSeconds))
+    {
+        if (plainPort < 1024 || plainPort > 65535)
+        {
+            spdlog::error("Error: port number must be in the range of [1024, 65535]");
+            return 1;
+        }
+        if (plain.durationSeconds <= 0.0)
+        {
+            spdlog::error("Error: time argument must be greater than 0");
+            return 1;
+        }
+        plain.port = static_cast<unsigned short>(plainPort);
+        if (!initStampClock(ClockSource::Steady))
+        {
+            return 1;
+        }
+        runClient(plain);
+        return 0;
+    }
+
     std::string mode(argv[1]);
 
-    if ((mode == "-s" && argc != 4) || (mode == "-c" && argc != 8))
+    if ((mode == "-s" && argc < 4) || (mode == "-c" && argc < 7))
     {
         spdlog::error("Error: missing or extra arguments");
         return 1;
@@ -411,9 +1638,119 @@ int main(int argc, char* argv[])
             ("h,host", "Server hostname", cxxopts::value<std::string>())
             ("p,port", "Port number (1024 <= port <= 65535)", cxxopts::value<int>())
             ("t,time", "Duration in seconds (must be > 0)", cxxopts::value<double>())
+            ("4,ipv4", "IPv4 only: resolve A records (client) / listen on 0.0.0.0 (server)")
+            ("6,ipv6", "IPv6 only: resolve AAAA records (client) / listen on [::] only (server)")
+            ("w,window", "Chunks in flight before waiting for an ack (client; 1 = stop-and-wait)",
+                cxxopts::value<int>()->default_value(std::to_string(DEFAULT_WINDOW)))
+            ("P,parallel", "Number of parallel streams (client connects / server accepts N; "
+                "a client's control connection overrides the server's)",
+                cxxopts::value<int>()->default_value(std::to_string(DEFAULT_STREAMS)))
+            ("zerocopy", "Client send path: copy, msg (MSG_ZEROCOPY), sendfile or splice; "
+                "also reports CPU time per GB",
+                cxxopts::value<std::string>()->implicit_value("msg"))
+            ("recv-mode", "Server receive path: copy, trunc (MSG_TRUNC discard) or splice "
+                "(to /dev/null); also reports syscall counts",
+                cxxopts::value<std::string>()->default_value("copy"))
+            ("read-size", "Bytes the server asks for per receive call",
+                cxxopts::value<size_t>()->default_value(std::to_string(DEFAULT_READ_SIZE)))
+            ("engine", "I/O engine for the RTT and data phases: blocking, epoll or uring"
+#ifdef IPERFER_AF_XDP
+                "; xdp sends and receives -u datagrams over AF_XDP"
+#endif
+                , cxxopts::value<std::string>()->default_value("blocking"))
+#ifdef IPERFER_AF_XDP
+            ("xdp-dev", "Interface for --engine xdp (both ends)", cxxopts::value<std::string>())
+            ("xdp-queue", "NIC queue for --engine xdp; steer the test's flow to it (default 0)",
+                cxxopts::value<unsigned>())
+#endif
+            ("i,interval", "Report throughput every N seconds during the data phase",
+                cxxopts::value<double>())
+            ("clock", "Clock for the data loop's deadline checks and -i stamps: auto (= steady), "
+                "steady, coarse (CLOCK_MONOTONIC_COARSE) or tsc; totals always use steady_clock",
+                cxxopts::value<std::string>()->default_value("auto"))
+            ("l,len", "Chunk size for the data phase, e.g. 8K or 1M (client; default 80000)",
+                cxxopts::value<std::string>())
+            ("sweep", "Repeat the data phase (-t each) for chunk sizes MIN, 2*MIN, ... MAX "
+                "over one connection (client)",
+                cxxopts::value<std::string>()->implicit_value("1K:16M"))
+            ("R,reverse", "Reverse mode: the server sends and the client receives (client)")
+            ("bidir", "Bidirectional mode: both ends send at once, without acks (client)")
+            ("u,udp", "UDP mode: paced datagrams (client) / loss and jitter accounting (server)")
+            ("b,bitrate", "Target send rate in bits/s, e.g. 100M: -u datagrams (default 1M), "
+                "or a token-bucket pace per TCP stream, both ends' senders (client)",
+                cxxopts::value<std::string>())
+            ("sndbuf", "SO_SNDBUF size, e.g. 4M (default: kernel autotuning)",
+                cxxopts::value<std::string>())
+            ("rcvbuf", "SO_RCVBUF size, e.g. 4M (default: kernel autotuning)",
+                cxxopts::value<std::string>())
+            ("N,nodelay", "Set TCP_NODELAY (disable Nagle)")
+            ("C,congestion", "TCP congestion control, e.g. cubic or bbr",
+                cxxopts::value<std::string>())
+            ("M,mss", "TCP_MAXSEG in bytes", cxxopts::value<int>())
+            ("max-pacing-rate", "SO_MAX_PACING_RATE in bits/s, e.g. 500M",
+                cxxopts::value<std::string>())
+            ("busy-poll", "SO_BUSY_POLL: microseconds to spin on the device queue per blocking "
+                "receive (above net.core.busy_read needs CAP_NET_ADMIN)", cxxopts::value<int>())
+            ("prefer-busy-poll", "SO_PREFER_BUSY_POLL: also defer the device's interrupts "
+                "while busy-polling (Linux 5.11+; needs --busy-poll)")
+            ("affinity", "Pin stream i's thread (and its buffers' NUMA node) to the i-th CPU "
+                "of a list like 0-3,8, wrapping around; also reports per-thread CPU use",
+                cxxopts::value<std::string>())
+            ("tcp-info", "Capture TCP_INFO (cwnd, srtt, retransmits, pacing rate) at every -i "
+                "interval and at the end of the data phase")
+            ("fastopen", "TCP Fast Open: the server accepts data in the SYN, the client's data "
+                "streams send their first bytes in it once they have a cookie")
+            ("addr-cache", "File remembering the address each host was last reached at, so "
+                "later runs skip the resolver and the address race (client)",
+                cxxopts::value<std::string>())
+            ("rtt-count", "Round trips in the RTT phase, agreed over the control connection "
+                "(client; default " + std::to_string(RTT_EXCHANGES) + ")", cxxopts::value<int>())
+            ("profile", "Read perf counters (cycles, instructions, cache misses, context "
+                "switches) and count send/recv calls around the RTT and data phases, and "
+                "report their cost per byte")
+            ("payload", "What the data phase's chunks carry (client, for both ends): zeros, "
+                "random (one pre-generated incompressible chunk) or seq (random with a "
+                "sequence number stamped in each chunk)",
+                cxxopts::value<std::string>()->default_value("zeros"))
+            ("verify", "Receivers check every chunk's CRC32C (and seq stamp) against the "
+                "payload and report bad chunks and the time the checks took (client)")
+            ("json", "Print the results as one JSON document on stdout (logs go to stderr)")
+            ("csv", "Print the results as CSV rows on stdout (logs go to stderr)")
+            ("latency", "Latency mode (client): N timed request/response exchanges "
+                "reported as percentiles, instead of -t",
+                cxxopts::value<long long>())
+            ("msg-size", "Request/response size in bytes for --latency",
+                cxxopts::value<size_t>()->default_value(std::to_string(DEFAULT_MSG_SIZE)))
+            ("rr", "Transaction mode (client): REQ:RESP byte requests and responses, "
+                "e.g. 1:1 or 200:16K, as many as fit in -t, reported as transactions/s "
+                "and latency percentiles", cxxopts::value<std::string>())
+            ("rr-depth", "Requests in flight per --rr connection (default 1)",
+                cxxopts::value<int>())
+            ("crr", "With --rr: a fresh connection for every transaction (client)")
+            ("under-load", "Probe the RTT on a connection of its own every S seconds "
+                "(default 0.01), first idle, then while the streams run, and report how "
+                "much the load inflates it (client)",
+                cxxopts::value<double>()->implicit_value(std::to_string(DEFAULT_PROBE_INTERVAL)))
+            ("repeat", "Run the test N times over one process and control connection (client)",
+                cxxopts::value<int>())
+            ("every", "Seconds from the start of one --repeat run to the next "
+                "(client; default: back to back)", cxxopts::value<double>())
+            ("no-control", "Skip the control connection that negotiates the test and swaps "
+                "results, for servers that only speak the per-stream protocol (client)")
+            ("daemon", "Keep serving clients concurrently until killed (server)")
+            ("workers", "Reactor threads for --daemon, each with its own epoll and "
+                "SO_REUSEPORT socket (default: one per CPU, or per --affinity CPU)",
+                cxxopts::value<int>())
+            ("backlog", "Listen backlog (server)",
+                cxxopts::value<int>()->default_value(std::to_string(BACKLOG)))
             ("help", "Print help");
 
         auto parsed = options.parse(argc, argv);
+        if (!parsed.unmatched().empty())
+        {
+            spdlog::error("Error: missing or extra arguments");
+            return 1;
+        }
 
         if (parsed.count("help") ||
            (!parsed.count("server") && !parsed.count("client")))
@@ -437,30 +1774,537 @@ int main(int argc, char* argv[])
             return 1;
         }
 
+        int streams = parsed["parallel"].as<int>();
+        if (streams < 1)
+        {
+            spdlog::error("Error: parallel stream count must be at least 1");
+            return 1;
+        }
+
+        EngineKind engine = EngineKind::Blocking;
+        if (!parseEngineKind(parsed["engine"].as<std::string>(), engine))
+        {
+            spdlog::error("Error: --engine must be blocking, epoll or uring"
+#ifdef IPERFER_AF_XDP
+                          " (or xdp, with -u)"
+#endif
+                          );
+            return 1;
+        }
+
+        ClockSource clockSource = ClockSource::Steady;
+        if (!parseClockSource(parsed["clock"].as<std::string>(), clockSource))
+        {
+            spdlog::error("Error: --clock must be auto, steady, coarse or tsc");
+            return 1;
+        }
+
         if (isServer)
         {
-            if (parsed.count("host") || parsed.count("time"))
+            if (parsed.count("host") || parsed.count("time") || parsed.count("window") ||
+                parsed.count("zerocopy") || parsed.count("latency") || parsed.count("msg-size") ||
+                parsed.count("rr") || parsed.count("rr-depth") || parsed.count("crr") ||
+                parsed.count("under-load") || parsed.count("addr-cache") ||
+                parsed.count("rtt-count") || parsed.count("len") || parsed.count("sweep") || parsed.count("bitrate") ||
+                parsed.count("reverse") || parsed.count("bidir") || parsed.count("no-control") ||
+                parsed.count("payload") || parsed.count("verify") || parsed.count("repeat") ||
+                parsed.count("every"))
             {
                 spdlog::error("Error: extra arguments provided in server mode.");
                 return 1;
             }
-            runServer(static_cast<unsigned short>(port));
+            ServerOptions opts;
+            opts.port     = static_cast<unsigned short>(port);
+            opts.streams  = streams;
+            opts.backlog  = parsed["backlog"].as<int>();
+            opts.readSize = parsed["read-size"].as<size_t>();
+            if (!parseAddressFamily(parsed, opts.family))
+            {
+                return 1;
+            }
+            if (opts.backlog < 1)
+            {
+                spdlog::error("Error: backlog must be at least 1");
+                return 1;
+            }
+            if (!parseRecvMode(parsed["recv-mode"].as<std::string>(), opts.recvMode))
+            {
+                spdlog::error("Error: --recv-mode must be copy, trunc or splice");
+                return 1;
+            }
+            if (opts.readSize < 1)
+            {
+                spdlog::error("Error: read size must be at least 1 byte");
+                return 1;
+            }
+            opts.engine   = engine;
+            // The clock line is logged, so after --json/--csv moved the log
+            if (!parseInterval(parsed, opts.intervalSeconds) ||
+                !parseOutputFormat(parsed, opts.output) ||
+                !initStampClock(clockSource))
+            {
+                return 1;
+            }
+            opts.reportSyscalls = parsed.count("recv-mode") || parsed.count("read-size");
+            if (!parseSocketTuning(parsed, opts.tuning, opts.reportSocket) ||
+                !parseAffinity(parsed, opts.cpus))
+            {
+                return 1;
+            }
+            opts.reportThreads = !opts.cpus.empty() || opts.tuning.busyPollUs > 0;
+            opts.profile = parsed.count("profile") > 0;
+            if (!parseXdpOptions(parsed, engine, opts.xdpDevice, opts.xdpQueue))
+            {
+                return 1;
+            }
+            if (engine != EngineKind::Blocking && opts.recvMode != RecvMode::Copy)
+            {
+                spdlog::error("Error: --recv-mode {} needs the blocking engine",
+                              recvModeName(opts.recvMode));
+                return 1;
+            }
+            if (parsed.count("workers") && !parsed.count("daemon"))
+            {
+                spdlog::error("Error: --workers only applies to --daemon");
+                return 1;
+            }
+            if (parsed.count("udp"))
+            {
+                if (parsed.count("daemon") || parsed.count("parallel") ||
+                    (parsed.count("engine") && engine != EngineKind::Xdp) ||
+                    parsed.count("recv-mode") || parsed.count("read-size") ||
+                    parsed.count("interval") || parsed.count("profile"))
+                {
+                    spdlog::error("Error: -u takes no --daemon, --parallel, --engine (but xdp), "
+                                  "--recv-mode, --read-size, --interval or --profile");
+                    return 1;
+                }
+                if (opts.tuning.tcpOnly() || opts.tuning.tcpInfo)
+                {
+                    spdlog::error("Error: --nodelay, --congestion, --mss, --fastopen and "
+                                  "--tcp-info are TCP options");
+                    return 1;
+                }
+                opts.udp = true;
+                runServerUdp(opts);
+            }
+            else if (parsed.count("daemon"))
+            {
+                if (parsed.count("parallel"))
+                {
+                    spdlog::error("Error: --parallel does not apply to --daemon; "
+                                  "every connection is served on its own");
+                    return 1;
+                }
+                if (parsed.count("engine") || parsed.count("interval") ||
+                    opts.output != OutputFormat::Text || opts.tuning.tcpInfo ||
+                    parsed.count("profile"))
+                {
+                    spdlog::error("Error: --engine, --interval, --json, --csv, --tcp-info and "
+                                  "--profile do not apply to --daemon; it runs its own epoll "
+                                  "loop");
+                    return 1;
+                }
+                if (parsed.count("workers"))
+                {
+                    opts.workers = parsed["workers"].as<int>();
+                    if (opts.workers < 1)
+                    {
+                        spdlog::error("Error: --workers must be at least 1");
+                        return 1;
+                    }
+                }
+                runDaemon(opts); // pins each worker itself
+            }
+            else
+            {
+                runServer(opts);
+            }
         }
         else if (isClient)
         {
-            if (!parsed.count("host") || !parsed.count("time"))
+            if (parsed.count("daemon") || parsed.count("backlog") ||
+                parsed.count("recv-mode") || parsed.count("read-size") || parsed.count("workers"))
+            {
+                spdlog::error("Error: --daemon, --backlog, --recv-mode, --read-size and "
+                              "--workers are server options.");
+                return 1;
+            }
+            bool latency = parsed.count("latency") > 0;
+            if (!parsed.count("host") || (!parsed.count("time") && !latency))
             {
                 spdlog::error("Error: missing required -h <host> or -t <time> arguments.");
                 return 1;
             }
             std::string hostname = parsed["host"].as<std::string>();
-            double duration = parsed["time"].as<double>();
-            if (duration <= 0.0)
+            double duration = 0.0;
+            if (latency)
+            {
+                if (parsed.count("time") || parsed.count("window") || parsed.count("zerocopy") ||
+                    parsed.count("interval") || parsed.count("len") || parsed.count("sweep") ||
+                    parsed.count("payload") || parsed.count("verify"))
+                {
+                    spdlog::error("Error: --latency does not take -t, --window, --zerocopy, "
+                                  "--interval, -l, --sweep, --payload or --verify");
+                    return 1;
+                }
+            }
+            else
+            {
+                duration = parsed["time"].as<double>();
+                if (duration <= 0.0)
+                {
+                    spdlog::error("Error: time argument must be greater than 0");
+                    return 1;
+                }
+                if (parsed.count("msg-size"))
+                {
+                    spdlog::error("Error: --msg-size only applies to --latency");
+                    return 1;
+                }
+            }
+            int window = parsed["window"].as<int>();
+            if (window < 1)
+            {
+                spdlog::error("Error: window must be at least 1");
+                return 1;
+            }
+            ClientOptions opts;
+            opts.hostname        = hostname;
+            opts.port            = static_cast<unsigned short>(port);
+            opts.durationSeconds = duration;
+            opts.window          = window;
+            opts.streams         = streams;
+            opts.control         = !parsed.count("no-control");
+            if (opts.control && streams > MAX_CONTROL_STREAMS)
+            {
+                spdlog::error("Error: at most {} parallel streams with a control connection",
+                              MAX_CONTROL_STREAMS);
+                return 1;
+            }
+            if (!parseAddressFamily(parsed, opts.family) ||
+                !parseInterval(parsed, opts.intervalSeconds) ||
+                !parseOutputFormat(parsed, opts.output) ||
+                !parseSocketTuning(parsed, opts.tuning, opts.reportSocket) ||
+                !parseAffinity(parsed, opts.cpus) ||
+                !initStampClock(clockSource))
+            {
+                return 1;
+            }
+            opts.reportThreads = !opts.cpus.empty() || opts.tuning.busyPollUs > 0;
+            if (latency && opts.tuning.tcpInfo)
+            {
+                spdlog::error("Error: --tcp-info only applies to the throughput data phase");
+                return 1;
+            }
+            if (latency)
+            {
+                opts.latencyCount = parsed["latency"].as<long long>();
+                opts.msgSize      = parsed["msg-size"].as<size_t>();
+                if (opts.latencyCount < 1)
+                {
+                    spdlog::error("Error: --latency needs at least 1 exchange");
+                    return 1;
+                }
+                if (opts.msgSize < 1 || opts.msgSize > MAX_MSG_SIZE)
+                {
+                    spdlog::error("Error: --msg-size must be between 1 and {} bytes",
+                                  MAX_MSG_SIZE);
+                    return 1;
+                }
+            }
+            if (parsed.count("rr-depth") || parsed.count("crr"))
+            {
+                if (!parsed.count("rr"))
+                {
+                    spdlog::error("Error: --rr-depth and --crr need --rr");
+                    return 1;
+                }
+            }
+            if (parsed.count("rr"))
+            {
+                if (latency || parsed.count("window") || parsed.count("zerocopy") ||
+                    parsed.count("interval") || parsed.count("len") || parsed.count("sweep") ||
+                    parsed.count("reverse") || parsed.count("bidir") || parsed.count("payload") ||
+                    parsed.count("verify") || parsed.count("bitrate") || parsed.count("udp") ||
+                    opts.tuning.tcpInfo)
+                {
+                    spdlog::error("Error: --rr takes no --latency, --window, --zerocopy, "
+                                  "--interval, -l, --sweep, -R, --bidir, --payload, --verify, "
+                                  "-b, -u or --tcp-info");
+                    return 1;
+                }
+                std::string spec = parsed["rr"].as<std::string>();
+                size_t colon = spec.find(':');
+                if (colon == std::string::npos ||
+                    !parseByteSize(spec.substr(0, colon), opts.rr.requestSize) ||
+                    !parseByteSize(spec.substr(colon + 1), opts.rr.responseSize) ||
+                    opts.rr.requestSize < 1 || opts.rr.requestSize > MAX_MSG_SIZE ||
+                    opts.rr.responseSize < 1 || opts.rr.responseSize > MAX_MSG_SIZE)
+                {
+                    spdlog::error("Error: --rr takes REQ:RESP sizes between 1 and {} bytes, "
+                                  "e.g. 1:1 or 200:16K", MAX_MSG_SIZE);
+                    return 1;
+                }
+                if (parsed.count("rr-depth"))
+                {
+                    opts.rr.depth = parsed["rr-depth"].as<int>();
+                }
+                size_t inFlight = static_cast<size_t>(std::max(opts.rr.depth, 1)) *
+                                  (opts.rr.requestSize + opts.rr.responseSize);
+                if (opts.rr.depth < 1 || opts.rr.depth > MAX_RR_DEPTH ||
+                    inFlight > MAX_RR_IN_FLIGHT)
+                {
+                    spdlog::error("Error: --rr-depth must be between 1 and {}, with depth x "
+                                  "(REQ + RESP) at most {} bytes", MAX_RR_DEPTH, MAX_RR_IN_FLIGHT);
+                    return 1;
+                }
+                if (parsed.count("crr"))
+                {
+                    if (!opts.control || opts.rr.depth != 1 || parsed.count("engine"))
+                    {
+                        spdlog::error("Error: --crr needs the control connection and takes "
+                                      "no --rr-depth, --no-control or --engine");
+                        return 1;
+                    }
+                    opts.crr = true;
+                    opts.rr.perConnection = 1;
+                }
+            }
+            if (!parseXdpOptions(parsed, engine, opts.xdpDevice, opts.xdpQueue))
+            {
+                return 1;
+            }
+            if (parsed.count("udp"))
+            {
+                if (latency || parsed.count("window") || parsed.count("parallel") ||
+                    parsed.count("zerocopy") ||
+                    (parsed.count("engine") && engine != EngineKind::Xdp) ||
+                    parsed.count("interval") || parsed.count("sweep") ||
+                    parsed.count("reverse") || parsed.count("bidir") || parsed.count("no-control") ||
+                    parsed.count("payload") || parsed.count("verify") || parsed.count("repeat") ||
+                    parsed.count("every") || parsed.count("under-load") ||
+                    parsed.count("profile"))
+                {
+                    spdlog::error("Error: -u takes no --latency, --window, --parallel, "
+                                  "--zerocopy, --engine (but xdp), --interval, --sweep, -R, --bidir, "
+                                  "--no-control, --payload, --verify, --repeat, --every, "
+                                  "--under-load or --profile");
+                    return 1;
+                }
+                if (opts.tuning.tcpOnly() || opts.tuning.tcpInfo)
+                {
+                    spdlog::error("Error: --nodelay, --congestion, --mss, --fastopen and "
+                                  "--tcp-info are TCP options");
+                    return 1;
+                }
+                opts.udp = true;
+                opts.bitrate = DEFAULT_UDP_BITRATE;
+                if (parsed.count("bitrate") &&
+                    !parseBitrate(parsed["bitrate"].as<std::string>(), opts.bitrate))
+                {
+                    spdlog::error("Error: -b must be a positive rate, e.g. 500K, 100M or 1G");
+                    return 1;
+                }
+                if (parsed.count("len") &&
+                    (!parseByteSize(parsed["len"].as<std::string>(), opts.datagramSize) ||
+                     opts.datagramSize < UDP_HEADER_SIZE || opts.datagramSize > MAX_DATAGRAM_SIZE))
+                {
+                    spdlog::error("Error: -l with -u must be between {} and {} bytes",
+                                  UDP_HEADER_SIZE, MAX_DATAGRAM_SIZE);
+                    return 1;
+                }
+                opts.engine = engine;
+                runClient(opts);
+                return 0;
+            }
+            if (parsed.count("repeat"))
+            {
+                opts.repeat = parsed["repeat"].as<int>();
+                if (opts.repeat < 1)
+                {
+                    spdlog::error("Error: --repeat must be at least 1");
+                    return 1;
+                }
+                if (!opts.control)
+                {
+                    spdlog::error("Error: --repeat runs every test over the control "
+                                  "connection; drop --no-control");
+                    return 1;
+                }
+            }
+            if (parsed.count("every"))
+            {
+                opts.everySeconds = parsed["every"].as<double>();
+                if (!parsed.count("repeat") || opts.everySeconds <= 0.0)
+                {
+                    spdlog::error("Error: --every takes a gap greater than 0 and needs --repeat");
+                    return 1;
+                }
+            }
+            if (parsed.count("reverse") || parsed.count("bidir"))
+            {
+                if (parsed.count("reverse") && parsed.count("bidir"))
+                {
+                    spdlog::error("Error: -R and --bidir are mutually exclusive");
+                    return 1;
+                }
+                if (latency || parsed.count("udp") || parsed.count("len") ||
+                    parsed.count("sweep") || parsed.count("zerocopy"))
+                {
+                    spdlog::error("Error: -R and --bidir take no --latency, -u, -l, --sweep "
+                                  "or --zerocopy");
+                    return 1;
+                }
+                if (parsed.count("bidir") && parsed.count("window"))
+                {
+                    spdlog::error("Error: --bidir sends without acks, so --window does not apply");
+                    return 1;
+                }
+                opts.direction = parsed.count("reverse") ? Direction::Reverse : Direction::Bidir;
+            }
+            if (parsed.count("len") && parsed.count("sweep"))
+            {
+                spdlog::error("Error: -l and --sweep are mutually exclusive");
+                return 1;
+            }
+            if (parsed.count("len"))
+            {
+                size_t len = 0;
+                if (!parseByteSize(parsed["len"].as<std::string>(), len) ||
+                    len < 1 || len > MAX_CHUNK_SIZE)
+                {
+                    spdlog::error("Error: -l must be a size between 1 and {} bytes", MAX_CHUNK_SIZE);
+                    return 1;
+                }
+                opts.chunkSizes.push_back(len);
+            }
+            if (parsed.count("sweep"))
+            {
+                size_t minSize = 0;
+                size_t maxSize = 0;
+                if (!parseSweepRange(parsed["sweep"].as<std::string>(), minSize, maxSize))
+                {
+                    spdlog::error("Error: --sweep takes MIN:MAX sizes (e.g. 1K:16M), "
+                                  "MIN <= MAX <= {} bytes", MAX_CHUNK_SIZE);
+                    return 1;
+                }
+                opts.chunkSizes = sweepSizes(minSize, maxSize);
+            }
+            if (parsed.count("zerocopy"))
+            {
+                if (!parseZeroCopyMode(parsed["zerocopy"].as<std::string>(), opts.zerocopy))
+                {
+                    spdlog::error("Error: --zerocopy must be copy, msg, sendfile or splice");
+                    return 1;
+                }
+                opts.reportCpu = true;
+            }
+            if (!parsePayloadPattern(parsed["payload"].as<std::string>(), opts.payload))
+            {
+                spdlog::error("Error: --payload must be zeros, random or seq");
+                return 1;
+            }
+            opts.verify = parsed.count("verify") > 0;
+            bool stamped = opts.payload == PayloadPattern::Sequence;
+            if (!opts.chunkSizes.empty() && (opts.verify || stamped))
+            {
+                spdlog::error("Error: --verify and --payload seq apply to the timed data "
+                              "phase, not -l or --sweep");
+                return 1;
+            }
+            if (stamped && opts.zerocopy != ZeroCopyMode::Copy)
+            {
+                spdlog::error("Error: --payload seq stamps every chunk as it is sent, "
+                              "which needs --zerocopy copy");
+                return 1;
+            }
+            // Without the control connection the server sends zeros and checks nothing
+            if (!opts.control &&
+                (opts.verify || (opts.payload != PayloadPattern::Zeros &&
+                                 opts.direction != Direction::Forward)))
+            {
+                spdlog::error("Error: --verify and a server-sent --payload are agreed over "
+                              "the control connection; drop --no-control");
+                return 1;
+            }
+            if (parsed.count("bitrate"))
+            {
+                if (latency || !opts.chunkSizes.empty())
+                {
+                    spdlog::error("Error: -b paces the timed data phase, not --latency, -l "
+                                  "or --sweep");
+                    return 1;
+                }
+                if (!parseBitrate(parsed["bitrate"].as<std::string>(), opts.bitrate))
+                {
+                    spdlog::error("Error: -b must be a positive rate, e.g. 500K, 100M or 1G");
+                    return 1;
+                }
+                // The server only paces its own sends if the control connection says so
+                if (!opts.control && opts.direction != Direction::Forward)
+                {
+                    spdlog::error("Error: -b with -R or --bidir is agreed over the control "
+                                  "connection; drop --no-control");
+                    return 1;
+                }
+            }
+            if (parsed.count("rtt-count"))
+            {
+                opts.rttExchanges = parsed["rtt-count"].as<int>();
+                if (latency || opts.rr.requestSize > 0 || opts.rttExchanges < 1 ||
+                    opts.rttExchanges > MAX_RTT_EXCHANGES)
+                {
+                    spdlog::error("Error: --rtt-count must be between 1 and {}, and --latency "
+                                  "and --rr have no RTT phase", MAX_RTT_EXCHANGES);
+                    return 1;
+                }
+                if (!opts.control)
+                {
+                    spdlog::error("Error: --rtt-count is agreed over the control connection; "
+                                  "drop --no-control");
+                    return 1;
+                }
+            }
+            if (parsed.count("profile"))
+            {
+                if (latency || opts.rr.requestSize > 0)
+                {
+                    spdlog::error("Error: --profile covers the RTT and data phases, which "
+                                  "--latency and --rr do not have");
+                    return 1;
+                }
+                opts.profile = true;
+            }
+            if (parsed.count("addr-cache"))
+            {
+                opts.addrCache = parsed["addr-cache"].as<std::string>();
+            }
+            if (parsed.count("under-load"))
+            {
+                opts.probeInterval = parsed["under-load"].as<double>();
+                if (latency || opts.rr.requestSize > 0 || opts.probeInterval <= 0.0)
+                {
+                    spdlog::error("Error: --under-load takes an interval greater than 0 and "
+                                  "probes the data phase, not --latency or --rr");
+                    return 1;
+                }
+                // The server has to know to accept the probe after the streams
+                if (!opts.control)
+                {
+                    spdlog::error("Error: --under-load's probe connection is agreed over the "
+                                  "control connection; drop --no-control");
+                    return 1;
+                }
+            }
+            opts.engine = engine;
+            if (engine != EngineKind::Blocking && opts.zerocopy != ZeroCopyMode::Copy)
             {
-                spdlog::error("Error: time argument must be greater than 0");
+                spdlog::error("Error: --zerocopy={} needs the blocking engine",
+                              zeroCopyModeName(opts.zerocopy));
                 return 1;
             }
-            runClient(hostname, static_cast<unsigned short>(port), duration);
+            runClient(opts);
         }
     }
     catch (const std::exception& e)
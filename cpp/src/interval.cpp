@@ -0,0 +1,119 @@
+#include "interval.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+// How often the reporter looks at the rings; well under any sensible -i
+const auto POLL_PERIOD = std::chrono::milliseconds(10);
+
+double rateMbps(const IntervalSample& s)
+{
+    double seconds = s.end - s.start;
+    return seconds > 0.0 ? (static_cast<double>(s.bytes) * 8.0 / seconds) / 1e6 : 0.0;
+}
+
+} // namespace
+
+IntervalReporter::IntervalReporter(int streams, double intervalSeconds, const char* verb)
+    : interval_(intervalSeconds),
+      verb_(verb),
+      samples_(streams)
+{
+    rings_.reserve(streams);
+    for (int i = 0; i < streams; i++)
+    {
+        rings_.push_back(std::make_unique<IntervalRing>());
+    }
+    thread_ = std::thread(&IntervalReporter::run, this);
+}
+
+IntervalReporter::~IntervalReporter()
+{
+    stop();
+}
+
+void IntervalReporter::stop()
+{
+    if (!thread_.joinable())
+    {
+        return;
+    }
+    stopping_.store(true, std::memory_order_release);
+    thread_.join();
+
+    // Streams that ended early never complete the later sums; print what there is
+    for (const Pending& p : sums_)
+    {
+        if (p.reported > 0 && p.reported < static_cast<int>(rings_.size()))
+        {
+            spdlog::info("[SUM] {:.2f}-{:.2f} sec {}={} KB, Rate={:.3f} Mbps, Streams={}",
+                         p.sum.start, p.sum.end, verb_, p.sum.bytes / 1000LL,
+                         rateMbps(p.sum), p.reported);
+        }
+    }
+}
+
+void IntervalReporter::run()
+{
+    while (!stopping_.load(std::memory_order_acquire))
+    {
+        drain();
+        std::this_thread::sleep_for(POLL_PERIOD);
+    }
+    drain(); // producers are done by the time stop() is called
+}
+
+void IntervalReporter::drain()
+{
+    const int streams = static_cast<int>(rings_.size());
+    IntervalSample s;
+    for (int i = 0; i < streams; i++)
+    {
+        while (rings_[i]->pop(s))
+        {
+            samples_[i].push_back(s);
+            std::string ackWait;
+            if (s.ackWaits > 0)
+            {
+                ackWait = fmt::format(", AckWait={:.3f}ms",
+                                      s.ackWaitSeconds * 1000.0 / s.ackWaits);
+            }
+            ackWait += formatTcpInfo(s.tcpInfo);
+            if (streams == 1)
+            {
+                spdlog::info("{:.2f}-{:.2f} sec {}={} KB, Rate={:.3f} Mbps{}",
+                             s.start, s.end, verb_, s.bytes / 1000LL, rateMbps(s), ackWait);
+                continue;
+            }
+            spdlog::info("[stream {}] {:.2f}-{:.2f} sec {}={} KB, Rate={:.3f} Mbps{}",
+                         i, s.start, s.end, verb_, s.bytes / 1000LL, rateMbps(s), ackWait);
+
+            if (s.index >= static_cast<int>(sums_.size()))
+            {
+                sums_.resize(s.index + 1);
+            }
+            Pending& p = sums_[s.index];
+            if (p.reported == 0)
+            {
+                p.sum = s;
+            }
+            else
+            {
+                p.sum.start = std::min(p.sum.start, s.start);
+                p.sum.end = std::max(p.sum.end, s.end);
+                p.sum.bytes += s.bytes;
+            }
+            if (++p.reported == streams)
+            {
+                spdlog::info("[SUM] {:.2f}-{:.2f} sec {}={} KB, Rate={:.3f} Mbps",
+                             p.sum.start, p.sum.end, verb_, p.sum.bytes / 1000LL,
+                             rateMbps(p.sum));
+            }
+        }
+    }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "sockopt.hpp"
+
+// Bounded single-producer/single-consumer queue. The producer only writes
+// tail_ and the consumer only writes head_, so neither side ever blocks or
+// takes a lock; push() simply fails when the consumer has fallen behind.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(const T& item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        slots_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = slots_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots_[Capacity];
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// Counters for one stream over one reporting interval
+struct IntervalSample
+{
+    int index = 0;        // interval number, 0-based
+    double start = 0.0;   // seconds since the data phase began
+    double end = 0.0;
+    long long bytes = 0;
+    double ackWaitSeconds = 0.0; // client: time blocked on acks
+    unsigned long ackWaits = 0;
+    TcpInfoSnapshot tcpInfo; // --tcp-info: taken as the interval closes
+};
+
+static const size_t INTERVAL_RING_SIZE = 256; // per stream; ~4 min of 1s reports
+
+using IntervalRing = SpscRing<IntervalSample, INTERVAL_RING_SIZE>;
+
+// -i reporting: every stream's data loop pushes one sample per interval into
+// its own ring, and a background thread formats them, so spdlog never runs
+// in a send/receive loop. Per-stream lines are printed when there is more
+// than one stream, and a [SUM] line once every stream has reported.
+class IntervalReporter
+{
+public:
+    IntervalReporter(int streams, double intervalSeconds, const char* verb);
+    ~IntervalReporter();
+
+    double intervalSeconds() const { return interval_; }
+    IntervalRing& ring(int stream) { return *rings_[stream]; }
+
+    // Every sample a stream reported; only valid after stop()
+    const std::vector<IntervalSample>& samples(int stream) const { return samples_[stream]; }
+
+    // Drain whatever is left and join the reporter thread
+    void stop();
+
+private:
+    void run();
+    void drain();
+
+    struct Pending
+    {
+        int reported = 0;
+        IntervalSample sum;
+    };
+
+    const double interval_;
+    const char* verb_;
+    std::vector<std::unique_ptr<IntervalRing>> rings_;
+    std::vector<Pending> sums_; // indexed by interval number, reporter thread only
+    std::vector<std::vector<IntervalSample>> samples_; // per stream, reporter thread only
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+// Producer side for one stream. A meter built without a reporter does nothing.
+class IntervalMeter
+{
+public:
+    IntervalMeter(IntervalReporter* reporter, int stream)
+        : ring_(reporter ? &reporter->ring(stream) : nullptr),
+          interval_(reporter ? reporter->intervalSeconds() : 0.0),
+          nextEnd_(interval_)
+    {
+    }
+
+    bool enabled() const { return ring_ != nullptr; }
+
+    // --tcp-info: snapshot TCP_INFO on sockfd at the end of every interval
+    void watchSocket(int sockfd) { sockfd_ = sockfd; }
+
+    // elapsed: seconds since the data phase began
+    void add(long long bytes, double elapsed)
+    {
+        if (ring_ == nullptr)
+        {
+            return;
+        }
+        current_.bytes += bytes;
+        if (elapsed >= nextEnd_)
+        {
+            emit(elapsed);
+        }
+    }
+
+    void addAckWait(double seconds)
+    {
+        current_.ackWaitSeconds += seconds;
+        current_.ackWaits++;
+    }
+
+    // The last, usually partial, interval
+    void finish(double elapsed)
+    {
+        if (ring_ != nullptr && elapsed > current_.start)
+        {
+            emit(elapsed);
+        }
+    }
+
+private:
+    void emit(double elapsed)
+    {
+        current_.index = static_cast<int>((current_.start + 1e-9) / interval_);
+        current_.end = elapsed;
+        if (sockfd_ >= 0)
+        {
+            readTcpInfo(sockfd_, current_.tcpInfo);
+        }
+        ring_->push(current_); // a full ring means the reporter is stalled; drop
+        IntervalSample next;
+        next.start = elapsed;
+        current_ = next;
+        while (nextEnd_ <= elapsed)
+        {
+            nextEnd_ += interval_;
+        }
+    }
+
+    IntervalRing* ring_;
+    double interval_;
+    double nextEnd_;
+    int sockfd_ = -1;
+    IntervalSample current_;
+};
@@ -0,0 +1,291 @@
+#include "io_engine.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "uring_engine.hpp"
+
+bool parseEngineKind(const std::string& name, EngineKind& kind)
+{
+    if (name == "blocking")
+    {
+        kind = EngineKind::Blocking;
+    }
+    else if (name == "epoll")
+    {
+        kind = EngineKind::Epoll;
+    }
+    else if (name == "uring")
+    {
+        kind = EngineKind::Uring;
+    }
+#ifdef IPERFER_AF_XDP
+    else if (name == "xdp")
+    {
+        kind = EngineKind::Xdp;
+    }
+#endif
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void logIoError(const char* call, int err)
+{
+    spdlog::error("{} failed: {}", call, strerror(err));
+}
+
+const char* engineKindName(EngineKind kind)
+{
+    switch (kind)
+    {
+        case EngineKind::Blocking: return "blocking";
+        case EngineKind::Epoll:    return "epoll";
+        case EngineKind::Uring:    return "uring";
+        case EngineKind::Xdp:      return "xdp";
+    }
+    return "?";
+}
+
+namespace
+{
+
+class BlockingEngine : public IoEngine
+{
+public:
+    EngineKind kind() const override { return EngineKind::Blocking; }
+
+    bool sendAll(int fd, const char* buf, size_t len) override
+    {
+        size_t totalSent = 0;
+        while (totalSent < len)
+        {
+            syscalls_++;
+            counts_.sends++;
+            ssize_t sent = send(fd, buf + totalSent, len - totalSent, 0);
+            if (sent < 0)
+            {
+                logIoError("send()", errno);
+                return false;
+            }
+            if (sent == 0)
+            {
+                // Connection closed unexpectedly
+                return false;
+            }
+            totalSent += sent;
+            counts_.shortSends += totalSent < len;
+        }
+        return true;
+    }
+
+    bool recvAll(int fd, char* buf, size_t len) override
+    {
+        size_t totalRecv = 0;
+        while (totalRecv < len)
+        {
+            ssize_t r = recvSome(fd, buf + totalRecv, len - totalRecv);
+            if (r <= 0)
+            {
+                // Connection closed or error (already logged)
+                return false;
+            }
+            totalRecv += r;
+            counts_.shortRecvs += totalRecv < len;
+        }
+        return true;
+    }
+
+    ssize_t recvSome(int fd, char* buf, size_t len) override
+    {
+        syscalls_++;
+        counts_.recvs++;
+        ssize_t r = recv(fd, buf, len, 0);
+        if (r < 0)
+        {
+            logIoError("recv()", errno);
+        }
+        return r;
+    }
+};
+
+// Edge-triggered registration for both directions, done once in attach();
+// every EAGAIN is followed by an epoll_wait() for the direction we need
+class EpollEngine : public IoEngine
+{
+public:
+    ~EpollEngine() override
+    {
+        if (epfd_ >= 0)
+        {
+            close(epfd_);
+        }
+    }
+
+    EngineKind kind() const override { return EngineKind::Epoll; }
+
+    bool init()
+    {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0)
+        {
+            spdlog::error("epoll_create1() failed: {}", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool attach(int fd) override
+    {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        {
+            spdlog::error("fcntl(O_NONBLOCK) failed: {}", strerror(errno));
+            return false;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            spdlog::error("epoll_ctl() failed: {}", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool sendAll(int fd, const char* buf, size_t len) override
+    {
+        size_t totalSent = 0;
+        while (totalSent < len)
+        {
+            syscalls_++;
+            counts_.sends++;
+            ssize_t sent = send(fd, buf + totalSent, len - totalSent, 0);
+            if (sent < 0)
+            {
+                if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(EPOLLOUT))
+                {
+                    continue;
+                }
+                logIoError("send()", errno);
+                return false;
+            }
+            if (sent == 0)
+            {
+                return false;
+            }
+            totalSent += sent;
+            counts_.shortSends += totalSent < len;
+        }
+        return true;
+    }
+
+    bool recvAll(int fd, char* buf, size_t len) override
+    {
+        size_t totalRecv = 0;
+        while (totalRecv < len)
+        {
+            ssize_t r = recvSome(fd, buf + totalRecv, len - totalRecv);
+            if (r <= 0)
+            {
+                return false;
+            }
+            totalRecv += r;
+            counts_.shortRecvs += totalRecv < len;
+        }
+        return true;
+    }
+
+    ssize_t recvSome(int fd, char* buf, size_t len) override
+    {
+        while (true)
+        {
+            syscalls_++;
+            counts_.recvs++;
+            ssize_t r = recv(fd, buf, len, 0);
+            if (r >= 0)
+            {
+                return r;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(EPOLLIN))
+            {
+                continue;
+            }
+            logIoError("recv()", errno);
+            return r;
+        }
+    }
+
+private:
+    // Block until the (single) attached socket reports `want`, or an error/hangup,
+    // which the retried call will then surface
+    bool waitFor(uint32_t want)
+    {
+        epoll_event events[4];
+        while (true)
+        {
+            syscalls_++;
+            int n = epoll_wait(epfd_, events, 4, -1);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                spdlog::error("epoll_wait() failed: {}", strerror(errno));
+                return false;
+            }
+            for (int i = 0; i < n; i++)
+            {
+                if (events[i].events & (want | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    int epfd_ = -1;
+};
+
+} // namespace
+
+std::unique_ptr<IoEngine> makeIoEngine(EngineKind kind)
+{
+    switch (kind)
+    {
+        case EngineKind::Blocking:
+            return std::make_unique<BlockingEngine>();
+        case EngineKind::Epoll:
+        {
+            auto engine = std::make_unique<EpollEngine>();
+            if (!engine->init())
+            {
+                return nullptr;
+            }
+            return engine;
+        }
+        case EngineKind::Uring:
+        {
+            auto engine = std::make_unique<UringEngine>();
+            if (!engine->init())
+            {
+                return nullptr;
+            }
+            return engine;
+        }
+        case EngineKind::Xdp:
+            // Datagrams only; udp.cpp drives the AF_XDP socket itself
+            spdlog::error("The xdp engine only drives -u tests");
+            return nullptr;
+    }
+    return nullptr;
+}
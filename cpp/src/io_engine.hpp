@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// Which syscall machinery drives the RTT and data phases (--engine)
+enum class EngineKind
+{
+    Blocking, // blocking send()/recv(), one syscall per partial transfer
+    Epoll,    // non-blocking socket, epoll_wait() whenever it would block
+    Uring,    // io_uring: fixed send buffer, multishot recv into a provided buffer ring
+    Xdp,      // AF_XDP, for -u only (af_xdp.hpp); parsed with -DIPERFER_AF_XDP=ON
+};
+
+bool parseEngineKind(const std::string& name, EngineKind& kind);
+const char* engineKindName(EngineKind kind);
+
+// Send and receive calls an engine has made (--profile). A short transfer
+// is one inside sendAll()/recvAll() that moved less than was left, so the
+// loop had to go round again.
+struct IoCounts
+{
+    unsigned long sends = 0;
+    unsigned long recvs = 0;
+    unsigned long shortSends = 0;
+    unsigned long shortRecvs = 0;
+};
+
+// Socket I/O used by the client and server phases. One engine per thread;
+// none of them is safe to share between threads.
+class IoEngine
+{
+public:
+    virtual ~IoEngine() = default;
+
+    virtual EngineKind kind() const = 0;
+
+    // Prepare a connected socket for this engine (e.g. switch to non-blocking)
+    virtual bool attach(int fd) { (void)fd; return true; }
+
+    // Transfer exactly len bytes; false on error or if the peer closed
+    virtual bool sendAll(int fd, const char* buf, size_t len) = 0;
+    virtual bool recvAll(int fd, char* buf, size_t len) = 0;
+
+    // A single receive of up to len bytes: > 0 bytes, 0 on close, < 0 on error
+    virtual ssize_t recvSome(int fd, char* buf, size_t len) = 0;
+
+    // recvSome() for payload nobody reads. scratch (len bytes) may be unused
+    // when the engine can land the data in buffers of its own.
+    virtual ssize_t recvDiscard(int fd, char* scratch, size_t len)
+    {
+        return recvSome(fd, scratch, len);
+    }
+
+    // Hint that buf will be sent over and over (io_uring pins it as a fixed buffer)
+    virtual void registerSendBuffer(const char* buf, size_t len) { (void)buf; (void)len; }
+
+    // Syscalls this engine has made so far
+    unsigned long syscalls() const { return syscalls_; }
+    const IoCounts& counts() const { return counts_; }
+
+protected:
+    unsigned long syscalls_ = 0;
+    IoCounts counts_;
+};
+
+// nullptr (error logged) if the kernel lacks what the engine needs
+std::unique_ptr<IoEngine> makeIoEngine(EngineKind kind);
+
+// "send() failed: <err>" for the engines' transfer loops, kept out of line
+// (and cold) so the formatting code stays out of them
+__attribute__((cold, noinline)) void logIoError(const char* call, int err);
@@ -0,0 +1,401 @@
+#include "latency.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "io_engine.hpp"
+
+namespace
+{
+
+const uint64_t SUB_BUCKETS = 1ULL << LatencyHistogram::SUB_BUCKET_BITS;
+
+// One block of SUB_BUCKETS per possible leading-bit position above the exact range
+const size_t BUCKET_COUNT = (65 - LatencyHistogram::SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+// Every request is one write, so Nagle would hold back the second half of a
+// request that spans segments until the first is acked
+void setNoDelay(int sockfd)
+{
+    int on = 1;
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+    {
+        spdlog::debug("TCP_NODELAY: {}", strerror(errno));
+    }
+}
+
+const size_t RR_HELLO_SIZE = 1 + 3 * sizeof(uint32_t);
+
+bool sendTransactionHello(IoEngine& io, int sockfd, const TransactionSpec& spec)
+{
+    char hello[RR_HELLO_SIZE];
+    hello[0] = RR_HELLO;
+    uint32_t words[3] = {htonl(static_cast<uint32_t>(spec.requestSize)),
+                         htonl(static_cast<uint32_t>(spec.responseSize)),
+                         htonl(spec.perConnection)};
+    std::memcpy(hello + 1, words, sizeof(words));
+    return io.sendAll(sockfd, hello, sizeof(hello));
+}
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end)
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : buckets_(BUCKET_COUNT, 0)
+{
+}
+
+// Values below SUB_BUCKETS map to themselves; above that, the block is picked
+// by the leading bit and the slot by the next SUB_BUCKET_BITS bits
+size_t LatencyHistogram::bucketIndex(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return static_cast<size_t>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS;
+    return static_cast<size_t>(shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketTop(size_t index)
+{
+    size_t block = index / SUB_BUCKETS;
+    if (block == 0)
+    {
+        return index;
+    }
+    int shift = static_cast<int>(block) - 1;
+    uint64_t low = ((index % SUB_BUCKETS) + SUB_BUCKETS) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    buckets_[bucketIndex(value)]++;
+    count_++;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < buckets_.size(); i++)
+    {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+double LatencyHistogram::mean() const
+{
+    return count_ > 0 ? static_cast<double>(sum_ / count_) : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count_)));
+    rank = std::clamp<uint64_t>(rank, 1, count_);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); i++)
+    {
+        seen += buckets_[i];
+        if (seen >= rank)
+        {
+            return std::min(bucketTop(i), max_);
+        }
+    }
+    return max_;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> LatencyHistogram::nonEmptyBuckets() const
+{
+    std::vector<std::pair<uint64_t, uint64_t>> out;
+    for (size_t i = 0; i < buckets_.size(); i++)
+    {
+        if (buckets_[i] > 0)
+        {
+            out.emplace_back(std::min(bucketTop(i), max_), buckets_[i]);
+        }
+    }
+    return out;
+}
+
+bool sendLatencyHello(IoEngine& io, int sockfd, size_t msgSize)
+{
+    setNoDelay(sockfd);
+    char hello[1 + sizeof(uint32_t)];
+    hello[0] = LATENCY_HELLO;
+    uint32_t sizeNet = htonl(static_cast<uint32_t>(msgSize));
+    std::memcpy(hello + 1, &sizeNet, sizeof(sizeNet));
+    if (!io.sendAll(sockfd, hello, sizeof(hello)))
+    {
+        spdlog::error("Latency: hello send() failed");
+        return false;
+    }
+    return true;
+}
+
+bool runLatencyExchanges(IoEngine& io, int sockfd, size_t msgSize, long long count,
+                         LatencyHistogram& hist)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // 1) Hello: mode byte + request size, so the server knows how much to echo
+    if (!sendLatencyHello(io, sockfd, msgSize))
+    {
+        return false;
+    }
+
+    // 2) Timed exchanges; the buffers are reused so the loop never allocates
+    std::vector<char> request(msgSize, 'M');
+    std::vector<char> response(msgSize);
+    for (long long i = 0; i < count; i++)
+    {
+        auto sendTime = Clock::now();
+        if (!io.sendAll(sockfd, request.data(), msgSize))
+        {
+            spdlog::error("Latency: send() failed");
+            return false;
+        }
+        if (!io.recvAll(sockfd, response.data(), msgSize))
+        {
+            spdlog::error("Latency: recv() failed (server closed?)");
+            return false;
+        }
+        auto recvTime = Clock::now();
+        hist.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(recvTime - sendTime).count()));
+    }
+    return true;
+}
+
+long long echoLatencyExchanges(IoEngine& io, int sockfd)
+{
+    uint32_t sizeNet = 0;
+    if (!io.recvAll(sockfd, reinterpret_cast<char*>(&sizeNet), sizeof(sizeNet)))
+    {
+        spdlog::error("Latency: hello recv() failed");
+        return -1;
+    }
+    size_t msgSize = ntohl(sizeNet);
+    if (msgSize < 1 || msgSize > MAX_MSG_SIZE)
+    {
+        spdlog::error("Latency: client asked for {} byte requests (max {})",
+                      msgSize, MAX_MSG_SIZE);
+        return -1;
+    }
+    setNoDelay(sockfd);
+
+    // recvAll() can't tell a clean close from a torn request, so peek at the
+    // first byte of each request on its own
+    std::vector<char> buf(msgSize);
+    long long exchanges = 0;
+    while (true)
+    {
+        ssize_t r = io.recvSome(sockfd, buf.data(), 1);
+        if (r == 0)
+        {
+            return exchanges;
+        }
+        if (r < 0 || (msgSize > 1 && !io.recvAll(sockfd, buf.data() + 1, msgSize - 1)))
+        {
+            spdlog::error("Latency: recv() failed");
+            return -1;
+        }
+        if (!io.sendAll(sockfd, buf.data(), msgSize))
+        {
+            spdlog::error("Latency: send() failed");
+            return -1;
+        }
+        exchanges++;
+    }
+}
+
+void logLatencySummary(size_t msgSize, const LatencyHistogram& hist)
+{
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    spdlog::info("Latency: exchanges={}, size={} B, min={:.1f}us, mean={:.1f}us, "
+                 "p50={:.1f}us, p90={:.1f}us, p99={:.1f}us, p99.9={:.1f}us, max={:.1f}us",
+                 hist.count(), msgSize, us(hist.min()), hist.mean() / 1000.0,
+                 us(hist.percentile(0.50)), us(hist.percentile(0.90)),
+                 us(hist.percentile(0.99)), us(hist.percentile(0.999)), us(hist.max()));
+}
+
+bool runTransactions(IoEngine& io, int sockfd, const TransactionSpec& spec,
+                     std::chrono::steady_clock::time_point deadline, LatencyHistogram& hist)
+{
+    using Clock = std::chrono::steady_clock;
+
+    setNoDelay(sockfd);
+    if (!sendTransactionHello(io, sockfd, spec))
+    {
+        spdlog::error("Transactions: hello send() failed");
+        return false;
+    }
+
+    // Responses come back in request order, so the send times are a ring
+    // with the oldest outstanding request at head
+    std::vector<char> request(spec.requestSize, 'Q');
+    std::vector<char> response(spec.responseSize);
+    const size_t depth = static_cast<size_t>(spec.depth);
+    std::vector<Clock::time_point> sentAt(depth);
+    size_t head = 0;
+    size_t inFlight = 0;
+    uint64_t started = 0;
+    bool sending = true;
+    while (true)
+    {
+        // Top the pipeline up until the deadline, then only drain it
+        while (sending && inFlight < depth)
+        {
+            auto now = Clock::now();
+            if (now >= deadline || (spec.perConnection > 0 && started == spec.perConnection))
+            {
+                sending = false;
+                break;
+            }
+            sentAt[(head + inFlight) % depth] = now;
+            if (!io.sendAll(sockfd, request.data(), request.size()))
+            {
+                spdlog::error("Transactions: send() failed");
+                return false;
+            }
+            inFlight++;
+            started++;
+        }
+        if (inFlight == 0)
+        {
+            return true;
+        }
+        if (!io.recvAll(sockfd, response.data(), response.size()))
+        {
+            spdlog::error("Transactions: recv() failed (server closed?)");
+            return false;
+        }
+        hist.record(elapsedNs(sentAt[head], Clock::now()));
+        head = (head + 1) % depth;
+        inFlight--;
+    }
+}
+
+bool runConnectTransactions(IoEngine& io, const std::function<int()>& openConnection,
+                            const TransactionSpec& spec,
+                            std::chrono::steady_clock::time_point deadline,
+                            LatencyHistogram& hist)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<char> request(spec.requestSize, 'Q');
+    std::vector<char> response(spec.responseSize);
+    for (auto start = Clock::now(); start < deadline; start = Clock::now())
+    {
+        int fd = openConnection();
+        if (fd < 0)
+        {
+            spdlog::error("Transactions: connect() failed: {}", strerror(errno));
+            return false;
+        }
+        setNoDelay(fd);
+        char eof = 0;
+        bool ok = io.attach(fd) && sendTransactionHello(io, fd, spec) &&
+                  io.sendAll(fd, request.data(), request.size()) &&
+                  io.recvAll(fd, response.data(), response.size()) &&
+                  io.recvSome(fd, &eof, 1) == 0; // the server closes first
+        close(fd);
+        if (!ok)
+        {
+            spdlog::error("Transactions: the exchange on a fresh connection failed");
+            return false;
+        }
+        hist.record(elapsedNs(start, Clock::now()));
+    }
+    return true;
+}
+
+long long answerTransactions(IoEngine& io, int sockfd)
+{
+    uint32_t words[3];
+    if (!io.recvAll(sockfd, reinterpret_cast<char*>(words), sizeof(words)))
+    {
+        spdlog::error("Transactions: hello recv() failed");
+        return -1;
+    }
+    size_t requestSize = ntohl(words[0]);
+    size_t responseSize = ntohl(words[1]);
+    uint32_t perConnection = ntohl(words[2]);
+    if (requestSize < 1 || requestSize > MAX_MSG_SIZE ||
+        responseSize < 1 || responseSize > MAX_MSG_SIZE)
+    {
+        spdlog::error("Transactions: client asked for {}:{} byte transactions (max {})",
+                      requestSize, responseSize, MAX_MSG_SIZE);
+        return -1;
+    }
+    setNoDelay(sockfd);
+
+    // As in echoLatencyExchanges(): the first byte of each request on its
+    // own, so a clean close isn't mistaken for a torn request
+    std::vector<char> request(requestSize);
+    std::vector<char> response(responseSize, 'R');
+    long long transactions = 0;
+    while (perConnection == 0 || transactions < perConnection)
+    {
+        ssize_t r = io.recvSome(sockfd, request.data(), 1);
+        if (r == 0)
+        {
+            break;
+        }
+        if (r < 0 ||
+            (requestSize > 1 && !io.recvAll(sockfd, request.data() + 1, requestSize - 1)))
+        {
+            spdlog::error("Transactions: recv() failed");
+            return -1;
+        }
+        if (!io.sendAll(sockfd, response.data(), responseSize))
+        {
+            spdlog::error("Transactions: send() failed");
+            return -1;
+        }
+        transactions++;
+    }
+    return transactions;
+}
+
+void logTransactionSummary(const TransactionSummary& summary, const LatencyHistogram& hist)
+{
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    spdlog::info("Transactions: {} in {:.3f} s = {:.1f}/s, request={} B, response={} B, "
+                 "{}", summary.count, summary.seconds, summary.perSecond(),
+                 summary.spec.requestSize, summary.spec.responseSize,
+                 summary.connectEach ? std::string("a connection each")
+                                     : fmt::format("depth={}", summary.spec.depth));
+    spdlog::info("Transactions: latency min={:.1f}us, mean={:.1f}us, p50={:.1f}us, "
+                 "p90={:.1f}us, p99={:.1f}us, p99.9={:.1f}us, max={:.1f}us",
+                 us(hist.min()), hist.mean() / 1000.0, us(hist.percentile(0.50)),
+                 us(hist.percentile(0.90)), us(hist.percentile(0.99)),
+                 us(hist.percentile(0.999)), us(hist.max()));
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+class IoEngine;
+
+// Latency mode (--latency N): instead of the RTT + data phases, the client
+// opens with LATENCY_HELLO and the request size, then does N request/response
+// exchanges that the server echoes back until the client closes.
+static const char LATENCY_HELLO = 'L'; // first byte; a throughput client sends 'M'
+static const size_t DEFAULT_MSG_SIZE = 1;
+static const size_t MAX_MSG_SIZE = 1 << 20; // 1MB per request
+
+// Transaction mode (--rr REQ:RESP), netperf TCP_RR style: requests and
+// responses of their own sizes, up to depth requests pipelined on each
+// connection, for -t seconds. The client opens with RR_HELLO and {request
+// size, response size, transactions per connection} (u32 each, network
+// order); the server answers every request with a response of the agreed
+// size. After perConnection transactions (0 = no limit) the server closes
+// first, so with --crr (TCP_CRR: a connection per transaction, perConnection
+// 1) TIME_WAIT piles up on the server rather than eating client ports.
+static const char RR_HELLO = 'T';
+static const int MAX_RR_DEPTH = 1024;
+// depth * (request + response) at most: small enough for the socket buffers
+// that neither end blocks on send() while the other does too
+static const size_t MAX_RR_IN_FLIGHT = 256 * 1024;
+
+struct TransactionSpec
+{
+    size_t requestSize = 0; // 0 = not a transaction test
+    size_t responseSize = 0;
+    int depth = 1;              // --rr-depth: requests in flight per connection
+    uint32_t perConnection = 0; // --crr: 1
+};
+
+// What a client's transaction test did, for the summary and the report
+struct TransactionSummary
+{
+    TransactionSpec spec;
+    bool connectEach = false; // --crr
+    uint64_t count = 0;
+    double seconds = 0.0;
+
+    double perSecond() const { return seconds > 0.0 ? count / seconds : 0.0; }
+};
+
+// Log-bucketed histogram in the style of HdrHistogram: values below
+// 2^SUB_BUCKET_BITS are exact, larger ones keep SUB_BUCKET_BITS significant
+// bits (under 1% error). All buckets are allocated up front, so record() is
+// a couple of shifts and an increment.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 7;
+
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ > 0 ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const;
+
+    // Smallest recorded value v such that a fraction q (0..1) of samples are <= v,
+    // reported as the top of its bucket (capped at max())
+    uint64_t percentile(double q) const;
+
+    // (bucket top, count) for every bucket that holds samples, ascending
+    std::vector<std::pair<uint64_t, uint64_t>> nonEmptyBuckets() const;
+
+private:
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketTop(size_t index);
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    long double sum_ = 0.0;
+};
+
+// Client side: LATENCY_HELLO and msgSize on a connected socket (with
+// TCP_NODELAY set), after which the server echoes msgSize-byte requests.
+// False (logged) if the send failed.
+bool sendLatencyHello(IoEngine& io, int sockfd, size_t msgSize);
+
+// Client side: count exchanges of msgSize bytes on a connected socket, each
+// timed with steady_clock and recorded in nanoseconds. False on I/O error.
+bool runLatencyExchanges(IoEngine& io, int sockfd, size_t msgSize, long long count,
+                         LatencyHistogram& hist);
+
+// Server side, after LATENCY_HELLO was read: echo requests until the client
+// closes. Returns the number of exchanges, or -1 on error.
+long long echoLatencyExchanges(IoEngine& io, int sockfd);
+
+// "Latency: exchanges=..., p50=...us" summary line
+void logLatencySummary(size_t msgSize, const LatencyHistogram& hist);
+
+// Client side of --rr on a connected socket: the hello, then transactions
+// until deadline (or spec.perConnection of them), each timed from its
+// request's send to the last byte of its response, in ns. False on I/O error.
+bool runTransactions(IoEngine& io, int sockfd, const TransactionSpec& spec,
+                     std::chrono::steady_clock::time_point deadline, LatencyHistogram& hist);
+
+// --crr: one transaction per connection from openConnection() (a connected
+// socket, or -1 with errno set) until deadline, each timed from its connect()
+// to the server's close. False (logged) on the first failure.
+bool runConnectTransactions(IoEngine& io, const std::function<int()>& openConnection,
+                            const TransactionSpec& spec,
+                            std::chrono::steady_clock::time_point deadline,
+                            LatencyHistogram& hist);
+
+// Server side, after RR_HELLO was read: answer requests until the client
+// closes or perConnection are done. Returns the transactions, -1 on error.
+long long answerTransactions(IoEngine& io, int sockfd);
+
+// "Transactions: N in T s = X/s, ..., p50=...us" summary line
+void logTransactionSummary(const TransactionSummary& summary, const LatencyHistogram& hist);
@@ -0,0 +1,118 @@
+#include "link_rate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <spdlog/spdlog.h>
+
+#include "common.hpp"
+
+const char* linkRateMethodName(LinkRateMethod method)
+{
+    switch (method)
+    {
+        case LinkRateMethod::None:          return "none";
+        case LinkRateMethod::AckDispersion: return "ack-dispersion";
+        case LinkRateMethod::ServiceTime:   return "service-time";
+    }
+    return "?";
+}
+
+IdleRtt idleRttOf(const std::vector<double>& rttSamplesMs)
+{
+    IdleRtt idle;
+    idle.seconds = averageLastRtts(rttSamplesMs) / 1000.0;
+    // The same last 4 samples the average takes
+    auto first = rttSamplesMs.end() - std::min<std::ptrdiff_t>(rttSamplesMs.size(), 4);
+    if (first != rttSamplesMs.end())
+    {
+        auto [lo, hi] = std::minmax_element(first, rttSamplesMs.end());
+        idle.spreadSeconds = (*hi - *lo) / 1000.0;
+    }
+    return idle;
+}
+
+LinkRateEstimator::LinkRateEstimator(size_t chunkSize, int window, const IdleRtt& idleRtt)
+    : chunkSize_(chunkSize),
+      method_(window == 0 ? LinkRateMethod::None
+              : window == 1 ? LinkRateMethod::ServiceTime : LinkRateMethod::AckDispersion),
+      idleRtt_(idleRtt)
+{
+}
+
+void LinkRateEstimator::onServiceTime(double seconds)
+{
+    hist_.record(static_cast<uint64_t>(std::llround(seconds * 1e9)));
+}
+
+void LinkRateEstimator::onAcks(double now, int acked)
+{
+    // The first read only ends the initial burst; gaps start from there
+    if (lastAck_ >= 0.0 && acked > 0)
+    {
+        hist_.record(static_cast<uint64_t>(std::llround((now - lastAck_) * 1e9 / acked)));
+    }
+    lastAck_ = now;
+}
+
+LinkRateEstimate LinkRateEstimator::finish(double goodputMbps) const
+{
+    LinkRateEstimate estimate;
+    estimate.samples = hist_.count();
+    if (method_ == LinkRateMethod::None || estimate.samples < MIN_LINK_RATE_SAMPLES)
+    {
+        return estimate;
+    }
+
+    double perChunk = static_cast<double>(hist_.percentile(0.5)) / 1e9;
+    if (method_ == LinkRateMethod::ServiceTime)
+    {
+        // Queueing under load only makes this longer, so a non-positive
+        // remainder means the RTT phase overestimated the idle RTT; a tiny
+        // one is a difference of two noisy numbers
+        perChunk -= idleRtt_.seconds;
+        if (perChunk <= idleRtt_.spreadSeconds ||
+            perChunk < idleRtt_.seconds * MIN_SERVICE_SHARE)
+        {
+            return estimate;
+        }
+    }
+    if (perChunk <= 0.0)
+    {
+        return estimate;
+    }
+    estimate.method = method_;
+    estimate.rateMbps = (static_cast<double>(chunkSize_) * 8.0 / perChunk) / 1e6;
+    if (goodputMbps > 0.0 && estimate.rateMbps > goodputMbps * MAX_LINK_RATE_RATIO)
+    {
+        estimate.rateMbps = goodputMbps * MAX_LINK_RATE_RATIO;
+        estimate.capped = true;
+    }
+    return estimate;
+}
+
+void logLinkRateSummary(const char* verb, const std::vector<StreamResult>& results)
+{
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const LinkRateEstimate& e = results[i].linkRate;
+        if (!results[i].ok || e.samples == 0)
+        {
+            continue;
+        }
+        std::string stream = results.size() > 1 ? fmt::format("[stream {}] ", i) : "";
+        if (e.method == LinkRateMethod::None)
+        {
+            spdlog::info("{}{} link rate estimate: none ({} samples, {})", stream, verb,
+                         e.samples, e.samples < MIN_LINK_RATE_SAMPLES
+                                        ? "too few" : "ack timing within the idle RTT's noise");
+        }
+        else
+        {
+            spdlog::info("{}{} link rate estimate{}{:.3f} Mbps ({}, {} samples{})", stream, verb,
+                         e.capped ? " >= " : "=", e.rateMbps, linkRateMethodName(e.method),
+                         e.samples, e.capped ? fmt::format(", capped at {:.0f}x goodput",
+                                                           MAX_LINK_RATE_RATIO) : "");
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "latency.hpp"
+
+// Bottleneck estimate from the sender's per-chunk timestamps under load,
+// reported next to (never folded into) the wall-clock goodput:
+//
+//   ack-dispersion  window > 1: with the pipe full, acks come back spaced by
+//                   the time the bottleneck takes to deliver one chunk, so
+//                   the median per-chunk ack gap gives the link rate
+//   service-time    stop-and-wait: each chunk takes its transmission time
+//                   plus one idle RTT, so the rate is chunk size over the
+//                   median send-to-ack time less the RTT-phase average
+//
+// Medians keep a few scheduler hiccups from moving the estimate. Without
+// acks (--bidir) or with too few samples there is no estimate, nor when a
+// service-time remainder is lost in the idle RTT's noise: no larger than
+// the spread of the RTT samples, or under MIN_SERVICE_SHARE of the RTT.
+// An estimate is capped at MAX_LINK_RATE_RATIO times the goodput, where
+// what is left of the ack timing says more about the hosts than the link.
+enum class LinkRateMethod
+{
+    None,
+    AckDispersion,
+    ServiceTime,
+};
+
+static const uint64_t MIN_LINK_RATE_SAMPLES = 8;
+static const double MIN_SERVICE_SHARE = 0.1;    // of the idle RTT
+static const double MAX_LINK_RATE_RATIO = 20.0; // times the goodput
+
+struct LinkRateEstimate
+{
+    LinkRateMethod method = LinkRateMethod::None;
+    double rateMbps = 0.0;
+    uint64_t samples = 0;
+    bool capped = false; // rateMbps is MAX_LINK_RATE_RATIO x goodput, a lower bound
+};
+
+// The RTT phase's idle baseline: the averageLastRtts() mean and how far
+// apart the samples behind it were
+struct IdleRtt
+{
+    double seconds = 0.0;
+    double spreadSeconds = 0.0;
+};
+
+IdleRtt idleRttOf(const std::vector<double>& rttSamplesMs);
+
+const char* linkRateMethodName(LinkRateMethod method);
+
+class LinkRateEstimator
+{
+public:
+    LinkRateEstimator(size_t chunkSize, int window, const IdleRtt& idleRtt);
+
+    // Stop-and-wait: one chunk went from send() to its ack in this long
+    void onServiceTime(double seconds);
+
+    // Pipelined: an ack read at time now (seconds) covered acked chunks,
+    // with the window full since the previous read
+    void onAcks(double now, int acked);
+
+    // goodputMbps: the phase's own, which bounds what the estimate may claim
+    LinkRateEstimate finish(double goodputMbps) const;
+
+private:
+    size_t chunkSize_;
+    LinkRateMethod method_;
+    IdleRtt idleRtt_;
+    double lastAck_ = -1.0;
+    LatencyHistogram hist_; // per-chunk ns; the median is all we need
+};
+
+struct StreamResult;
+
+// "Link rate estimate=... Mbps (method, N samples)" per stream that has one
+void logLinkRateSummary(const char* verb, const std::vector<StreamResult>& results);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "common.hpp"
+#include "data_phase.hpp"
+#include "io_engine.hpp"
+#include "latency.hpp"
+#include "payload.hpp"
+#include "recv_path.hpp"
+#include "report.hpp"
+#include "sockopt.hpp"
+#include "udp.hpp"
+#include "zerocopy.hpp"
+
+// Everything main() parsed for a client run
+struct ClientOptions
+{
+    std::string hostname;
+    unsigned short port = 0;
+    AddressFamily family = AddressFamily::Any; // -4 / -6: resolve and connect over one only
+    double durationSeconds = 0.0;
+    int window = DEFAULT_WINDOW;
+    int streams = DEFAULT_STREAMS;
+    Direction direction = Direction::Forward; // -R / --bidir
+    ZeroCopyMode zerocopy = ZeroCopyMode::Copy;
+    EngineKind engine = EngineKind::Blocking;
+    double intervalSeconds = 0.0; // -i: 0 = final summary only
+    OutputFormat output = OutputFormat::Text;
+    bool reportCpu = false; // --zerocopy given: print the CPU-per-GB line
+    long long latencyCount = 0; // --latency N: N timed exchanges instead of a data phase
+    size_t msgSize = DEFAULT_MSG_SIZE;
+    TransactionSpec rr; // --rr REQ:RESP (+ --rr-depth): transactions instead of a data phase
+    bool crr = false;   // --crr: a fresh connection per transaction
+    double probeInterval = 0.0; // --under-load: seconds between RTT probes; 0 = no probe
+    int rttExchanges = RTT_EXCHANGES; // --rtt-count
+    std::string addrCache;            // --addr-cache file; empty = always resolve
+    std::vector<size_t> chunkSizes; // -l / --sweep: framed data phase; empty = 80KB chunks
+    bool udp = false;               // -u: paced datagrams instead of the TCP phases
+    double bitrate = 0.0; // -b, bits/s: TCP 0 = unpaced; -u defaults to DEFAULT_UDP_BITRATE
+    size_t datagramSize = DEFAULT_DATAGRAM_SIZE; // -l with -u
+    std::string xdpDevice;  // --xdp-dev, for --engine xdp
+    unsigned xdpQueue = 0;  // --xdp-queue
+    SocketTuning tuning;
+    bool reportSocket = false; // a tuning option given: print the effective socket settings
+    bool control = true;       // negotiate over a control connection (--no-control: don't)
+    PayloadPattern payload = PayloadPattern::Zeros; // --payload, for both ends' senders
+    bool verify = false;       // --verify: receivers check every chunk (needs control)
+    std::vector<int> cpus;     // --affinity: stream i runs on cpus[i % size]
+    bool reportThreads = false; // --affinity/--busy-poll given: per-thread CPU lines
+    bool profile = false;       // --profile: perf counters and I/O counts per phase
+    int repeat = 1;             // --repeat: runs over one control connection
+    double everySeconds = 0.0;  // --every: start-to-start gap between runs; 0 = back to back
+};
+
+// Everything main() parsed for a server run
+struct ServerOptions
+{
+    unsigned short port = 0;
+    AddressFamily family = AddressFamily::Any; // -4 / -6: listen on one only; else dual-stack
+    int streams = DEFAULT_STREAMS;
+    int backlog = BACKLOG;
+    RecvMode recvMode = RecvMode::Copy;
+    EngineKind engine = EngineKind::Blocking;
+    size_t readSize = DEFAULT_READ_SIZE;
+    double intervalSeconds = 0.0; // -i: 0 = final summary only
+    OutputFormat output = OutputFormat::Text;
+    bool udp = false; // -u
+    std::string xdpDevice;  // --xdp-dev, for --engine xdp
+    unsigned xdpQueue = 0;  // --xdp-queue
+    SocketTuning tuning;
+    bool reportSocket = false; // a tuning option given: print the effective socket settings
+    bool reportSyscalls = false; // --recv-mode/--read-size given: print syscall stats
+    std::vector<int> cpus;       // --affinity: stream i runs on cpus[i % size]
+    bool reportThreads = false;  // --affinity/--busy-poll given: per-thread CPU lines
+    bool profile = false;        // --profile: perf counters and I/O counts per phase
+    int workers = 0;             // --daemon: reactor threads; 0 = one per CPU
+};
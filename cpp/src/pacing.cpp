@@ -0,0 +1,55 @@
+#include "pacing.hpp"
+
+#include <algorithm>
+#include <thread>
+
+TokenBucket::TokenBucket(double bitsPerSecond, size_t chunkSize)
+    : bytesPerSecond_(bitsPerSecond / 8.0)
+{
+    double burst = bytesPerSecond_ * std::chrono::duration<double>(PACING_BURST).count();
+    depth_  = std::max(burst, static_cast<double>(chunkSize));
+    tokens_ = static_cast<double>(chunkSize);
+}
+
+void TokenBucket::refill(Clock::time_point now)
+{
+    if (!started_)
+    {
+        // The clock starts with the first send, not at construction
+        started_ = true;
+        last_ = now;
+        return;
+    }
+    double elapsed = std::chrono::duration<double>(now - last_).count();
+    tokens_ = std::min(depth_, tokens_ + elapsed * bytesPerSecond_);
+    last_ = now;
+}
+
+bool TokenBucket::take(size_t bytes, Clock::time_point deadline)
+{
+    if (!paced())
+    {
+        return true;
+    }
+    const double need = static_cast<double>(bytes);
+    auto now = Clock::now();
+    refill(now);
+    while (tokens_ < need)
+    {
+        auto wait = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((need - tokens_) / bytesPerSecond_));
+        auto wake = std::min(now + wait, deadline);
+        std::this_thread::sleep_until(wake);
+        auto woke = Clock::now();
+        slept_ += std::chrono::duration<double>(woke - now).count();
+        if (wake == deadline)
+        {
+            return false;
+        }
+        // Oversleeping only banks tokens, so the average stays on the rate
+        now = woke;
+        refill(now);
+    }
+    tokens_ -= need;
+    return true;
+}
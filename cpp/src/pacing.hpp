@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+// -b for TCP: a token bucket the timed sender spends one chunk's bytes from
+// before each send, so a health check can run alongside production traffic
+// without saturating the link. Tokens accrue at the target rate (per stream,
+// like iperf3) up to a burst of PACING_BURST worth, and never less than one
+// chunk, so time spent blocked on acks or in send() isn't lost and the
+// average still lands on the target. Pacing is in user space and needs no
+// qdisc; --max-pacing-rate (SO_MAX_PACING_RATE) remains for kernel pacing.
+static const auto PACING_BURST = std::chrono::milliseconds(10);
+
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // bitsPerSecond 0 = unpaced: take() never waits
+    TokenBucket(double bitsPerSecond, size_t chunkSize);
+
+    bool paced() const { return bytesPerSecond_ > 0.0; }
+
+    // Sleep until bytes may go. If that would be past deadline, sleeps until
+    // deadline instead (so the phase still lasts its full time) and returns false.
+    bool take(size_t bytes, Clock::time_point deadline);
+
+    // Time take() spent sleeping so far
+    double sleptSeconds() const { return slept_; }
+
+private:
+    void refill(Clock::time_point now);
+
+    double bytesPerSecond_;
+    double depth_;  // burst cap, bytes
+    double tokens_; // one chunk to start with: the first send goes at once
+    Clock::time_point last_;
+    bool started_ = false;
+    double slept_ = 0.0;
+};
@@ -0,0 +1,382 @@
+#include "payload.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <endian.h>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define IPERFER_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define IPERFER_CRC32C_ARMV8 1
+#endif
+
+namespace
+{
+
+const uint32_t CRC32C_POLY = 0x82F63B78; // reflected Castagnoli polynomial
+
+// Software fallback, one byte per step
+struct Crc32cTable
+{
+    uint32_t entries[256];
+
+    Crc32cTable()
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; k++)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            }
+            entries[n] = crc;
+        }
+    }
+};
+
+const Crc32cTable TABLE;
+
+uint32_t crc32cTable(uint32_t crc, const unsigned char* p, size_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc = TABLE.entries[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#ifdef IPERFER_CRC32C_SSE42
+// The crc32 instruction has a 3-cycle latency but issues every cycle, so
+// three independent lanes over adjacent blocks run ~3x faster; the lanes are
+// then combined by "appending" block-length runs of zeros to the earlier
+// ones, a fixed linear operator on the CRC kept as four byte tables.
+const size_t LONG_BLOCK = 8192;
+const size_t SHORT_BLOCK = 256;
+
+uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec)
+    {
+        if (vec & 1)
+        {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+void gf2MatrixSquare(uint32_t* square, const uint32_t* mat)
+{
+    for (int n = 0; n < 32; n++)
+    {
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+    }
+}
+
+// The operator for len (a power of two) zero bytes, as byte tables
+struct ZerosShift
+{
+    uint32_t tables[4][256];
+
+    explicit ZerosShift(size_t len)
+    {
+        uint32_t even[32];
+        uint32_t odd[32];
+        odd[0] = CRC32C_POLY; // one zero bit
+        uint32_t row = 1;
+        for (int n = 1; n < 32; n++)
+        {
+            odd[n] = row;
+            row <<= 1;
+        }
+        gf2MatrixSquare(even, odd); // two zero bits
+        gf2MatrixSquare(odd, even); // four
+        const uint32_t* op = nullptr;
+        while (true)
+        {
+            gf2MatrixSquare(even, odd); // eight (one byte) on the first pass
+            len >>= 1;
+            if (len == 0)
+            {
+                op = even;
+                break;
+            }
+            gf2MatrixSquare(odd, even);
+            len >>= 1;
+            if (len == 0)
+            {
+                op = odd;
+                break;
+            }
+        }
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            tables[0][n] = gf2MatrixTimes(op, n);
+            tables[1][n] = gf2MatrixTimes(op, n << 8);
+            tables[2][n] = gf2MatrixTimes(op, n << 16);
+            tables[3][n] = gf2MatrixTimes(op, n << 24);
+        }
+    }
+
+    uint32_t operator()(uint32_t crc) const
+    {
+        return tables[0][crc & 0xff] ^ tables[1][(crc >> 8) & 0xff] ^
+               tables[2][(crc >> 16) & 0xff] ^ tables[3][crc >> 24];
+    }
+};
+
+const ZerosShift LONG_SHIFT(LONG_BLOCK);
+const ZerosShift SHORT_SHIFT(SHORT_BLOCK);
+
+uint64_t load64(const unsigned char* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <size_t Block>
+__attribute__((target("sse4.2")))
+uint64_t crc32cLanes(uint64_t crc0, const unsigned char*& p, size_t& len, const ZerosShift& shift)
+{
+    while (len >= 3 * Block)
+    {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const unsigned char* end = p + Block;
+        do
+        {
+            crc0 = _mm_crc32_u64(crc0, load64(p));
+            crc1 = _mm_crc32_u64(crc1, load64(p + Block));
+            crc2 = _mm_crc32_u64(crc2, load64(p + 2 * Block));
+            p += 8;
+        } while (p < end);
+        crc0 = shift(static_cast<uint32_t>(crc0)) ^ crc1;
+        crc0 = shift(static_cast<uint32_t>(crc0)) ^ crc2;
+        p += 2 * Block;
+        len -= 3 * Block;
+    }
+    return crc0;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32cSse42(uint32_t crc, const unsigned char* p, size_t len)
+{
+    uint64_t crc0 = ~crc;
+    while (len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+    {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p++);
+        len--;
+    }
+    crc0 = crc32cLanes<LONG_BLOCK>(crc0, p, len, LONG_SHIFT);
+    crc0 = crc32cLanes<SHORT_BLOCK>(crc0, p, len, SHORT_SHIFT);
+    while (len >= 8)
+    {
+        crc0 = _mm_crc32_u64(crc0, load64(p));
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p++);
+        len--;
+    }
+    return ~static_cast<uint32_t>(crc0);
+}
+
+const bool HAVE_SSE42 = __builtin_cpu_supports("sse4.2");
+#endif
+
+#ifdef IPERFER_CRC32C_ARMV8
+uint32_t crc32cArmv8(uint32_t crc, const unsigned char* p, size_t len)
+{
+    crc = ~crc;
+    while (len >= 8)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        crc = __crc32cb(crc, *p++);
+        len--;
+    }
+    return ~crc;
+}
+#endif
+
+// xorshift64*: fast, and plenty random for a compressor
+uint64_t nextRandom(uint64_t& state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+void fillRandom(char* buf, size_t len)
+{
+    uint64_t state = PAYLOAD_SEED;
+    size_t off = 0;
+    for (; off + sizeof(uint64_t) <= len; off += sizeof(uint64_t))
+    {
+        uint64_t v = nextRandom(state);
+        std::memcpy(buf + off, &v, sizeof(v));
+    }
+    uint64_t v = nextRandom(state);
+    std::memcpy(buf + off, &v, len - off);
+}
+
+} // namespace
+
+bool parsePayloadPattern(const std::string& name, PayloadPattern& pattern)
+{
+    if (name == "zeros")
+    {
+        pattern = PayloadPattern::Zeros;
+    }
+    else if (name == "random")
+    {
+        pattern = PayloadPattern::Random;
+    }
+    else if (name == "seq")
+    {
+        pattern = PayloadPattern::Sequence;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char* payloadPatternName(PayloadPattern pattern)
+{
+    switch (pattern)
+    {
+        case PayloadPattern::Zeros:    return "zeros";
+        case PayloadPattern::Random:   return "random";
+        case PayloadPattern::Sequence: return "seq";
+    }
+    return "?";
+}
+
+void fillPayload(PayloadPattern pattern, char* buf, size_t chunkSize, size_t slots)
+{
+    if (pattern == PayloadPattern::Zeros || chunkSize == 0)
+    {
+        std::memset(buf, 0, chunkSize * slots);
+        return;
+    }
+    fillRandom(buf, chunkSize);
+    for (size_t s = 1; s < slots; s++)
+    {
+        std::memcpy(buf + s * chunkSize, buf, chunkSize);
+    }
+}
+
+void stampSequence(char* chunk, uint64_t index)
+{
+    uint64_t be = htobe64(index);
+    std::memcpy(chunk, &be, sizeof(be));
+}
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t len)
+{
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+#ifdef IPERFER_CRC32C_SSE42
+    if (HAVE_SSE42)
+    {
+        return crc32cSse42(crc, p, len);
+    }
+#endif
+#ifdef IPERFER_CRC32C_ARMV8
+    return crc32cArmv8(crc, p, len);
+#else
+    return crc32cTable(crc, p, len);
+#endif
+}
+
+const char* crc32cImplName()
+{
+#ifdef IPERFER_CRC32C_SSE42
+    if (HAVE_SSE42)
+    {
+        return "sse4.2";
+    }
+#endif
+#ifdef IPERFER_CRC32C_ARMV8
+    return "armv8";
+#else
+    return "table";
+#endif
+}
+
+PayloadVerifier::PayloadVerifier(PayloadPattern pattern, size_t chunkSize)
+    : chunkSize_(chunkSize),
+      stampBytes_(pattern == PayloadPattern::Sequence ? std::min(SEQUENCE_BYTES, chunkSize) : 0)
+{
+    std::vector<char> chunk(chunkSize);
+    fillPayload(pattern, chunk.data(), chunkSize, 1);
+    expected_ = crc32c(0, chunk.data() + stampBytes_, chunkSize - stampBytes_);
+    stats_.enabled = true;
+}
+
+void PayloadVerifier::onData(const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t take = 0;
+        if (offset_ < stampBytes_)
+        {
+            take = std::min(stampBytes_ - offset_, len);
+            std::memcpy(stamp_ + offset_, data, take);
+        }
+        else
+        {
+            take = std::min(chunkSize_ - offset_, len);
+            crc_ = crc32c(crc_, data, take);
+        }
+        data += take;
+        len -= take;
+        offset_ += take;
+        if (offset_ == chunkSize_)
+        {
+            finishChunk();
+        }
+    }
+}
+
+void PayloadVerifier::finishChunk()
+{
+    bool ok = crc_ == expected_;
+    uint64_t index = nextIndex_;
+    if (stampBytes_ == SEQUENCE_BYTES)
+    {
+        uint64_t be;
+        std::memcpy(&be, stamp_, sizeof(be));
+        index = be64toh(be);
+        ok = ok && index == nextIndex_;
+    }
+    if (!ok && stats_.badChunks == 0)
+    {
+        spdlog::error("Verify: chunk {} is corrupt (crc32c {:#010x}, expected {:#010x}; "
+                      "stamp {})", nextIndex_, crc_, expected_, index);
+    }
+    stats_.chunks++;
+    stats_.badChunks += ok ? 0 : 1;
+    nextIndex_++;
+    offset_ = 0;
+    crc_ = 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// What the data phase's chunks carry (--payload) and how a receiver checks
+// them (--verify). Both ends derive the content from the pattern alone, so
+// nothing but the pattern name has to travel in the TestParams:
+//
+//   zeros   all zero bytes, as before
+//   random  one chunk of xorshift64* output from a fixed seed, generated
+//           before the data phase and sent over and over (incompressible,
+//           but cheap: no per-send generation)
+//   seq     the random chunk with its first SEQUENCE_BYTES overwritten by
+//           the chunk's index in the stream (big-endian), so a receiver
+//           also catches lost, repeated or reordered chunks
+//
+// The verifier CRC32Cs each chunk's bytes past the sequence stamp as they
+// arrive and compares against the one expected value for the pattern.
+enum class PayloadPattern : uint32_t
+{
+    Zeros = 0,
+    Random = 1,
+    Sequence = 2,
+};
+
+static const size_t SEQUENCE_BYTES = sizeof(uint64_t);
+static const uint64_t PAYLOAD_SEED = 0x9E3779B97F4A7C15ULL;
+
+bool parsePayloadPattern(const std::string& name, PayloadPattern& pattern);
+const char* payloadPatternName(PayloadPattern pattern);
+
+// Fill slots consecutive chunkSize-byte chunks with pattern's content
+// (sequence stamps are the sender's job, per send)
+void fillPayload(PayloadPattern pattern, char* buf, size_t chunkSize, size_t slots);
+
+// Write index into the chunk's sequence stamp
+void stampSequence(char* chunk, uint64_t index);
+
+// CRC32C (Castagnoli) of len bytes, continuing from crc (0 to start). Uses
+// the SSE4.2 / ARMv8 CRC instructions when the CPU has them.
+uint32_t crc32c(uint32_t crc, const char* data, size_t len);
+
+// "sse4.2", "armv8" or "table": what crc32c() runs on here
+const char* crc32cImplName();
+
+// --verify outcome for one stream
+struct VerifyStats
+{
+    bool enabled = false;
+    uint64_t chunks = 0;    // whole chunks checked
+    uint64_t badChunks = 0; // ...whose content or sequence stamp was wrong
+    double seconds = 0.0;   // spent checking, inside the timed data phase
+};
+
+// Receiver side: fed the stream in whatever pieces recv() returns
+class PayloadVerifier
+{
+public:
+    PayloadVerifier(PayloadPattern pattern, size_t chunkSize);
+
+    void onData(const char* data, size_t len);
+
+    // A torn last chunk isn't counted, like the byte totals
+    const VerifyStats& stats() const { return stats_; }
+    VerifyStats& stats() { return stats_; }
+
+private:
+    void finishChunk();
+
+    size_t chunkSize_;
+    size_t stampBytes_;   // SEQUENCE_BYTES for seq, else 0
+    uint32_t expected_;   // CRC32C of a chunk past its stamp
+    size_t offset_ = 0;   // into the current chunk
+    uint32_t crc_ = 0;
+    unsigned char stamp_[SEQUENCE_BYTES] = {};
+    uint64_t nextIndex_ = 0;
+    VerifyStats stats_;
+};
@@ -0,0 +1,107 @@
+#include "probe.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+LoadProbe::LoadProbe(int sockfd, double intervalSeconds)
+    : sockfd_(sockfd), io_(makeIoEngine(EngineKind::Blocking)), intervalSeconds_(intervalSeconds)
+{
+}
+
+LoadProbe::~LoadProbe()
+{
+    stop();
+}
+
+bool LoadProbe::probeOnce(LatencyHistogram& hist)
+{
+    using Clock = std::chrono::steady_clock;
+
+    char byte = 'P';
+    auto sendTime = Clock::now();
+    if (!io_->sendAll(sockfd_, &byte, 1) || !io_->recvAll(sockfd_, &byte, 1))
+    {
+        spdlog::error("Under load: the probe connection failed");
+        return false;
+    }
+    hist.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sendTime).count()));
+    return true;
+}
+
+bool LoadProbe::measureIdle()
+{
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(intervalSeconds_));
+    ok_ = sendLatencyHello(*io_, sockfd_, 1);
+    for (int i = 0; ok_ && i < IDLE_PROBES; i++)
+    {
+        ok_ = probeOnce(idle_);
+        std::this_thread::sleep_for(interval);
+    }
+    return ok_;
+}
+
+// Probes go out on a fixed schedule; one that comes back after its
+// successor was due is followed at once rather than by a burst
+void LoadProbe::start()
+{
+    if (!ok_)
+    {
+        return;
+    }
+    thread_ = std::thread([this]() {
+        using Clock = std::chrono::steady_clock;
+        auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(intervalSeconds_));
+        auto next = Clock::now();
+        while (!stop_.load(std::memory_order_relaxed))
+        {
+            if (!probeOnce(loaded_))
+            {
+                return;
+            }
+            next = std::max(next + interval, Clock::now());
+            std::this_thread::sleep_until(next);
+        }
+    });
+}
+
+void LoadProbe::stop()
+{
+    stop_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+    if (sockfd_ >= 0)
+    {
+        close(sockfd_);
+        sockfd_ = -1;
+    }
+}
+
+void logLoadProbeSummary(const LoadProbe& probe)
+{
+    const LatencyHistogram& idle = probe.idle();
+    const LatencyHistogram& loaded = probe.loaded();
+    if (idle.count() == 0 || loaded.count() == 0)
+    {
+        return;
+    }
+    auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    auto line = [&ms](const char* name, const LatencyHistogram& h) {
+        spdlog::info("Under load: {} RTT p50={:.3f}ms, p90={:.3f}ms, p99={:.3f}ms, max={:.3f}ms "
+                     "({} probes)", name, ms(h.percentile(0.50)), ms(h.percentile(0.90)),
+                     ms(h.percentile(0.99)), ms(h.max()), h.count());
+    };
+    line("idle", idle);
+    line("loaded", loaded);
+    double idleP50 = ms(idle.percentile(0.50));
+    double loadedP50 = ms(loaded.percentile(0.50));
+    spdlog::info("Under load: the streams added {:.3f}ms at p50 ({:.1f}x) and {:.3f}ms at p99",
+                 loadedP50 - idleP50, idleP50 > 0.0 ? loadedP50 / idleP50 : 0.0,
+                 ms(loaded.percentile(0.99)) - ms(idle.percentile(0.99)));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "io_engine.hpp"
+#include "latency.hpp"
+
+// Latency under load (--under-load): the RTT phase only sees the idle path,
+// but what a full link does to everyone else's latency is the queue the bulk
+// streams build at the bottleneck. One more connection to the server, next
+// to the -P data streams, speaks the --latency protocol (1-byte echoes,
+// TCP_NODELAY) every interval from its own thread: IDLE_PROBES times before
+// the streams start, then for as long as they run. It has its own socket,
+// so it sees the shared queue without the data streams' send buffers. It
+// always uses the blocking engine, whatever --engine drives the streams.
+static const double DEFAULT_PROBE_INTERVAL = 0.01; // seconds between probes
+static const int IDLE_PROBES = 20;
+
+class LoadProbe
+{
+public:
+    // sockfd: the connected probe socket; the probe closes it
+    LoadProbe(int sockfd, double intervalSeconds);
+    ~LoadProbe();
+
+    LoadProbe(const LoadProbe&) = delete;
+    LoadProbe& operator=(const LoadProbe&) = delete;
+
+    // The hello and the idle baseline, before the streams start. False
+    // (logged) on I/O error; the probe is then off.
+    bool measureIdle();
+
+    // Probe on a thread of its own until stop(), which joins it and closes
+    // the connection: the server only swaps results once the probe is gone
+    void start();
+    void stop();
+
+    double intervalSeconds() const { return intervalSeconds_; }
+    const LatencyHistogram& idle() const { return idle_; }
+    const LatencyHistogram& loaded() const { return loaded_; }
+
+private:
+    // One timed 1-byte exchange into hist; false (logged) on error
+    bool probeOnce(LatencyHistogram& hist);
+
+    int sockfd_;
+    std::unique_ptr<IoEngine> io_;
+    double intervalSeconds_;
+    bool ok_ = false;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    LatencyHistogram idle_;
+    LatencyHistogram loaded_;
+};
+
+// "Under load: idle RTT p50=..., loaded RTT p50=..., +X at p50/p99" lines
+void logLoadProbeSummary(const LoadProbe& probe);
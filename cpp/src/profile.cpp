@@ -0,0 +1,302 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <spdlog/spdlog.h>
+
+#include "common.hpp"
+
+namespace
+{
+
+static const int COUNTERS = static_cast<int>(ProfileCounter::Count);
+
+// value, time enabled, time running: multiplexed counters are scaled up by
+// enabled / running over the phase
+struct CounterRead
+{
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+};
+
+int openCounter(ProfileCounter counter, bool excludeKernel)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    switch (counter)
+    {
+        case ProfileCounter::Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case ProfileCounter::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case ProfileCounter::ContextSwitches:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        case ProfileCounter::CacheMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case ProfileCounter::Count:
+            return -1;
+    }
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    // This thread, any CPU
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::once_flag g_warnUserOnly;
+std::once_flag g_warnMissing;
+
+} // namespace
+
+const char* profileCounterName(ProfileCounter counter)
+{
+    switch (counter)
+    {
+        case ProfileCounter::Cycles:          return "cycles";
+        case ProfileCounter::Instructions:    return "instructions";
+        case ProfileCounter::ContextSwitches: return "context_switches";
+        case ProfileCounter::CacheMisses:     return "cache_misses";
+        case ProfileCounter::Count:           break;
+    }
+    return "?";
+}
+
+PhaseProfiler::PhaseProfiler()
+{
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        auto counter = static_cast<ProfileCounter>(i);
+        fds_[i] = userOnly_ ? -1 : openCounter(counter, false);
+        if (fds_[i] < 0 && !userOnly_ && (errno == EACCES || errno == EPERM))
+        {
+            // kernel.perf_event_paranoid >= 2: user space only, for every counter
+            userOnly_ = true;
+            std::call_once(g_warnUserOnly, []() {
+                spdlog::warn("Profile: perf_event_paranoid keeps the kernel out; "
+                             "counting user space only");
+            });
+        }
+        if (fds_[i] < 0 && userOnly_)
+        {
+            // Context switches happen in the kernel, so a user-space count is
+            // always 0; the thread's rusage has them instead
+            if (counter == ProfileCounter::ContextSwitches)
+            {
+                switchesFromRusage_ = true;
+                continue;
+            }
+            fds_[i] = openCounter(counter, true);
+        }
+        if (fds_[i] < 0)
+        {
+            int err = errno;
+            std::call_once(g_warnMissing, [counter, err]() {
+                spdlog::warn("Profile: no {} counter ({}); reporting what opened",
+                             profileCounterName(counter), strerror(err));
+            });
+        }
+    }
+}
+
+PhaseProfiler::~PhaseProfiler()
+{
+    for (int fd : fds_)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+bool PhaseProfiler::opened(int counter) const
+{
+    return fds_[counter] >= 0 ||
+           (switchesFromRusage_ && counter == static_cast<int>(ProfileCounter::ContextSwitches));
+}
+
+// Scaled counts so far; values[i] is only meaningful where counter i opened
+bool PhaseProfiler::read(uint64_t* values) const
+{
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        values[i] = 0;
+        if (fds_[i] < 0)
+        {
+            continue;
+        }
+        CounterRead r{};
+        if (::read(fds_[i], &r, sizeof(r)) != static_cast<ssize_t>(sizeof(r)))
+        {
+            return false;
+        }
+        values[i] = (r.running > 0 && r.running < r.enabled)
+            ? static_cast<uint64_t>(static_cast<double>(r.value) * r.enabled / r.running)
+            : r.value;
+    }
+    if (switchesFromRusage_)
+    {
+        rusage ru{};
+        if (getrusage(RUSAGE_THREAD, &ru) != 0)
+        {
+            return false;
+        }
+        values[static_cast<int>(ProfileCounter::ContextSwitches)] =
+            static_cast<uint64_t>(ru.ru_nvcsw + ru.ru_nivcsw);
+    }
+    return true;
+}
+
+void PhaseProfiler::begin(const IoEngine& io)
+{
+    ioStart_ = io.counts();
+    syscallsStart_ = io.syscalls();
+    read(start_);
+    startTime_ = Clock::now();
+}
+
+void PhaseProfiler::end(const IoEngine& io, long long bytes, PhaseProfile& out)
+{
+    auto endTime = Clock::now();
+    uint64_t now[COUNTERS];
+    bool ok = read(now);
+    const IoCounts& counts = io.counts();
+
+    out.valid = true;
+    out.userOnly = userOnly_;
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        out.have[i] = ok && opened(i);
+        out.counters[i] = out.have[i] && now[i] >= start_[i] ? now[i] - start_[i] : 0;
+    }
+    out.io.sends      = counts.sends - ioStart_.sends;
+    out.io.recvs      = counts.recvs - ioStart_.recvs;
+    out.io.shortSends = counts.shortSends - ioStart_.shortSends;
+    out.io.shortRecvs = counts.shortRecvs - ioStart_.shortRecvs;
+    out.syscalls = io.syscalls() - syscallsStart_;
+    out.seconds = std::chrono::duration<double>(endTime - startTime_).count();
+    out.bytes = bytes;
+}
+
+namespace
+{
+
+// One phase summed over the streams; have[] only where every stream had it
+PhaseProfile sumPhases(const std::vector<StreamResult>& results, PhaseProfile StreamProfile::*phase)
+{
+    PhaseProfile total;
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        total.have[i] = true;
+    }
+    for (const auto& r : results)
+    {
+        const PhaseProfile& p = r.profile.*phase;
+        if (!r.ok || !p.valid)
+        {
+            continue;
+        }
+        total.valid = true;
+        total.userOnly = total.userOnly || p.userOnly;
+        for (int i = 0; i < COUNTERS; i++)
+        {
+            total.have[i] = total.have[i] && p.have[i];
+            total.counters[i] += p.counters[i];
+        }
+        total.io.sends      += p.io.sends;
+        total.io.recvs      += p.io.recvs;
+        total.io.shortSends += p.io.shortSends;
+        total.io.shortRecvs += p.io.shortRecvs;
+        total.syscalls  += p.syscalls;
+        total.seconds    = std::max(total.seconds, p.seconds);
+        total.bytes     += p.bytes;
+        total.exchanges += p.exchanges;
+    }
+    return total;
+}
+
+// "1.23 cycles/B, 0.91 instructions/B (IPC 0.74), 0.05 cache misses/KB, "
+// for the counters that opened. perUnit divides the cycle and instruction
+// counts; cache misses go per missUnit.
+std::string formatCounters(const PhaseProfile& p, double perUnit, const char* unit,
+                           double perMissUnit, const char* missUnit)
+{
+    auto have = [&p](ProfileCounter c) { return p.have[static_cast<int>(c)]; };
+    auto value = [&p](ProfileCounter c) {
+        return static_cast<double>(p.counters[static_cast<int>(c)]);
+    };
+    std::string out;
+    if (have(ProfileCounter::Cycles))
+    {
+        out += fmt::format("{:.2f} cycles/{}, ", value(ProfileCounter::Cycles) / perUnit, unit);
+    }
+    if (have(ProfileCounter::Instructions))
+    {
+        out += fmt::format("{:.2f} instructions/{}", value(ProfileCounter::Instructions) / perUnit,
+                           unit);
+        if (have(ProfileCounter::Cycles) && value(ProfileCounter::Cycles) > 0.0)
+        {
+            out += fmt::format(" (IPC {:.2f})",
+                               value(ProfileCounter::Instructions) / value(ProfileCounter::Cycles));
+        }
+        out += ", ";
+    }
+    if (have(ProfileCounter::CacheMisses))
+    {
+        out += fmt::format("{:.2f} cache misses/{}, ",
+                           value(ProfileCounter::CacheMisses) / perMissUnit, missUnit);
+    }
+    if (have(ProfileCounter::ContextSwitches))
+    {
+        out += fmt::format("{} context switches, ", p.counters[static_cast<int>(
+                               ProfileCounter::ContextSwitches)]);
+    }
+    return out;
+}
+
+} // namespace
+
+void logProfileSummary(const char* verb, const std::vector<StreamResult>& results)
+{
+    PhaseProfile rtt = sumPhases(results, &StreamProfile::rtt);
+    PhaseProfile data = sumPhases(results, &StreamProfile::data);
+    const char* scope = rtt.userOnly || data.userOnly ? " (user space)" : "";
+    auto io = [](const PhaseProfile& p) {
+        return fmt::format("{} sends ({} short), {} recvs ({} short), {} syscalls",
+                           p.io.sends, p.io.shortSends, p.io.recvs, p.io.shortRecvs, p.syscalls);
+    };
+    if (rtt.valid && rtt.exchanges > 0)
+    {
+        double n = static_cast<double>(rtt.exchanges);
+        spdlog::info("Profile: {} RTT phase{}: {} exchanges in {:.3f} ms; {}{}", verb, scope,
+                     rtt.exchanges, rtt.seconds * 1000.0,
+                     formatCounters(rtt, n, "exchange", n, "exchange"), io(rtt));
+    }
+    if (data.valid && data.bytes > 0)
+    {
+        double bytes = static_cast<double>(data.bytes);
+        unsigned long transfers = data.io.sends + data.io.recvs;
+        spdlog::info("Profile: {} data phase{}: {} KB in {:.3f} s; {}{}, {:.0f} B/transfer", verb,
+                     scope, data.bytes / 1000LL, data.seconds,
+                     formatCounters(data, bytes, "B", bytes / 1000.0, "KB"), io(data),
+                     transfers > 0 ? bytes / static_cast<double>(transfers) : 0.0);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "io_engine.hpp"
+
+// --profile: what a stream's RTT and data phases cost. Each phase is
+// bracketed by two reads of the calling thread's perf_event counters and
+// of its engine's IoCounts, so nothing is added inside the loops. The
+// counters are inherited by threads the stream starts (the --bidir
+// receiver), but that receiver's engine keeps its own IoCounts, which are
+// not included. Payload moved outside the engine (MSG_ZEROCOPY, sendfile,
+// splice receives) shows in the syscall lines instead.
+//
+// Hardware counters are often missing in VMs and containers, and with
+// kernel.perf_event_paranoid >= 2 only user space is counted; context
+// switches then come from the stream thread's rusage, without the --bidir
+// receiver's. Whatever opened is reported, the I/O counts always are.
+enum class ProfileCounter
+{
+    Cycles,
+    Instructions,
+    ContextSwitches,
+    CacheMisses,
+    Count,
+};
+
+const char* profileCounterName(ProfileCounter counter);
+
+struct PhaseProfile
+{
+    bool valid = false;
+    bool userOnly = false; // the kernel's share of the hardware counts is missing
+    uint64_t counters[static_cast<int>(ProfileCounter::Count)] = {};
+    bool have[static_cast<int>(ProfileCounter::Count)] = {};
+    IoCounts io;
+    unsigned long syscalls = 0; // every syscall the engine made, epoll_wait() etc. included
+    double seconds = 0.0;
+    long long bytes = 0;     // payload both ways (the RTT phase: 2 per exchange)
+    long long exchanges = 0; // RTT phase only
+};
+
+struct StreamProfile
+{
+    PhaseProfile rtt;
+    PhaseProfile data;
+};
+
+// One per stream thread, built on that thread
+class PhaseProfiler
+{
+public:
+    PhaseProfiler();
+    ~PhaseProfiler();
+
+    PhaseProfiler(const PhaseProfiler&) = delete;
+    PhaseProfiler& operator=(const PhaseProfiler&) = delete;
+
+    void begin(const IoEngine& io);
+    void end(const IoEngine& io, long long bytes, PhaseProfile& out);
+
+private:
+    bool opened(int counter) const;
+    bool read(uint64_t* values) const;
+
+    using Clock = std::chrono::steady_clock;
+
+    int fds_[static_cast<int>(ProfileCounter::Count)];
+    bool userOnly_ = false;
+    bool switchesFromRusage_ = false; // userOnly_: getrusage(RUSAGE_THREAD), this thread only
+    uint64_t start_[static_cast<int>(ProfileCounter::Count)] = {};
+    IoCounts ioStart_;
+    unsigned long syscallsStart_ = 0;
+    Clock::time_point startTime_;
+};
+
+struct StreamResult;
+
+// "Profile <phase>:" lines per phase, summed over the streams that completed:
+// cycles and instructions per byte (per exchange for the RTT phase), IPC,
+// cache misses per KB, context switches and the send/recv counts
+void logProfileSummary(const char* verb, const std::vector<StreamResult>& results);
@@ -0,0 +1,146 @@
+#include "recv_path.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "io_engine.hpp"
+
+bool parseRecvMode(const std::string& name, RecvMode& mode)
+{
+    if (name == "copy")
+    {
+        mode = RecvMode::Copy;
+    }
+    else if (name == "trunc")
+    {
+        mode = RecvMode::Trunc;
+    }
+    else if (name == "splice")
+    {
+        mode = RecvMode::Splice;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char* recvModeName(RecvMode mode)
+{
+    switch (mode)
+    {
+        case RecvMode::Copy:   return "copy";
+        case RecvMode::Trunc:  return "trunc";
+        case RecvMode::Splice: return "splice";
+    }
+    return "?";
+}
+
+ChunkReceiver::ChunkReceiver(IoEngine* engine, int sockfd, RecvMode mode,
+                             char* buf, size_t readSize)
+    : engine_(engine), sockfd_(sockfd), mode_(mode), buf_(buf), readSize_(readSize)
+{
+}
+
+ChunkReceiver::~ChunkReceiver()
+{
+    if (pipe_[0] >= 0)
+    {
+        close(pipe_[0]);
+        close(pipe_[1]);
+    }
+    if (devNull_ >= 0)
+    {
+        close(devNull_);
+    }
+}
+
+bool ChunkReceiver::init()
+{
+    if (mode_ != RecvMode::Splice)
+    {
+        return true;
+    }
+    if (pipe2(pipe_, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        spdlog::error("pipe2() failed: {}", strerror(errno));
+        return false;
+    }
+    // Best effort: a pipe as large as one read keeps it to two splices per read
+    fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(readSize_));
+    devNull_ = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devNull_ < 0)
+    {
+        spdlog::error("open(/dev/null) failed: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+ssize_t ChunkReceiver::receive()
+{
+    if (mode_ == RecvMode::Copy && engine_ != nullptr)
+    {
+        unsigned long before = engine_->syscalls();
+        ssize_t r = engine_->recvDiscard(sockfd_, buf_, readSize_);
+        syscalls_ += engine_->syscalls() - before;
+        return r;
+    }
+    return receive(readSize_);
+}
+
+ssize_t ChunkReceiver::receive(size_t maxLen)
+{
+    const size_t len = std::min(maxLen, readSize_);
+    switch (mode_)
+    {
+        case RecvMode::Copy:
+        {
+            if (engine_ == nullptr)
+            {
+                syscalls_++;
+                return recv(sockfd_, buf_, len, 0);
+            }
+            unsigned long before = engine_->syscalls();
+            ssize_t r = engine_->recvSome(sockfd_, buf_, len);
+            syscalls_ += engine_->syscalls() - before;
+            return r;
+        }
+
+        case RecvMode::Trunc:
+            // tcp(7): with MSG_TRUNC the data is discarded rather than copied out
+            syscalls_++;
+            return recv(sockfd_, nullptr, len, MSG_TRUNC);
+
+        case RecvMode::Splice:
+        {
+            syscalls_++;
+            ssize_t n = splice(sockfd_, nullptr, pipe_[1], nullptr, len,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n <= 0)
+            {
+                return n;
+            }
+            ssize_t left = n;
+            while (left > 0)
+            {
+                syscalls_++;
+                ssize_t out = splice(pipe_[0], nullptr, devNull_, nullptr,
+                                     static_cast<size_t>(left), SPLICE_F_MOVE);
+                if (out <= 0)
+                {
+                    return -1;
+                }
+                left -= out;
+            }
+            return n;
+        }
+    }
+    return -1;
+}
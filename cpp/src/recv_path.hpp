@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+class IoEngine;
+
+// How the server pulls payload off the socket (--recv-mode). The payload is
+// never looked at, so the non-copy modes only need the byte count.
+enum class RecvMode
+{
+    Copy,   // recv() into a userspace buffer
+    Trunc,  // recv(MSG_TRUNC): TCP discards the bytes in the kernel, no copy
+    Splice, // splice() socket -> pipe -> /dev/null
+};
+
+bool parseRecvMode(const std::string& name, RecvMode& mode);
+const char* recvModeName(RecvMode mode);
+
+// Consumes up to readSize bytes per call. Copy mode goes through the I/O
+// engine when one is given; otherwise (and in the other modes) receive()
+// issues its own syscalls and also works on a non-blocking socket, where it
+// returns -1 with errno EAGAIN.
+class ChunkReceiver
+{
+public:
+    // buf (readSize bytes) is only written in Copy mode and may be shared
+    // between receivers since its contents are discarded
+    ChunkReceiver(IoEngine* engine, int sockfd, RecvMode mode, char* buf, size_t readSize);
+    ~ChunkReceiver();
+    ChunkReceiver(const ChunkReceiver&) = delete;
+    ChunkReceiver& operator=(const ChunkReceiver&) = delete;
+
+    bool init();
+
+    // Bytes consumed (> 0), 0 on orderly close, -1 on error (errno set)
+    ssize_t receive();
+
+    // The same, but never consumes more than maxLen bytes (so a frame header
+    // that follows stays in the socket); Copy mode uses the engine's recvSome()
+    ssize_t receive(size_t maxLen);
+
+    // Syscalls spent moving payload (splice costs two per receive())
+    unsigned long syscalls() const { return syscalls_; }
+
+private:
+    IoEngine* engine_;
+    int sockfd_;
+    RecvMode mode_;
+    char* buf_;
+    size_t readSize_;
+    int pipe_[2] = {-1, -1};
+    int devNull_ = -1;
+    unsigned long syscalls_ = 0;
+};
@@ -0,0 +1,641 @@
+#include "report.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include "startup.hpp"
+
+namespace
+{
+
+// Rough per-record sizes, only used to reserve the output buffer up front
+const size_t HEADER_BYTES = 512;
+const size_t STREAM_BYTES = 256;
+const size_t INTERVAL_BYTES = 96;
+const size_t BUCKET_BYTES = 32;
+const size_t STEP_BYTES = 160;
+const size_t TCP_INFO_BYTES = 192;
+const size_t PROFILE_BYTES = 640; // both phases, JSON or CSV
+
+size_t streamsSize(const std::vector<StreamResult>& results, const IntervalReporter* intervals)
+{
+    size_t bytes = results.size() * STREAM_BYTES;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        size_t samples = intervals ? intervals->samples(static_cast<int>(i)).size() : 0;
+        bytes += samples * (INTERVAL_BYTES + TCP_INFO_BYTES);
+        bytes += results[i].steps.size() * STEP_BYTES;
+        bytes += results[i].profile.data.valid ? PROFILE_BYTES : 0;
+    }
+    return bytes;
+}
+
+size_t estimateSize(const RunReport& report)
+{
+    size_t bytes = HEADER_BYTES + streamsSize(report.results, report.intervals) +
+                   streamsSize(report.reverseResults, report.reverseIntervals) +
+                   streamsSize(report.peerResults, nullptr) +
+                   streamsSize(report.peerReverseResults, nullptr);
+    if (report.latency)
+    {
+        bytes += report.latency->nonEmptyBuckets().size() * BUCKET_BYTES;
+    }
+    return bytes;
+}
+
+double intervalRateMbps(const IntervalSample& s)
+{
+    double seconds = s.end - s.start;
+    return seconds > 0.0 ? (static_cast<double>(s.bytes) * 8.0 / seconds) / 1e6 : 0.0;
+}
+
+double us(uint64_t ns)
+{
+    return static_cast<double>(ns) / 1000.0;
+}
+
+void formatUdpJson(std::string& out, const char* name, const UdpStats& u)
+{
+    fmt::format_to(std::back_inserter(out),
+                   "\"{}\":{{\"datagrams\":{},\"bytes\":{},\"seconds\":{:.6f},"
+                   "\"rate_mbps\":{:.3f},\"lost\":{},\"out_of_order\":{},\"jitter_ms\":{:.6f}}}",
+                   name, u.datagrams, u.bytes, u.seconds, u.rateMbps(), u.lost, u.outOfOrder,
+                   u.jitterMs);
+}
+
+// --under-load: one phase's probe RTTs, without the buckets
+void formatProbeJson(std::string& out, const char* name, const LatencyHistogram& h)
+{
+    fmt::format_to(std::back_inserter(out),
+                   "\"{}\":{{\"count\":{},\"min_us\":{:.3f},\"mean_us\":{:.3f},"
+                   "\"p50_us\":{:.3f},\"p90_us\":{:.3f},\"p99_us\":{:.3f},\"max_us\":{:.3f}}}",
+                   name, h.count(), us(h.min()), h.mean() / 1000.0, us(h.percentile(0.50)),
+                   us(h.percentile(0.90)), us(h.percentile(0.99)), us(h.max()));
+}
+
+void formatProbeCsv(std::string& out, const char* record, const LatencyHistogram& h)
+{
+    const std::pair<const char*, double> stats[] = {
+        {"count", static_cast<double>(h.count())},
+        {"min_us", us(h.min())},
+        {"mean_us", h.mean() / 1000.0},
+        {"p50_us", us(h.percentile(0.50))},
+        {"p90_us", us(h.percentile(0.90))},
+        {"p99_us", us(h.percentile(0.99))},
+        {"max_us", us(h.max())},
+    };
+    for (const auto& [name, value] : stats)
+    {
+        fmt::format_to(std::back_inserter(out), "{},,,,,,,,,{},{:.3f}\n", record, name, value);
+    }
+}
+
+void formatTcpInfoJson(std::string& out, const TcpInfoSnapshot& t)
+{
+    fmt::format_to(std::back_inserter(out),
+                   ",\"tcp_info\":{{\"cwnd\":{},\"mss\":{},\"srtt_us\":{},\"rttvar_us\":{},"
+                   "\"retransmits\":{},\"pacing_rate_bps\":{},\"delivery_rate_bps\":{}}}",
+                   t.cwnd, t.mss, t.srttUs, t.rttvarUs, t.retransmits,
+                   t.pacingRate == ~0ULL ? 0 : t.pacingRate * 8, t.deliveryRate * 8);
+}
+
+// One row per field; start/end are empty for the end-of-test snapshot
+void formatTcpInfoCsv(std::string& out, const char* prefix, size_t stream, const std::string& span,
+                      const TcpInfoSnapshot& t)
+{
+    auto it = std::back_inserter(out);
+    const std::pair<const char*, uint64_t> stats[] = {
+        {"cwnd", t.cwnd},
+        {"srtt_us", t.srttUs},
+        {"retransmits", t.retransmits},
+        {"pacing_rate_bps", t.pacingRate == ~0ULL ? 0 : t.pacingRate * 8},
+    };
+    for (const auto& [name, value] : stats)
+    {
+        fmt::format_to(it, "{}tcp_info,{},{},,,,,,{},{}\n", prefix, stream, span, name,
+                       value);
+    }
+}
+
+// --profile: one phase's counters (only those that opened) and I/O counts
+void formatPhaseProfileJson(std::string& out, const char* name, const PhaseProfile& p)
+{
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, "\"{}\":{{\"seconds\":{:.6f},\"bytes\":{}", name, p.seconds, p.bytes);
+    if (p.exchanges > 0)
+    {
+        fmt::format_to(it, ",\"exchanges\":{}", p.exchanges);
+    }
+    for (int i = 0; i < static_cast<int>(ProfileCounter::Count); i++)
+    {
+        if (p.have[i])
+        {
+            fmt::format_to(it, ",\"{}\":{}", profileCounterName(static_cast<ProfileCounter>(i)),
+                           p.counters[i]);
+        }
+    }
+    fmt::format_to(it, ",\"user_only\":{},\"sends\":{},\"short_sends\":{},\"recvs\":{},"
+                       "\"short_recvs\":{},\"syscalls\":{}}}",
+                   p.userOnly, p.io.sends, p.io.shortSends, p.io.recvs, p.io.shortRecvs,
+                   p.syscalls);
+}
+
+// stat = <phase>_<counter>; seconds, bytes and the engine's syscalls in their columns
+void formatPhaseProfileCsv(std::string& out, const char* prefix, size_t stream, const char* name,
+                           const PhaseProfile& p)
+{
+    auto it = std::back_inserter(out);
+    auto row = [&](const char* stat, uint64_t value) {
+        fmt::format_to(it, "{}profile,{},,{:.6f},{},,,,{},{}_{},{}\n", prefix, stream, p.seconds,
+                       p.bytes, p.syscalls, name, stat, value);
+    };
+    for (int i = 0; i < static_cast<int>(ProfileCounter::Count); i++)
+    {
+        if (p.have[i])
+        {
+            row(profileCounterName(static_cast<ProfileCounter>(i)), p.counters[i]);
+        }
+    }
+    row("sends", p.io.sends);
+    row("short_sends", p.io.shortSends);
+    row("recvs", p.io.recvs);
+    row("short_recvs", p.io.shortRecvs);
+}
+
+// withLoss: the receive-side stats too; the sender only knows its datagram count
+void formatUdpCsv(std::string& out, const char* side, const UdpStats& u, bool withLoss)
+{
+    auto it = std::back_inserter(out);
+    const std::pair<const char*, double> stats[] = {
+        {"datagrams", static_cast<double>(u.datagrams)},
+        {"lost", static_cast<double>(u.lost)},
+        {"out_of_order", static_cast<double>(u.outOfOrder)},
+        {"jitter_ms", u.jitterMs},
+    };
+    for (size_t i = 0; i < (withLoss ? std::size(stats) : 1); i++)
+    {
+        fmt::format_to(it, "udp,,,{:.6f},{},{:.3f},,,,{}_{},{}\n",
+                       u.seconds, u.bytes, u.rateMbps(), side, stats[i].first, stats[i].second);
+    }
+}
+
+// ,"<prefix>streams":[...],"<prefix>sum":{...} for one direction of the test
+void formatStreamsJson(std::string& out, const char* prefix,
+                       const std::vector<StreamResult>& results, const IntervalReporter* intervals)
+{
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, ",\"{}streams\":[", prefix);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const StreamResult& r = results[i];
+        fmt::format_to(it, "{}{{\"id\":{},\"ok\":{},\"bytes\":{},\"seconds\":{:.6f},"
+                           "\"rate_mbps\":{:.3f},\"rtt_ms\":{},\"cpu_s\":{:.6f},\"syscalls\":{},"
+                           "\"ack_syscalls\":{}",
+                       i > 0 ? "," : "", i, r.ok, r.bytes, r.seconds, r.rateMbps, r.rttMillis,
+                       r.cpuSeconds, r.syscalls, r.ackSyscalls);
+        // CPU time as a share of one CPU over the data phase
+        fmt::format_to(it, ",\"cpu_util\":{:.4f}",
+                       r.seconds > 0.0 ? r.cpuSeconds / r.seconds : 0.0);
+        if (r.cpu >= 0)
+        {
+            fmt::format_to(it, ",\"cpu\":{}", r.cpu);
+        }
+        if (r.linkRate.samples > 0)
+        {
+            fmt::format_to(it, ",\"link_rate\":{{\"method\":\"{}\",\"rate_mbps\":{:.3f},"
+                               "\"samples\":{},\"capped\":{}}}",
+                           linkRateMethodName(r.linkRate.method), r.linkRate.rateMbps,
+                           r.linkRate.samples, r.linkRate.capped);
+        }
+        if (r.exchanges >= 0)
+        {
+            fmt::format_to(it, ",\"exchanges\":{}", r.exchanges);
+        }
+        if (r.verify.enabled)
+        {
+            fmt::format_to(it, ",\"verify\":{{\"chunks\":{},\"bad_chunks\":{},\"seconds\":{:.6f}}}",
+                           r.verify.chunks, r.verify.badChunks, r.verify.seconds);
+        }
+        if (r.tcpInfo.valid)
+        {
+            formatTcpInfoJson(out, r.tcpInfo);
+        }
+        if (r.profile.data.valid)
+        {
+            out += ",\"profile\":{";
+            formatPhaseProfileJson(out, "rtt", r.profile.rtt);
+            out += ',';
+            formatPhaseProfileJson(out, "data", r.profile.data);
+            out += '}';
+        }
+        if (!r.steps.empty())
+        {
+            out += ",\"steps\":[";
+            for (size_t k = 0; k < r.steps.size(); k++)
+            {
+                const SweepStep& st = r.steps[k];
+                fmt::format_to(it, "{}{{\"chunk_size\":{},\"bytes\":{},\"seconds\":{:.6f},"
+                                   "\"rate_mbps\":{:.3f},\"syscalls\":{},\"ack_syscalls\":{}}}",
+                               k > 0 ? "," : "", st.chunkSize, st.bytes, st.seconds,
+                               st.rateMbps, st.syscalls, st.ackSyscalls);
+            }
+            out += ']';
+        }
+        if (intervals)
+        {
+            out += ",\"intervals\":[";
+            const auto& samples = intervals->samples(static_cast<int>(i));
+            for (size_t k = 0; k < samples.size(); k++)
+            {
+                const IntervalSample& s = samples[k];
+                fmt::format_to(it, "{}{{\"start\":{:.6f},\"end\":{:.6f},\"bytes\":{},"
+                                   "\"rate_mbps\":{:.3f}",
+                               k > 0 ? "," : "", s.start, s.end, s.bytes, intervalRateMbps(s));
+                if (s.ackWaits > 0)
+                {
+                    fmt::format_to(it, ",\"ack_wait_ms\":{:.6f}",
+                                   s.ackWaitSeconds * 1000.0 / s.ackWaits);
+                }
+                if (s.tcpInfo.valid)
+                {
+                    formatTcpInfoJson(out, s.tcpInfo);
+                }
+                out += '}';
+            }
+            out += ']';
+        }
+        out += '}';
+    }
+    out += ']';
+
+    SummaryTotals totals = sumResults(results);
+    fmt::format_to(it, ",\"{}sum\":{{\"bytes\":{},\"rate_mbps\":{:.3f},\"rtt_ms\":{},"
+                       "\"ok_streams\":{},\"fairness\":{:.6f}}}",
+                   prefix, totals.bytes, totals.rateMbps, totals.rttMillis, totals.okStreams,
+                   fairnessIndex(results));
+}
+
+void formatJson(std::string& out, const RunReport& report)
+{
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, "{{\"role\":\"{}\",\"mode\":\"{}\",\"options\":{{\"engine\":\"{}\","
+                       "\"path\":\"{}\",\"streams\":{},\"window\":{},\"duration_s\":{},"
+                       "\"interval_s\":{},\"read_size\":{},\"msg_size\":{},\"direction\":\"{}\","
+                       "\"buffers\":\"{}\",\"payload\":\"{}\",\"verify\":{},"
+                       "\"bitrate_bps\":{:.0f}}}",
+                   report.role, report.mode, report.engine, report.path, report.streams,
+                   report.window, report.durationSeconds, report.intervalSeconds,
+                   report.readSize, report.msgSize, report.direction, report.buffers,
+                   report.payload, report.verify, report.bitrate);
+    if (report.run >= 0)
+    {
+        // --repeat writes one object per run, a line each
+        fmt::format_to(it, ",\"run\":{}", report.run);
+    }
+
+    if (report.startup)
+    {
+        // ms since process start at each phase's end
+        out += ",\"startup_ms\":{";
+        bool first = true;
+        for (int i = 0; i < static_cast<int>(StartupPhase::Count); i++)
+        {
+            double at = startupSeconds(static_cast<StartupPhase>(i));
+            if (at >= 0.0)
+            {
+                fmt::format_to(it, "{}\"{}\":{:.3f}", first ? "" : ",",
+                               startupPhaseName(static_cast<StartupPhase>(i)), at * 1000.0);
+                first = false;
+            }
+        }
+        out += '}';
+    }
+
+    if (report.connect)
+    {
+        const ConnectReport& c = *report.connect;
+        fmt::format_to(it, ",\"connect\":{{\"host\":\"{}\",\"source\":\"{}\","
+                           "\"address\":\"{}\",\"v6_addresses\":{},\"v4_addresses\":{},"
+                           "\"resolve_ms\":{:.3f},\"connect_ms\":{:.3f},\"attempts\":[",
+                       c.host, c.source, formatAddress(c.winner.sockAddr()), c.v6Addresses,
+                       c.v4Addresses, c.resolveSeconds * 1000.0, c.connectSeconds * 1000.0);
+        for (size_t k = 0; k < c.attempts.size(); k++)
+        {
+            const ConnectAttempt& a = c.attempts[k];
+            fmt::format_to(it, "{}{{\"address\":\"{}\",\"ms\":{:.3f},\"result\":\"{}\"}}",
+                           k > 0 ? "," : "", formatAddress(a.address.sockAddr()),
+                           a.seconds * 1000.0, attemptResult(a));
+        }
+        out += "],\"stream_connect_ms\":[";
+        for (size_t k = 0; k < report.connectSeconds.size(); k++)
+        {
+            fmt::format_to(it, "{}{:.3f}", k > 0 ? "," : "", report.connectSeconds[k] * 1000.0);
+        }
+        out += "]}";
+    }
+
+    formatStreamsJson(out, "", report.results, report.intervals);
+    if (!report.reverseResults.empty())
+    {
+        formatStreamsJson(out, "reverse_", report.reverseResults, report.reverseIntervals);
+    }
+    if (!report.peerResults.empty())
+    {
+        formatStreamsJson(out, "peer_", report.peerResults, nullptr);
+    }
+    if (!report.peerReverseResults.empty())
+    {
+        formatStreamsJson(out, "peer_reverse_", report.peerReverseResults, nullptr);
+    }
+
+    if (report.latency)
+    {
+        const LatencyHistogram& h = *report.latency;
+        fmt::format_to(it, ",\"latency\":{{\"count\":{},\"min_us\":{:.3f},\"mean_us\":{:.3f},"
+                           "\"p50_us\":{:.3f},\"p90_us\":{:.3f},\"p99_us\":{:.3f},"
+                           "\"p999_us\":{:.3f},\"max_us\":{:.3f},\"buckets\":[",
+                       h.count(), us(h.min()), h.mean() / 1000.0, us(h.percentile(0.50)),
+                       us(h.percentile(0.90)), us(h.percentile(0.99)),
+                       us(h.percentile(0.999)), us(h.max()));
+        bool first = true;
+        for (const auto& [top, count] : h.nonEmptyBuckets())
+        {
+            fmt::format_to(it, "{}[{:.3f},{}]", first ? "" : ",", us(top), count);
+            first = false;
+        }
+        out += "]}";
+    }
+    if (report.transactions)
+    {
+        const TransactionSummary& t = *report.transactions;
+        fmt::format_to(it, ",\"transactions\":{{\"request\":{},\"response\":{},\"depth\":{},"
+                           "\"connect_each\":{},\"count\":{},\"seconds\":{:.6f},"
+                           "\"per_second\":{:.3f}}}",
+                       t.spec.requestSize, t.spec.responseSize, t.spec.depth,
+                       t.connectEach ? "true" : "false", t.count, t.seconds, t.perSecond());
+    }
+    if (report.probe)
+    {
+        fmt::format_to(it, ",\"under_load\":{{\"interval_s\":{:.6f},",
+                       report.probe->intervalSeconds());
+        formatProbeJson(out, "idle", report.probe->idle());
+        out += ',';
+        formatProbeJson(out, "loaded", report.probe->loaded());
+        out += '}';
+    }
+    if (report.udpSent || report.udpReceived)
+    {
+        out += ",\"udp\":{";
+        if (report.udpSent)
+        {
+            formatUdpJson(out, "sent", *report.udpSent);
+        }
+        if (report.udpReceived && report.udpReceived->valid)
+        {
+            out += report.udpSent ? "," : "";
+            formatUdpJson(out, "received", *report.udpReceived);
+        }
+        out += '}';
+    }
+    out += "}\n";
+}
+
+// The stream, step, interval, tcp_info and sum rows of one direction, each
+// record name prefixed (e.g. reverse_stream)
+void formatStreamsCsv(std::string& out, const char* prefix,
+                      const std::vector<StreamResult>& results, const IntervalReporter* intervals)
+{
+    auto it = std::back_inserter(out);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const StreamResult& r = results[i];
+        fmt::format_to(it, "{}stream,{},0.000000,{:.6f},{},{:.3f},{},{:.6f},{},{},{}\n",
+                       prefix, i, r.seconds, r.bytes, r.rateMbps, r.rttMillis, r.cpuSeconds,
+                       r.syscalls, r.exchanges >= 0 ? "exchanges" : "ok",
+                       r.exchanges >= 0 ? r.exchanges : static_cast<long long>(r.ok));
+        // stat = cpu, value = the CPU the stream's thread was pinned to
+        if (r.cpu >= 0)
+        {
+            fmt::format_to(it, "{}affinity,{},,,,,,{:.6f},,cpu,{}\n", prefix, i, r.cpuSeconds,
+                           r.cpu);
+        }
+        // stat = method, value = samples behind the estimate
+        if (r.linkRate.samples > 0)
+        {
+            fmt::format_to(it, "{}link_rate,{},,,,{:.3f},,,,{},{}\n", prefix, i,
+                           r.linkRate.rateMbps, linkRateMethodName(r.linkRate.method),
+                           r.linkRate.samples);
+        }
+        // stat = chunks / bad_chunks checked by --verify, cpu_s = time spent checking
+        if (r.verify.enabled)
+        {
+            fmt::format_to(it, "{}verify,{},,,,,,{:.6f},,chunks,{}\n", prefix, i,
+                           r.verify.seconds, r.verify.chunks);
+            fmt::format_to(it, "{}verify,{},,,,,,,,bad_chunks,{}\n", prefix, i,
+                           r.verify.badChunks);
+        }
+        // stat = chunk size, value = payload + ack syscalls per second
+        for (const SweepStep& st : r.steps)
+        {
+            double perSecond = st.seconds > 0.0
+                ? static_cast<double>(st.syscalls + st.ackSyscalls) / st.seconds : 0.0;
+            fmt::format_to(it, "{}step,{},,{:.6f},{},{:.3f},,,{},{},{:.0f}\n", prefix, i, st.seconds,
+                           st.bytes, st.rateMbps, st.syscalls, st.chunkSize, perSecond);
+        }
+        if (intervals)
+        {
+            for (const IntervalSample& s : intervals->samples(static_cast<int>(i)))
+            {
+                fmt::format_to(it, "{}interval,{},{:.6f},{:.6f},{},{:.3f},,,,", prefix, i, s.start,
+                               s.end, s.bytes, intervalRateMbps(s));
+                if (s.ackWaits > 0)
+                {
+                    fmt::format_to(it, "ack_wait_ms,{:.6f}", s.ackWaitSeconds * 1000.0 / s.ackWaits);
+                }
+                else
+                {
+                    out += ',';
+                }
+                out += '\n';
+                if (s.tcpInfo.valid)
+                {
+                    formatTcpInfoCsv(out, prefix, i, fmt::format("{:.6f},{:.6f}", s.start, s.end), s.tcpInfo);
+                }
+            }
+        }
+        if (r.tcpInfo.valid)
+        {
+            formatTcpInfoCsv(out, prefix, i, ",", r.tcpInfo);
+        }
+        if (r.profile.data.valid)
+        {
+            formatPhaseProfileCsv(out, prefix, i, "rtt", r.profile.rtt);
+            formatPhaseProfileCsv(out, prefix, i, "data", r.profile.data);
+        }
+    }
+
+    SummaryTotals totals = sumResults(results);
+    double cpuSeconds = 0.0;
+    unsigned long syscalls = 0;
+    for (const auto& r : results)
+    {
+        cpuSeconds += r.cpuSeconds;
+        syscalls += r.syscalls;
+    }
+    fmt::format_to(it, "{}sum,,,,{},{:.3f},{},{:.6f},{},fairness,{:.6f}\n",
+                   prefix, totals.bytes, totals.rateMbps, totals.rttMillis, cpuSeconds, syscalls,
+                   fairnessIndex(results));
+}
+
+// One header, one row per record; columns a record doesn't use stay empty
+void formatCsv(std::string& out, const RunReport& report)
+{
+    auto it = std::back_inserter(out);
+    out += "record,stream,start,end,bytes,rate_mbps,rtt_ms,cpu_s,syscalls,stat,value\n";
+    if (report.run >= 0)
+    {
+        fmt::format_to(it, "run,,,,,,,,,index,{}\n", report.run);
+    }
+
+    if (report.startup)
+    {
+        // end: seconds since process start
+        for (int i = 0; i < static_cast<int>(StartupPhase::Count); i++)
+        {
+            double at = startupSeconds(static_cast<StartupPhase>(i));
+            if (at >= 0.0)
+            {
+                fmt::format_to(it, "startup,,,{:.6f},,,,,,phase,{}\n", at,
+                               startupPhaseName(static_cast<StartupPhase>(i)));
+            }
+        }
+    }
+
+    if (report.connect)
+    {
+        // start/end: seconds; stat/value: what the row is about
+        const ConnectReport& c = *report.connect;
+        fmt::format_to(it, "resolve,,0.000000,{:.6f},,,,,,addresses,{}\n", c.resolveSeconds,
+                       c.v6Addresses + c.v4Addresses);
+        for (size_t k = 0; k < c.attempts.size(); k++)
+        {
+            const ConnectAttempt& a = c.attempts[k];
+            fmt::format_to(it, "connect_attempt,{},,{:.6f},,,,,,{},{}\n", k, a.seconds,
+                           attemptResult(a), formatAddress(a.address.sockAddr()));
+        }
+        for (size_t i = 0; i < report.connectSeconds.size(); i++)
+        {
+            fmt::format_to(it, "connect,{},,{:.6f},,,,,,address,{}\n", i, report.connectSeconds[i],
+                           formatAddress(c.winner.sockAddr()));
+        }
+    }
+
+    formatStreamsCsv(out, "", report.results, report.intervals);
+    if (!report.reverseResults.empty())
+    {
+        formatStreamsCsv(out, "reverse_", report.reverseResults, report.reverseIntervals);
+    }
+    if (!report.peerResults.empty())
+    {
+        formatStreamsCsv(out, "peer_", report.peerResults, nullptr);
+    }
+    if (!report.peerReverseResults.empty())
+    {
+        formatStreamsCsv(out, "peer_reverse_", report.peerReverseResults, nullptr);
+    }
+
+    if (report.latency)
+    {
+        const LatencyHistogram& h = *report.latency;
+        const std::pair<const char*, double> stats[] = {
+            {"count", static_cast<double>(h.count())},
+            {"min_us", us(h.min())},
+            {"mean_us", h.mean() / 1000.0},
+            {"p50_us", us(h.percentile(0.50))},
+            {"p90_us", us(h.percentile(0.90))},
+            {"p99_us", us(h.percentile(0.99))},
+            {"p999_us", us(h.percentile(0.999))},
+            {"max_us", us(h.max())},
+        };
+        for (const auto& [name, value] : stats)
+        {
+            fmt::format_to(it, "latency,,,,,,,,,{},{:.3f}\n", name, value);
+        }
+        // stat = bucket upper bound in us, value = samples in the bucket
+        for (const auto& [top, count] : h.nonEmptyBuckets())
+        {
+            fmt::format_to(it, "bucket,,,,,,,,,{:.3f},{}\n", us(top), count);
+        }
+    }
+    if (report.transactions)
+    {
+        const TransactionSummary& t = *report.transactions;
+        const std::pair<const char*, double> stats[] = {
+            {"request", static_cast<double>(t.spec.requestSize)},
+            {"response", static_cast<double>(t.spec.responseSize)},
+            {"depth", static_cast<double>(t.spec.depth)},
+            {"connect_each", t.connectEach ? 1.0 : 0.0},
+            {"count", static_cast<double>(t.count)},
+            {"seconds", t.seconds},
+            {"per_second", t.perSecond()},
+        };
+        for (const auto& [name, value] : stats)
+        {
+            fmt::format_to(it, "transactions,,,,,,,,,{},{:.3f}\n", name, value);
+        }
+    }
+    if (report.probe)
+    {
+        formatProbeCsv(out, "idle_rtt", report.probe->idle());
+        formatProbeCsv(out, "loaded_rtt", report.probe->loaded());
+    }
+    if (report.udpSent)
+    {
+        formatUdpCsv(out, "sent", *report.udpSent, false);
+    }
+    if (report.udpReceived && report.udpReceived->valid)
+    {
+        formatUdpCsv(out, "received", *report.udpReceived, true);
+    }
+}
+
+} // namespace
+
+void writeReport(OutputFormat format, const RunReport& report)
+{
+    if (format == OutputFormat::Text)
+    {
+        return;
+    }
+
+    std::string out;
+    out.reserve(estimateSize(report));
+    if (format == OutputFormat::Json)
+    {
+        formatJson(out, report);
+    }
+    else
+    {
+        formatCsv(out, report);
+    }
+
+    // A single write() unless stdout is a pipe that takes it in pieces
+    size_t written = 0;
+    while (written < out.size())
+    {
+        ssize_t w = write(STDOUT_FILENO, out.data() + written, out.size() - written);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spdlog::error("Writing report failed: {}", strerror(errno));
+            return;
+        }
+        written += static_cast<size_t>(w);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "common.hpp"
+#include "interval.hpp"
+#include "latency.hpp"
+#include "probe.hpp"
+#include "udp.hpp"
+
+// How the final results are printed (--json / --csv). In the machine-readable
+// formats the log lines move to stderr and stdout carries only the report.
+enum class OutputFormat
+{
+    Text,
+    Json,
+    Csv,
+};
+
+// Everything one run produced, gathered for the end-of-run report
+struct RunReport
+{
+    const char* role = "client"; // or "server"
+    const char* mode = "throughput"; // or "latency" / "transactions" / "udp"
+    const char* engine = "blocking";
+    const char* path = "copy"; // send path (client) / receive path (server)
+    const char* buffers = "heap"; // what backed the data buffers (buffer_pool.hpp)
+    const char* direction = "forward"; // or "reverse" / "bidir"
+    const char* payload = "zeros"; // payload.hpp pattern name
+    bool verify = false;           // --verify: receivers checked every chunk
+    int streams = 0;
+    int window = 0;
+    double durationSeconds = 0.0;
+    double intervalSeconds = 0.0;
+    size_t readSize = 0;
+    size_t msgSize = 0;
+    double bitrate = 0.0; // -b on TCP: per-stream pace, bits/s; 0 = unpaced
+    int run = -1;         // --repeat: this run's index; -1 = a single run
+    bool startup = false; // client's first run: include the startup timeline
+
+    std::vector<StreamResult> results;               // client -> server data
+    const IntervalReporter* intervals = nullptr;     // only with -i
+    std::vector<StreamResult> reverseResults;        // -R / --bidir: server -> client data
+    const IntervalReporter* reverseIntervals = nullptr;
+    std::vector<StreamResult> peerResults;           // the other end's view, over the
+    std::vector<StreamResult> peerReverseResults;    // control connection (if any)
+    const LatencyHistogram* latency = nullptr;   // only client --latency / --rr
+    const TransactionSummary* transactions = nullptr; // only client --rr
+    const LoadProbe* probe = nullptr;            // only client --under-load
+    const UdpStats* udpSent = nullptr;           // only client -u
+    const UdpStats* udpReceived = nullptr;       // -u: the server's counts
+    const ConnectReport* connect = nullptr;      // client TCP: resolution and the race
+    std::vector<double> connectSeconds;          // ...and each data stream's connect()
+};
+
+// Formats into one pre-sized buffer and writes it to stdout in one go
+void writeReport(OutputFormat format, const RunReport& report);
@@ -0,0 +1,163 @@
+#include "sockopt.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <linux/tcp.h> // the full struct tcp_info (pacing and delivery rates)
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // Linux 5.11; older libc headers lack it
+#endif
+
+namespace
+{
+
+bool setIntOption(int sockfd, int level, int name, int value, const char* label)
+{
+    if (setsockopt(sockfd, level, name, &value, sizeof(value)) < 0)
+    {
+        spdlog::error("setsockopt({}={}) failed: {}", label, value, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int getIntOption(int sockfd, int level, int name)
+{
+    int value = 0;
+    socklen_t len = sizeof(value);
+    if (getsockopt(sockfd, level, name, &value, &len) < 0)
+    {
+        return -1;
+    }
+    return value;
+}
+
+} // namespace
+
+bool applySocketTuning(int sockfd, const SocketTuning& tuning)
+{
+    if (tuning.sndbuf > 0 && !setIntOption(sockfd, SOL_SOCKET, SO_SNDBUF, tuning.sndbuf, "SO_SNDBUF"))
+    {
+        return false;
+    }
+    if (tuning.rcvbuf > 0 && !setIntOption(sockfd, SOL_SOCKET, SO_RCVBUF, tuning.rcvbuf, "SO_RCVBUF"))
+    {
+        return false;
+    }
+    if (tuning.nodelay && !setIntOption(sockfd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY"))
+    {
+        return false;
+    }
+    if (tuning.mss > 0 && !setIntOption(sockfd, IPPROTO_TCP, TCP_MAXSEG, tuning.mss, "TCP_MAXSEG"))
+    {
+        return false;
+    }
+    if (!tuning.congestion.empty() &&
+        setsockopt(sockfd, IPPROTO_TCP, TCP_CONGESTION, tuning.congestion.data(),
+                   static_cast<socklen_t>(tuning.congestion.size())) < 0)
+    {
+        spdlog::error("setsockopt(TCP_CONGESTION={}) failed: {} (see "
+                      "net.ipv4.tcp_available_congestion_control)",
+                      tuning.congestion, strerror(errno));
+        return false;
+    }
+    if (tuning.maxPacingRate > 0)
+    {
+        // Only enforced by the fq qdisc, or by TCP's internal pacing without it
+        uint64_t rate = tuning.maxPacingRate;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) < 0)
+        {
+            spdlog::error("setsockopt(SO_MAX_PACING_RATE={}) failed: {}", rate, strerror(errno));
+            return false;
+        }
+    }
+    // Raising SO_BUSY_POLL past net.core.busy_read needs CAP_NET_ADMIN
+    if (tuning.busyPollUs > 0 &&
+        !setIntOption(sockfd, SOL_SOCKET, SO_BUSY_POLL, tuning.busyPollUs, "SO_BUSY_POLL"))
+    {
+        return false;
+    }
+    if (tuning.preferBusyPoll &&
+        !setIntOption(sockfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, 1, "SO_PREFER_BUSY_POLL"))
+    {
+        return false;
+    }
+    return true;
+}
+
+bool enableFastOpen(int sockfd, bool listener)
+{
+    // net.ipv4.tcp_fastopen: bit 0 enables clients, bit 1 servers
+    static std::once_flag checked;
+    std::call_once(checked, [listener]() {
+        int sysctl = 0;
+        std::ifstream("/proc/sys/net/ipv4/tcp_fastopen") >> sysctl;
+        int bit = listener ? 2 : 1;
+        if ((sysctl & bit) == 0)
+        {
+            spdlog::warn("Socket: net.ipv4.tcp_fastopen={} leaves TCP Fast Open off for {}s "
+                         "(needs {:#x}); connections use a plain handshake", sysctl,
+                         listener ? "server" : "client", bit);
+        }
+    });
+    if (listener)
+    {
+        return setIntOption(sockfd, IPPROTO_TCP, TCP_FASTOPEN, FASTOPEN_QUEUE, "TCP_FASTOPEN");
+    }
+    return setIntOption(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT");
+}
+
+void logSocketSettings(int sockfd)
+{
+    char congestion[16] = {};
+    socklen_t len = sizeof(congestion) - 1;
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_CONGESTION, congestion, &len) < 0)
+    {
+        std::strcpy(congestion, "n/a"); // not a TCP socket
+    }
+    spdlog::info("Socket: SndBuf={} B, RcvBuf={} B, Congestion={}, BusyPoll={}us",
+                 getIntOption(sockfd, SOL_SOCKET, SO_SNDBUF),
+                 getIntOption(sockfd, SOL_SOCKET, SO_RCVBUF), congestion,
+                 getIntOption(sockfd, SOL_SOCKET, SO_BUSY_POLL));
+}
+
+bool readTcpInfo(int sockfd, TcpInfoSnapshot& snapshot)
+{
+    tcp_info info;
+    std::memset(&info, 0, sizeof(info));
+    socklen_t len = sizeof(info);
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+    {
+        return false;
+    }
+    // Older kernels fill a shorter struct; the fields they lack stay zero
+    snapshot.cwnd         = info.tcpi_snd_cwnd;
+    snapshot.mss          = info.tcpi_snd_mss;
+    snapshot.srttUs       = info.tcpi_rtt;
+    snapshot.rttvarUs     = info.tcpi_rttvar;
+    snapshot.retransmits  = info.tcpi_total_retrans;
+    snapshot.pacingRate   = info.tcpi_pacing_rate;
+    snapshot.deliveryRate = info.tcpi_delivery_rate;
+    snapshot.valid        = true;
+    return true;
+}
+
+std::string formatTcpInfo(const TcpInfoSnapshot& snapshot)
+{
+    if (!snapshot.valid)
+    {
+        return {};
+    }
+    // ~0 is the kernel's "no pacing limit"
+    std::string pacing = snapshot.pacingRate == ~0ULL
+        ? std::string("unlimited")
+        : fmt::format("{:.3f} Mbps", static_cast<double>(snapshot.pacingRate) * 8.0 / 1e6);
+    return fmt::format(", Cwnd={}, Srtt={:.3f}ms, Rttvar={:.3f}ms, Retrans={}, Pacing={}",
+                       snapshot.cwnd, snapshot.srttUs / 1000.0, snapshot.rttvarUs / 1000.0,
+                       snapshot.retransmits, pacing);
+}
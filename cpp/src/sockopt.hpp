@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Socket tuning (--sndbuf, --rcvbuf, --nodelay, --congestion, --mss,
+// --max-pacing-rate, --busy-poll, --prefer-busy-poll). Every field left at its default keeps the kernel's
+// choice, so an untuned run behaves exactly as before. The client applies
+// these before connect() and the server to its listening socket, whose
+// accepted connections inherit them; buffer sizes and the MSS have to be in
+// place before the handshake, where the window scale and MSS are agreed.
+static const size_t MAX_SOCKET_BUFFER = 1 << 30; // the kernel doubles it into an int
+static const int MIN_MSS = 88;    // the kernel's TCP_MIN_MSS
+static const int MAX_MSS = 65495; // largest MSS over loopback
+static const size_t MAX_CONGESTION_NAME = 16; // TCP_CA_NAME_MAX
+static const int MAX_BUSY_POLL_US = 1000000;
+static const int FASTOPEN_QUEUE = 256; // --fastopen server: TFO requests pending at once
+
+struct SocketTuning
+{
+    int sndbuf = 0;             // SO_SNDBUF bytes; 0 = autotuning
+    int rcvbuf = 0;             // SO_RCVBUF bytes; 0 = autotuning
+    bool nodelay = false;       // TCP_NODELAY
+    std::string congestion;     // TCP_CONGESTION, e.g. cubic or bbr; empty = system default
+    int mss = 0;                // TCP_MAXSEG; 0 = path default
+    uint64_t maxPacingRate = 0; // SO_MAX_PACING_RATE, bytes/s; 0 = unlimited
+    int busyPollUs = 0;         // SO_BUSY_POLL: spin on the device queue this long per
+                                // blocking receive; 0 = sleep for the interrupt
+    bool preferBusyPoll = false; // SO_PREFER_BUSY_POLL: also defer the device's IRQs
+    bool tcpInfo = false;       // --tcp-info: capture TCP_INFO snapshots
+    bool fastOpen = false;      // --fastopen: TCP Fast Open; see enableFastOpen()
+
+    // Anything but the buffer sizes only makes sense on a TCP socket
+    bool tcpOnly() const { return nodelay || !congestion.empty() || mss > 0 || fastOpen; }
+};
+
+// Sender-side state from TCP_INFO at one point in the data phase
+struct TcpInfoSnapshot
+{
+    bool valid = false;
+    uint32_t cwnd = 0;          // segments
+    uint32_t mss = 0;           // bytes, as sent
+    uint32_t srttUs = 0;
+    uint32_t rttvarUs = 0;
+    uint32_t retransmits = 0;   // segments retransmitted over the connection
+    uint64_t pacingRate = 0;    // bytes/s
+    uint64_t deliveryRate = 0;  // bytes/s, the kernel's latest estimate
+};
+
+// setsockopt() every option tuning asks for; logs and returns false on the
+// first one the kernel rejects (e.g. a congestion module that isn't loaded)
+bool applySocketTuning(int sockfd, const SocketTuning& tuning);
+
+// TCP Fast Open, which applySocketTuning() leaves alone as the two ends
+// differ. A listener gets TCP_FASTOPEN (FASTOPEN_QUEUE); a client socket
+// TCP_FASTOPEN_CONNECT, so once a cookie from an earlier connection to the
+// server is cached its connect() returns at once and the first send()
+// carries its bytes in the SYN. Without a cookie, or if the sysctl
+// net.ipv4.tcp_fastopen lacks this side's bit (warned about once), it is
+// an ordinary handshake. false (logged) if the kernel refuses the option.
+bool enableFastOpen(int sockfd, bool listener);
+
+// One "Socket:" line with the buffer sizes the kernel actually granted
+// (it doubles the requested value), the congestion control and busy-poll
+// time in use
+void logSocketSettings(int sockfd);
+
+// false (snapshot.valid stays false) when the socket has no TCP_INFO
+bool readTcpInfo(int sockfd, TcpInfoSnapshot& snapshot);
+
+// ", Cwnd=..., Srtt=..." suffix for a log line; empty for an invalid snapshot
+std::string formatTcpInfo(const TcpInfoSnapshot& snapshot);
@@ -0,0 +1,73 @@
+#include "startup.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point PROCESS_START = Clock::now();
+
+// ns since PROCESS_START, + 1 so that 0 means unmarked
+std::atomic<int64_t> marks[static_cast<int>(StartupPhase::Count)];
+
+} // namespace
+
+void markStartup(StartupPhase phase)
+{
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     Clock::now() - PROCESS_START).count() + 1;
+    int64_t unmarked = 0;
+    marks[static_cast<int>(phase)].compare_exchange_strong(unmarked, ns,
+                                                           std::memory_order_relaxed);
+}
+
+double startupSeconds(StartupPhase phase)
+{
+    int64_t ns = marks[static_cast<int>(phase)].load(std::memory_order_relaxed);
+    return ns > 0 ? static_cast<double>(ns - 1) / 1e9 : -1.0;
+}
+
+const char* startupPhaseName(StartupPhase phase)
+{
+    switch (phase)
+    {
+        case StartupPhase::Logger:    return "logger";
+        case StartupPhase::Options:   return "options";
+        case StartupPhase::Connected: return "connect";
+        case StartupPhase::Control:   return "control";
+        case StartupPhase::Streams:   return "streams";
+        case StartupPhase::DataStart: return "rtt";
+        case StartupPhase::Count:     break;
+    }
+    return "?";
+}
+
+// Each phase as the time since the previous one that was reached
+void logStartupTimeline()
+{
+    std::string phases;
+    double previous = 0.0;
+    for (int i = 0; i < static_cast<int>(StartupPhase::Count); i++)
+    {
+        double at = startupSeconds(static_cast<StartupPhase>(i));
+        if (at < 0.0)
+        {
+            continue;
+        }
+        phases += fmt::format("{}{} {:.3f} ms", phases.empty() ? "" : ", ",
+                              startupPhaseName(static_cast<StartupPhase>(i)),
+                              (at - previous) * 1000.0);
+        previous = at;
+    }
+    double first = startupSeconds(StartupPhase::DataStart);
+    if (first < 0.0)
+    {
+        return;
+    }
+    spdlog::info("Startup: {}; first payload byte after {:.3f} ms", phases, first * 1000.0);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+// Where a short client run spends the time before its first payload byte.
+// Each phase is marked once, the first time it is reached (the first stream
+// to finish its RTT phase ends it), in steady_clock time since this module's
+// static initialisation, i.e. about when the process was loaded.
+enum class StartupPhase
+{
+    Logger,    // logging set up
+    Options,   // command line parsed and checked
+    Connected, // the first connection (control, else stream 0): resolve + race
+    Control,   // the test agreed over it
+    Streams,   // every data stream connected
+    DataStart, // RTT phase done: the first payload byte goes out
+    Count,
+};
+
+void markStartup(StartupPhase phase);
+
+// Seconds since process start at phase's mark; < 0 if never marked
+double startupSeconds(StartupPhase phase);
+
+const char* startupPhaseName(StartupPhase phase);
+
+// "Startup: logger 0.2 ms, options 0.1 ms, ...; first byte after 1.9 ms"
+void logStartupTimeline();
@@ -0,0 +1,399 @@
+#include "sweep.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "buffer_pool.hpp"
+#include "clock.hpp"
+#include "interval.hpp"
+#include "io_engine.hpp"
+#include "options.hpp"
+#include "recv_path.hpp"
+#include "zerocopy.hpp"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t FRAME_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool sendFrameHeader(IoEngine& io, int sockfd, uint32_t chunkSize, uint32_t count)
+{
+    uint32_t header[2] = {htonl(chunkSize), htonl(count)};
+    return io.sendAll(sockfd, reinterpret_cast<const char*>(header), FRAME_HEADER_SIZE);
+}
+
+// Size the next batch to about SWEEP_BATCH_SECONDS at the rate seen so far in
+// this step, so the time limit is checked often without a header per chunk
+uint32_t nextBatch(long long stepBytes, double stepSeconds, size_t chunkSize)
+{
+    if (stepSeconds <= 0.0 || stepBytes == 0)
+    {
+        return 1;
+    }
+    double chunks = static_cast<double>(stepBytes) / stepSeconds * SWEEP_BATCH_SECONDS /
+                    static_cast<double>(chunkSize);
+    return static_cast<uint32_t>(std::clamp(chunks, 1.0, static_cast<double>(SWEEP_MAX_BATCH)));
+}
+
+// One frame's count * size bytes, acking each completed chunk, with the
+// chunk size's class fixed at compile time (ChunkTracker::onDataSized());
+// false (logged) on a receive or ack failure
+template <bool Pow2Chunks>
+bool receiveFrame(IoEngine& io, int sockfd, ChunkReceiver& receiver, const ServerOptions& opts,
+                  uint64_t remaining, const std::vector<char>& acks, ChunkTracker& tracker,
+                  Clock::time_point phaseStart, IntervalMeter& meter, SweepStep& step,
+                  Clock::time_point& lastData)
+{
+    const unsigned chunkShift = static_cast<unsigned>(std::countr_zero(tracker.chunkSize));
+    while (remaining > 0)
+    {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, opts.readSize));
+        ssize_t r = receiver.receive(want);
+        if (r <= 0)
+        {
+            spdlog::error("Data transfer: {} receive failed: {}",
+                          recvModeName(opts.recvMode), r == 0 ? "closed" : strerror(errno));
+            return false;
+        }
+        remaining -= static_cast<uint64_t>(r);
+        step.bytes += r;
+        lastData = Clock::now();
+        if (meter.enabled())
+        {
+            meter.add(r, std::chrono::duration<double>(lastData - phaseStart).count());
+        }
+
+        size_t completed = tracker.onDataSized<Pow2Chunks>(static_cast<size_t>(r), chunkShift);
+        if (completed == 0)
+        {
+            continue;
+        }
+        step.ackSyscalls++;
+        if (!io.sendAll(sockfd, acks.data(), completed * ONE_BYTE_SIZE))
+        {
+            spdlog::error("Data transfer: ack send failed");
+            return false;
+        }
+    }
+    return true;
+}
+
+using RecvFrame = bool (*)(IoEngine&, int, ChunkReceiver&, const ServerOptions&, uint64_t,
+                           const std::vector<char>&, ChunkTracker&, Clock::time_point,
+                           IntervalMeter&, SweepStep&, Clock::time_point&);
+
+} // namespace
+
+bool parseByteSize(const std::string& text, size_t& bytes)
+{
+    // stoull() would also take leading blanks, '+' and '-' (negating the value)
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+    size_t pos = 0;
+    unsigned long long value = 0;
+    try
+    {
+        value = std::stoull(text, &pos);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    int shift = 0;
+    if (pos + 1 == text.size())
+    {
+        switch (text[pos])
+        {
+            case 'K': case 'k': shift = 10; break;
+            case 'M': case 'm': shift = 20; break;
+            case 'G': case 'g': shift = 30; break;
+            default: return false;
+        }
+    }
+    else if (pos != text.size())
+    {
+        return false;
+    }
+    if (value > (SIZE_MAX >> shift))
+    {
+        return false; // would wrap around, e.g. 17592186044417M to 1M
+    }
+    bytes = static_cast<size_t>(value << shift);
+    return true;
+}
+
+bool parseSweepRange(const std::string& text, size_t& minSize, size_t& maxSize)
+{
+    size_t colon = text.find(':');
+    if (colon == std::string::npos ||
+        !parseByteSize(text.substr(0, colon), minSize) ||
+        !parseByteSize(text.substr(colon + 1), maxSize))
+    {
+        return false;
+    }
+    return minSize >= 1 && minSize <= maxSize && maxSize <= MAX_CHUNK_SIZE;
+}
+
+std::vector<size_t> sweepSizes(size_t minSize, size_t maxSize)
+{
+    std::vector<size_t> sizes;
+    for (size_t size = minSize; size < maxSize; size *= 2)
+    {
+        sizes.push_back(size);
+    }
+    sizes.push_back(maxSize);
+    return sizes;
+}
+
+bool sendSizedSteps(IoEngine& io, int sockfd, const ClientOptions& opts, BufferArena* arena,
+                    IntervalMeter& meter, StreamResult& result)
+{
+    const int window = opts.window;
+
+    // Nagle would hold a small chunk back behind its unacked frame header
+    int on = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    const size_t maxSize = *std::max_element(opts.chunkSizes.begin(), opts.chunkSizes.end());
+    DataBuffer chunk(arena, maxSize); // every step sends a prefix of this
+    fillPayload(opts.payload, chunk.data(), maxSize, 1);
+    std::vector<char> ackBuf(window, '\0');
+
+    long long totalBytes = 0;
+    double totalSeconds = 0.0;
+    auto phaseStart = Clock::now();
+    LoopTimer stamps(0.0); // -i stamps; the batches already bound the deadline checks
+
+    for (size_t size : opts.chunkSizes)
+    {
+        ChunkSender sender(io, sockfd, opts.zerocopy, chunk.data(), size);
+        if (!sender.init())
+        {
+            return false;
+        }
+        SweepStep step;
+        step.chunkSize = size;
+        int inFlight = 0;
+        bool failed = false;
+
+        auto stepStart = Clock::now();
+        double elapsed = 0.0;
+        while (!failed && elapsed < opts.durationSeconds)
+        {
+            uint32_t batch = nextBatch(step.bytes, elapsed, size);
+            unsigned long before = io.syscalls();
+            if (!sendFrameHeader(io, sockfd, static_cast<uint32_t>(size), batch))
+            {
+                spdlog::error("Sweep: frame header send() failed");
+                return false;
+            }
+            step.syscalls += io.syscalls() - before;
+
+            for (uint32_t j = 0; j < batch; j++)
+            {
+                if (!sender.send())
+                {
+                    spdlog::error("Data transfer: send() failed");
+                    return false;
+                }
+                step.bytes += static_cast<long long>(size);
+                inFlight++;
+                if (meter.enabled())
+                {
+                    meter.add(static_cast<long long>(size), stamps.now());
+                }
+
+                if (inFlight >= window)
+                {
+                    step.ackSyscalls++;
+                    ssize_t r = io.recvSome(sockfd, ackBuf.data(), inFlight);
+                    if (r <= 0)
+                    {
+                        failed = true;
+                        break;
+                    }
+                    inFlight -= static_cast<int>(r);
+                }
+            }
+            elapsed = secondsSince(stepStart);
+        }
+
+        // Drain the window so the next step starts from an empty pipe
+        while (!failed && inFlight > 0)
+        {
+            step.ackSyscalls++;
+            ssize_t r = io.recvSome(sockfd, ackBuf.data(), inFlight);
+            if (r <= 0)
+            {
+                failed = true;
+                break;
+            }
+            inFlight -= static_cast<int>(r);
+        }
+        if (failed)
+        {
+            spdlog::error("Data transfer: ack receive failed (server closed?)");
+            return false;
+        }
+        step.seconds = secondsSince(stepStart);
+        sender.finish();
+        step.syscalls += sender.syscalls();
+        step.rateMbps = goodputMbps(step.bytes, step.seconds);
+
+        totalBytes += step.bytes;
+        totalSeconds += step.seconds;
+        result.syscalls += step.syscalls;
+        result.ackSyscalls += step.ackSyscalls;
+        result.steps.push_back(step);
+    }
+
+    if (!sendFrameHeader(io, sockfd, 0, 0))
+    {
+        spdlog::error("Sweep: end-of-data header send() failed");
+        return false;
+    }
+    meter.finish(secondsSince(phaseStart));
+
+    result.bytes = totalBytes;
+    result.seconds = totalSeconds;
+    result.rateMbps = goodputMbps(totalBytes, totalSeconds);
+    return true;
+}
+
+bool receiveSizedSteps(IoEngine& io, int sockfd, const ServerOptions& opts, BufferArena* arena,
+                       IntervalMeter& meter, StreamResult& result)
+{
+    DataBuffer dataBuf(arena, opts.recvMode == RecvMode::Copy ? opts.readSize : 0);
+    std::vector<char> acks;
+    ChunkReceiver receiver(&io, sockfd, opts.recvMode, dataBuf.data(), opts.readSize);
+    if (!receiver.init())
+    {
+        return false;
+    }
+
+    ChunkTracker tracker;
+    bool inStep = false;
+    SweepStep step;
+    unsigned long stepSyscallsBase = 0;
+    Clock::time_point stepStart;
+    Clock::time_point lastData;
+    auto phaseStart = Clock::now();
+    bool ok = true;
+    double totalSeconds = 0.0;
+
+    auto closeStep = [&]() {
+        if (!inStep)
+        {
+            return;
+        }
+        step.seconds = std::chrono::duration<double>(lastData - stepStart).count();
+        step.syscalls += receiver.syscalls() - stepSyscallsBase;
+        step.rateMbps = goodputMbps(step.bytes, step.seconds);
+        result.bytes += step.bytes;
+        result.syscalls += step.syscalls;
+        result.ackSyscalls += step.ackSyscalls;
+        result.steps.push_back(step);
+        totalSeconds += step.seconds;
+        inStep = false;
+    };
+
+    while (ok)
+    {
+        uint32_t header[2];
+        unsigned long before = io.syscalls();
+        if (!io.recvAll(sockfd, reinterpret_cast<char*>(header), FRAME_HEADER_SIZE))
+        {
+            spdlog::error("Sweep: client closed without an end-of-data header");
+            ok = false;
+            break;
+        }
+        unsigned long headerSyscalls = io.syscalls() - before;
+        size_t size = ntohl(header[0]);
+        uint64_t count = ntohl(header[1]);
+        if (size == 0)
+        {
+            break;
+        }
+        if (size > MAX_CHUNK_SIZE)
+        {
+            spdlog::error("Sweep: client announced {} byte chunks (max {})", size, MAX_CHUNK_SIZE);
+            ok = false;
+            break;
+        }
+
+        if (!inStep || size != step.chunkSize)
+        {
+            closeStep();
+            step = SweepStep();
+            step.chunkSize = size;
+            tracker = ChunkTracker();
+            tracker.chunkSize = size;
+            acks.assign(opts.readSize / size + 1, 'A');
+            stepSyscallsBase = receiver.syscalls();
+            stepStart = Clock::now();
+            lastData = stepStart;
+            inStep = true;
+        }
+        step.syscalls += headerSyscalls;
+
+        RecvFrame frame = std::has_single_bit(size) ? &receiveFrame<true> : &receiveFrame<false>;
+        ok = frame(io, sockfd, receiver, opts, count * size, acks, tracker, phaseStart, meter,
+                   step, lastData);
+    }
+    closeStep();
+    meter.finish(std::chrono::duration<double>(Clock::now() - phaseStart).count());
+
+    result.seconds = totalSeconds;
+    result.rateMbps = goodputMbps(result.bytes, totalSeconds);
+    return ok;
+}
+
+void logSweepSummary(const char* verb, const std::vector<StreamResult>& results)
+{
+    size_t steps = 0;
+    for (const auto& r : results)
+    {
+        steps = std::max(steps, r.steps.size());
+    }
+    for (size_t k = 0; k < steps; k++)
+    {
+        SweepStep sum;
+        double syscallRate = 0.0;
+        for (const auto& r : results)
+        {
+            if (k >= r.steps.size())
+            {
+                continue;
+            }
+            const SweepStep& s = r.steps[k];
+            sum.chunkSize = s.chunkSize;
+            sum.bytes += s.bytes;
+            sum.rateMbps += s.rateMbps;
+            if (s.seconds > 0.0)
+            {
+                syscallRate += static_cast<double>(s.syscalls + s.ackSyscalls) / s.seconds;
+            }
+        }
+        spdlog::info("Sweep size={} B: {}={} KB, Rate={:.3f} Mbps, Syscalls={:.0f}/s",
+                     sum.chunkSize, verb, sum.bytes / 1000LL, sum.rateMbps, syscallRate);
+    }
+}
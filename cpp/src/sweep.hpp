@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+class BufferArena;
+class IoEngine;
+class IntervalMeter;
+struct ClientOptions;
+struct ServerOptions;
+
+// Sized data phase (-l SIZE / --sweep MIN:MAX). The client sends SIZED_HELLO
+// in place of its first RTT 'M', and after the RTT phase frames its chunks in
+// batches: an 8-byte header {chunk size, chunk count} (network order) and
+// then exactly that many chunks. A {0, 0} header ends the data phase. Acks
+// stay one byte per chunk, so --window works unchanged, and a new chunk size
+// in a header starts the next sweep step on the same connection.
+static const char SIZED_HELLO = 'S';
+static const size_t MAX_CHUNK_SIZE = 64 << 20; // 64MB
+static const size_t DEFAULT_SWEEP_MIN = 1 << 10; // 1KB
+static const size_t DEFAULT_SWEEP_MAX = 16 << 20; // 16MB
+static const double SWEEP_BATCH_SECONDS = 0.01; // a batch is ~10ms of sending
+static const uint32_t SWEEP_MAX_BATCH = 1 << 16; // chunks per header
+
+// "64K", "1M", "1500": decimal count with an optional K/M/G (binary) suffix
+bool parseByteSize(const std::string& text, size_t& bytes);
+
+// "MIN:MAX" in parseByteSize() units; MIN <= MAX, both within [1, MAX_CHUNK_SIZE]
+bool parseSweepRange(const std::string& text, size_t& minSize, size_t& maxSize);
+
+// min, 2*min, 4*min, ... and finally max itself
+std::vector<size_t> sweepSizes(size_t minSize, size_t maxSize);
+
+// Client: one step of opts.durationSeconds per entry of opts.chunkSizes.
+// Fills result (bytes, syscalls, steps, overall goodput); false on I/O error.
+// The payload buffer comes from arena (may be null) while it has room.
+bool sendSizedSteps(IoEngine& io, int sockfd, const ClientOptions& opts, BufferArena* arena,
+                    IntervalMeter& meter, StreamResult& result);
+
+// Server: receive framed batches until the {0, 0} header or the client closes
+bool receiveSizedSteps(IoEngine& io, int sockfd, const ServerOptions& opts, BufferArena* arena,
+                       IntervalMeter& meter, StreamResult& result);
+
+// One line per step, summed over streams
+void logSweepSummary(const char* verb, const std::vector<StreamResult>& results);
@@ -0,0 +1,796 @@
+#include "udp.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include <endian.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "options.hpp"
+
+#ifdef IPERFER_AF_XDP
+#include "af_xdp.hpp"
+#endif
+
+namespace
+{
+
+const uint32_t UDP_MAGIC = 0x49505544; // "IPUD"
+const uint32_t FLAG_DATA = 0;
+const uint32_t FLAG_FIN = 1;
+const uint32_t FLAG_REPORT = 2;
+
+const int64_t SPIN_NS = 50000;           // busy-wait the last 50us before a send is due
+const int FIN_ATTEMPTS = 10;
+const int FIN_WAIT_MS = 100;             // per attempt, for the server's report
+const int SERVER_IDLE_TIMEOUT_S = 3;     // test over if the client goes quiet this long
+const int UDP_RCVBUF = 4 << 20;
+const int XDP_DRAIN_MS = 1000;           // for the last frames' completions before the FIN
+const uint64_t REORDER_WINDOW = 1 << 16; // sequence numbers a late datagram may still fill
+const int64_t XDP_SPIN_NS = 1000000;     // of an empty RX ring before blocking in poll()
+
+int64_t monotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t realtimeNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// clock_nanosleep() for the bulk of the wait, then spin: timer slack alone
+// would put tens of microseconds of error on every send
+void sleepUntil(int64_t deadlineNs)
+{
+    int64_t now = monotonicNs();
+    if (deadlineNs - now > SPIN_NS)
+    {
+        int64_t wake = deadlineNs - SPIN_NS;
+        timespec ts{static_cast<time_t>(wake / 1000000000LL), static_cast<long>(wake % 1000000000LL)};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+    while (monotonicNs() < deadlineNs)
+    {
+    }
+}
+
+struct Header
+{
+    uint32_t magic;
+    uint32_t flags;
+    uint64_t seq;
+    int64_t sendNs;
+};
+
+void writeHeader(char* buf, uint32_t flags, uint64_t seq, int64_t sendNs)
+{
+    uint32_t magic = htonl(UDP_MAGIC);
+    uint32_t f = htonl(flags);
+    uint64_t s = htobe64(seq);
+    uint64_t t = htobe64(static_cast<uint64_t>(sendNs));
+    std::memcpy(buf, &magic, 4);
+    std::memcpy(buf + 4, &f, 4);
+    std::memcpy(buf + 8, &s, 8);
+    std::memcpy(buf + 16, &t, 8);
+}
+
+bool readHeader(const char* buf, size_t len, Header& h)
+{
+    if (len < UDP_HEADER_SIZE)
+    {
+        return false;
+    }
+    uint32_t magic, flags;
+    uint64_t seq, sendNs;
+    std::memcpy(&magic, buf, 4);
+    std::memcpy(&flags, buf + 4, 4);
+    std::memcpy(&seq, buf + 8, 8);
+    std::memcpy(&sendNs, buf + 16, 8);
+    h.magic = ntohl(magic);
+    h.flags = ntohl(flags);
+    h.seq = be64toh(seq);
+    h.sendNs = static_cast<int64_t>(be64toh(sendNs));
+    return h.magic == UDP_MAGIC;
+}
+
+// Report payload after the header: the receive-side UdpStats as six big-endian words
+const size_t REPORT_SIZE = UDP_HEADER_SIZE + 6 * sizeof(uint64_t);
+
+void writeStatsDatagram(char* buf, const UdpStats& s)
+{
+    writeHeader(buf, FLAG_REPORT, 0, 0);
+    uint64_t words[6] = {
+        static_cast<uint64_t>(s.datagrams), static_cast<uint64_t>(s.bytes),
+        static_cast<uint64_t>(s.lost), static_cast<uint64_t>(s.outOfOrder),
+        static_cast<uint64_t>(std::llround(s.jitterMs * 1e6)),  // ns
+        static_cast<uint64_t>(std::llround(s.seconds * 1e9)),   // ns
+    };
+    for (int i = 0; i < 6; i++)
+    {
+        uint64_t w = htobe64(words[i]);
+        std::memcpy(buf + UDP_HEADER_SIZE + i * 8, &w, 8);
+    }
+}
+
+void readStatsDatagram(const char* buf, UdpStats& s)
+{
+    uint64_t words[6];
+    for (int i = 0; i < 6; i++)
+    {
+        std::memcpy(&words[i], buf + UDP_HEADER_SIZE + i * 8, 8);
+        words[i] = be64toh(words[i]);
+    }
+    s.datagrams  = static_cast<long long>(words[0]);
+    s.bytes      = static_cast<long long>(words[1]);
+    s.lost       = static_cast<long long>(words[2]);
+    s.outOfOrder = static_cast<long long>(words[3]);
+    s.jitterMs   = static_cast<double>(words[4]) / 1e6;
+    s.seconds    = static_cast<double>(words[5]) / 1e9;
+    s.valid      = true;
+}
+
+void setRecvTimeout(int sock, int millis)
+{
+    timeval tv{millis / 1000, (millis % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// The server's side of one test: loss, reordering and jitter from the
+// datagrams as they arrive, whichever path brought them
+class TestReceiver
+{
+public:
+    explicit TestReceiver(UdpStats& received) : received_(received)
+    {
+        std::memset(&client_, 0, sizeof(client_));
+    }
+
+    void onDatagram(const char* buf, size_t len, const sockaddr_storage& peer, socklen_t peerLen,
+                    int64_t arrival)
+    {
+        Header h;
+        if (finished_ || !readHeader(buf, len, h))
+        {
+            return; // not ours, or after the FIN
+        }
+        if (!started_)
+        {
+            started_ = true;
+            client_ = peer;
+            clientLen_ = peerLen;
+            firstArrival_ = arrival;
+            spdlog::info("Client connected from {}",
+                         formatAddress(reinterpret_cast<const sockaddr*>(&client_)));
+        }
+        if (h.flags == FLAG_FIN)
+        {
+            client_ = peer;
+            clientLen_ = peerLen;
+            // Sequence numbers past the last arrival were sent but never seen
+            if (h.seq > nextSeq_)
+            {
+                received_.lost += static_cast<long long>(h.seq - nextSeq_);
+            }
+            finished_ = true;
+            return;
+        }
+        if (h.flags != FLAG_DATA)
+        {
+            return;
+        }
+
+        // Loss/reorder: a gap counts as lost until the missing datagram
+        // shows up late. A duplicate is dropped, from every count; one
+        // older than REORDER_WINDOW can't be told from a duplicate, so its
+        // sequence number stays lost.
+        bool late = h.seq < nextSeq_;
+        if (late && nextSeq_ - h.seq <= REORDER_WINDOW && seen(h.seq))
+        {
+            return;
+        }
+        if (!late)
+        {
+            received_.lost += static_cast<long long>(h.seq - nextSeq_);
+            forget(nextSeq_, h.seq + 1);
+            nextSeq_ = h.seq + 1;
+            markSeen(h.seq);
+        }
+        else
+        {
+            received_.outOfOrder++;
+            if (nextSeq_ - h.seq <= REORDER_WINDOW)
+            {
+                received_.lost--;
+                markSeen(h.seq);
+            }
+        }
+        received_.datagrams++;
+        received_.bytes += static_cast<long long>(len);
+        lastArrival_ = arrival;
+
+        // RFC 3550 6.4.1: J += (|D(i-1,i)| - J) / 16 over relative transit
+        // times, so the two hosts' clock offset cancels out
+        int64_t transit = arrival - h.sendNs;
+        if (haveTransit_)
+        {
+            double d = std::fabs(static_cast<double>(transit - prevTransit_));
+            jitterNs_ += (d - jitterNs_) / 16.0;
+        }
+        prevTransit_ = transit;
+        haveTransit_ = true;
+    }
+
+    void finish()
+    {
+        received_.jitterMs = jitterNs_ / 1e6;
+        received_.seconds  = static_cast<double>(lastArrival_ - firstArrival_) / 1e9;
+        received_.valid    = started_;
+    }
+
+    bool started() const { return started_; }
+    bool finished() const { return finished_; }
+    // Where the report goes: the FIN's sender
+    const sockaddr_storage& client() const { return client_; }
+    socklen_t clientLen() const { return clientLen_; }
+
+private:
+    // seen_: a ring of REORDER_WINDOW bits, one per sequence number below nextSeq_
+    bool seen(uint64_t seq) const
+    {
+        uint64_t i = seq % REORDER_WINDOW;
+        return (seen_[i / 64] >> (i % 64)) & 1;
+    }
+
+    void markSeen(uint64_t seq)
+    {
+        uint64_t i = seq % REORDER_WINDOW;
+        seen_[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    // [from, to) are new sequence numbers: their bits held older ones
+    void forget(uint64_t from, uint64_t to)
+    {
+        if (to - from >= REORDER_WINDOW)
+        {
+            std::fill(seen_.begin(), seen_.end(), 0);
+            return;
+        }
+        for (uint64_t seq = from; seq < to; seq++)
+        {
+            uint64_t i = seq % REORDER_WINDOW;
+            seen_[i / 64] &= ~(uint64_t(1) << (i % 64));
+        }
+    }
+
+    UdpStats& received_;
+    std::vector<uint64_t> seen_ = std::vector<uint64_t>(REORDER_WINDOW / 64, 0);
+    bool started_ = false;
+    bool finished_ = false;
+    sockaddr_storage client_;
+    socklen_t clientLen_ = 0;
+    int64_t firstArrival_ = 0;
+    int64_t lastArrival_ = 0;
+    uint64_t nextSeq_ = 0;
+    double jitterNs_ = 0.0;
+    int64_t prevTransit_ = 0;
+    bool haveTransit_ = false;
+};
+
+const size_t STAMP_CONTROL_SIZE = CMSG_SPACE(sizeof(timespec));
+
+// The SO_TIMESTAMPNS arrival time of one datagram, moved from CLOCK_REALTIME
+// onto the monotonic clock the send stamps use; fallback if there is none
+int64_t kernelArrival(const msghdr& hdr, int64_t realToMono, int64_t fallback)
+{
+    for (cmsghdr* c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), c))
+    {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec - realToMono;
+        }
+    }
+    return fallback;
+}
+
+// One recvmmsg() batch slot per datagram, each able to hold the largest one
+// and its kernel receive timestamp
+struct RecvBatch
+{
+    std::vector<char> bufs = std::vector<char>(MAX_DATAGRAM_SIZE * UDP_BATCH);
+    std::vector<iovec> iov = std::vector<iovec>(UDP_BATCH);
+    std::vector<mmsghdr> msgs = std::vector<mmsghdr>(UDP_BATCH);
+    std::vector<sockaddr_storage> peers = std::vector<sockaddr_storage>(UDP_BATCH);
+    std::vector<char> control = std::vector<char>(STAMP_CONTROL_SIZE * UDP_BATCH);
+
+    void reset()
+    {
+        for (int i = 0; i < UDP_BATCH; i++)
+        {
+            iov[i].iov_base = bufs.data() + i * MAX_DATAGRAM_SIZE;
+            iov[i].iov_len = MAX_DATAGRAM_SIZE;
+            std::memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+            msgs[i].msg_hdr.msg_control = control.data() + i * STAMP_CONTROL_SIZE;
+            msgs[i].msg_hdr.msg_controllen = STAMP_CONTROL_SIZE;
+        }
+    }
+
+    // Each datagram at its own arrival time, not the batch's: one recvmmsg()
+    // can hold datagrams that came in far apart
+    void deliver(int n, TestReceiver& rx)
+    {
+        int64_t mono = monotonicNs();
+        int64_t realToMono = realtimeNs() - mono;
+        for (int i = 0; i < n && !rx.finished(); i++)
+        {
+            rx.onDatagram(bufs.data() + i * MAX_DATAGRAM_SIZE, msgs[i].msg_len, peers[i],
+                          msgs[i].msg_hdr.msg_namelen,
+                          kernelArrival(msgs[i].msg_hdr, realToMono, mono));
+        }
+    }
+};
+
+#ifdef IPERFER_AF_XDP
+// --engine xdp on the client: frames for the flow sock is connected to, on
+// opts.xdpDevice. An empty datagram through sock first gets the next hop
+// into the neighbour table. Exits on failure.
+std::unique_ptr<XdpSocket> openXdpSender(int sock, const PeerAddress& serverAddr,
+                                         const ClientOptions& opts)
+{
+    sockaddr_storage local;
+    socklen_t localLen = sizeof(local);
+    if (getsockname(sock, reinterpret_cast<sockaddr*>(&local), &localLen) < 0)
+    {
+        spdlog::error("getsockname() failed: {}", strerror(errno));
+        close(sock);
+        exit(1);
+    }
+    send(sock, nullptr, 0, 0);
+    auto xsk = std::make_unique<XdpSocket>();
+    if (!xsk->openSender(opts.xdpDevice, opts.xdpQueue, local, serverAddr.storage,
+                         opts.datagramSize, UDP_HEADER_SIZE))
+    {
+        close(sock);
+        exit(1);
+    }
+    spdlog::info("UDP: AF_XDP on {}", xsk->description());
+    return xsk;
+}
+#endif
+
+// The kernel path: blocking recvmmsg() until the FIN or the idle timeout
+void receiveFromSocket(int sock, TestReceiver& rx)
+{
+    RecvBatch batch;
+    while (!rx.finished())
+    {
+        batch.reset();
+        int n = recvmmsg(sock, batch.msgs.data(), UDP_BATCH, MSG_WAITFORONE, nullptr);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                spdlog::error("UDP: client silent for {}s, ending the test without a FIN",
+                              SERVER_IDLE_TIMEOUT_S);
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spdlog::error("recvmmsg() failed: {}", strerror(errno));
+            break;
+        }
+        bool wasStarted = rx.started();
+        batch.deliver(n, rx);
+        if (!wasStarted && rx.started())
+        {
+            setRecvTimeout(sock, SERVER_IDLE_TIMEOUT_S * 1000);
+        }
+    }
+}
+
+#ifdef IPERFER_AF_XDP
+// v4-mapped, when the peer came off AF_XDP as AF_INET but the report goes
+// out of a dual-stack AF_INET6 socket
+void matchSocketFamily(int sock, sockaddr_storage& peer, socklen_t& peerLen)
+{
+    sockaddr_storage local;
+    socklen_t localLen = sizeof(local);
+    if (peer.ss_family != AF_INET ||
+        getsockname(sock, reinterpret_cast<sockaddr*>(&local), &localLen) < 0 ||
+        local.ss_family != AF_INET6)
+    {
+        return;
+    }
+    sockaddr_in in = reinterpret_cast<const sockaddr_in&>(peer);
+    sockaddr_in6 in6;
+    std::memset(&in6, 0, sizeof(in6));
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = in.sin_port;
+    in6.sin6_addr.s6_addr[10] = 0xff;
+    in6.sin6_addr.s6_addr[11] = 0xff;
+    std::memcpy(&in6.sin6_addr.s6_addr[12], &in.sin_addr, 4);
+    std::memcpy(&peer, &in6, sizeof(in6));
+    peerLen = sizeof(in6);
+}
+
+// --engine xdp: the test's port redirected to an AF_XDP socket on
+// opts.xdpDevice. The kernel socket is polled alongside it for the FIN and
+// for whatever the NIC hashes to other queues. Frames carry no receive
+// timestamp, so while datagrams keep coming the rings are spun on rather
+// than waited for, and each pass's frames are stamped as it finds them.
+void receiveWithXdp(int sock, const ServerOptions& opts, TestReceiver& rx)
+{
+    XdpSocket xsk;
+    if (!xsk.openReceiver(opts.xdpDevice, opts.xdpQueue, opts.port))
+    {
+        close(sock);
+        exit(1);
+    }
+    spdlog::info("UDP: AF_XDP on {}", xsk.description());
+
+    RecvBatch batch;
+    std::vector<XdpDatagram> datagrams(XDP_RING_SIZE);
+    long long viaXdp = 0;
+    long long viaSocket = 0;
+    pollfd fds[2] = {{xsk.fd(), POLLIN, 0}, {sock, POLLIN, 0}};
+    int64_t lastFrame = 0;
+    while (!rx.finished())
+    {
+        bool spin = rx.started() && monotonicNs() - lastFrame < XDP_SPIN_NS;
+        int ready = poll(fds, 2, spin ? 0 : rx.started() ? SERVER_IDLE_TIMEOUT_S * 1000 : -1);
+        if (ready == 0 && spin)
+        {
+            continue;
+        }
+        if (ready == 0)
+        {
+            spdlog::error("UDP: client silent for {}s, ending the test without a FIN",
+                          SERVER_IDLE_TIMEOUT_S);
+            break;
+        }
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spdlog::error("poll() failed: {}", strerror(errno));
+            break;
+        }
+        int64_t arrival = monotonicNs();
+        int n = xsk.receive(datagrams.data(), static_cast<int>(datagrams.size()));
+        if (n > 0)
+        {
+            lastFrame = arrival;
+        }
+        for (int i = 0; i < n && !rx.finished(); i++)
+        {
+            XdpDatagram& dg = datagrams[static_cast<size_t>(i)];
+            matchSocketFamily(sock, dg.peer, dg.peerLen);
+            rx.onDatagram(dg.payload, dg.len, dg.peer, dg.peerLen, arrival);
+        }
+        xsk.release();
+        viaXdp += n;
+
+        batch.reset();
+        int k = recvmmsg(sock, batch.msgs.data(), UDP_BATCH, MSG_DONTWAIT, nullptr);
+        if (k > 0)
+        {
+            batch.deliver(k, rx);
+            viaSocket += k;
+        }
+    }
+    spdlog::info("UDP: {} datagrams over AF_XDP, {} through the kernel socket", viaXdp,
+                 viaSocket);
+}
+#endif
+
+// The report can be lost like any datagram: for as long as the client
+// keeps retrying its FIN, answer every retry with the report again
+void answerRetriedFins(int sock, const std::vector<char>& report)
+{
+    const int64_t until = monotonicNs() + FIN_ATTEMPTS * FIN_WAIT_MS * 1000000LL;
+    std::vector<char> buf(MAX_DATAGRAM_SIZE);
+    pollfd pfd{sock, POLLIN, 0};
+    for (int64_t left = until - monotonicNs(); left > 0; left = until - monotonicNs())
+    {
+        if (poll(&pfd, 1, static_cast<int>((left + 999999) / 1000000)) <= 0)
+        {
+            continue; // timed out (the loop ends) or EINTR
+        }
+        sockaddr_storage peer;
+        socklen_t peerLen = sizeof(peer);
+        ssize_t r = recvfrom(sock, buf.data(), buf.size(), MSG_DONTWAIT,
+                             reinterpret_cast<sockaddr*>(&peer), &peerLen);
+        Header h;
+        if (r > 0 && readHeader(buf.data(), static_cast<size_t>(r), h) && h.flags == FLAG_FIN)
+        {
+            sendto(sock, report.data(), report.size(), 0, reinterpret_cast<sockaddr*>(&peer),
+                   peerLen);
+        }
+    }
+}
+
+} // namespace
+
+bool parseBitrate(const std::string& text, double& bitsPerSecond)
+{
+    size_t pos = 0;
+    double value = 0.0;
+    try
+    {
+        value = std::stod(text, &pos);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    double scale = 1.0;
+    if (pos + 1 == text.size())
+    {
+        switch (text[pos])
+        {
+            case 'K': case 'k': scale = 1e3; break;
+            case 'M': case 'm': scale = 1e6; break;
+            case 'G': case 'g': scale = 1e9; break;
+            default: return false;
+        }
+    }
+    else if (pos != text.size())
+    {
+        return false;
+    }
+    bitsPerSecond = value * scale;
+    return bitsPerSecond > 0.0;
+}
+
+void runUdpClient(const PeerAddress& serverAddr, const ClientOptions& opts,
+                  UdpStats& sent, UdpStats& received)
+{
+    const size_t size = opts.datagramSize;
+
+    // 1) Connected UDP socket, so sendmmsg() needs no per-message address
+    int sock = socket(serverAddr.family(), SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        spdlog::error("Error creating UDP socket: {}", strerror(errno));
+        exit(1);
+    }
+    if (!applySocketTuning(sock, opts.tuning))
+    {
+        close(sock);
+        exit(1);
+    }
+    if (connect(sock, serverAddr.sockAddr(), serverAddr.len) < 0)
+    {
+        spdlog::error("Could not connect UDP socket to {}:{} -> {}: {}", opts.hostname,
+                      opts.port, formatAddress(serverAddr.sockAddr()), strerror(errno));
+        close(sock);
+        exit(1);
+    }
+
+    if (opts.reportSocket)
+    {
+        logSocketSettings(sock);
+    }
+
+    // 2) One buffer and iovec per batch slot, built once
+    std::vector<char> payload(size * UDP_BATCH, '\0');
+    std::vector<iovec> iov(UDP_BATCH);
+    std::vector<mmsghdr> msgs(UDP_BATCH);
+    for (int i = 0; i < UDP_BATCH; i++)
+    {
+        iov[i].iov_base = payload.data() + i * size;
+        iov[i].iov_len = size;
+        std::memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+#ifdef IPERFER_AF_XDP
+    std::unique_ptr<XdpSocket> xsk;
+    std::vector<char*> frames(UDP_BATCH);
+    if (opts.engine == EngineKind::Xdp)
+    {
+        xsk = openXdpSender(sock, serverAddr, opts);
+    }
+#endif
+
+    // 3) Paced send: datagram k is due at start + k * gap; whatever is due
+    //    (up to a batch) goes out in one sendmmsg(). Each is stamped with the
+    //    time its batch actually goes out, so sender-side slip and batching
+    //    show up in the server's jitter as they would on the wire.
+    const double gapNs = static_cast<double>(size) * 8.0 * 1e9 / opts.bitrate;
+    const int64_t durationNs = static_cast<int64_t>(opts.durationSeconds * 1e9);
+    const int64_t start = monotonicNs();
+    auto dueNs = [&](uint64_t k) {
+        return start + static_cast<int64_t>(static_cast<double>(k) * gapNs);
+    };
+    uint64_t seq = 0;
+    unsigned long syscalls = 0;
+    while (true)
+    {
+        int64_t now = monotonicNs();
+        if (now - start >= durationNs)
+        {
+            break;
+        }
+        uint64_t due = static_cast<uint64_t>(static_cast<double>(now - start) / gapNs) + 1;
+        if (due <= seq)
+        {
+            sleepUntil(dueNs(seq));
+            continue;
+        }
+        int batch = static_cast<int>(std::min<uint64_t>(due - seq, UDP_BATCH));
+#ifdef IPERFER_AF_XDP
+        if (xsk)
+        {
+            // Straight into UMEM frames; none free means the ring is full: retry
+            int n = xsk->reserve(batch, frames.data());
+            int64_t sendNs = monotonicNs();
+            for (int i = 0; i < n; i++)
+            {
+                writeHeader(frames[i], FLAG_DATA, seq + i, sendNs);
+            }
+            xsk->submit(n);
+            seq += static_cast<uint64_t>(n);
+            continue;
+        }
+#endif
+        int64_t sendNs = monotonicNs();
+        for (int i = 0; i < batch; i++)
+        {
+            writeHeader(payload.data() + i * size, FLAG_DATA, seq + i, sendNs);
+        }
+        syscalls++;
+        int n = sendmmsg(sock, msgs.data(), batch, 0);
+        if (n < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN)
+            {
+                continue; // qdisc full; the datagrams stay due and are retried
+            }
+            spdlog::error("sendmmsg() failed: {}", strerror(errno));
+            break;
+        }
+        seq += static_cast<uint64_t>(n);
+    }
+    int64_t end = monotonicNs();
+
+    sent.datagrams = static_cast<long long>(seq);
+    sent.bytes     = static_cast<long long>(seq * size);
+    sent.seconds   = static_cast<double>(end - start) / 1e9;
+    sent.valid     = true;
+    spdlog::debug("UDP: {} sendmmsg() calls", syscalls);
+#ifdef IPERFER_AF_XDP
+    if (xsk && !xsk->drain(XDP_DRAIN_MS))
+    {
+        spdlog::warn("UDP: AF_XDP frames still in flight after {} ms", XDP_DRAIN_MS);
+    }
+#endif
+
+    // 4) FIN until the server's report comes back
+    char fin[UDP_HEADER_SIZE];
+    writeHeader(fin, FLAG_FIN, seq, end);
+    std::vector<char> reply(REPORT_SIZE);
+    setRecvTimeout(sock, FIN_WAIT_MS);
+    for (int attempt = 0; attempt < FIN_ATTEMPTS && !received.valid; attempt++)
+    {
+        if (send(sock, fin, sizeof(fin), 0) < 0 && errno == ECONNREFUSED)
+        {
+            break; // ICMP port unreachable: nobody is listening
+        }
+        ssize_t r = recv(sock, reply.data(), reply.size(), 0);
+        Header h;
+        if (r == static_cast<ssize_t>(REPORT_SIZE) &&
+            readHeader(reply.data(), static_cast<size_t>(r), h) && h.flags == FLAG_REPORT)
+        {
+            readStatsDatagram(reply.data(), received);
+        }
+    }
+    if (!received.valid)
+    {
+        spdlog::error("UDP: no report from the server");
+    }
+    close(sock);
+}
+
+void runUdpServer(const ServerOptions& opts, UdpStats& received)
+{
+    // 1) - 3) Create, size the receive buffer and bind
+    int sock = openServerSocket(SOCK_DGRAM, opts.family);
+    if (sock < 0)
+    {
+        exit(1);
+    }
+    SocketTuning tuning = opts.tuning;
+    if (tuning.rcvbuf == 0)
+    {
+        tuning.rcvbuf = UDP_RCVBUF;
+    }
+    if (!applySocketTuning(sock, tuning))
+    {
+        close(sock);
+        exit(1);
+    }
+    if (opts.reportSocket)
+    {
+        logSocketSettings(sock);
+    }
+
+    // Per-datagram arrival times for the jitter, whatever recvmmsg() batches
+    int on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+    {
+        spdlog::warn("SO_TIMESTAMPNS failed ({}); arrivals stamped per batch", strerror(errno));
+    }
+
+    if (!bindWildcard(sock, opts.port))
+    {
+        spdlog::error("Error binding to port {}: {}", opts.port, strerror(errno));
+        close(sock);
+        exit(1);
+    }
+    spdlog::info("iPerfer UDP server started");
+
+    // 4) Batched receive; every slot can hold the largest datagram
+    TestReceiver rx(received);
+#ifdef IPERFER_AF_XDP
+    if (opts.engine == EngineKind::Xdp)
+    {
+        receiveWithXdp(sock, opts, rx);
+    }
+    else
+#endif
+    {
+        receiveFromSocket(sock, rx);
+    }
+    rx.finish();
+
+    // 5) Answer the FIN with the report
+    if (rx.finished())
+    {
+        std::vector<char> report(REPORT_SIZE);
+        writeStatsDatagram(report.data(), received);
+        sendto(sock, report.data(), report.size(), 0,
+               reinterpret_cast<const sockaddr*>(&rx.client()), rx.clientLen());
+        answerRetriedFins(sock, report);
+    }
+    close(sock);
+}
+
+void logUdpSummary(const char* verb, const UdpStats& stats, bool withLoss)
+{
+    if (!withLoss)
+    {
+        spdlog::info("UDP {}={} KB, Rate={:.3f} Mbps, Datagrams={}",
+                     verb, stats.bytes / 1000LL, stats.rateMbps(), stats.datagrams);
+        return;
+    }
+    long long expected = stats.datagrams + stats.lost;
+    double lossPct = expected > 0 ? 100.0 * static_cast<double>(stats.lost) / expected : 0.0;
+    spdlog::info("UDP {}={} KB, Rate={:.3f} Mbps, Datagrams={}, Lost={}/{} ({:.3f}%), "
+                 "OutOfOrder={}, Jitter={:.3f}ms",
+                 verb, stats.bytes / 1000LL, stats.rateMbps(), stats.datagrams, stats.lost,
+                 expected, lossPct, stats.outOfOrder, stats.jitterMs);
+}
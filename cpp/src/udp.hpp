@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <netinet/in.h>
+
+#include "address.hpp"
+
+struct ClientOptions;
+struct ServerOptions;
+
+// UDP mode (-u). The client paces sequence-numbered, timestamped datagrams
+// at a target bitrate (-b) and ends with a FIN datagram; the server answers
+// the FIN with its receive statistics (loss, reordering, RFC 3550 jitter).
+static const size_t UDP_HEADER_SIZE = 24; // magic, flags, seq, send timestamp
+static const size_t DEFAULT_DATAGRAM_SIZE = 1470; // fits a 1500-byte MTU
+static const size_t MAX_DATAGRAM_SIZE = 65507;
+static const double DEFAULT_UDP_BITRATE = 1e6; // bits/s, iperf's default
+static const int UDP_BATCH = 32; // datagrams per sendmmsg()/recvmmsg()
+
+// One side's view of a UDP test
+struct UdpStats
+{
+    long long datagrams = 0;
+    long long bytes = 0;      // whole datagrams, header included
+    long long lost = 0;       // server: sequence numbers never seen
+    long long outOfOrder = 0; // server: arrived after a higher sequence number
+    double jitterMs = 0.0;    // server: RFC 3550 interarrival jitter
+    double seconds = 0.0;
+    bool valid = false;
+
+    double rateMbps() const
+    {
+        return seconds > 0.0 ? (static_cast<double>(bytes) * 8.0 / seconds) / 1e6 : 0.0;
+    }
+};
+
+// "100M", "1.5G", "64000": bits per second with an optional decimal K/M/G suffix
+bool parseBitrate(const std::string& text, double& bitsPerSecond);
+
+// Client: paced send to serverAddr for opts.durationSeconds. received is the
+// server's report, if it arrived (received.valid).
+void runUdpClient(const PeerAddress& serverAddr, const ClientOptions& opts,
+                  UdpStats& sent, UdpStats& received);
+
+// Server: one test on opts.port (dual-stack unless -4 / -6); exits on setup failure
+void runUdpServer(const ServerOptions& opts, UdpStats& received);
+
+// withLoss: also print loss, reordering and jitter (receive-side stats)
+void logUdpSummary(const char* verb, const UdpStats& stats, bool withLoss);
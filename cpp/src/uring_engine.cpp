@@ -0,0 +1,444 @@
+#include "uring_engine.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <spdlog/spdlog.h>
+
+static const unsigned URING_ENTRIES = 64;
+static const unsigned BUF_RING_ENTRIES = 64;    // power of two
+static const unsigned BUF_RING_BUF_SIZE = 65536; // bytes per provided buffer
+static const uint16_t BUF_GROUP = 0;
+
+// user_data tags telling single-shot completions apart from multishot ones
+static const uint64_t TAG_SYNC = 1;
+static const uint64_t TAG_MULTISHOT = 2;
+
+namespace
+{
+
+int uringSetup(unsigned entries, io_uring_params* p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                                    flags, nullptr, 0));
+}
+
+int uringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+} // namespace
+
+UringEngine::~UringEngine()
+{
+    if (bufPool_ != nullptr)
+    {
+        munmap(bufPool_, bufPoolBytes_);
+    }
+    if (bufRing_ != nullptr)
+    {
+        munmap(bufRing_, bufRingBytes_);
+    }
+    if (sqes_ != nullptr)
+    {
+        munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != nullptr && cqRing_ != sqRing_)
+    {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != nullptr)
+    {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if (ringFd_ >= 0)
+    {
+        close(ringFd_);
+    }
+}
+
+bool UringEngine::init()
+{
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    ringFd_ = uringSetup(URING_ENTRIES, &p);
+    if (ringFd_ < 0)
+    {
+        spdlog::error("io_uring_setup() failed: {}", strerror(errno));
+        return false;
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        sqRing_ = nullptr;
+        spdlog::error("mmap(io_uring SQ ring) failed: {}", strerror(errno));
+        return false;
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            cqRing_ = nullptr;
+            spdlog::error("mmap(io_uring CQ ring) failed: {}", strerror(errno));
+            return false;
+        }
+    }
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        spdlog::error("mmap(io_uring SQEs) failed: {}", strerror(errno));
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    char* cq = static_cast<char*>(cqRing_);
+    sqHead_  = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_  = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cqHead_  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_  = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_    = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* UringEngine::nextSqe()
+{
+    // Only this thread produces, so the tail needs no atomic read
+    unsigned tail = *sqTail_;
+    unsigned idx = tail & sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    pendingSubmit_++;
+    return sqe;
+}
+
+bool UringEngine::enter(unsigned toSubmit, unsigned minComplete)
+{
+    while (true)
+    {
+        syscalls_++;
+        int r = uringEnter(ringFd_, toSubmit, minComplete,
+                           minComplete ? IORING_ENTER_GETEVENTS : 0);
+        if (r >= 0)
+        {
+            pendingSubmit_ -= std::min(pendingSubmit_, static_cast<unsigned>(r));
+            return true;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        spdlog::error("io_uring_enter() failed: {}", strerror(errno));
+        return false;
+    }
+}
+
+bool UringEngine::popCompletion(Completion& c)
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    if (head == tail)
+    {
+        return false;
+    }
+    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+    c.userData = cqe.user_data;
+    c.res = cqe.res;
+    c.flags = cqe.flags;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+int32_t UringEngine::runSync()
+{
+    unsigned toSubmit = pendingSubmit_;
+    while (true)
+    {
+        if (!enter(toSubmit, 1))
+        {
+            return -EIO;
+        }
+        toSubmit = 0;
+        Completion c;
+        while (popCompletion(c))
+        {
+            if (c.userData == TAG_SYNC)
+            {
+                return c.res;
+            }
+            msPending_.push_back(c);
+        }
+    }
+}
+
+void UringEngine::registerSendBuffer(const char* buf, size_t len)
+{
+    if (fixedBuf_ != nullptr)
+    {
+        return; // one fixed buffer is all the send path needs
+    }
+    iovec iov{const_cast<char*>(buf), len};
+    syscalls_++;
+    if (uringRegister(ringFd_, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        spdlog::debug("io_uring: fixed buffer registration failed ({}), using plain sends",
+                      strerror(errno));
+        return;
+    }
+    fixedBuf_ = buf;
+    fixedLen_ = len;
+}
+
+bool UringEngine::sendAll(int fd, const char* buf, size_t len)
+{
+    size_t totalSent = 0;
+    while (totalSent < len)
+    {
+        const char* p = buf + totalSent;
+        size_t n = len - totalSent;
+        io_uring_sqe* sqe = nextSqe();
+        bool fixed = fixedBuf_ != nullptr && p >= fixedBuf_ && p + n <= fixedBuf_ + fixedLen_;
+        sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(p);
+        sqe->len = static_cast<uint32_t>(n);
+        sqe->buf_index = 0;
+        sqe->user_data = TAG_SYNC;
+
+        counts_.sends++;
+        int32_t res = runSync();
+        if (res < 0)
+        {
+            if (fixed && res == -EINVAL)
+            {
+                // Kernel won't do fixed writes on this socket; stop trying
+                fixedBuf_ = nullptr;
+                continue;
+            }
+            logIoError("send()", -res);
+            return false;
+        }
+        if (res == 0)
+        {
+            return false;
+        }
+        totalSent += static_cast<size_t>(res);
+        counts_.shortSends += totalSent < len;
+    }
+    return true;
+}
+
+bool UringEngine::recvAll(int fd, char* buf, size_t len)
+{
+    size_t totalRecv = 0;
+    while (totalRecv < len)
+    {
+        ssize_t r = recvSome(fd, buf + totalRecv, len - totalRecv);
+        if (r <= 0)
+        {
+            return false;
+        }
+        totalRecv += static_cast<size_t>(r);
+        counts_.shortRecvs += totalRecv < len;
+    }
+    return true;
+}
+
+ssize_t UringEngine::recvSome(int fd, char* buf, size_t len)
+{
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->user_data = TAG_SYNC;
+
+    counts_.recvs++;
+    int32_t res = runSync();
+    if (res < 0)
+    {
+        logIoError("recv()", -res);
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+bool UringEngine::setupBufferRing()
+{
+    bufRingTried_ = true;
+
+    bufRingBytes_ = BUF_RING_ENTRIES * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufRingBytes_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    bufPoolBytes_ = static_cast<size_t>(BUF_RING_ENTRIES) * BUF_RING_BUF_SIZE;
+    void* pool = mmap(nullptr, bufPoolBytes_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED || pool == MAP_FAILED)
+    {
+        if (ring != MAP_FAILED)
+        {
+            munmap(ring, bufRingBytes_);
+        }
+        if (pool != MAP_FAILED)
+        {
+            munmap(pool, bufPoolBytes_);
+        }
+        return false;
+    }
+    bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+    bufPool_ = static_cast<char*>(pool);
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+    reg.ring_entries = BUF_RING_ENTRIES;
+    reg.bgid = BUF_GROUP;
+    syscalls_++;
+    if (uringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        spdlog::debug("io_uring: provided buffer ring unavailable ({}), "
+                      "using single-shot recv", strerror(errno));
+        return false;
+    }
+
+    for (unsigned i = 0; i < BUF_RING_ENTRIES; i++)
+    {
+        recycleBuffer(static_cast<uint16_t>(i));
+    }
+    bufRingOk_ = true;
+    return true;
+}
+
+void UringEngine::recycleBuffer(uint16_t bid)
+{
+    io_uring_buf& b = bufRing_->bufs[bufTail_ & (BUF_RING_ENTRIES - 1)];
+    b.addr = reinterpret_cast<uint64_t>(bufPool_ + static_cast<size_t>(bid) * BUF_RING_BUF_SIZE);
+    b.len = BUF_RING_BUF_SIZE;
+    b.bid = bid;
+    bufTail_++;
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+}
+
+bool UringEngine::armMultishot(int fd)
+{
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = TAG_MULTISHOT;
+    msFd_ = fd;
+    msArmed_ = true;
+    return true;
+}
+
+ssize_t UringEngine::recvDiscard(int fd, char* scratch, size_t len)
+{
+    if (!bufRingTried_)
+    {
+        setupBufferRing();
+    }
+    if (!bufRingOk_)
+    {
+        return recvSome(fd, scratch, len);
+    }
+
+    while (true)
+    {
+        if (msPending_.empty())
+        {
+            if (!msArmed_ || msFd_ != fd)
+            {
+                armMultishot(fd);
+            }
+            if (!enter(pendingSubmit_, 1))
+            {
+                return -1;
+            }
+            Completion c;
+            while (popCompletion(c))
+            {
+                // No single-shot op is outstanding here, so everything is ours
+                msPending_.push_back(c);
+            }
+            continue;
+        }
+
+        Completion c = msPending_.front();
+        msPending_.pop_front();
+        if (!(c.flags & IORING_CQE_F_MORE))
+        {
+            msArmed_ = false; // kernel dropped the multishot; re-arm on next wait
+        }
+        if (c.flags & IORING_CQE_F_BUFFER)
+        {
+            recycleBuffer(static_cast<uint16_t>(c.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+
+        counts_.recvs++; // one multishot completion per receive
+        if (c.res > 0)
+        {
+            msDelivered_ = true;
+            return c.res;
+        }
+        if (c.res == 0)
+        {
+            return 0; // peer closed
+        }
+        if (c.res == -ENOBUFS)
+        {
+            if (!msDelivered_)
+            {
+                // Registration succeeded but the kernel never picked a buffer
+                // from a full ring; some kernels behave this way, so stop
+                // using the ring instead of re-arming forever.
+                spdlog::debug("io_uring: provided buffer ring never delivered, "
+                              "using single-shot recv");
+                bufRingOk_ = false;
+                msArmed_ = false;
+                msPending_.clear();
+                return recvSome(fd, scratch, len);
+            }
+            continue; // ring ran dry before we recycled; buffers are back now
+        }
+        logIoError("recv()", -c.res);
+        errno = -c.res;
+        return -1;
+    }
+}
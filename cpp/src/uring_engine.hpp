@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+
+#include "io_engine.hpp"
+
+// io_uring engine on the raw syscalls (no liburing dependency). Operations are
+// issued one at a time and submitted together with the wait for their
+// completion, so each costs a single io_uring_enter(). Two kernel features are
+// used when available and silently skipped when not:
+//  - the buffer passed to registerSendBuffer() becomes a fixed buffer and is
+//    sent with IORING_OP_WRITE_FIXED (no per-send page pinning);
+//  - recvDiscard() keeps one multishot recv armed on the socket, landing data
+//    in a provided buffer ring that is recycled immediately (kernel >= 6.0).
+class UringEngine : public IoEngine
+{
+public:
+    ~UringEngine() override;
+
+    EngineKind kind() const override { return EngineKind::Uring; }
+
+    bool init();
+
+    bool sendAll(int fd, const char* buf, size_t len) override;
+    bool recvAll(int fd, char* buf, size_t len) override;
+    ssize_t recvSome(int fd, char* buf, size_t len) override;
+    ssize_t recvDiscard(int fd, char* scratch, size_t len) override;
+    void registerSendBuffer(const char* buf, size_t len) override;
+
+private:
+    struct Completion
+    {
+        uint64_t userData;
+        int32_t res;
+        uint32_t flags;
+    };
+
+    io_uring_sqe* nextSqe();
+    // Submit everything queued and wait for at least one completion
+    bool enter(unsigned toSubmit, unsigned minComplete);
+    bool popCompletion(Completion& c);
+    // Submit the queued single-shot op and return its res (-errno on failure);
+    // multishot completions arriving meanwhile are parked in msPending_
+    int32_t runSync();
+
+    bool setupBufferRing();
+    bool armMultishot(int fd);
+    void recycleBuffer(uint16_t bid);
+
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned pendingSubmit_ = 0;
+
+    // Fixed send buffer (index 0)
+    const char* fixedBuf_ = nullptr;
+    size_t fixedLen_ = 0;
+
+    // Provided buffer ring for multishot recv
+    io_uring_buf_ring* bufRing_ = nullptr;
+    size_t bufRingBytes_ = 0;
+    char* bufPool_ = nullptr;
+    size_t bufPoolBytes_ = 0;
+    uint16_t bufTail_ = 0;
+    bool bufRingTried_ = false;
+    bool bufRingOk_ = false;
+    int msFd_ = -1;       // socket the multishot recv is armed on
+    bool msArmed_ = false;
+    bool msDelivered_ = false; // ring has handed us data at least once
+    std::deque<Completion> msPending_;
+};
@@ -0,0 +1,328 @@
+#include "zerocopy.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+
+#include "io_engine.hpp"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// Cap on unacknowledged MSG_ZEROCOPY sends; keeps the notification backlog well
+// under the socket's optmem limit, past which send() fails with ENOBUFS
+static const unsigned long ZC_MAX_OUTSTANDING = 256;
+static const int ZC_FINISH_TIMEOUT_MS = 1000;
+
+bool parseZeroCopyMode(const std::string& name, ZeroCopyMode& mode)
+{
+    if (name == "copy")
+    {
+        mode = ZeroCopyMode::Copy;
+    }
+    else if (name == "msg")
+    {
+        mode = ZeroCopyMode::MsgZerocopy;
+    }
+    else if (name == "sendfile")
+    {
+        mode = ZeroCopyMode::Sendfile;
+    }
+    else if (name == "splice")
+    {
+        mode = ZeroCopyMode::Splice;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char* zeroCopyModeName(ZeroCopyMode mode)
+{
+    switch (mode)
+    {
+        case ZeroCopyMode::Copy:        return "copy";
+        case ZeroCopyMode::MsgZerocopy: return "msg";
+        case ZeroCopyMode::Sendfile:    return "sendfile";
+        case ZeroCopyMode::Splice:      return "splice";
+    }
+    return "?";
+}
+
+ChunkSender::ChunkSender(IoEngine& engine, int sockfd, ZeroCopyMode mode,
+                         const char* chunk, size_t len, size_t slots)
+    : engine_(engine), sockfd_(sockfd), mode_(mode), chunk_(chunk), len_(len),
+      slots_(std::max<size_t>(slots, 1))
+{
+}
+
+ChunkSender::~ChunkSender()
+{
+    if (memfd_ >= 0)
+    {
+        close(memfd_);
+    }
+    if (pipe_[0] >= 0)
+    {
+        close(pipe_[0]);
+        close(pipe_[1]);
+    }
+}
+
+bool ChunkSender::init()
+{
+    if (mode_ == ZeroCopyMode::Copy)
+    {
+        engine_.registerSendBuffer(chunk_, len_ * slots_);
+    }
+
+    if (mode_ == ZeroCopyMode::MsgZerocopy)
+    {
+        int one = 1;
+        if (setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+        {
+            spdlog::error("setsockopt(SO_ZEROCOPY) failed: {}", strerror(errno));
+            return false;
+        }
+    }
+
+    if (mode_ == ZeroCopyMode::Sendfile || mode_ == ZeroCopyMode::Splice)
+    {
+        // The chunk lives once in the page cache; later sends only move page refs
+        memfd_ = memfd_create("iperfer-chunk", MFD_CLOEXEC);
+        if (memfd_ < 0)
+        {
+            spdlog::error("memfd_create() failed: {}", strerror(errno));
+            return false;
+        }
+        size_t written = 0;
+        while (written < len_)
+        {
+            ssize_t w = write(memfd_, chunk_ + written, len_ - written);
+            if (w < 0)
+            {
+                spdlog::error("write(memfd) failed: {}", strerror(errno));
+                return false;
+            }
+            written += static_cast<size_t>(w);
+        }
+    }
+
+    if (mode_ == ZeroCopyMode::Splice)
+    {
+        if (pipe2(pipe_, O_CLOEXEC) < 0)
+        {
+            spdlog::error("pipe2() failed: {}", strerror(errno));
+            return false;
+        }
+        // Best effort: a pipe that holds a whole chunk halves the splice calls
+        fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(len_));
+    }
+    return true;
+}
+
+bool ChunkSender::send()
+{
+    switch (mode_)
+    {
+        case ZeroCopyMode::Copy:
+        {
+            unsigned long before = engine_.syscalls();
+            bool ok = engine_.sendAll(sockfd_, nextSlot(), len_);
+            syscalls_ += engine_.syscalls() - before;
+            return ok;
+        }
+        case ZeroCopyMode::MsgZerocopy: return sendZerocopy();
+        case ZeroCopyMode::Sendfile:    return sendFile();
+        case ZeroCopyMode::Splice:      return sendSplice();
+    }
+    return false;
+}
+
+const char* ChunkSender::nextSlot()
+{
+    const char* slot = chunk_ + nextSlot_ * len_;
+    nextSlot_ = (nextSlot_ + 1) % slots_;
+    return slot;
+}
+
+bool ChunkSender::sendZerocopy()
+{
+    const char* slot = nextSlot();
+    size_t totalSent = 0;
+    while (totalSent < len_)
+    {
+        if (zcIssued_ - zcCompleted_ >= ZC_MAX_OUTSTANDING && !reapCompletions(-1))
+        {
+            return false;
+        }
+
+        syscalls_++;
+        ssize_t sent = ::send(sockfd_, slot + totalSent, len_ - totalSent, MSG_ZEROCOPY);
+        if (sent < 0)
+        {
+            if (errno == ENOBUFS)
+            {
+                // Out of optmem for pinned pages: wait for the kernel to release some
+                if (!reapCompletions(-1))
+                {
+                    return false;
+                }
+                continue;
+            }
+            spdlog::error("send(MSG_ZEROCOPY) failed: {}", strerror(errno));
+            return false;
+        }
+        if (sent == 0)
+        {
+            return false;
+        }
+        totalSent += static_cast<size_t>(sent);
+        zcIssued_++;
+    }
+    // Opportunistic, non-blocking: keep the error queue short
+    return reapCompletions(0);
+}
+
+bool ChunkSender::sendFile()
+{
+    off_t offset = 0;
+    while (static_cast<size_t>(offset) < len_)
+    {
+        syscalls_++;
+        ssize_t sent = sendfile(sockfd_, memfd_, &offset, len_ - static_cast<size_t>(offset));
+        if (sent <= 0)
+        {
+            if (sent < 0)
+            {
+                spdlog::error("sendfile() failed: {}", strerror(errno));
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ChunkSender::sendSplice()
+{
+    loff_t offset = 0;
+    while (static_cast<size_t>(offset) < len_)
+    {
+        syscalls_++;
+        ssize_t inPipe = splice(memfd_, &offset, pipe_[1], nullptr,
+                                len_ - static_cast<size_t>(offset), SPLICE_F_MORE);
+        if (inPipe <= 0)
+        {
+            spdlog::error("splice(memfd -> pipe) failed: {}",
+                          inPipe < 0 ? strerror(errno) : "short read");
+            return false;
+        }
+        while (inPipe > 0)
+        {
+            syscalls_++;
+            ssize_t out = splice(pipe_[0], nullptr, sockfd_, nullptr,
+                                 static_cast<size_t>(inPipe), SPLICE_F_MORE);
+            if (out <= 0)
+            {
+                if (out < 0)
+                {
+                    spdlog::error("splice(pipe -> socket) failed: {}", strerror(errno));
+                }
+                return false;
+            }
+            inPipe -= out;
+        }
+    }
+    return true;
+}
+
+bool ChunkSender::reapCompletions(int timeoutMs)
+{
+    if (timeoutMs != 0)
+    {
+        // Error-queue readiness is always reported as POLLERR
+        pollfd pfd{sockfd_, 0, 0};
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR)
+        {
+            spdlog::error("poll(error queue) failed: {}", strerror(errno));
+            return false;
+        }
+        if (ready == 0)
+        {
+            return true;
+        }
+    }
+
+    while (true)
+    {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sockfd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return true;
+            }
+            spdlog::error("recvmsg(MSG_ERRQUEUE) failed: {}", strerror(errno));
+            return false;
+        }
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            bool isRecvErr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                             (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!isRecvErr)
+            {
+                continue;
+            }
+            sock_extended_err serr;
+            std::memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+            if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr.ee_errno != 0)
+            {
+                continue;
+            }
+            // Notification ids [ee_info, ee_data] are done with our pages
+            unsigned long n = static_cast<unsigned long>(serr.ee_data - serr.ee_info) + 1;
+            zcCompleted_ += n;
+            if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                zcCopied_ += n;
+            }
+        }
+    }
+}
+
+void ChunkSender::finish()
+{
+    if (mode_ != ZeroCopyMode::MsgZerocopy)
+    {
+        return;
+    }
+    while (zcCompleted_ < zcIssued_)
+    {
+        unsigned long before = zcCompleted_;
+        if (!reapCompletions(ZC_FINISH_TIMEOUT_MS) || zcCompleted_ == before)
+        {
+            break; // peer gone or kernel slow; nothing left worth waiting for
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class IoEngine;
+
+// How the client hands each data chunk to the kernel (--zerocopy)
+enum class ZeroCopyMode
+{
+    Copy,        // plain send(): payload copied into the socket buffer every time
+    MsgZerocopy, // send(MSG_ZEROCOPY): pages pinned, completions reaped from the error queue
+    Sendfile,    // sendfile() from a memfd holding one chunk
+    Splice,      // splice() memfd -> pipe -> socket
+};
+
+bool parseZeroCopyMode(const std::string& name, ZeroCopyMode& mode);
+const char* zeroCopyModeName(ZeroCopyMode mode);
+
+// Sends fixed-size chunks of a payload buffer over a connected socket using
+// the selected mode. Copy mode goes through the I/O engine; the others issue
+// their own syscalls on a blocking socket. init() must succeed before send().
+//
+// chunk holds slots consecutive len-byte chunks (one per window slot), which
+// copy and MSG_ZEROCOPY sends take in turn, so the one the kernel may still
+// reference isn't the next one sent; sendfile and splice only ever send the
+// first, from their memfd.
+class ChunkSender
+{
+public:
+    ChunkSender(IoEngine& engine, int sockfd, ZeroCopyMode mode, const char* chunk, size_t len,
+                size_t slots = 1);
+    ~ChunkSender();
+    ChunkSender(const ChunkSender&) = delete;
+    ChunkSender& operator=(const ChunkSender&) = delete;
+
+    bool init();
+
+    // Queue one whole chunk; false on a socket error or closed connection
+    bool send();
+
+    // Wait (bounded) for outstanding MSG_ZEROCOPY notifications; no-op otherwise
+    void finish();
+
+    // MSG_ZEROCOPY sends the kernel completed by copying (e.g. over loopback)
+    unsigned long copiedSends() const { return zcCopied_; }
+    unsigned long completedSends() const { return zcCompleted_; }
+
+    // Syscalls spent moving payload (send/sendfile/splice; not error-queue reaps)
+    unsigned long syscalls() const { return syscalls_; }
+
+private:
+    // The slot the next chunk goes out from
+    const char* nextSlot();
+    bool sendZerocopy();
+    bool sendFile();
+    bool sendSplice();
+    // Reap pending completions; blocks up to timeoutMs for the first one
+    bool reapCompletions(int timeoutMs);
+
+    IoEngine& engine_;
+    int sockfd_;
+    ZeroCopyMode mode_;
+    const char* chunk_;
+    size_t len_;
+    size_t slots_;
+    size_t nextSlot_ = 0;
+
+    int memfd_ = -1;
+    int pipe_[2] = {-1, -1};
+
+    unsigned long zcIssued_ = 0;    // send() calls that took data (one notification id each)
+    unsigned long zcCompleted_ = 0; // ids reported back on the error queue
+    unsigned long zcCopied_ = 0;    // ...of which the kernel fell back to copying
+    unsigned long syscalls_ = 0;
+};
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""
+Automated iPerfer measurements on a Mininet topology.
+
+Builds the network from a topology script (util/topology.py by default),
+then runs each step of a plan: every host pair in a step is measured at
+the same time, one iPerfer server and client per pair, in each of the
+chosen modes (throughput, latency, parallel streams). The clients' and
+servers' --json output is collected into one report.
+
+    sudo python3 util/measure.py
+    sudo python3 util/measure.py --modes throughput --time 20
+    sudo python3 util/measure.py --topology topology/topology_ivanlam.py \\
+        --step a=h1:h3 --step b=h1:h5,h2:h4
+
+Pairs are written client:server. Without --step, util/topology.py gets
+the project's measurement matrix (ASSIGNMENT_PLAN below); other
+topologies need at least one --step.
+"""
+
+import argparse
+import importlib.util
+import json
+import os
+import subprocess
+import sys
+import time
+
+from mininet.link import TCLink
+from mininet.log import setLogLevel, info
+from mininet.net import Mininet
+from mininet.topo import Topo
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+
+DEFAULT_TOPOLOGY = os.path.join(HERE, 'topology.py')
+DEFAULT_IPERFER = os.path.join(ROOT, 'build', 'bin', 'iPerfer')
+DEFAULT_REPORT = os.path.join(ROOT, 'measurement', 'report.json')
+MODES = ('throughput', 'latency', 'parallel')
+
+BASE_PORT = 5201          # pair i of a step listens on BASE_PORT + i
+SERVER_START_S = 0.5      # for every server of a step to be listening
+SERVER_EXIT_S = 5         # after its client is done, before it is killed
+
+# (step name, [(client, server), ...]) for util/topology.py: the links
+# L1-L5 one at a time, h1-h10 alone, two and three pairs sharing s1-s6,
+# then h1-h10 alongside h3-h8
+ASSIGNMENT_PLAN = [
+    ('L1', [('h3', 'h1')]),
+    ('L2', [('h4', 'h3')]),
+    ('L3', [('h7', 'h3')]),
+    ('L4', [('h8', 'h4')]),
+    ('L5', [('h9', 'h8')]),
+    ('h1-h10', [('h1', 'h10')]),
+    ('mux2', [('h1', 'h10'), ('h2', 'h9')]),
+    ('mux3', [('h1', 'h10'), ('h2', 'h9'), ('h5', 'h6')]),
+    ('h1-h10+h3-h8', [('h1', 'h10'), ('h3', 'h8')]),
+]
+
+
+def load_topology(path):
+    """The Topo subclass defined in the script at path, instantiated"""
+    spec = importlib.util.spec_from_file_location('measured_topology', path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    for value in vars(module).values():
+        if (isinstance(value, type) and issubclass(value, Topo) and value is not Topo
+                and value.__module__ == module.__name__):
+            return value()
+    sys.exit(f'{path}: no Topo subclass found')
+
+
+def parse_step(text):
+    """'name=h1:h3,h2:h4' -> ('name', [('h1', 'h3'), ('h2', 'h4')])"""
+    name, sep, pairs = text.partition('=')
+    if not sep or not pairs:
+        raise argparse.ArgumentTypeError(f'{text}: expected NAME=CLIENT:SERVER[,...]')
+    result = []
+    for pair in pairs.split(','):
+        client, sep, server = pair.partition(':')
+        if not sep or not client or not server:
+            raise argparse.ArgumentTypeError(f'{pair}: expected CLIENT:SERVER')
+        result.append((client, server))
+    return name, result
+
+
+def client_args(mode, args):
+    """iPerfer client options for one mode, besides -c/-h/-p/--json"""
+    if mode == 'latency':
+        return ['--latency', str(args.latency_count)]
+    duration = ['-t', str(args.time)]
+    if mode == 'parallel':
+        return duration + ['-P', str(args.parallel)]
+    return duration
+
+
+def summarize(mode, result):
+    """The numbers the summary table shows, from a client's JSON"""
+    if mode == 'latency':
+        latency = result.get('latency', {})
+        return {'rtt_ms': latency.get('mean_us', 0.0) / 1000.0,
+                'p99_ms': latency.get('p99_us', 0.0) / 1000.0}
+    total = result.get('sum', {})
+    return {'rate_mbps': total.get('rate_mbps', 0.0), 'rtt_ms': total.get('rtt_ms', 0),
+            'streams': total.get('ok_streams', 0)}
+
+
+def read_json(text):
+    try:
+        return json.loads(text)
+    except ValueError:
+        return None
+
+
+def run_step(net, name, pairs, mode, args):
+    """One mode over every pair of a step at once; a record per pair"""
+    runs = []
+    for i, (client, server) in enumerate(pairs):
+        port = BASE_PORT + i
+        client_host = net.get(client)
+        server_host = net.get(server)
+        runs.append({
+            'step': name, 'mode': mode, 'client': client, 'server': server,
+            'client_ip': client_host.IP(), 'server_ip': server_host.IP(), 'port': port,
+            'server_proc': server_host.popen([args.iperfer, '-s', '-p', str(port), '--json'],
+                                             stdout=subprocess.PIPE, stderr=subprocess.PIPE),
+        })
+    time.sleep(SERVER_START_S)
+
+    info(f'*** {name} {mode}: ' + ', '.join(f"{r['client']} -> {r['server']}" for r in runs)
+         + '\n')
+    for run in runs:
+        command = [args.iperfer, '-c', '-h', run['server_ip'], '-p', str(run['port']),
+                   '--json'] + client_args(mode, args)
+        run['client_proc'] = net.get(run['client']).popen(command, stdout=subprocess.PIPE,
+                                                          stderr=subprocess.PIPE)
+
+    for run in runs:
+        client_proc = run.pop('client_proc')
+        server_proc = run.pop('server_proc')
+        out, err = client_proc.communicate()
+        try:
+            server_out, _ = server_proc.communicate(timeout=SERVER_EXIT_S)
+        except subprocess.TimeoutExpired:
+            server_proc.kill()
+            server_out, _ = server_proc.communicate()
+        run['client_result'] = read_json(out.decode(errors='replace'))
+        run['server_result'] = read_json(server_out.decode(errors='replace'))
+        run['ok'] = client_proc.returncode == 0 and run['client_result'] is not None
+        if run['ok']:
+            run['summary'] = summarize(mode, run['client_result'])
+        else:
+            run['error'] = err.decode(errors='replace').strip().splitlines()[-3:]
+    return runs
+
+
+def print_summary(runs):
+    print(f"{'step':<14} {'mode':<11} {'pair':<10} {'Mbps':>10} {'RTT ms':>9}")
+    for run in runs:
+        pair = f"{run['client']}-{run['server']}"
+        if not run['ok']:
+            print(f"{run['step']:<14} {run['mode']:<11} {pair:<10} {'failed':>10}")
+            continue
+        s = run['summary']
+        rate = f"{s['rate_mbps']:.3f}" if 'rate_mbps' in s else '-'
+        print(f"{run['step']:<14} {run['mode']:<11} {pair:<10} {rate:>10} {s['rtt_ms']:>9.3f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('--topology', default=DEFAULT_TOPOLOGY,
+                        help='Mininet topology script (default: util/topology.py)')
+    parser.add_argument('--iperfer', default=DEFAULT_IPERFER,
+                        help='iPerfer binary (default: build/bin/iPerfer)')
+    parser.add_argument('--step', action='append', type=parse_step, default=[],
+                        help='NAME=CLIENT:SERVER[,CLIENT:SERVER...]; pairs of a step run '
+                             'together, steps one after another (repeatable)')
+    parser.add_argument('--modes', default=','.join(MODES),
+                        help='Comma-separated subset of ' + ', '.join(MODES))
+    parser.add_argument('--time', type=float, default=10.0,
+                        help='Seconds per throughput / parallel run (default: 10)')
+    parser.add_argument('--latency-count', type=int, default=100,
+                        help='Timed exchanges per latency run (default: 100)')
+    parser.add_argument('--parallel', type=int, default=4,
+                        help='Streams per parallel run (default: 4)')
+    parser.add_argument('-o', '--output', default=DEFAULT_REPORT,
+                        help='Report file (default: measurement/report.json)')
+    args = parser.parse_args()
+
+    modes = [m for m in args.modes.split(',') if m]
+    for mode in modes:
+        if mode not in MODES:
+            parser.error(f'unknown mode {mode}; choose from ' + ', '.join(MODES))
+    plan = args.step
+    if not plan:
+        if os.path.abspath(args.topology) != DEFAULT_TOPOLOGY:
+            parser.error('give the pairs to measure on this topology with --step')
+        plan = ASSIGNMENT_PLAN
+    args.iperfer = os.path.abspath(args.iperfer)
+    if not os.access(args.iperfer, os.X_OK):
+        parser.error(f'{args.iperfer} is not executable; build iPerfer first')
+
+    setLogLevel('info')
+    net = Mininet(topo=load_topology(args.topology), link=TCLink, autoSetMacs=True,
+                  autoStaticArp=True)
+    net.start()
+    runs = []
+    started = time.time()
+    try:
+        for name, pairs in plan:
+            for host in {h for pair in pairs for h in pair}:
+                if host not in net:
+                    sys.exit(f'step {name}: no host {host} in {args.topology}')
+            for mode in modes:
+                runs += run_step(net, name, pairs, mode, args)
+    finally:
+        net.stop()
+
+    report = {
+        'topology': os.path.abspath(args.topology),
+        'iperfer': args.iperfer,
+        'modes': modes,
+        'time_s': args.time,
+        'latency_count': args.latency_count,
+        'parallel': args.parallel,
+        'elapsed_s': round(time.time() - started, 1),
+        'runs': runs,
+    }
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2)
+    print_summary(runs)
+    print(f'Report: {args.output}')
+    return 0 if all(run['ok'] for run in runs) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())